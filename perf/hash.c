@@ -0,0 +1,107 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/utils/hash.c"
+#include "../src/utils/alloc.c"
+#include "../src/utils/err.c"
+#include "../src/utils/stopwatch.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*  Measures the lookup latency of the hash table used e.g. for routing
+    replies to the peers in REP socket. With no arguments, the measurement
+    is done for 1k, 10k and 100k keys. */
+
+#define LOOKUP_COUNT 10000000
+
+static void measure (int key_count)
+{
+    int i;
+    int j;
+    uint32_t tmp;
+    struct nn_hash hash;
+    struct nn_hash_item *items;
+    uint32_t *keys;
+    struct nn_stopwatch stopwatch;
+    uint64_t elapsed;
+    struct nn_hash_item *item;
+
+    items = malloc (key_count * sizeof (struct nn_hash_item));
+    nn_assert (items);
+    keys = malloc (key_count * sizeof (uint32_t));
+    nn_assert (keys);
+
+    /*  Keys are assigned sequentially, same way as REP socket does. */
+    nn_hash_init (&hash);
+    for (i = 0; i != key_count; ++i) {
+        keys [i] = 0x12345678 + i;
+        nn_hash_item_init (&items [i]);
+        nn_hash_insert (&hash, keys [i], &items [i]);
+    }
+
+    /*  Look up the keys in random order. */
+    for (i = key_count - 1; i > 0; --i) {
+        j = rand () % (i + 1);
+        tmp = keys [i];
+        keys [i] = keys [j];
+        keys [j] = tmp;
+    }
+
+    nn_stopwatch_init (&stopwatch);
+    for (i = 0; i != LOOKUP_COUNT; ++i) {
+        item = nn_hash_get (&hash, keys [i % key_count]);
+        nn_assert (item);
+    }
+    elapsed = nn_stopwatch_term (&stopwatch);
+
+    printf ("key count: %d\n", key_count);
+    printf ("average lookup time: %.3f [ns]\n",
+        (double) elapsed * 1000 / LOOKUP_COUNT);
+
+    for (i = 0; i != key_count; ++i) {
+        nn_hash_erase (&hash, &items [i]);
+        nn_hash_item_term (&items [i]);
+    }
+    nn_hash_term (&hash);
+    free (keys);
+    free (items);
+}
+
+int main (int argc, char *argv [])
+{
+    if (argc > 2) {
+        printf ("usage: hash [<key-count>]\n");
+        return 1;
+    }
+
+    if (argc == 2) {
+        measure (atoi (argv [1]));
+        return 0;
+    }
+
+    measure (1000);
+    measure (10000);
+    measure (100000);
+
+    return 0;
+}
@@ -60,6 +60,11 @@ void worker (NN_UNUSED void *arg)
         assert (rc == (int)message_size);
     }
 
+    /*  Don't close the socket before the last message was received by
+        the peer. Otherwise it may be dropped while still in flight. */
+    rc = nn_recv (s, buf, message_size, 0);
+    assert (rc == 0);
+
     free (buf);
     rc = nn_close (s);
     assert (rc == 0);
@@ -108,6 +113,10 @@ int main (int argc, char *argv [])
 
     elapsed = nn_stopwatch_term (&stopwatch);
 
+    /*  Let the worker know it's safe to close its socket. */
+    rc = nn_send (s, buf, 0, 0);
+    assert (rc == 0);
+
     latency = (double) elapsed / (roundtrip_count * 2);
     printf ("message size: %d [B]\n", (int) message_size);
     printf ("roundtrip count: %d\n", (int) roundtrip_count);
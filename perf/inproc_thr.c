@@ -61,6 +61,11 @@ void worker (NN_UNUSED void *arg)
         assert (rc == (int)message_size);
     }
 
+    /*  Don't close the socket before all the messages were received by
+        the peer. Otherwise they may be dropped while still in flight. */
+    rc = nn_recv (s, buf, message_size, 0);
+    assert (rc == 0);
+
     free (buf);
     rc = nn_close (s);
     assert (rc == 0);
@@ -109,6 +114,10 @@ int main (int argc, char *argv [])
 
     elapsed = nn_stopwatch_term (&stopwatch);
 
+    /*  Let the worker know it's safe to close its socket. */
+    rc = nn_send (s, buf, 0, 0);
+    assert (rc == 0);
+
     nn_thread_term (&thread);
     free (buf);
     rc = nn_close (s);
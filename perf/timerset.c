@@ -0,0 +1,94 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/aio/timerset.c"
+#include "../src/utils/clock.c"
+#include "../src/utils/alloc.c"
+#include "../src/utils/err.c"
+#include "../src/utils/stopwatch.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*  Measures the cost of adding and removing timers when there's a large
+    number of timers in the set, e.g. per-request resend timers. */
+
+int main (int argc, char *argv [])
+{
+    int i;
+    int j;
+    int timer_count;
+    int *order;
+    int tmp;
+    struct nn_timerset timerset;
+    struct nn_timerset_hndl *hndls;
+    struct nn_stopwatch stopwatch;
+    uint64_t elapsed;
+
+    if (argc != 2) {
+        printf ("usage: timerset <timer-count>\n");
+        return 1;
+    }
+
+    timer_count = atoi (argv [1]);
+    hndls = malloc (timer_count * sizeof (struct nn_timerset_hndl));
+    nn_assert (hndls);
+    order = malloc (timer_count * sizeof (int));
+    nn_assert (order);
+
+    /*  Remove the timers in random order. */
+    for (i = 0; i != timer_count; ++i)
+        order [i] = i;
+    for (i = timer_count - 1; i > 0; --i) {
+        j = rand () % (i + 1);
+        tmp = order [i];
+        order [i] = order [j];
+        order [j] = tmp;
+    }
+
+    nn_timerset_init (&timerset);
+    for (i = 0; i != timer_count; ++i)
+        nn_timerset_hndl_init (&hndls [i]);
+
+    nn_stopwatch_init (&stopwatch);
+    for (i = 0; i != timer_count; ++i)
+        nn_timerset_add (&timerset, 1000 + rand () % 60000, &hndls [i]);
+    elapsed = nn_stopwatch_term (&stopwatch);
+    printf ("timer count: %d\n", timer_count);
+    printf ("average insert time: %.3f [us]\n",
+        (double) elapsed / timer_count);
+
+    nn_stopwatch_init (&stopwatch);
+    for (i = 0; i != timer_count; ++i)
+        nn_timerset_rm (&timerset, &hndls [order [i]]);
+    elapsed = nn_stopwatch_term (&stopwatch);
+    printf ("average cancel time: %.3f [us]\n",
+        (double) elapsed / timer_count);
+
+    for (i = 0; i != timer_count; ++i)
+        nn_timerset_hndl_term (&hndls [i]);
+    nn_timerset_term (&timerset);
+    free (order);
+    free (hndls);
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+
+#include "../src/protocols/pubsub/trie.c"
+#include "../src/utils/alloc.c"
+#include "../src/utils/err.c"
+#include "../src/utils/stopwatch.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*  Measures the matching speed of the trie used to filter messages in SUB
+    socket. With no arguments, the measurement is done for 1k and 100k
+    subscriptions. */
+
+#define MATCH_COUNT 10000000
+#define MSG_COUNT 4096
+#define MSG_SIZE 64
+
+static void measure (int sub_count)
+{
+    int i;
+    int j;
+    int tmp;
+    int *order;
+    int matched;
+    struct nn_trie trie;
+    char topic [MSG_SIZE];
+    uint8_t *msgs;
+    uint8_t *msg;
+    struct nn_stopwatch stopwatch;
+    uint64_t elapsed;
+
+    /*  Subscribe to hierarchical topics such as "md.NYSE.S00042.", in random
+        order, the same way as subscriptions arrive from the applications. */
+    order = malloc (sub_count * sizeof (int));
+    nn_assert (order);
+    for (i = 0; i != sub_count; ++i)
+        order [i] = i;
+    for (i = sub_count - 1; i > 0; --i) {
+        j = rand () % (i + 1);
+        tmp = order [i];
+        order [i] = order [j];
+        order [j] = tmp;
+    }
+    nn_trie_init (&trie);
+    for (i = 0; i != sub_count; ++i) {
+        sprintf (topic, "md.%s.S%05d.", order [i] % 3 == 0 ? "NYSE" :
+            order [i] % 3 == 1 ? "NASDAQ" : "LSE", order [i] / 3);
+        nn_trie_subscribe (&trie, (const uint8_t*) topic, strlen (topic));
+    }
+    free (order);
+
+    /*  Prepare the messages. Roughly half of them match a subscription. */
+    msgs = malloc (MSG_COUNT * MSG_SIZE);
+    nn_assert (msgs);
+    for (i = 0; i != MSG_COUNT; ++i) {
+        msg = msgs + i * MSG_SIZE;
+        memset (msg, 'x', MSG_SIZE);
+        sprintf ((char*) msg, "md.%s.S%05d.trade", rand () % 3 == 0 ? "NYSE" :
+            rand () % 2 ? "NASDAQ" : "LSE", rand () % (sub_count * 2 / 3 + 1));
+    }
+
+    matched = 0;
+    nn_stopwatch_init (&stopwatch);
+    for (i = 0; i != MATCH_COUNT; ++i)
+        matched += nn_trie_match (&trie, msgs + (i % MSG_COUNT) * MSG_SIZE,
+            MSG_SIZE);
+    elapsed = nn_stopwatch_term (&stopwatch);
+
+    printf ("subscription count: %d\n", sub_count);
+    printf ("messages matched: %d%%\n", (int) ((uint64_t) matched * 100 /
+        MATCH_COUNT));
+    printf ("matching speed: %.0f [matches/s]\n",
+        (double) MATCH_COUNT * 1000000 / elapsed);
+
+    nn_trie_term (&trie);
+    free (msgs);
+}
+
+int main (int argc, char *argv [])
+{
+    if (argc > 2) {
+        printf ("usage: trie [<subscription-count>]\n");
+        return 1;
+    }
+
+    if (argc == 2) {
+        measure (atoi (argv [1]));
+        return 0;
+    }
+
+    measure (1000);
+    measure (100000);
+
+    return 0;
+}
+
@@ -31,6 +31,7 @@ void nn_ctx_init (struct nn_ctx *self, struct nn_pool *pool,
 {
     nn_mutex_init (&self->sync);
     self->pool = pool;
+    self->worker = nn_pool_choose_worker (pool);
     nn_queue_init (&self->events);
     nn_queue_init (&self->eventsto);
     self->onleave = onleave;
@@ -55,13 +56,7 @@ void nn_ctx_leave (struct nn_ctx *self)
     struct nn_queue eventsto;
 
     /*  Process any queued events before leaving the context. */
-    while (1) {
-        item = nn_queue_pop (&self->events);
-        event = nn_cont (item, struct nn_fsm_event, item);
-        if (!event)
-            break;
-        nn_fsm_event_process (event);
-    }
+    nn_ctx_flush (self);
 
     /*  Notify the owner that we are leaving the context. */
     if (nn_fast (self->onleave != NULL))
@@ -95,9 +90,23 @@ void nn_ctx_leave (struct nn_ctx *self)
     nn_queue_term (&eventsto);
 }
 
+void nn_ctx_flush (struct nn_ctx *self)
+{
+    struct nn_queue_item *item;
+    struct nn_fsm_event *event;
+
+    while (1) {
+        item = nn_queue_pop (&self->events);
+        event = nn_cont (item, struct nn_fsm_event, item);
+        if (!event)
+            break;
+        nn_fsm_event_process (event);
+    }
+}
+
 struct nn_worker *nn_ctx_choose_worker (struct nn_ctx *self)
 {
-    return nn_pool_choose_worker (self->pool);
+    return self->worker;
 }
 
 void nn_ctx_raise (struct nn_ctx *self, struct nn_fsm_event *event)
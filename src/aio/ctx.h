@@ -37,6 +37,12 @@ typedef void (*nn_ctx_onleave) (struct nn_ctx *self);
 struct nn_ctx {
     struct nn_mutex sync;
     struct nn_pool *pool;
+
+    /*  Worker thread that all the asynchronous objects living in this context
+        are bound to. Keeping them on a single worker avoids contending for
+        the context from several worker threads at once. */
+    struct nn_worker *worker;
+
     struct nn_queue events;
     struct nn_queue eventsto;
     nn_ctx_onleave onleave;
@@ -49,6 +55,10 @@ void nn_ctx_term (struct nn_ctx *self);
 void nn_ctx_enter (struct nn_ctx *self);
 void nn_ctx_leave (struct nn_ctx *self);
 
+/*  Process the events raised within the context so far, without leaving it.
+    Events raised to other contexts are still delivered only on leave. */
+void nn_ctx_flush (struct nn_ctx *self);
+
 struct nn_worker *nn_ctx_choose_worker (struct nn_ctx *self);
 
 void nn_ctx_raise (struct nn_ctx *self, struct nn_fsm_event *event);
@@ -22,20 +22,87 @@
 
 #include "pool.h"
 
-/*  TODO: The dummy implementation of a thread pool. As for now there's only
-    one worker thread created. */
+#include "../utils/alloc.h"
+#include "../utils/err.h"
+#include "../utils/fast.h"
 
-int nn_pool_init (struct nn_pool *self)
+#if defined NN_HAVE_WINDOWS
+#include "../utils/win.h"
+#else
+#include <unistd.h>
+#endif
+
+/*  Private functions. */
+static int nn_pool_ncpus (void);
+
+int nn_pool_init (struct nn_pool *self, int nworkers)
 {
-    return nn_worker_init (&self->worker);
+    int rc;
+    int i;
+
+    /*  By default, run one worker thread per CPU core. */
+    if (nworkers <= 0)
+        nworkers = nn_pool_ncpus ();
+    if (nworkers > NN_POOL_MAX_WORKERS)
+        nworkers = NN_POOL_MAX_WORKERS;
+
+    self->workers = nn_alloc (sizeof (struct nn_worker) * nworkers,
+        "worker pool");
+    alloc_assert (self->workers);
+    nn_atomic_init (&self->next, 0);
+
+    /*  Start the worker threads. If any of them fails to start, shut down
+        those that are already running. */
+    for (i = 0; i != nworkers; ++i) {
+        rc = nn_worker_init (&self->workers [i]);
+        if (nn_slow (rc < 0)) {
+            while (i > 0)
+                nn_worker_term (&self->workers [--i]);
+            nn_atomic_term (&self->next);
+            nn_free (self->workers);
+            self->workers = NULL;
+            self->nworkers = 0;
+            return rc;
+        }
+    }
+    self->nworkers = nworkers;
+
+    return 0;
 }
 
 void nn_pool_term (struct nn_pool *self)
 {
-    nn_worker_term (&self->worker);
+    int i;
+
+    for (i = 0; i != self->nworkers; ++i)
+        nn_worker_term (&self->workers [i]);
+    nn_atomic_term (&self->next);
+    nn_free (self->workers);
+    self->workers = NULL;
+    self->nworkers = 0;
 }
 
 struct nn_worker *nn_pool_choose_worker (struct nn_pool *self)
 {
-    return &self->worker;
+    uint32_t i;
+
+    i = nn_atomic_inc (&self->next, 1);
+    return &self->workers [i % self->nworkers];
+}
+
+static int nn_pool_ncpus (void)
+{
+#if defined NN_HAVE_WINDOWS
+    SYSTEM_INFO info;
+
+    GetSystemInfo (&info);
+    return info.dwNumberOfProcessors > 0 ? (int) info.dwNumberOfProcessors : 1;
+#elif defined _SC_NPROCESSORS_ONLN
+    long n;
+
+    n = sysconf (_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int) n : 1;
+#else
+    return 1;
+#endif
 }
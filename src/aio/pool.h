@@ -25,14 +25,30 @@
 
 #include "worker.h"
 
+#include "../utils/atomic.h"
+
+/*  Upper limit on the number of worker threads in the pool. */
+#define NN_POOL_MAX_WORKERS 64
+
 /*  Worker thread pool. */
 
 struct nn_pool {
-    struct nn_worker worker;
+
+    /*  Array of worker threads. */
+    struct nn_worker *workers;
+    int nworkers;
+
+    /*  Round-robin cursor used to distribute new objects among the workers. */
+    struct nn_atomic next;
 };
 
-int nn_pool_init (struct nn_pool *self);
+/*  Starts 'nworkers' worker threads. If 'nworkers' is zero or negative, one
+    worker per available CPU core is started. */
+int nn_pool_init (struct nn_pool *self, int nworkers);
 void nn_pool_term (struct nn_pool *self);
+
+/*  Returns the worker thread to bind a new object to. Subsequent calls cycle
+    through all the workers in the pool. */
 struct nn_worker *nn_pool_choose_worker (struct nn_pool *self);
 
 #endif
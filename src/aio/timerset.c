@@ -23,59 +23,81 @@
 #include "timerset.h"
 
 #include "../utils/fast.h"
-#include "../utils/cont.h"
+#include "../utils/alloc.h"
 #include "../utils/err.h"
 
+/*  Each node of the heap has up to this many children. Compared to binary
+    heap, the heap is shallower and the children of a node share a cache
+    line. */
+#define NN_TIMERSET_ARITY 4
+
+/*  Initial size of the heap. */
+#define NN_TIMERSET_INITIAL_CAPACITY 16
+
+/*  Private functions. */
+static int nn_timerset_less (struct nn_timerset_hndl *a,
+    struct nn_timerset_hndl *b);
+static void nn_timerset_place (struct nn_timerset *self, size_t index,
+    struct nn_timerset_hndl *hndl);
+static void nn_timerset_up (struct nn_timerset *self, size_t index);
+static void nn_timerset_down (struct nn_timerset *self, size_t index);
+static void nn_timerset_erase (struct nn_timerset *self, size_t index);
+
 void nn_timerset_init (struct nn_timerset *self)
 {
     nn_clock_init (&self->clock);
-    nn_list_init (&self->timeouts);
+    self->heap = NULL;
+    self->count = 0;
+    self->capacity = 0;
+    self->seq = 0;
 }
 
 void nn_timerset_term (struct nn_timerset *self)
 {
-    nn_list_term (&self->timeouts);
+    nn_assert (self->count == 0);
+    if (self->heap)
+        nn_free (self->heap);
     nn_clock_term (&self->clock);
 }
 
 int nn_timerset_add (struct nn_timerset *self, int timeout,
     struct nn_timerset_hndl *hndl)
 {
-    struct nn_list_item *it;
-    struct nn_timerset_hndl *ith;
-    int first;
-
     /*  Compute the instant when the timeout will be due. */
     hndl->timeout = nn_clock_now (&self->clock) + timeout;
-
-    /*  Insert it into the ordered list of timeouts. */
-    for (it = nn_list_begin (&self->timeouts);
-          it != nn_list_end (&self->timeouts);
-          it = nn_list_next (&self->timeouts, it)) {
-        ith = nn_cont (it, struct nn_timerset_hndl, list);
-        if (hndl->timeout < ith->timeout)
-            break;
+    hndl->seq = self->seq++;
+
+    /*  Make sure there's room for one more timeout in the heap. */
+    if (nn_slow (self->count == self->capacity)) {
+        self->capacity = self->capacity ?
+            self->capacity * 2 : NN_TIMERSET_INITIAL_CAPACITY;
+        self->heap = nn_realloc (self->heap,
+            self->capacity * sizeof (struct nn_timerset_hndl*));
+        alloc_assert (self->heap);
     }
 
+    /*  Put the timeout at the bottom of the heap and let it bubble up. */
+    nn_timerset_place (self, self->count, hndl);
+    ++self->count;
+    nn_timerset_up (self, hndl->index);
+
     /*  If the new timeout happens to be the first one to expire, let the user
         know that the current waiting interval has to be changed. */
-    first = nn_list_begin (&self->timeouts) == it ? 1 : 0;
-    nn_list_insert (&self->timeouts, &hndl->list, it);
-    return first;
+    return hndl->index == 0 ? 1 : 0;
 }
 
 int nn_timerset_rm (struct nn_timerset *self, struct nn_timerset_hndl *hndl)
 {
     int first;
 
-    /*  Ignore if handle is not in the timeouts list. */
-    if (!nn_list_item_isinlist (&hndl->list))
+    /*  Ignore if handle is not in the heap. */
+    if (hndl->index == NN_TIMERSET_INACTIVE)
         return 0;
 
     /*  If it was the first timeout that was removed, the actual waiting time
         may have changed. We'll thus return 1 to let the user know. */
-    first = nn_list_begin (&self->timeouts) == &hndl->list ? 1 : 0;
-    nn_list_erase (&self->timeouts, &hndl->list);
+    first = hndl->index == 0 ? 1 : 0;
+    nn_timerset_erase (self, hndl->index);
     return first;
 }
 
@@ -83,11 +105,10 @@ int nn_timerset_timeout (struct nn_timerset *self)
 {
     int timeout;
 
-    if (nn_fast (nn_list_empty (&self->timeouts)))
+    if (nn_fast (self->count == 0))
         return -1;
 
-    timeout = (int) (nn_cont (nn_list_begin (&self->timeouts),
-        struct nn_timerset_hndl, list)->timeout - nn_clock_now (&self->clock));
+    timeout = (int) (self->heap [0]->timeout - nn_clock_now (&self->clock));
     return timeout < 0 ? 0 : timeout;
 }
 
@@ -96,34 +117,113 @@ int nn_timerset_event (struct nn_timerset *self, struct nn_timerset_hndl **hndl)
     struct nn_timerset_hndl *first;
 
     /*  If there's no timeout, there's no event to report. */
-    if (nn_fast (nn_list_empty (&self->timeouts)))
+    if (nn_fast (self->count == 0))
         return -EAGAIN;
 
     /*  If no timeout have expired yet, there's no event to return. */
-    first = nn_cont (nn_list_begin (&self->timeouts),
-        struct nn_timerset_hndl, list);
+    first = self->heap [0];
     if (first->timeout > nn_clock_now (&self->clock))
         return -EAGAIN;
 
-    /*  Return the first timeout and remove it from the list of active
-        timeouts. */
-    nn_list_erase (&self->timeouts, &first->list);
+    /*  Return the first timeout and remove it from the heap. */
+    nn_timerset_erase (self, 0);
     *hndl = first;
     return 0;
 }
 
 void nn_timerset_hndl_init (struct nn_timerset_hndl *self)
 {
-    nn_list_item_init (&self->list);
+    self->index = NN_TIMERSET_INACTIVE;
 }
 
 void nn_timerset_hndl_term (struct nn_timerset_hndl *self)
 {
-    nn_list_item_term (&self->list);
+    nn_assert (self->index == NN_TIMERSET_INACTIVE);
 }
 
 int nn_timerset_hndl_isactive (struct nn_timerset_hndl *self)
 {
-    return nn_list_item_isinlist (&self->list);
+    return self->index != NN_TIMERSET_INACTIVE ? 1 : 0;
+}
+
+static int nn_timerset_less (struct nn_timerset_hndl *a,
+    struct nn_timerset_hndl *b)
+{
+    if (a->timeout != b->timeout)
+        return a->timeout < b->timeout ? 1 : 0;
+    return a->seq < b->seq ? 1 : 0;
+}
+
+static void nn_timerset_place (struct nn_timerset *self, size_t index,
+    struct nn_timerset_hndl *hndl)
+{
+    self->heap [index] = hndl;
+    hndl->index = index;
 }
 
+static void nn_timerset_up (struct nn_timerset *self, size_t index)
+{
+    size_t parent;
+    struct nn_timerset_hndl *hndl;
+
+    hndl = self->heap [index];
+    while (index > 0) {
+        parent = (index - 1) / NN_TIMERSET_ARITY;
+        if (!nn_timerset_less (hndl, self->heap [parent]))
+            break;
+        nn_timerset_place (self, index, self->heap [parent]);
+        index = parent;
+    }
+    nn_timerset_place (self, index, hndl);
+}
+
+static void nn_timerset_down (struct nn_timerset *self, size_t index)
+{
+    size_t child;
+    size_t last;
+    size_t best;
+    struct nn_timerset_hndl *hndl;
+
+    hndl = self->heap [index];
+    while (1) {
+
+        /*  Find the child that expires first. */
+        child = index * NN_TIMERSET_ARITY + 1;
+        if (child >= self->count)
+            break;
+        last = child + NN_TIMERSET_ARITY;
+        if (last > self->count)
+            last = self->count;
+        best = child;
+        for (++child; child < last; ++child)
+            if (nn_timerset_less (self->heap [child], self->heap [best]))
+                best = child;
+
+        if (!nn_timerset_less (self->heap [best], hndl))
+            break;
+        nn_timerset_place (self, index, self->heap [best]);
+        index = best;
+    }
+    nn_timerset_place (self, index, hndl);
+}
+
+static void nn_timerset_erase (struct nn_timerset *self, size_t index)
+{
+    struct nn_timerset_hndl *last;
+
+    nn_assert (index < self->count);
+    self->heap [index]->index = NN_TIMERSET_INACTIVE;
+
+    /*  Fill the hole with the last timeout in the heap and restore the heap
+        property. The moved timeout may need to go either up or down. */
+    --self->count;
+    if (index == self->count)
+        return;
+    last = self->heap [self->count];
+    nn_timerset_place (self, index, last);
+    if (index > 0 && nn_timerset_less (last,
+          self->heap [(index - 1) / NN_TIMERSET_ARITY]))
+        nn_timerset_up (self, index);
+    else
+        nn_timerset_down (self, index);
+}
@@ -24,19 +24,40 @@
 #define NN_TIMERSET_INCLUDED
 
 #include "../utils/clock.h"
-#include "../utils/list.h"
+#include "../utils/int.h"
 
-/*  This class stores a list of timeouts and reports the next one to expire
-    along with the time till it happens. */
+#include <stddef.h>
+
+/*  This class stores a set of timeouts and reports the next one to expire
+    along with the time till it happens. Timeouts are kept in a 4-ary heap,
+    so that both adding and removing a timeout is O(log n). */
+
+/*  Index of the handle that is not in the set. */
+#define NN_TIMERSET_INACTIVE ((size_t) -1)
 
 struct nn_timerset_hndl {
-    struct nn_list_item list;
+
+    /*  Position of the handle in the heap. */
+    size_t index;
+
+    /*  The instant when the timeout is due. */
     uint64_t timeout;
+
+    /*  Sequence number of the timeout. Makes timeouts due at the same instant
+        expire in the order they were added. */
+    uint64_t seq;
 };
 
 struct nn_timerset {
     struct nn_clock clock;
-    struct nn_list timeouts;
+
+    /*  The heap of timeouts. The first one to expire is at index 0. */
+    struct nn_timerset_hndl **heap;
+    size_t count;
+    size_t capacity;
+
+    /*  Sequence number to be assigned to the next timeout. */
+    uint64_t seq;
 };
 
 void nn_timerset_init (struct nn_timerset *self);
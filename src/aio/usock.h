@@ -26,6 +26,10 @@
 /*  Import the definition of nn_iovec. */
 #include "../nn.h"
 
+#include "../utils/int.h"
+
+#include <stddef.h>
+
 /*  OS-level sockets. */
 
 /*  Event types generated by nn_usock. */
@@ -37,14 +41,37 @@
 #define NN_USOCK_ACCEPT_ERROR 6
 #define NN_USOCK_STOPPED 7
 #define NN_USOCK_SHUTDOWN 8
+#define NN_USOCK_RELEASED 9
+
+/*  Maximum number of iovecs that can be passed to nn_usock_send function.
+    Stream transports use it to send several messages in a single batch. */
+#define NN_USOCK_MAX_IOVCNT 64
 
-/*  Maximum number of iovecs that can be passed to nn_usock_send function. */
-#define NN_USOCK_MAX_IOVCNT 3
+/*  With zero-copy sending turned on, only batches of at least this size are
+    sent without copying. For smaller batches, pinning the pages and
+    processing the completion notification costs more than the copy. */
+#define NN_USOCK_ZEROCOPY_THRESHOLD (64 * 1024)
+
+/*  On Linux, files can be sent to a socket directly by the kernel. */
+#if defined NN_HAVE_LINUX
+#define NN_USOCK_HAVE_SENDFILE
+#endif
 
-/*  Size of the buffer used for batch-reads of inbound data. To keep the
-    performance optimal make sure that this value is larger than network MTU. */
+/*  Default size of the buffer used for batch-reads of inbound data. To keep
+    the performance optimal make sure that this value is larger than network
+    MTU. */
 #define NN_USOCK_BATCH_SIZE 2048
 
+/*  The batch buffer is a chunk which can be split into this many sub-chunks,
+    allowing inbound messages to be passed to the user without copying. */
+#define NN_USOCK_BATCH_SUBCHUNKS 64
+
+/*  Inbound messages smaller than 1/NN_USOCK_BATCH_COPYDIV of the batch buffer
+    are copied out of it rather than passed as sub-chunks. That way a small
+    message retained by the user doesn't pin a buffer much larger than
+    itself. */
+#define NN_USOCK_BATCH_COPYDIV 16
+
 #if defined NN_HAVE_WINDOWS
 #include "usock_win.h"
 #else
@@ -85,8 +112,45 @@ void nn_usock_connect (struct nn_usock *self, const struct sockaddr *addr,
 
 void nn_usock_send (struct nn_usock *self, const struct nn_iovec *iov,
     int iovcnt);
+
+#if defined NN_USOCK_HAVE_SENDFILE
+/*  Same as nn_usock_send, except that the buffers are followed by 'len'
+    bytes of the file 'fd' starting at 'offset'. The file is passed to
+    the socket by the kernel, without being copied to the user space. */
+void nn_usock_sendfile (struct nn_usock *self, const struct nn_iovec *iov,
+    int iovcnt, int fd, uint64_t offset, size_t len);
+#endif
 void nn_usock_recv (struct nn_usock *self, void *buf, size_t len);
 
+/*  Sets the size of the buffer used for batch-reads of inbound data. Should be
+    called before any data are received from the socket. */
+void nn_usock_set_batch_size (struct nn_usock *self, size_t size);
+
+/*  Returns the data that were already read from the OS socket but were not
+    received by the user yet. The user may process the data in place and
+    then mark them as received by nn_usock_consume instead of calling
+    nn_usock_recv. None of these can be used while nn_usock_recv is in
+    progress. */
+size_t nn_usock_batch (struct nn_usock *self, uint8_t **data);
+void nn_usock_consume (struct nn_usock *self, size_t len);
+
+/*  Returns the chunk holding the data returned by nn_usock_batch, or NULL.
+    Consumed data can be passed on as sub-chunks of it (see
+    nn_chunk_alloc_sub), avoiding the copy. The usock won't reuse the memory
+    until all the sub-chunks are deallocated. */
+void *nn_usock_batch_chunk (struct nn_usock *self);
+
+/*  Turns on zero-copy sending of large batches, if supported by the OS.
+    Should be called before the socket is activated. In zero-copy mode,
+    the kernel may still be reading from the buffers after NN_USOCK_SENT is
+    raised. The buffers of a batch must be kept intact until the value
+    returned by nn_usock_zcdone reaches the value nn_usock_zcseq returned at
+    the time NN_USOCK_SENT was received. NN_USOCK_RELEASED is raised each
+    time nn_usock_zcdone advances. */
+int nn_usock_set_zerocopy (struct nn_usock *self);
+uint32_t nn_usock_zcseq (struct nn_usock *self);
+uint32_t nn_usock_zcdone (struct nn_usock *self);
+
 int nn_usock_geterrno (struct nn_usock *self);
 
 #endif
@@ -46,9 +46,13 @@ struct nn_usock {
         uint8_t *buf;
         size_t len;
 
-        /*  Buffer for batch-reading inbound data. */
+        /*  Buffer for batch-reading inbound data. It is allocated as a chunk
+            slab so that received messages can refer to it. */
         uint8_t *batch;
 
+        /*  Capacity of the batch buffer. */
+        size_t batch_size;
+
         /*  Size of the batch buffer. */
         size_t batch_len;
 
@@ -66,6 +70,22 @@ struct nn_usock {
 
         /*  List of buffers being sent at the moment. Referenced from 'hdr'. */
         struct iovec iov [NN_USOCK_MAX_IOVCNT];
+
+        /*  1 if zero-copy sending is turned on. */
+        int zerocopy;
+
+        /*  Additional flags for sendmsg when sending the current batch. */
+        int flags;
+
+        /*  Number of send calls done in zero-copy mode so far and number of
+            those the kernel have reported as completed. */
+        uint32_t zcseq;
+        uint32_t zcdone;
+
+        /*  Part of the file to send once the buffers are sent. */
+        int file;
+        uint64_t file_offset;
+        size_t file_len;
     } out;
 
     /*  Asynchronous tasks for the worker. */
@@ -81,6 +101,7 @@ struct nn_usock {
     struct nn_fsm_event event_sent;
     struct nn_fsm_event event_received;
     struct nn_fsm_event event_error;
+    struct nn_fsm_event event_released;
 
     /*  In ACCEPTING state points to the socket being accepted.
         In BEING_ACCEPTED state points to the listener socket. */
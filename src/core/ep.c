@@ -231,7 +231,7 @@ void nn_ep_clear_error (struct nn_ep *self)
     nn_sock_report_error (self->sock, self, 0);
 }
 
-void nn_ep_stat_increment (struct nn_ep *self, int name, int increment)
+void nn_ep_stat_increment (struct nn_ep *self, int name, int64_t increment)
 {
     nn_sock_stat_increment (self->sock, name, increment);
 }
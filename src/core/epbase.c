@@ -73,6 +73,7 @@ void nn_epbase_clear_error (struct nn_epbase *self)
     nn_ep_clear_error (self->ep);
 }
 
-void nn_epbase_stat_increment(struct nn_epbase *self, int name, int increment) {
+void nn_epbase_stat_increment(struct nn_epbase *self, int name,
+    int64_t increment) {
     nn_ep_stat_increment(self->ep, name, increment);
 }
@@ -34,17 +34,21 @@
 
 #include "../utils/err.h"
 #include "../utils/alloc.h"
+#include "../utils/atomic.h"
 #include "../utils/mutex.h"
 #include "../utils/list.h"
 #include "../utils/cont.h"
 #include "../utils/random.h"
 #include "../utils/glock.h"
 #include "../utils/chunk.h"
+#include "../utils/chunkpool.h"
+#include "../utils/bigpool.h"
 #include "../utils/msg.h"
 #include "../utils/attr.h"
 
 #include "../transports/inproc/inproc.h"
 #include "../transports/ipc/ipc.h"
+#include "../transports/shm/shm.h"
 #include "../transports/tcp/tcp.h"
 
 #include "../protocols/pair/pair.h"
@@ -84,21 +88,37 @@
 #endif
 
 /*  Max number of concurrent SP sockets. */
-#define NN_MAX_SOCKETS 512
+#define NN_MAX_SOCKETS (1 << 20)
 
-/*  To save some space, list of unused socket slots uses uint16_t integers to
-    refer to individual sockets. If there's a need to more that 0x10000 sockets,
-    the type should be changed to uint32_t or int. */
-CT_ASSERT (NN_MAX_SOCKETS <= 0x10000);
+/*  The socket table is split into segments which are allocated only once
+    all the existing slots are in use. Segments are never deallocated before
+    the library is terminated, so the socket can be looked up without holding
+    the global lock. */
+#define NN_SOCKET_SEGMENT_SHIFT 9
+#define NN_SOCKET_SEGMENT_SIZE (1 << NN_SOCKET_SEGMENT_SHIFT)
+#define NN_SOCKET_SEGMENTS (NN_MAX_SOCKETS / NN_SOCKET_SEGMENT_SIZE)
+
+/*  Returns the socket table entry for socket descriptor s. */
+#define NN_SOCK(s) (self.socks [(s) >> NN_SOCKET_SEGMENT_SHIFT] \
+    [(s) & (NN_SOCKET_SEGMENT_SIZE - 1)])
 
 /*  This check is performed at the beginning of each socket operation to make
-    sure that the library was initialised and the socket actually exists. */
+    sure that the library was initialised and the socket actually exists.
+    The global lock is not held, so the segment is checked via its pointer
+    rather than via nslots. The pointer is published only after the segment
+    is initialised, see nn_global_grow. */
 #define NN_BASIC_CHECKS \
-    if (nn_slow (!self.socks || !self.socks [s])) {\
+    if (nn_slow (!self.socks || (unsigned) s >= NN_MAX_SOCKETS ||\
+          !self.socks [(unsigned) s >> NN_SOCKET_SEGMENT_SHIFT] ||\
+          !NN_SOCK (s))) {\
         errno = EBADF;\
         return -1;\
     }
 
+/*  Maximum number of messages nn_sendmmsg and nn_recvmmsg pass to the socket
+    at once. Longer vectors are processed in several batches. */
+#define NN_GLOBAL_MMSG_BATCH 64
+
 #define NN_CTX_FLAG_ZOMBIE 1
 
 #define NN_GLOBAL_SRC_STAT_TIMER 1
@@ -110,13 +130,22 @@ CT_ASSERT (NN_MAX_SOCKETS <= 0x10000);
 struct nn_global {
 
     /*  The global table of existing sockets. The descriptor representing
-        the socket is the index to this table. This pointer is also used to
-        find out whether context is initialised. If it is NULL, context is
-        uninitialised. */
-    struct nn_sock **socks;
+        the socket is the index to this table. The table consists of
+        NN_SOCKET_SEGMENTS pointers to the segments, only first nslots of
+        which are allocated. This pointer is also used to find out whether
+        context is initialised. If it is NULL, context is uninitialised. */
+    struct nn_sock ***socks;
+
+    /*  Number of socket slots in the allocated segments. */
+    size_t nslots;
+
+    /*  All the allocated socket descriptors. First nsocks of them are in use,
+        the rest are unused. This way we can iterate over the open sockets
+        without scanning the whole table. */
+    uint32_t *fds;
 
-    /*  Stack of unused file descriptors. */
-    uint16_t *unused;
+    /*  Position of each socket descriptor in the fds array. */
+    uint32_t *fdpos;
 
     /*  Number of actual open sockets in the socket table. */
     size_t nsocks;
@@ -157,6 +186,9 @@ static struct nn_global self = {0};
 static void nn_global_init (void);
 static void nn_global_term (void);
 
+/*  Allocates a new segment of the socket table. */
+static void nn_global_grow (void);
+
 /*  Transport-related private functions. */
 static void nn_global_add_transport (struct nn_transport *transport);
 static void nn_global_add_socktype (struct nn_socktype *socktype);
@@ -169,6 +201,16 @@ static int nn_global_create_ep (int s, const char *addr, int bind);
     does no locking by itself */
 static int nn_global_create_socket (int domain, int protocol);
 
+/*  Private functions that convert between the user-supplied message headers
+    and message objects. Shared by the single- and multi-message variants of
+    the send and receive functions. */
+static int nn_global_sendmsg_init (const struct nn_msghdr *msghdr,
+    struct nn_msg *msg, size_t *sz);
+static void nn_global_sendmsg_term (const struct nn_msghdr *msghdr,
+    struct nn_msg *msg);
+static int nn_global_recvmsg_fill (struct nn_msghdr *msghdr,
+    struct nn_msg *msg, size_t *sz);
+
 /*  FSM callbacks  */
 static void nn_global_handler (struct nn_fsm *self,
     int src, int type, void *srcptr);
@@ -192,6 +234,7 @@ static void nn_global_init (void)
     char *envvar;
     int rc;
     char *addr;
+    int nworkers;
 
 #if defined NN_HAVE_WINDOWS
     WSADATA data;
@@ -211,16 +254,22 @@ static void nn_global_init (void)
 
     /*  Initialise the memory allocation subsystem. */
     nn_alloc_init ();
+    nn_chunkpool_init ();
+    nn_bigpool_init ();
 
     /*  Seed the pseudo-random number generator. */
     nn_random_seed ();
 
-    /*  Allocate the global table of SP sockets. */
-    self.socks = nn_alloc ((sizeof (struct nn_sock*) * NN_MAX_SOCKETS) +
-        (sizeof (uint16_t) * NN_MAX_SOCKETS), "socket table");
+    /*  Allocate the global table of SP sockets. The segments themselves
+        are allocated when the sockets are created. */
+    self.socks = nn_alloc (sizeof (struct nn_sock**) * NN_SOCKET_SEGMENTS,
+        "socket table");
     alloc_assert (self.socks);
-    for (i = 0; i != NN_MAX_SOCKETS; ++i)
+    for (i = 0; i != NN_SOCKET_SEGMENTS; ++i)
         self.socks [i] = NULL;
+    self.nslots = 0;
+    self.fds = NULL;
+    self.fdpos = NULL;
     self.nsocks = 0;
     self.flags = 0;
 
@@ -233,11 +282,9 @@ static void nn_global_init (void)
     envvar = getenv("NN_PRINT_STATISTICS");
     self.print_statistics = envvar && *envvar;
 
-    /*  Allocate the stack of unused file descriptors. */
-    self.unused = (uint16_t*) (self.socks + NN_MAX_SOCKETS);
-    alloc_assert (self.unused);
-    for (i = 0; i != NN_MAX_SOCKETS; ++i)
-        self.unused [i] = NN_MAX_SOCKETS - i - 1;
+    /*  Number of worker threads. Zero means one thread per CPU core.  */
+    envvar = getenv("NN_WORKER_THREADS");
+    nworkers = envvar ? atoi (envvar) : 0;
 
     /*  Initialise other parts of the global state. */
     nn_list_init (&self.transports);
@@ -247,6 +294,7 @@ static void nn_global_init (void)
     nn_global_add_transport (nn_inproc);
 #if !defined NN_HAVE_WINDOWS
     nn_global_add_transport (nn_ipc);
+    nn_global_add_transport (nn_shm);
 #endif
     nn_global_add_transport (nn_tcp);
 
@@ -273,7 +321,8 @@ static void nn_global_init (void)
     nn_global_add_socktype (nn_xbus_socktype);
 
     /*  Start the worker threads. */
-    nn_pool_init (&self.pool);
+    rc = nn_pool_init (&self.pool, nworkers);
+    errnum_assert (rc == 0, -rc);
 
     /*  Start FSM  */
     nn_fsm_init_root (&self.fsm, nn_global_handler, nn_global_shutdown,
@@ -282,7 +331,12 @@ static void nn_global_init (void)
 
     nn_ctx_init (&self.ctx, nn_global_getpool (), NULL);
     nn_timer_init (&self.stat_timer, NN_GLOBAL_SRC_STAT_TIMER, &self.fsm);
+
+    /*  The FSM starts the statistics timer, so the worker thread may
+        already be processing its events. Do it from within the context. */
+    nn_ctx_enter (&self.ctx);
     nn_fsm_start (&self.fsm);
+    nn_ctx_leave (&self.ctx);
 
     /*   Initializing special sockets.  */
     addr = getenv ("NN_STATISTICS_SOCKET");
@@ -322,6 +376,7 @@ static void nn_global_term (void)
 #if defined NN_HAVE_WINDOWS
     int rc;
 #endif
+    size_t i;
     struct nn_list_item *it;
     struct nn_transport *tp;
 
@@ -355,12 +410,20 @@ static void nn_global_term (void)
     /*  Final deallocation of the nn_global object itself. */
     nn_list_term (&self.socktypes);
     nn_list_term (&self.transports);
+    for (i = 0; i != self.nslots / NN_SOCKET_SEGMENT_SIZE; ++i)
+        nn_free (self.socks [i]);
+    if (self.fds) {
+        nn_free (self.fds);
+        nn_free (self.fdpos);
+    }
     nn_free (self.socks);
 
     /*  This marks the global state as uninitialised. */
     self.socks = NULL;
 
     /*  Shut down the memory allocation subsystem. */
+    nn_chunkpool_term ();
+    nn_bigpool_term ();
     nn_alloc_term ();
 
     /*  On Windows, uninitialise the socket library. */
@@ -381,9 +444,8 @@ void nn_term (void)
 
     /*  Mark all open sockets as terminating. */
     if (self.socks && self.nsocks) {
-        for (i = 0; i != NN_MAX_SOCKETS; ++i)
-            if (self.socks [i])
-                nn_sock_zombify (self.socks [i]);
+        for (i = 0; i != (int) self.nsocks; ++i)
+            nn_sock_zombify (NN_SOCK (self.fds [i]));
     }
 
     nn_glock_unlock ();
@@ -401,12 +463,73 @@ void *nn_allocmsg (size_t size, int type)
     return NULL;
 }
 
+void *nn_allocmsg_file (int fd, nn_uint64_t offset, size_t size)
+{
+    int rc;
+    void *result;
+
+    rc = nn_chunk_alloc_file (fd, offset, size, &result);
+    if (rc == 0)
+        return result;
+    errno = -rc;
+    return NULL;
+}
+
 int nn_freemsg (void *msg)
 {
     nn_chunk_free (msg);
     return 0;
 }
 
+int nn_get_allocstats (struct nn_allocstats *stats)
+{
+    if (nn_slow (!stats)) {
+        errno = EFAULT;
+        return -1;
+    }
+    nn_bigpool_stats (stats);
+    return 0;
+}
+
+static void nn_global_grow (void)
+{
+    uint32_t i;
+    uint32_t nslots;
+    struct nn_sock **segment;
+
+    /*  The function is called with nn_glock held */
+    nn_assert (self.nsocks == self.nslots);
+    nn_assert (self.nslots < NN_MAX_SOCKETS);
+
+    nslots = self.nslots + NN_SOCKET_SEGMENT_SIZE;
+    if (!self.fds) {
+        self.fds = nn_alloc (sizeof (uint32_t) * nslots, "socket table");
+        self.fdpos = nn_alloc (sizeof (uint32_t) * nslots, "socket table");
+    }
+    else {
+        self.fds = nn_realloc (self.fds, sizeof (uint32_t) * nslots);
+        self.fdpos = nn_realloc (self.fdpos, sizeof (uint32_t) * nslots);
+    }
+    alloc_assert (self.fds);
+    alloc_assert (self.fdpos);
+    for (i = self.nslots; i != nslots; ++i) {
+        self.fds [i] = i;
+        self.fdpos [i] = i;
+    }
+
+    segment = nn_alloc (sizeof (struct nn_sock*) * NN_SOCKET_SEGMENT_SIZE,
+        "socket table");
+    alloc_assert (segment);
+    for (i = 0; i != NN_SOCKET_SEGMENT_SIZE; ++i)
+        segment [i] = NULL;
+
+    /*  Socket lookups don't take the global lock. Make sure the initialised
+        contents of the segment are visible before the segment itself is. */
+    nn_atomic_barrier ();
+    self.socks [self.nslots >> NN_SOCKET_SEGMENT_SHIFT] = segment;
+    self.nslots = nslots;
+}
+
 int nn_global_create_socket (int domain, int protocol)
 {
     int rc;
@@ -421,13 +544,16 @@ int nn_global_create_socket (int domain, int protocol)
         return -EAFNOSUPPORT;
     }
 
-    /*  If socket limit was reached, report error. */
-    if (nn_slow (self.nsocks >= NN_MAX_SOCKETS)) {
-        return -EMFILE;
+    /*  If all the slots are used, allocate a new segment of the socket
+        table. If socket limit was reached, report error. */
+    if (nn_slow (self.nsocks >= self.nslots)) {
+        if (nn_slow (self.nslots >= NN_MAX_SOCKETS))
+            return -EMFILE;
+        nn_global_grow ();
     }
 
     /*  Find an empty socket slot. */
-    s = self.unused [NN_MAX_SOCKETS - self.nsocks - 1];
+    s = self.fds [self.nsocks];
 
     /*  Find the appropriate socket type. */
     for (it = nn_list_begin (&self.socktypes);
@@ -444,7 +570,7 @@ int nn_global_create_socket (int domain, int protocol)
                 return rc;
 
             /*  Adjust the global socket table. */
-            self.socks [s] = sock;
+            NN_SOCK (s) = sock;
             ++self.nsocks;
             return s;
         }
@@ -486,6 +612,7 @@ int nn_socket (int domain, int protocol)
 int nn_close (int s)
 {
     int rc;
+    uint32_t pos;
 
     NN_BASIC_CHECKS;
 
@@ -494,18 +621,23 @@ int nn_close (int s)
     nn_glock_lock ();
 
     /*  Deallocate the socket object. */
-    rc = nn_sock_term (self.socks [s]);
+    rc = nn_sock_term (NN_SOCK (s));
     if (nn_slow (rc == -EINTR)) {
         errno = EINTR;
         return -1;
     }
 
-    /*  Remove the socket from the socket table, add it to unused socket
-        table. */
-    nn_free (self.socks [s]);
-    self.socks [s] = NULL;
-    self.unused [NN_MAX_SOCKETS - self.nsocks] = s;
+    /*  Remove the socket from the socket table. Move its descriptor to
+        the unused part of the fds array by swapping it with the last
+        descriptor in use. */
+    nn_free (NN_SOCK (s));
+    NN_SOCK (s) = NULL;
     --self.nsocks;
+    pos = self.fdpos [s];
+    self.fds [pos] = self.fds [self.nsocks];
+    self.fdpos [self.fds [pos]] = pos;
+    self.fds [self.nsocks] = s;
+    self.fdpos [s] = self.nsocks;
 
     /*  Destroy the global context if there's no socket remaining. */
     nn_global_term ();
@@ -527,7 +659,7 @@ int nn_setsockopt (int s, int level, int option, const void *optval,
         return -1;
     }
 
-    rc = nn_sock_setopt (self.socks [s], level, option, optval, optvallen);
+    rc = nn_sock_setopt (NN_SOCK (s), level, option, optval, optvallen);
     if (nn_slow (rc < 0)) {
         errno = -rc;
         return -1;
@@ -549,7 +681,7 @@ int nn_getsockopt (int s, int level, int option, void *optval,
         return -1;
     }
 
-    rc = nn_sock_getopt (self.socks [s], level, option, optval, optvallen);
+    rc = nn_sock_getopt (NN_SOCK (s), level, option, optval, optvallen);
     if (nn_slow (rc < 0)) {
         errno = -rc;
         return -1;
@@ -599,7 +731,7 @@ int nn_shutdown (int s, int how)
 
     NN_BASIC_CHECKS;
 
-    rc = nn_sock_rm_ep (self.socks [s], how);
+    rc = nn_sock_rm_ep (NN_SOCK (s), how);
     if (nn_slow (rc < 0)) {
         errno = -rc;
         return -1;
@@ -641,7 +773,7 @@ int nn_send (int s, const void *buf, size_t len, int flags)
     }
 
     /*  Send it further down the stack. */
-    rc = nn_sock_send (self.socks [s], &msg, flags);
+    rc = nn_sock_send (NN_SOCK (s), &msg, flags);
     if (nn_slow (rc < 0)) {
         nn_chunkref_term (&msg.hdr);
 
@@ -654,8 +786,8 @@ int nn_send (int s, const void *buf, size_t len, int flags)
         errno = -rc;
         return -1;
     }
-    nn_sock_stat_increment (self.socks [s], NN_STAT_MESSAGES_SENT, 1);
-    nn_sock_stat_increment (self.socks [s], NN_STAT_BYTES_SENT, len);
+    nn_sock_stat_increment (NN_SOCK (s), NN_STAT_MESSAGES_SENT, 1);
+    nn_sock_stat_increment (NN_SOCK (s), NN_STAT_BYTES_SENT, len);
 
     return (int) len;
 }
@@ -674,7 +806,7 @@ int nn_recv (int s, void *buf, size_t len, int flags)
         return -1;
     }
 
-    rc = nn_sock_recv (self.socks [s], &msg, flags);
+    rc = nn_sock_recv (NN_SOCK (s), &msg, flags);
     if (nn_slow (rc < 0)) {
         errno = -rc;
         return -1;
@@ -690,8 +822,8 @@ int nn_recv (int s, void *buf, size_t len, int flags)
         memcpy (buf, nn_chunkref_data (&msg.body), len < sz ? len : sz);
     }
     nn_msg_term (&msg);
-    nn_sock_stat_increment (self.socks [s], NN_STAT_MESSAGES_RECEIVED, 1);
-    nn_sock_stat_increment (self.socks [s], NN_STAT_BYTES_RECEIVED, sz);
+    nn_sock_stat_increment (NN_SOCK (s), NN_STAT_MESSAGES_RECEIVED, 1);
+    nn_sock_stat_increment (NN_SOCK (s), NN_STAT_BYTES_RECEIVED, sz);
 
     return (int) sz;
 }
@@ -700,11 +832,34 @@ int nn_sendmsg (int s, const struct nn_msghdr *msghdr, int flags)
 {
     int rc;
     size_t sz;
-    int i;
-    struct nn_iovec *iov;
     struct nn_msg msg;
-    void *chunk;
-    int nnmsg;
+
+    NN_BASIC_CHECKS;
+
+    rc = nn_global_sendmsg_init (msghdr, &msg, &sz);
+    if (nn_slow (rc < 0)) {
+        errno = -rc;
+        return -1;
+    }
+
+    /*  Send it further down the stack. */
+    rc = nn_sock_send (NN_SOCK (s), &msg, flags);
+    if (nn_slow (rc < 0)) {
+        nn_global_sendmsg_term (msghdr, &msg);
+        errno = -rc;
+        return -1;
+    }
+    nn_sock_stat_increment (NN_SOCK (s), NN_STAT_MESSAGES_SENT, 1);
+    nn_sock_stat_increment (NN_SOCK (s), NN_STAT_BYTES_SENT, sz);
+
+    return (int) sz;
+}
+
+int nn_recvmsg (int s, struct nn_msghdr *msghdr, int flags)
+{
+    int rc;
+    struct nn_msg msg;
+    size_t sz;
 
     NN_BASIC_CHECKS;
 
@@ -718,56 +873,211 @@ int nn_sendmsg (int s, const struct nn_msghdr *msghdr, int flags)
         return -1;
     }
 
-    if (msghdr->msg_iovlen == 1 && msghdr->msg_iov [0].iov_len == NN_MSG) {
-        chunk = *(void**) msghdr->msg_iov [0].iov_base;
-        if (nn_slow (chunk == NULL)) {
-            errno = EFAULT;
+    /*  Get a message. */
+    rc = nn_sock_recv (NN_SOCK (s), &msg, flags);
+    if (nn_slow (rc < 0)) {
+        errno = -rc;
+        return -1;
+    }
+
+    rc = nn_global_recvmsg_fill (msghdr, &msg, &sz);
+    if (nn_slow (rc < 0)) {
+        errno = -rc;
+        return -1;
+    }
+
+    return (int) sz;
+}
+
+int nn_sendmmsg (int s, struct nn_mmsghdr *msgvec, unsigned int vlen,
+    int flags)
+{
+    int rc;
+    int err;
+    unsigned int i;
+    unsigned int n;
+    unsigned int count;
+    size_t sz;
+    struct nn_msg msgs [NN_GLOBAL_MMSG_BATCH];
+
+    NN_BASIC_CHECKS;
+
+    if (nn_slow (!msgvec && vlen)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    count = 0;
+    err = 0;
+    while (count < vlen && !err) {
+
+        /*  Create the message objects for the next batch. If one of the
+            messages is invalid, send the ones preceding it and report
+            the error only if there are none. */
+        n = vlen - count < NN_GLOBAL_MMSG_BATCH ?
+            vlen - count : NN_GLOBAL_MMSG_BATCH;
+        for (i = 0; i != n; ++i) {
+            err = nn_global_sendmsg_init (&msgvec [count + i].msg_hdr,
+                &msgs [i], &msgvec [count + i].msg_len);
+            if (nn_slow (err < 0))
+                break;
+        }
+        n = i;
+        if (n == 0)
+            break;
+
+        /*  Only wait for the very first message. */
+        rc = nn_sock_sendv (NN_SOCK (s), msgs, n,
+            count ? flags | NN_DONTWAIT : flags);
+
+        /*  Give the messages that weren't sent back to the user. */
+        for (i = rc < 0 ? 0 : rc; i != n; ++i)
+            nn_global_sendmsg_term (&msgvec [count + i].msg_hdr, &msgs [i]);
+        if (nn_slow (rc < 0)) {
+            err = rc;
+            break;
+        }
+
+        sz = 0;
+        for (i = 0; i != (unsigned int) rc; ++i)
+            sz += msgvec [count + i].msg_len;
+        nn_sock_stat_increment (NN_SOCK (s), NN_STAT_MESSAGES_SENT, rc);
+        nn_sock_stat_increment (NN_SOCK (s), NN_STAT_BYTES_SENT, sz);
+
+        count += rc;
+        if ((unsigned int) rc < n)
+            break;
+    }
+
+    if (nn_slow (count == 0 && err < 0)) {
+        errno = -err;
+        return -1;
+    }
+
+    return (int) count;
+}
+
+int nn_recvmmsg (int s, struct nn_mmsghdr *msgvec, unsigned int vlen,
+    int flags)
+{
+    int rc;
+    unsigned int i;
+    unsigned int n;
+    unsigned int count;
+    size_t sz;
+    struct nn_msghdr *msghdr;
+    struct nn_msg msgs [NN_GLOBAL_MMSG_BATCH];
+
+    NN_BASIC_CHECKS;
+
+    if (nn_slow (!msgvec && vlen)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /*  Check all the headers in advance so that we never have to drop
+        a message that was already received. */
+    for (i = 0; i != vlen; ++i) {
+        msghdr = &msgvec [i].msg_hdr;
+        if (nn_slow (msghdr->msg_iovlen < 0)) {
+            errno = EMSGSIZE;
             return -1;
         }
-        sz = nn_chunk_size (chunk);
-        nn_msg_init_chunk (&msg, chunk);
-        nnmsg = 1;
+        if (msghdr->msg_iovlen == 1 && msghdr->msg_iov [0].iov_len == NN_MSG)
+            continue;
+        for (n = 0; n != (unsigned int) msghdr->msg_iovlen; ++n) {
+            if (nn_slow (msghdr->msg_iov [n].iov_len == NN_MSG)) {
+                errno = EINVAL;
+                return -1;
+            }
+        }
+    }
+
+    count = 0;
+    while (count < vlen) {
+
+        /*  Only wait for the very first message. */
+        n = vlen - count < NN_GLOBAL_MMSG_BATCH ?
+            vlen - count : NN_GLOBAL_MMSG_BATCH;
+        rc = nn_sock_recvv (NN_SOCK (s), msgs, n,
+            count ? flags | NN_DONTWAIT : flags);
+        if (nn_slow (rc < 0)) {
+            if (count == 0) {
+                errno = -rc;
+                return -1;
+            }
+            break;
+        }
+
+        sz = 0;
+        for (i = 0; i != (unsigned int) rc; ++i) {
+            nn_global_recvmsg_fill (&msgvec [count + i].msg_hdr, &msgs [i],
+                &msgvec [count + i].msg_len);
+            sz += msgvec [count + i].msg_len;
+        }
+        nn_sock_stat_increment (NN_SOCK (s), NN_STAT_MESSAGES_RECEIVED, rc);
+        nn_sock_stat_increment (NN_SOCK (s), NN_STAT_BYTES_RECEIVED, sz);
+
+        count += rc;
+        if ((unsigned int) rc < n)
+            break;
+    }
+
+    return (int) count;
+}
+
+static int nn_global_sendmsg_init (const struct nn_msghdr *msghdr,
+    struct nn_msg *msg, size_t *sz)
+{
+    int i;
+    struct nn_iovec *iov;
+    void *chunk;
+
+    if (nn_slow (!msghdr))
+        return -EINVAL;
+
+    if (nn_slow (msghdr->msg_iovlen < 0))
+        return -EMSGSIZE;
+
+    if (msghdr->msg_iovlen == 1 && msghdr->msg_iov [0].iov_len == NN_MSG) {
+        chunk = *(void**) msghdr->msg_iov [0].iov_base;
+        if (nn_slow (chunk == NULL))
+            return -EFAULT;
+        *sz = nn_chunk_size (chunk);
+        nn_msg_init_chunk (msg, chunk);
     }
     else {
 
         /*  Compute the total size of the message. */
-        sz = 0;
+        *sz = 0;
         for (i = 0; i != msghdr->msg_iovlen; ++i) {
             iov = &msghdr->msg_iov [i];
-            if (nn_slow (iov->iov_len == NN_MSG)) {
-               errno = EINVAL;
-               return -1;
-            }
-            if (nn_slow (!iov->iov_base && iov->iov_len)) {
-                errno = EFAULT;
-                return -1;
-            }
-            if (nn_slow (sz + iov->iov_len < sz)) {
-                errno = EINVAL;
-                return -1;
-            }
-            sz += iov->iov_len;
+            if (nn_slow (iov->iov_len == NN_MSG))
+               return -EINVAL;
+            if (nn_slow (!iov->iov_base && iov->iov_len))
+                return -EFAULT;
+            if (nn_slow (*sz + iov->iov_len < *sz))
+                return -EINVAL;
+            *sz += iov->iov_len;
         }
 
         /*  Create a message object from the supplied scatter array. */
-        nn_msg_init (&msg, sz);
-        sz = 0;
+        nn_msg_init (msg, *sz);
+        *sz = 0;
         for (i = 0; i != msghdr->msg_iovlen; ++i) {
             iov = &msghdr->msg_iov [i];
-            memcpy (((uint8_t*) nn_chunkref_data (&msg.body)) + sz,
+            memcpy (((uint8_t*) nn_chunkref_data (&msg->body)) + *sz,
                 iov->iov_base, iov->iov_len);
-            sz += iov->iov_len;
+            *sz += iov->iov_len;
         }
-
-        nnmsg = 0;
     }
 
     /*  Add ancillary data to the message. */
     if (msghdr->msg_control) {
         if (msghdr->msg_controllen == NN_MSG) {
             chunk = *((void**) msghdr->msg_control);
-            nn_chunkref_term (&msg.hdr);
-            nn_chunkref_init_chunk (&msg.hdr, chunk);
+            nn_chunkref_term (&msg->hdr);
+            nn_chunkref_init_chunk (&msg->hdr, chunk);
         }
         else {
 
@@ -776,86 +1086,60 @@ int nn_sendmsg (int s, const struct nn_msghdr *msghdr, int flags)
         }
     }
 
-    /*  Send it further down the stack. */
-    rc = nn_sock_send (self.socks [s], &msg, flags);
-    if (nn_slow (rc < 0)) {
-
-        /*  If we are dealing with user-supplied buffer, detach it from
-            the message object. */
-        if (nnmsg)
-            nn_chunkref_init (&msg.body, 0);
+    return 0;
+}
 
-        nn_msg_term (&msg);
-        errno = -rc;
-        return -1;
-    }
-    nn_sock_stat_increment (self.socks [s], NN_STAT_MESSAGES_SENT, 1);
-    nn_sock_stat_increment (self.socks [s], NN_STAT_BYTES_SENT, sz);
+static void nn_global_sendmsg_term (const struct nn_msghdr *msghdr,
+    struct nn_msg *msg)
+{
+    /*  If we are dealing with user-supplied buffer, detach it from
+        the message object. */
+    if (msghdr->msg_iovlen == 1 && msghdr->msg_iov [0].iov_len == NN_MSG)
+        nn_chunkref_init (&msg->body, 0);
 
-    return (int) sz;
+    nn_msg_term (msg);
 }
 
-int nn_recvmsg (int s, struct nn_msghdr *msghdr, int flags)
+static int nn_global_recvmsg_fill (struct nn_msghdr *msghdr,
+    struct nn_msg *msg, size_t *sz)
 {
-    int rc;
-    struct nn_msg msg;
     uint8_t *data;
-    size_t sz;
+    size_t left;
     int i;
     struct nn_iovec *iov;
     void *chunk;
 
-    NN_BASIC_CHECKS;
-
-    if (nn_slow (!msghdr)) {
-        errno = EINVAL;
-        return -1;
-    }
-
-    if (nn_slow (msghdr->msg_iovlen < 0)) {
-        errno = EMSGSIZE;
-        return -1;
-    }
-
-    /*  Get a message. */
-    rc = nn_sock_recv (self.socks [s], &msg, flags);
-    if (nn_slow (rc < 0)) {
-        errno = -rc;
-        return -1;
-    }
-
     if (msghdr->msg_iovlen == 1 && msghdr->msg_iov [0].iov_len == NN_MSG) {
-        chunk = nn_chunkref_getchunk (&msg.body);
+        chunk = nn_chunkref_getchunk (&msg->body);
         *(void**) (msghdr->msg_iov [0].iov_base) = chunk;
-        sz = nn_chunk_size (chunk);
+        *sz = nn_chunk_size (chunk);
     }
     else {
 
         /*  Copy the message content into the supplied gather array. */
-        data = nn_chunkref_data (&msg.body);
-        sz = nn_chunkref_size (&msg.body);
+        data = nn_chunkref_data (&msg->body);
+        left = nn_chunkref_size (&msg->body);
         for (i = 0; i != msghdr->msg_iovlen; ++i) {
             iov = &msghdr->msg_iov [i];
             if (nn_slow (iov->iov_len == NN_MSG)) {
-                nn_msg_term (&msg);
-                errno = EINVAL;
-                return -1;
+                nn_msg_term (msg);
+                return -EINVAL;
             }
-            if (iov->iov_len > sz) {
-                memcpy (iov->iov_base, data, sz);
+            if (iov->iov_len > left) {
+                memcpy (iov->iov_base, data, left);
                 break;
             }
             memcpy (iov->iov_base, data, iov->iov_len);
             data += iov->iov_len;
-            sz -= iov->iov_len;
+            left -= iov->iov_len;
         }
-        sz = nn_chunkref_size (&msg.body);
+        *sz = nn_chunkref_size (&msg->body);
     }
 
     /*  Retrieve the ancillary data from the message. */
     if (msghdr->msg_control) {
         if (msghdr->msg_controllen == NN_MSG) {
-            chunk = nn_chunkref_getchunk (&msg.hdr);
+            chunk = nn_chunkref_getchunk (&msg->hdr);
             *((void**) msghdr->msg_control) = chunk;
         }
         else {
@@ -866,9 +1150,9 @@ int nn_recvmsg (int s, struct nn_msghdr *msghdr, int flags)
         }
     }
 
-    nn_msg_term (&msg);
+    nn_msg_term (msg);
 
-    return (int) sz;
+    return 0;
 }
 
 static void nn_global_add_transport (struct nn_transport *transport)
@@ -1033,13 +1317,13 @@ static void nn_global_submit_errors (int i, struct nn_sock *s,
 }
 
 static void nn_global_submit_statistics () {
+    size_t j;
     int i;
+    struct nn_sock *s;
 
-    /*  TODO(tailhook)  optimized it to use nsocks and unused  */
-    for(i = 0; i < NN_MAX_SOCKETS; ++i) {
-        struct nn_sock *s = self.socks [i];
-        if (!s)
-            continue;
+    for (j = 0; j != self.nsocks; ++j) {
+        i = self.fds [j];
+        s = NN_SOCK (i);
         if (i == self.statistics_socket)
             continue;
         nn_ctx_enter (&s->ctx);
@@ -1057,6 +1341,14 @@ static void nn_global_submit_statistics () {
             "bind_errors", s->statistics.bind_errors);
         nn_global_submit_counter (i, s,
             "accept_errors", s->statistics.accept_errors);
+        nn_global_submit_counter (i, s,
+            "compress_bytes_in", s->statistics.compress_bytes_in);
+        nn_global_submit_counter (i, s,
+            "compress_bytes_out", s->statistics.compress_bytes_out);
+        nn_global_submit_counter (i, s,
+            "compress_time", s->statistics.compress_time);
+        nn_global_submit_counter (i, s,
+            "decompress_time", s->statistics.decompress_time);
         nn_global_submit_counter (i, s,
             "messages_sent", s->statistics.messages_sent);
         nn_global_submit_counter (i, s,
@@ -1065,6 +1357,10 @@ static void nn_global_submit_statistics () {
             "bytes_sent", s->statistics.bytes_sent);
         nn_global_submit_counter (i, s,
             "bytes_received", s->statistics.bytes_received);
+        nn_global_submit_counter (i, s,
+            "match_cache_hits", s->statistics.match_cache_hits);
+        nn_global_submit_counter (i, s,
+            "match_cache_misses", s->statistics.match_cache_misses);
         nn_global_submit_level (i, s,
             "current_connections", s->statistics.current_connections);
         nn_global_submit_level (i, s,
@@ -1120,7 +1416,7 @@ static int nn_global_create_ep (int s, const char *addr, int bind)
     }
 
     /*  Ask the socket to create the endpoint. */
-    rc = nn_sock_add_ep (self.socks [s], tp, bind, addr);
+    rc = nn_sock_add_ep (NN_SOCK (s), tp, bind, addr);
     return rc;
 }
 
@@ -164,6 +164,12 @@ int nn_pipebase_ispeer (struct nn_pipebase *self, int socktype)
     return nn_sock_ispeer (self->sock, socktype);
 }
 
+void nn_pipebase_stat_increment (struct nn_pipebase *self, int name,
+    int64_t increment)
+{
+    nn_sock_stat_increment (self->sock, name, increment);
+}
+
 void nn_pipe_setdata (struct nn_pipe *self, void *data)
 {
     ((struct nn_pipebase*) self)->data = data;
@@ -213,6 +219,16 @@ int nn_pipe_recv (struct nn_pipe *self, struct nn_msg *msg)
     return rc | NN_PIPEBASE_RELEASE;
 }
 
+size_t nn_pipe_backlog (struct nn_pipe *self)
+{
+    struct nn_pipebase *pipebase;
+
+    pipebase = (struct nn_pipebase*) self;
+    if (!pipebase->vfptr->backlog)
+        return 0;
+    return pipebase->vfptr->backlog (pipebase);
+}
+
 void nn_pipe_getopt (struct nn_pipe *self, int level, int option,
     void *optval, size_t *optvallen)
 {
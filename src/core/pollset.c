@@ -0,0 +1,433 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../nn.h"
+
+#include "../utils/alloc.h"
+#include "../utils/fast.h"
+#include "../utils/err.h"
+#include "../utils/cont.h"
+#include "../utils/hash.h"
+#include "../utils/list.h"
+
+#if defined NN_HAVE_WINDOWS
+#include "../utils/win.h"
+#else
+#include "../aio/poller.h"
+#endif
+
+#include <stddef.h>
+#include <string.h>
+
+/*  Persistent counterpart of nn_poll. The file descriptors signalling
+    the readiness of the SP sockets are looked up and registered with
+    the OS-level pollset only when the socket is added, so waiting costs
+    no allocations and, with epoll or kqueue, is proportional to the number
+    of ready sockets rather than to the size of the set. On Windows there's
+    no such pollset available and the wait falls back to nn_poll. */
+
+#if !defined NN_HAVE_WINDOWS
+
+/*  One of the two file descriptors (RCVFD, SNDFD) of a socket. */
+struct nn_pollset_fd {
+    struct nn_poller_hndl hndl;
+
+    /*  NN_POLLIN or NN_POLLOUT. */
+    short event;
+
+    /*  1 if the file descriptor is registered with the poller. */
+    int registered;
+};
+
+#endif
+
+struct nn_pollset_item {
+
+    /*  The SP socket and the events the user is interested in. */
+    int s;
+    short events;
+
+    /*  Used to look up the item by the socket. */
+    struct nn_hash_item hitem;
+
+    /*  Used to iterate over all the items in the set. */
+    struct nn_list_item item;
+
+#if !defined NN_HAVE_WINDOWS
+    struct nn_pollset_fd in;
+    struct nn_pollset_fd out;
+
+    /*  The wait this item was last reported by and the position in
+        the output array it was reported at. Allows to merge IN and OUT
+        events for the socket into a single nn_pollfd. */
+    unsigned int gen;
+    int pos;
+#endif
+};
+
+struct nn_pollset {
+    struct nn_hash items;
+    struct nn_list list;
+    int nitems;
+
+#if defined NN_HAVE_WINDOWS
+
+    /*  Array passed to nn_poll. Has space for all the items in the set. */
+    struct nn_pollfd *pfds;
+    int capacity;
+#else
+    struct nn_poller poller;
+
+    /*  Sequence number of the current wait. */
+    unsigned int gen;
+#endif
+};
+
+#if !defined NN_HAVE_WINDOWS
+
+static int nn_pollset_fd_set (struct nn_pollset *self,
+    struct nn_pollset_item *item, struct nn_pollset_fd *pfd, int on);
+
+#endif
+
+struct nn_pollset *nn_pollset_create (void)
+{
+    struct nn_pollset *self;
+#if !defined NN_HAVE_WINDOWS
+    int rc;
+#endif
+
+    self = nn_alloc (sizeof (struct nn_pollset), "pollset");
+    alloc_assert (self);
+
+#if defined NN_HAVE_WINDOWS
+    self->pfds = NULL;
+    self->capacity = 0;
+#else
+    rc = nn_poller_init (&self->poller);
+    if (nn_slow (rc < 0)) {
+        nn_free (self);
+        errno = -rc;
+        return NULL;
+    }
+    self->gen = 0;
+#endif
+
+    nn_hash_init (&self->items);
+    nn_list_init (&self->list);
+    self->nitems = 0;
+
+    return self;
+}
+
+int nn_pollset_destroy (struct nn_pollset *self)
+{
+    struct nn_pollset_item *item;
+
+    if (nn_slow (!self)) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    while (!nn_list_empty (&self->list)) {
+        item = nn_cont (nn_list_begin (&self->list),
+            struct nn_pollset_item, item);
+        nn_pollset_remove (self, item->s);
+    }
+
+    nn_list_term (&self->list);
+    nn_hash_term (&self->items);
+#if defined NN_HAVE_WINDOWS
+    if (self->pfds)
+        nn_free (self->pfds);
+#else
+    nn_poller_term (&self->poller);
+#endif
+    nn_free (self);
+
+    return 0;
+}
+
+int nn_pollset_add (struct nn_pollset *self, int s, short events)
+{
+    int rc;
+    int domain;
+    size_t sz;
+    struct nn_pollset_item *item;
+#if defined NN_HAVE_WINDOWS
+    struct nn_pollfd *pfds;
+#endif
+
+    if (nn_slow (!self)) {
+        errno = EFAULT;
+        return -1;
+    }
+    if (nn_slow (s < 0)) {
+        errno = EBADF;
+        return -1;
+    }
+    if (nn_slow (nn_hash_get (&self->items, (uint32_t) s) != NULL)) {
+        errno = EEXIST;
+        return -1;
+    }
+
+    /*  Make sure the socket exists. */
+    sz = sizeof (domain);
+    rc = nn_getsockopt (s, NN_SOL_SOCKET, NN_DOMAIN, &domain, &sz);
+    if (nn_slow (rc < 0))
+        return -1;
+
+#if defined NN_HAVE_WINDOWS
+    if (self->nitems == self->capacity) {
+        pfds = nn_alloc (sizeof (struct nn_pollfd) * (self->capacity * 2 + 16),
+            "pollset");
+        alloc_assert (pfds);
+        if (self->pfds) {
+            memcpy (pfds, self->pfds,
+                sizeof (struct nn_pollfd) * self->capacity);
+            nn_free (self->pfds);
+        }
+        self->pfds = pfds;
+        self->capacity = self->capacity * 2 + 16;
+    }
+#endif
+
+    item = nn_alloc (sizeof (struct nn_pollset_item), "pollset item");
+    alloc_assert (item);
+    item->s = s;
+    item->events = 0;
+#if !defined NN_HAVE_WINDOWS
+    item->in.event = NN_POLLIN;
+    item->in.registered = 0;
+    item->out.event = NN_POLLOUT;
+    item->out.registered = 0;
+    item->gen = self->gen;
+    item->pos = 0;
+#endif
+    nn_hash_item_init (&item->hitem);
+    nn_list_item_init (&item->item);
+    nn_hash_insert (&self->items, (uint32_t) s, &item->hitem);
+    nn_list_insert (&self->list, &item->item, nn_list_end (&self->list));
+    ++self->nitems;
+
+    rc = nn_pollset_modify (self, s, events);
+    if (nn_slow (rc < 0)) {
+        rc = errno;
+        nn_pollset_remove (self, s);
+        errno = rc;
+        return -1;
+    }
+
+    return 0;
+}
+
+int nn_pollset_modify (struct nn_pollset *self, int s, short events)
+{
+    struct nn_pollset_item *item;
+#if !defined NN_HAVE_WINDOWS
+    int rc;
+#endif
+
+    if (nn_slow (!self)) {
+        errno = EFAULT;
+        return -1;
+    }
+    if (nn_slow (s < 0 || !nn_hash_get (&self->items, (uint32_t) s))) {
+        errno = ENOENT;
+        return -1;
+    }
+    item = nn_cont (nn_hash_get (&self->items, (uint32_t) s),
+        struct nn_pollset_item, hitem);
+
+#if !defined NN_HAVE_WINDOWS
+    rc = nn_pollset_fd_set (self, item, &item->in, events & NN_POLLIN);
+    if (nn_slow (rc < 0)) {
+        errno = -rc;
+        return -1;
+    }
+    rc = nn_pollset_fd_set (self, item, &item->out, events & NN_POLLOUT);
+    if (nn_slow (rc < 0)) {
+        errno = -rc;
+        return -1;
+    }
+#endif
+
+    item->events = events & (NN_POLLIN | NN_POLLOUT);
+    return 0;
+}
+
+int nn_pollset_remove (struct nn_pollset *self, int s)
+{
+    struct nn_pollset_item *item;
+
+    if (nn_slow (!self)) {
+        errno = EFAULT;
+        return -1;
+    }
+    if (nn_slow (s < 0 || !nn_hash_get (&self->items, (uint32_t) s))) {
+        errno = ENOENT;
+        return -1;
+    }
+    item = nn_cont (nn_hash_get (&self->items, (uint32_t) s),
+        struct nn_pollset_item, hitem);
+
+#if !defined NN_HAVE_WINDOWS
+    nn_pollset_fd_set (self, item, &item->in, 0);
+    nn_pollset_fd_set (self, item, &item->out, 0);
+#endif
+
+    nn_hash_erase (&self->items, &item->hitem);
+    nn_list_erase (&self->list, &item->item);
+    nn_hash_item_term (&item->hitem);
+    nn_list_item_term (&item->item);
+    nn_free (item);
+    --self->nitems;
+
+    return 0;
+}
+
+#if defined NN_HAVE_WINDOWS
+
+int nn_pollset_wait (struct nn_pollset *self, struct nn_pollfd *fds, int nfds,
+    int timeout)
+{
+    int rc;
+    int i;
+    int res;
+    struct nn_list_item *it;
+    struct nn_pollset_item *item;
+
+    if (nn_slow (!self || (!fds && nfds))) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    i = 0;
+    for (it = nn_list_begin (&self->list); it != nn_list_end (&self->list);
+          it = nn_list_next (&self->list, it)) {
+        item = nn_cont (it, struct nn_pollset_item, item);
+        self->pfds [i].fd = item->s;
+        self->pfds [i].events = item->events;
+        self->pfds [i].revents = 0;
+        ++i;
+    }
+
+    rc = nn_poll (self->pfds, self->nitems, timeout);
+    if (nn_slow (rc <= 0))
+        return rc;
+
+    res = 0;
+    for (i = 0; i != self->nitems && res != nfds; ++i) {
+        if (self->pfds [i].revents)
+            fds [res++] = self->pfds [i];
+    }
+
+    return res;
+}
+
+#else
+
+int nn_pollset_wait (struct nn_pollset *self, struct nn_pollfd *fds, int nfds,
+    int timeout)
+{
+    int rc;
+    int res;
+    int event;
+    struct nn_poller_hndl *hndl;
+    struct nn_pollset_fd *pfd;
+    struct nn_pollset_item *item;
+
+    if (nn_slow (!self || (!fds && nfds))) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    /*  Depending on the poller implementation, the wait may be interrupted
+        by a signal. Report it to the user the same way nn_poll does. */
+    rc = nn_poller_wait (&self->poller, timeout);
+    if (nn_slow (rc == -EINTR)) {
+        errno = EINTR;
+        return -1;
+    }
+    errnum_assert (rc == 0, -rc);
+    ++self->gen;
+
+    /*  The efds are level-triggered, so any event that doesn't fit into
+        the supplied array will be reported by the next wait. */
+    res = 0;
+    while (res != nfds) {
+        rc = nn_poller_event (&self->poller, &event, &hndl);
+        if (rc == -EAGAIN)
+            break;
+        errnum_assert (rc == 0, -rc);
+
+        pfd = nn_cont (hndl, struct nn_pollset_fd, hndl);
+        if (pfd->event == NN_POLLIN)
+            item = nn_cont (pfd, struct nn_pollset_item, in);
+        else
+            item = nn_cont (pfd, struct nn_pollset_item, out);
+
+        /*  First event for the socket in this wait. */
+        if (item->gen != self->gen) {
+            item->gen = self->gen;
+            item->pos = res;
+            fds [res].fd = item->s;
+            fds [res].events = item->events;
+            fds [res].revents = 0;
+            ++res;
+        }
+        fds [item->pos].revents |= pfd->event;
+    }
+
+    return res;
+}
+
+static int nn_pollset_fd_set (struct nn_pollset *self,
+    struct nn_pollset_item *item, struct nn_pollset_fd *pfd, int on)
+{
+    int rc;
+    int fd;
+    size_t sz;
+
+    if (on && !pfd->registered) {
+
+        /*  Readiness for both receiving and sending is signalled by
+            the respective efd being readable. */
+        sz = sizeof (fd);
+        rc = nn_getsockopt (item->s, NN_SOL_SOCKET,
+            pfd->event == NN_POLLIN ? NN_RCVFD : NN_SNDFD, &fd, &sz);
+        if (nn_slow (rc < 0))
+            return -nn_errno ();
+        nn_assert (sz == sizeof (fd));
+        nn_poller_add (&self->poller, fd, &pfd->hndl);
+        nn_poller_set_in (&self->poller, &pfd->hndl);
+        pfd->registered = 1;
+    }
+    else if (!on && pfd->registered) {
+        nn_poller_rm (&self->poller, &pfd->hndl);
+        pfd->registered = 0;
+    }
+
+    return 0;
+}
+
+#endif
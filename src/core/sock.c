@@ -33,6 +33,8 @@
 #include "../utils/fast.h"
 #include "../utils/alloc.h"
 #include "../utils/msg.h"
+#include "../utils/sleep.h"
+#include "../utils/stopwatch.h"
 
 /*  These bits specify whether individual efds are signalled or not at
     the moment. Storing this information allows us to avoid redundant signalling
@@ -40,6 +42,12 @@
 #define NN_SOCK_FLAG_IN 1
 #define NN_SOCK_FLAG_OUT 2
 
+/*  These bits are set once the user has asked for NN_SNDFD/NN_RCVFD. From
+    that point on the efds may be polled on at any time and have to reflect
+    the state of the socket after every operation. */
+#define NN_SOCK_FLAG_SNDFD 4
+#define NN_SOCK_FLAG_RCVFD 8
+
 /*  Possible states of the socket. */
 #define NN_SOCK_STATE_INIT 1
 #define NN_SOCK_STATE_ACTIVE 2
@@ -111,6 +119,8 @@ int nn_sock_init (struct nn_sock *self, struct nn_socktype *socktype, int fd)
     }
 
     self->flags = 0;
+    self->sndwaiters = 0;
+    self->rcvwaiters = 0;
     nn_clock_init (&self->clock);
     nn_list_init (&self->eps);
     nn_list_init (&self->sdeps);
@@ -120,8 +130,10 @@ int nn_sock_init (struct nn_sock *self, struct nn_socktype *socktype, int fd)
     self->linger = 1000;
     self->sndbuf = 128 * 1024;
     self->rcvbuf = 128 * 1024;
+    self->rcvbatch = 8 * 1024;
     self->sndtimeo = -1;
     self->rcvtimeo = -1;
+    self->rcvspin = 0;
     self->reconnect_ivl = 100;
     self->reconnect_ivl_max = 0;
     self->ep_template.sndprio = 8;
@@ -135,11 +147,17 @@ int nn_sock_init (struct nn_sock *self, struct nn_socktype *socktype, int fd)
     self->statistics.connect_errors = 0;
     self->statistics.bind_errors = 0;
     self->statistics.accept_errors = 0;
+    self->statistics.compress_bytes_in = 0;
+    self->statistics.compress_bytes_out = 0;
+    self->statistics.compress_time = 0;
+    self->statistics.decompress_time = 0;
 
     self->statistics.messages_sent = 0;
     self->statistics.messages_received = 0;
     self->statistics.bytes_sent = 0;
     self->statistics.bytes_received = 0;
+    self->statistics.match_cache_hits = 0;
+    self->statistics.match_cache_misses = 0;
 
     self->statistics.current_connections = 0;
     self->statistics.inprogress_connections = 0;
@@ -310,12 +328,22 @@ static int nn_sock_setopt_inner (struct nn_sock *self, int level,
                 return -EINVAL;
             dst = &self->rcvbuf;
             break;
+        case NN_RCVBATCH:
+            if (nn_slow (val <= 0))
+                return -EINVAL;
+            dst = &self->rcvbatch;
+            break;
         case NN_SNDTIMEO:
             dst = &self->sndtimeo;
             break;
         case NN_RCVTIMEO:
             dst = &self->rcvtimeo;
             break;
+        case NN_RCVSPIN:
+            if (nn_slow (val < 0))
+                return -EINVAL;
+            dst = &self->rcvspin;
+            break;
         case NN_RECONNECT_IVL:
             if (nn_slow (val < 0))
                 return -EINVAL;
@@ -389,12 +417,18 @@ int nn_sock_getopt_inner (struct nn_sock *self, int level,
         case NN_RCVBUF:
             intval = self->rcvbuf;
             break;
+        case NN_RCVBATCH:
+            intval = self->rcvbatch;
+            break;
         case NN_SNDTIMEO:
             intval = self->sndtimeo;
             break;
         case NN_RCVTIMEO:
             intval = self->rcvtimeo;
             break;
+        case NN_RCVSPIN:
+            intval = self->rcvspin;
+            break;
         case NN_RECONNECT_IVL:
             intval = self->reconnect_ivl;
             break;
@@ -410,6 +444,7 @@ int nn_sock_getopt_inner (struct nn_sock *self, int level,
         case NN_SNDFD:
             if (self->socktype->flags & NN_SOCKTYPE_FLAG_NOSEND)
                 return -ENOPROTOOPT;
+            self->flags |= NN_SOCK_FLAG_SNDFD;
             fd = nn_efd_getfd (&self->sndfd);
             memcpy (optval, &fd,
                 *optvallen < sizeof (nn_fd) ? *optvallen : sizeof (nn_fd));
@@ -418,6 +453,7 @@ int nn_sock_getopt_inner (struct nn_sock *self, int level,
         case NN_RCVFD:
             if (self->socktype->flags & NN_SOCKTYPE_FLAG_NORECV)
                 return -ENOPROTOOPT;
+            self->flags |= NN_SOCK_FLAG_RCVFD;
             fd = nn_efd_getfd (&self->rcvfd);
             memcpy (optval, &fd,
                 *optvallen < sizeof (nn_fd) ? *optvallen : sizeof (nn_fd));
@@ -463,6 +499,13 @@ int nn_sock_add_ep (struct nn_sock *self, struct nn_transport *transport,
 
     nn_ctx_enter (&self->ctx);
 
+    /*  Endpoints read the transport options from the worker thread. Create
+        the option set beforehand so that they never have to look up
+        the transport while nn_close() holds the global lock. */
+    if (transport->optset &&
+          !self->optsets [(-transport->id) - 1])
+        self->optsets [(-transport->id) - 1] = transport->optset ();
+
     /*  Instantiate the endpoint. */
     ep = nn_alloc (sizeof (struct nn_ep), "endpoint");
     rc = nn_ep_init (ep, NN_SOCK_SRC_EP, self, self->eid, transport,
@@ -527,6 +570,16 @@ int nn_sock_rm_ep (struct nn_sock *self, int eid)
 int nn_sock_send (struct nn_sock *self, struct nn_msg *msg, int flags)
 {
     int rc;
+
+    rc = nn_sock_sendv (self, msg, 1, flags);
+    return rc < 0 ? rc : 0;
+}
+
+int nn_sock_sendv (struct nn_sock *self, struct nn_msg *msgs, int count,
+    int flags)
+{
+    int rc;
+    int i;
     uint64_t deadline;
     uint64_t now;
     int timeout;
@@ -556,10 +609,29 @@ int nn_sock_send (struct nn_sock *self, struct nn_msg *msg, int flags)
         }
 
         /*  Try to send the message in a non-blocking way. */
-        rc = self->sockbase->vfptr->send (self->sockbase, msg);
+        rc = self->sockbase->vfptr->send (self->sockbase, &msgs [0]);
         if (nn_fast (rc == 0)) {
+
+            /*  Once the first message is through, transfer as many of the
+                remaining ones as possible without blocking. All of them are
+                done within a single context entry, so the readiness of
+                the socket is re-evaluated only once. */
+            for (i = 1; i != count; ++i) {
+                rc = self->sockbase->vfptr->send (self->sockbase, &msgs [i]);
+
+                /*  The pipe may become writeable again once the events raised
+                    by the previous operation are processed, e.g. when
+                    the transport has already passed the data to the kernel. */
+                if (rc == -EAGAIN) {
+                    nn_ctx_flush (&self->ctx);
+                    rc = self->sockbase->vfptr->send (self->sockbase,
+                        &msgs [i]);
+                }
+                if (rc < 0)
+                    break;
+            }
             nn_ctx_leave (&self->ctx);
-            return 0;
+            return i;
         }
         nn_assert (rc < 0);
 
@@ -578,14 +650,20 @@ int nn_sock_send (struct nn_sock *self, struct nn_msg *msg, int flags)
 
         /*  With blocking send, wait while there are new pipes available
             for sending. */
+        ++self->sndwaiters;
         nn_ctx_leave (&self->ctx);
         rc = nn_efd_wait (&self->sndfd, timeout);
-        if (nn_slow (rc == -ETIMEDOUT))
+        nn_ctx_enter (&self->ctx);
+        --self->sndwaiters;
+        if (nn_slow (rc == -ETIMEDOUT)) {
+            nn_ctx_leave (&self->ctx);
             return -EAGAIN;
-        if (nn_slow (rc == -EINTR))
+        }
+        if (nn_slow (rc == -EINTR)) {
+            nn_ctx_leave (&self->ctx);
             return -EINTR;
+        }
         errnum_assert (rc == 0, rc);
-        nn_ctx_enter (&self->ctx);
 
         /*  If needed, re-compute the timeout to reflect the time that have
             already elapsed. */
@@ -599,9 +677,21 @@ int nn_sock_send (struct nn_sock *self, struct nn_msg *msg, int flags)
 int nn_sock_recv (struct nn_sock *self, struct nn_msg *msg, int flags)
 {
     int rc;
+
+    rc = nn_sock_recvv (self, msg, 1, flags);
+    return rc < 0 ? rc : 0;
+}
+
+int nn_sock_recvv (struct nn_sock *self, struct nn_msg *msgs, int count,
+    int flags)
+{
+    int rc;
+    int i;
     uint64_t deadline;
     uint64_t now;
     int timeout;
+    int spinning;
+    struct nn_stopwatch spin;
 
     /*  Some sockets types cannot be used for receiving messages. */
     if (nn_slow (self->socktype->flags & NN_SOCKTYPE_FLAG_NORECV))
@@ -618,6 +708,7 @@ int nn_sock_recv (struct nn_sock *self, struct nn_msg *msg, int flags)
         deadline = nn_clock_now (&self->clock) + self->rcvtimeo;
         timeout = self->rcvtimeo;
     }
+    spinning = 0;
 
     while (1) {
 
@@ -628,10 +719,29 @@ int nn_sock_recv (struct nn_sock *self, struct nn_msg *msg, int flags)
         }
 
         /*  Try to receive the message in a non-blocking way. */
-        rc = self->sockbase->vfptr->recv (self->sockbase, msg);
+        rc = self->sockbase->vfptr->recv (self->sockbase, &msgs [0]);
         if (nn_fast (rc == 0)) {
+
+            /*  Once the first message is through, transfer as many of the
+                remaining ones as possible without blocking. All of them are
+                done within a single context entry, so the readiness of
+                the socket is re-evaluated only once. */
+            for (i = 1; i != count; ++i) {
+                rc = self->sockbase->vfptr->recv (self->sockbase, &msgs [i]);
+
+                /*  The pipe may become readable again once the events raised
+                    by the previous operation are processed, e.g. when
+                    the transport has already passed the data to the kernel. */
+                if (rc == -EAGAIN) {
+                    nn_ctx_flush (&self->ctx);
+                    rc = self->sockbase->vfptr->recv (self->sockbase,
+                        &msgs [i]);
+                }
+                if (rc < 0)
+                    break;
+            }
             nn_ctx_leave (&self->ctx);
-            return 0;
+            return i;
         }
         nn_assert (rc < 0);
 
@@ -648,16 +758,44 @@ int nn_sock_recv (struct nn_sock *self, struct nn_msg *msg, int flags)
             return -EAGAIN;
         }
 
+        /*  If NN_RCVSPIN is set, busy-poll for the message for the specified
+            number of microseconds before falling back to sleeping on the efd.
+            The context is released between the attempts so that the worker
+            thread can deliver inbound messages in the meantime. */
+        if (self->rcvspin > 0) {
+            if (!spinning) {
+                spinning = 1;
+                nn_stopwatch_init (&spin);
+            }
+            if (nn_stopwatch_term (&spin) < (uint64_t) self->rcvspin &&
+                  (self->rcvtimeo < 0 || timeout > 0)) {
+                nn_ctx_leave (&self->ctx);
+                nn_relax ();
+                nn_ctx_enter (&self->ctx);
+                if (self->rcvtimeo >= 0) {
+                    now = nn_clock_now (&self->clock);
+                    timeout = (int) (now > deadline ? 0 : deadline - now);
+                }
+                continue;
+            }
+        }
+
         /*  With blocking recv, wait while there are new pipes available
             for receiving. */
+        ++self->rcvwaiters;
         nn_ctx_leave (&self->ctx);
         rc = nn_efd_wait (&self->rcvfd, timeout);
-        if (nn_slow (rc == -ETIMEDOUT))
+        nn_ctx_enter (&self->ctx);
+        --self->rcvwaiters;
+        if (nn_slow (rc == -ETIMEDOUT)) {
+            nn_ctx_leave (&self->ctx);
             return -EAGAIN;
-        if (nn_slow (rc == -EINTR))
+        }
+        if (nn_slow (rc == -EINTR)) {
+            nn_ctx_leave (&self->ctx);
             return -EINTR;
+        }
         errnum_assert (rc == 0, rc);
-        nn_ctx_enter (&self->ctx);
 
         /*  If needed, re-compute the timeout to reflect the time that have
             already elapsed. */
@@ -689,6 +827,8 @@ static void nn_sock_onleave (struct nn_ctx *self)
 {
     struct nn_sock *sock;
     int events;
+    int in;
+    int out;
 
     sock = nn_cont (self, struct nn_sock, ctx);
 
@@ -697,12 +837,24 @@ static void nn_sock_onleave (struct nn_ctx *self)
     if (nn_slow (sock->state != NN_SOCK_STATE_ACTIVE))
         return;
 
+    /*  The efds only have to be up to date if there is somebody who can
+        observe them, i.e. a thread blocked in send/recv or a user polling
+        on NN_SNDFD/NN_RCVFD. In the common case of nobody waiting, this
+        saves the syscalls needed to signal and unsignal them. Stale efds
+        are fixed up here as soon as an observer appears. */
+    in = !(sock->socktype->flags & NN_SOCKTYPE_FLAG_NORECV) &&
+        (sock->rcvwaiters || (sock->flags & NN_SOCK_FLAG_RCVFD));
+    out = !(sock->socktype->flags & NN_SOCKTYPE_FLAG_NOSEND) &&
+        (sock->sndwaiters || (sock->flags & NN_SOCK_FLAG_SNDFD));
+    if (nn_fast (!in && !out))
+        return;
+
     /*  Check whether socket is readable and/or writeable at the moment. */
     events = sock->sockbase->vfptr->events (sock->sockbase);
     errnum_assert (events >= 0, -events);
 
     /*  Signal/unsignal IN as needed. */
-    if (!(sock->socktype->flags & NN_SOCKTYPE_FLAG_NORECV)) {
+    if (in) {
         if (events & NN_SOCKBASE_EVENT_IN) {
             if (!(sock->flags & NN_SOCK_FLAG_IN)) {
                 sock->flags |= NN_SOCK_FLAG_IN;
@@ -718,7 +870,7 @@ static void nn_sock_onleave (struct nn_ctx *self)
     }
 
     /*  Signal/unsignal OUT as needed. */
-    if (!(sock->socktype->flags & NN_SOCKTYPE_FLAG_NOSEND)) {
+    if (out) {
         if (events & NN_SOCKBASE_EVENT_OUT) {
             if (!(sock->flags & NN_SOCK_FLAG_OUT)) {
                 sock->flags |= NN_SOCK_FLAG_OUT;
@@ -977,7 +1129,8 @@ void nn_sock_report_error (struct nn_sock *self, struct nn_ep *ep, int errnum)
     }
 }
 
-void nn_sock_stat_increment (struct nn_sock *self, int name, int increment)
+void nn_sock_stat_increment (struct nn_sock *self, int name,
+    int64_t increment)
 {
     switch (name) {
         case NN_STAT_ESTABLISHED_CONNECTIONS:
@@ -1008,6 +1161,22 @@ void nn_sock_stat_increment (struct nn_sock *self, int name, int increment)
             nn_assert (increment > 0);
             self->statistics.accept_errors += increment;
             break;
+        case NN_STAT_COMPRESS_BYTES_IN:
+            nn_assert (increment >= 0);
+            self->statistics.compress_bytes_in += increment;
+            break;
+        case NN_STAT_COMPRESS_BYTES_OUT:
+            nn_assert (increment >= 0);
+            self->statistics.compress_bytes_out += increment;
+            break;
+        case NN_STAT_COMPRESS_TIME:
+            nn_assert (increment >= 0);
+            self->statistics.compress_time += increment;
+            break;
+        case NN_STAT_DECOMPRESS_TIME:
+            nn_assert (increment >= 0);
+            self->statistics.decompress_time += increment;
+            break;
         case NN_STAT_MESSAGES_SENT:
             nn_assert (increment > 0);
             self->statistics.messages_sent += increment;
@@ -1024,26 +1193,34 @@ void nn_sock_stat_increment (struct nn_sock *self, int name, int increment)
             nn_assert (increment >= 0);
             self->statistics.bytes_received += increment;
             break;
+        case NN_STAT_MATCH_CACHE_HITS:
+            nn_assert (increment > 0);
+            self->statistics.match_cache_hits += increment;
+            break;
+        case NN_STAT_MATCH_CACHE_MISSES:
+            nn_assert (increment > 0);
+            self->statistics.match_cache_misses += increment;
+            break;
 
         case NN_STAT_CURRENT_CONNECTIONS:
             nn_assert (increment > 0 ||
                 self->statistics.current_connections >= -increment);
-            self->statistics.current_connections += increment;
+            self->statistics.current_connections += (int) increment;
             break;
         case NN_STAT_INPROGRESS_CONNECTIONS:
             nn_assert (increment > 0 ||
                 self->statistics.inprogress_connections >= -increment);
-            self->statistics.inprogress_connections += increment;
+            self->statistics.inprogress_connections += (int) increment;
             break;
         case NN_STAT_CURRENT_SND_PRIORITY:
             /*  This is an exception, we don't want to increment priority  */
             nn_assert((increment > 0 && increment <= 16) || increment == -1);
-            self->statistics.current_snd_priority = increment;
+            self->statistics.current_snd_priority = (int) increment;
             break;
         case NN_STAT_CURRENT_EP_ERRORS:
             nn_assert (increment > 0 ||
                 self->statistics.current_ep_errors >= -increment);
-            self->statistics.current_ep_errors += increment;
+            self->statistics.current_ep_errors += (int) increment;
             break;
     }
 }
@@ -37,7 +37,7 @@
 struct nn_pipe;
 
 /*  The maximum implemented transport ID. */
-#define NN_MAX_TRANSPORT 3
+#define NN_MAX_TRANSPORT 4
 
 /*  The socket-internal statistics  */
 #define NN_STAT_MESSAGES_SENT          301
@@ -63,6 +63,13 @@ struct nn_sock
     struct nn_ctx ctx;
     struct nn_efd sndfd;
     struct nn_efd rcvfd;
+
+    /*  Number of threads blocked in nn_efd_wait() on sndfd and rcvfd.
+        The efds are kept in sync with the state of the socket only while
+        somebody is waiting on them or after the user has retrieved them
+        via NN_SNDFD/NN_RCVFD options. */
+    int sndwaiters;
+    int rcvwaiters;
     struct nn_sem termsem;
 
     /*  TODO: This clock can be accessed from different threads. If RDTSC
@@ -82,8 +89,10 @@ struct nn_sock
     int linger;
     int sndbuf;
     int rcvbuf;
+    int rcvbatch;
     int sndtimeo;
     int rcvtimeo;
+    int rcvspin;
     int reconnect_ivl;
     int reconnect_ivl_max;
 
@@ -111,6 +120,14 @@ struct nn_sock
         uint64_t bind_errors;
         /*  Errors accepting connections at nn_bind()'ed endpoint  */
         uint64_t accept_errors;
+        /*  Bytes of messages compressed before sending  */
+        uint64_t compress_bytes_in;
+        /*  Bytes those messages were compressed to  */
+        uint64_t compress_bytes_out;
+        /*  Time spent compressing messages, in microseconds  */
+        uint64_t compress_time;
+        /*  Time spent decompressing messages, in microseconds  */
+        uint64_t decompress_time;
 
         /*  Messages sent  */
         uint64_t messages_sent;
@@ -120,6 +137,10 @@ struct nn_sock
         uint64_t bytes_sent;
         /*  Bytes recevied (sum length of data in messages received)  */
         uint64_t bytes_received;
+        /*  Messages filtered using a cached subscription match result  */
+        uint64_t match_cache_hits;
+        /*  Messages that had to be matched against the subscriptions  */
+        uint64_t match_cache_misses;
 
         /*****  Level-style values *****/
 
@@ -171,6 +192,17 @@ int nn_sock_send (struct nn_sock *self, struct nn_msg *msg, int flags);
 /*  Receive a message from the socket. */
 int nn_sock_recv (struct nn_sock *self, struct nn_msg *msg, int flags);
 
+/*  Send up to 'count' messages to the socket. Only the first message is
+    waited for, the rest is sent only if it can be done straight away.
+    Returns number of messages sent or a negative error code if none were. */
+int nn_sock_sendv (struct nn_sock *self, struct nn_msg *msgs, int count,
+    int flags);
+
+/*  Receive up to 'count' messages from the socket. Same semantics as
+    nn_sock_sendv. */
+int nn_sock_recvv (struct nn_sock *self, struct nn_msg *msgs, int count,
+    int flags);
+
 /*  Set a socket option. */
 int nn_sock_setopt (struct nn_sock *self, int level, int option,
     const void *optval, size_t optvallen);
@@ -190,7 +222,8 @@ void nn_sock_rm (struct nn_sock *self, struct nn_pipe *pipe);
 
 /*  Monitoring callbacks  */
 void nn_sock_report_error(struct nn_sock *self, struct nn_ep *ep,  int errnum);
-void nn_sock_stat_increment(struct nn_sock *self, int name, int increment);
+void nn_sock_stat_increment(struct nn_sock *self, int name,
+    int64_t increment);
 
 #endif
 
@@ -56,7 +56,7 @@ int nn_sockbase_getopt (struct nn_sockbase *self, int option,
 }
 
 void nn_sockbase_stat_increment (struct nn_sockbase *self, int name,
-    int increment)
+    int64_t increment)
 {
     nn_sock_stat_increment (self->sock, name, increment);
 }
@@ -25,6 +25,7 @@
 
 #include "../inproc.h"
 #include "../ipc.h"
+#include "../shm.h"
 #include "../tcp.h"
 
 #include "../pair.h"
@@ -51,6 +52,7 @@ static const struct sym_value_name sym_value_names [] = {
     {NN_INPROC, "NN_INPROC"},
     {NN_IPC, "NN_IPC"},
     {NN_TCP, "NN_TCP"},
+    {NN_SHM, "NN_SHM"},
 
     {NN_PAIR, "NN_PAIR"},
     {NN_PUB, "NN_PUB"},
@@ -81,15 +83,35 @@ static const struct sym_value_name sym_value_names [] = {
     {NN_PROTOCOL, "NN_PROTOCOL"},
     {NN_IPV4ONLY, "NN_IPV4ONLY"},
     {NN_SOCKET_NAME, "NN_SOCKET_NAME"},
+    {NN_RCVBATCH, "NN_RCVBATCH"},
+    {NN_RCVSPIN, "NN_RCVSPIN"},
 
+    {NN_PUB_CONFLATE, "NN_PUB_CONFLATE"},
+    {NN_PUB_TOPIC_LENGTH, "NN_PUB_TOPIC_LENGTH"},
+    {NN_PUB_TOPIC_DELIMITER, "NN_PUB_TOPIC_DELIMITER"},
     {NN_SUB_SUBSCRIBE, "NN_SUB_SUBSCRIBE"},
     {NN_SUB_UNSUBSCRIBE, "NN_SUB_UNSUBSCRIBE"},
+    {NN_SUB_FORWARD, "NN_SUB_FORWARD"},
+    {NN_SUB_TOPIC_LENGTH, "NN_SUB_TOPIC_LENGTH"},
+    {NN_SUB_TOPIC_DELIMITER, "NN_SUB_TOPIC_DELIMITER"},
     {NN_REQ_RESEND_IVL, "NN_REQ_RESEND_IVL"},
+    {NN_REQ_CONCURRENCY, "NN_REQ_CONCURRENCY"},
+    {NN_REQ_ID, "NN_REQ_ID"},
+    {NN_REQ_LB_POLICY, "NN_REQ_LB_POLICY"},
+    {NN_PUSH_LB_POLICY, "NN_PUSH_LB_POLICY"},
     {NN_SURVEYOR_DEADLINE, "NN_SURVEYOR_DEADLINE"},
     {NN_TCP_NODELAY, "NN_TCP_NODELAY"},
+    {NN_TCP_ZEROCOPY, "NN_TCP_ZEROCOPY"},
+    {NN_TCP_COMPRESS, "NN_TCP_COMPRESS"},
+    {NN_TCP_COMPRESS_THRESHOLD, "NN_TCP_COMPRESS_THRESHOLD"},
+    {NN_SHM_SIZE, "NN_SHM_SIZE"},
 
     {NN_DONTWAIT, "NN_DONTWAIT"},
 
+    {NN_LB_ROUND_ROBIN, "NN_LB_ROUND_ROBIN"},
+    {NN_LB_TWO_CHOICES, "NN_LB_TWO_CHOICES"},
+    {NN_LB_LEAST_LOADED, "NN_LB_LEAST_LOADED"},
+
     {EADDRINUSE, "EADDRINUSE"},
     {EADDRNOTAVAIL, "EADDRNOTAVAIL"},
     {EAFNOSUPPORT, "EAFNOSUPPORT"},
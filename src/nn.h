@@ -56,6 +56,14 @@ extern "C" {
 #  define NN_INLINE static inline
 #endif
 
+/*  Unsigned 64-bit integer. stdint.h is not available everywhere, thus it's
+    defined here in the same way as in the library itself.                  */
+#if defined _WIN32
+typedef unsigned __int64 nn_uint64_t;
+#else
+typedef unsigned long long nn_uint64_t;
+#endif
+
 
 /******************************************************************************/
 /*  ABI versioning support.                                                   */
@@ -201,9 +209,26 @@ NN_EXPORT void nn_term (void);
 
 #define NN_MSG ((size_t) -1)
 
+/*  Allocation mechanisms for nn_allocmsg. */
+#define NN_ALLOCMSG_DEFAULT 0
+#define NN_ALLOCMSG_POOL 1
+
 NN_EXPORT void *nn_allocmsg (size_t size, int type);
+NN_EXPORT void *nn_allocmsg_file (int fd, nn_uint64_t offset,
+    size_t size);
 NN_EXPORT int nn_freemsg (void *msg);
 
+/*  Statistics of the allocator of large messages. */
+struct nn_allocstats {
+    size_t hits;
+    size_t misses;
+    size_t inuse;
+    size_t cached;
+    size_t huge;
+};
+
+NN_EXPORT int nn_get_allocstats (struct nn_allocstats *stats);
+
 /******************************************************************************/
 /*  Socket definition.                                                        */
 /******************************************************************************/
@@ -220,6 +245,11 @@ struct nn_msghdr {
     size_t msg_controllen;
 };
 
+struct nn_mmsghdr {
+    struct nn_msghdr msg_hdr;
+    size_t msg_len;
+};
+
 struct nn_cmsghdr {
     size_t cmsg_len;
     int cmsg_level;
@@ -288,10 +318,17 @@ NN_INLINE struct nn_cmsghdr *nn_cmsg_nexthdr_ (const struct nn_msghdr *mhdr,
 #define NN_PROTOCOL 13
 #define NN_IPV4ONLY 14
 #define NN_SOCKET_NAME 15
+#define NN_RCVBATCH 16
+#define NN_RCVSPIN 17
 
 /*  Send/recv options.                                                        */
 #define NN_DONTWAIT 1
 
+/*  Load-balancing policies (NN_PUSH_LB_POLICY, NN_REQ_LB_POLICY).            */
+#define NN_LB_ROUND_ROBIN 0
+#define NN_LB_TWO_CHOICES 1
+#define NN_LB_LEAST_LOADED 2
+
 NN_EXPORT int nn_socket (int domain, int protocol);
 NN_EXPORT int nn_close (int s);
 NN_EXPORT int nn_setsockopt (int s, int level, int option, const void *optval,
@@ -305,6 +342,10 @@ NN_EXPORT int nn_send (int s, const void *buf, size_t len, int flags);
 NN_EXPORT int nn_recv (int s, void *buf, size_t len, int flags);
 NN_EXPORT int nn_sendmsg (int s, const struct nn_msghdr *msghdr, int flags);
 NN_EXPORT int nn_recvmsg (int s, struct nn_msghdr *msghdr, int flags);
+NN_EXPORT int nn_sendmmsg (int s, struct nn_mmsghdr *msgvec,
+    unsigned int vlen, int flags);
+NN_EXPORT int nn_recvmmsg (int s, struct nn_mmsghdr *msgvec,
+    unsigned int vlen, int flags);
 
 /******************************************************************************/
 /*  Socket mutliplexing support.                                              */
@@ -321,6 +362,18 @@ struct nn_pollfd {
 
 NN_EXPORT int nn_poll (struct nn_pollfd *fds, int nfds, int timeout);
 
+/*  Persistent alternative to nn_poll. Sockets have to be removed from
+    the pollset before they are closed. */
+struct nn_pollset;
+
+NN_EXPORT struct nn_pollset *nn_pollset_create (void);
+NN_EXPORT int nn_pollset_destroy (struct nn_pollset *ps);
+NN_EXPORT int nn_pollset_add (struct nn_pollset *ps, int s, short events);
+NN_EXPORT int nn_pollset_modify (struct nn_pollset *ps, int s, short events);
+NN_EXPORT int nn_pollset_remove (struct nn_pollset *ps, int s);
+NN_EXPORT int nn_pollset_wait (struct nn_pollset *ps, struct nn_pollfd *fds,
+    int nfds, int timeout);
+
 /******************************************************************************/
 /*  Built-in support for devices.                                             */
 /******************************************************************************/
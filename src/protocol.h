@@ -69,6 +69,10 @@ int nn_pipe_send (struct nn_pipe *self, struct nn_msg *msg);
     the call. It will be initialised when the call succeeds. */
 int nn_pipe_recv (struct nn_pipe *self, struct nn_msg *msg);
 
+/*  Returns the number of bytes sent to the pipe that the peer haven't
+    received yet. Zero if the transport doesn't provide the information. */
+size_t nn_pipe_backlog (struct nn_pipe *self);
+
 /*  Get option for pipe. Mostly useful for endpoint-specific options  */
 void nn_pipe_getopt (struct nn_pipe *self, int level, int option,
     void *optval, size_t *optvallen);
@@ -152,7 +156,10 @@ int nn_sockbase_getopt (struct nn_sockbase *self, int option,
 
 /*  Add some statitistics for socket  */
 void nn_sockbase_stat_increment (struct nn_sockbase *self, int name,
-    int increment);
+    int64_t increment);
+
+#define NN_STAT_MATCH_CACHE_HITS 305
+#define NN_STAT_MATCH_CACHE_MISSES 306
 
 #define NN_STAT_CURRENT_SND_PRIORITY 401
 
@@ -164,17 +164,37 @@ static int nn_xpush_send (struct nn_sockbase *self, struct nn_msg *msg)
         msg, NULL);
 }
 
-static int nn_xpush_setopt (NN_UNUSED struct nn_sockbase *self,
-    NN_UNUSED int level, NN_UNUSED int option,
-    NN_UNUSED const void *optval, NN_UNUSED size_t optvallen)
+static int nn_xpush_setopt (struct nn_sockbase *self, int level, int option,
+    const void *optval, size_t optvallen)
 {
+    struct nn_xpush *xpush;
+
+    xpush = nn_cont (self, struct nn_xpush, sockbase);
+
+    if (level == NN_PUSH && option == NN_PUSH_LB_POLICY) {
+        if (nn_slow (optvallen != sizeof (int)))
+            return -EINVAL;
+        return nn_lb_set_policy (&xpush->lb, *(int*) optval);
+    }
+
     return -ENOPROTOOPT;
 }
 
-static int nn_xpush_getopt (NN_UNUSED struct nn_sockbase *self,
-    NN_UNUSED int level, NN_UNUSED int option,
-    NN_UNUSED void *optval, NN_UNUSED size_t *optvallen)
+static int nn_xpush_getopt (struct nn_sockbase *self, int level, int option,
+    void *optval, size_t *optvallen)
 {
+    struct nn_xpush *xpush;
+
+    xpush = nn_cont (self, struct nn_xpush, sockbase);
+
+    if (level == NN_PUSH && option == NN_PUSH_LB_POLICY) {
+        if (nn_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = nn_lb_get_policy (&xpush->lb);
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
     return -ENOPROTOOPT;
 }
 
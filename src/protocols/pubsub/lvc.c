@@ -0,0 +1,194 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+
+#include "lvc.h"
+
+#include "../../utils/alloc.h"
+#include "../../utils/cont.h"
+#include "../../utils/fast.h"
+#include "../../utils/err.h"
+
+#include <string.h>
+
+#define NN_LVC_INITIAL_BUCKETS 16
+
+struct nn_lvc_item {
+
+    /*  Item in the list of items in the cache. */
+    struct nn_list_item item;
+
+    /*  Next item in the same hash bucket. */
+    struct nn_lvc_item *next;
+
+    /*  Hash and size of the topic. The topic itself is the beginning of
+        the message body. */
+    uint32_t hash;
+    size_t topic;
+
+    struct nn_msg msg;
+};
+
+/*  Private functions. */
+static uint32_t nn_lvc_hash (const uint8_t *data, size_t size);
+static void nn_lvc_resize (struct nn_lvc *self, uint32_t buckets);
+
+void nn_lvc_init (struct nn_lvc *self)
+{
+    nn_list_init (&self->items);
+    self->count = 0;
+    self->buckets = NULL;
+    self->mask = 0;
+}
+
+void nn_lvc_term (struct nn_lvc *self)
+{
+    struct nn_lvc_item *item;
+
+    while (!nn_list_empty (&self->items)) {
+        item = nn_cont (nn_list_begin (&self->items), struct nn_lvc_item,
+            item);
+        nn_list_erase (&self->items, &item->item);
+        nn_list_item_term (&item->item);
+        nn_msg_term (&item->msg);
+        nn_free (item);
+    }
+    nn_list_term (&self->items);
+    nn_free (self->buckets);
+}
+
+int nn_lvc_put (struct nn_lvc *self, struct nn_msg *msg, size_t topic)
+{
+    uint8_t *data;
+    uint32_t hash;
+    struct nn_lvc_item *item;
+    struct nn_lvc_item **bucket;
+
+    data = nn_chunkref_data (&msg->body);
+    nn_assert (topic <= nn_chunkref_size (&msg->body));
+    hash = nn_lvc_hash (data, topic);
+
+    /*  If there's a message with the same topic, replace it. */
+    if (self->buckets) {
+        for (item = self->buckets [hash & self->mask]; item;
+              item = item->next) {
+            if (item->hash == hash && item->topic == topic &&
+                  memcmp (nn_chunkref_data (&item->msg.body), data,
+                  topic) == 0) {
+                nn_msg_term (&item->msg);
+                nn_msg_mv (&item->msg, msg);
+                return 1;
+            }
+        }
+    }
+
+    /*  Keep at most one item per bucket on average. */
+    if (nn_slow (!self->buckets))
+        nn_lvc_resize (self, NN_LVC_INITIAL_BUCKETS);
+    else if (nn_slow (self->count + 1 > (size_t) self->mask + 1))
+        nn_lvc_resize (self, (self->mask + 1) * 2);
+
+    item = nn_alloc (sizeof (struct nn_lvc_item), "last value");
+    alloc_assert (item);
+    item->hash = hash;
+    item->topic = topic;
+    nn_msg_mv (&item->msg, msg);
+    bucket = &self->buckets [hash & self->mask];
+    item->next = *bucket;
+    *bucket = item;
+    nn_list_item_init (&item->item);
+    nn_list_insert (&self->items, &item->item, nn_list_end (&self->items));
+    ++self->count;
+
+    return 0;
+}
+
+int nn_lvc_get (struct nn_lvc *self, struct nn_msg *msg)
+{
+    struct nn_lvc_item *item;
+    struct nn_lvc_item **it;
+
+    if (nn_list_empty (&self->items))
+        return -EAGAIN;
+
+    item = nn_cont (nn_list_begin (&self->items), struct nn_lvc_item, item);
+    for (it = &self->buckets [item->hash & self->mask]; *it != item;
+          it = &(*it)->next)
+        ;
+    *it = item->next;
+    nn_list_erase (&self->items, &item->item);
+    nn_list_item_term (&item->item);
+    nn_msg_mv (msg, &item->msg);
+    nn_free (item);
+    --self->count;
+
+    /*  Don't hold the hash table while there's nothing to look up. */
+    if (!self->count) {
+        nn_free (self->buckets);
+        self->buckets = NULL;
+        self->mask = 0;
+    }
+
+    return 0;
+}
+
+int nn_lvc_empty (struct nn_lvc *self)
+{
+    return self->count == 0 ? 1 : 0;
+}
+
+static uint32_t nn_lvc_hash (const uint8_t *data, size_t size)
+{
+    uint32_t hash;
+
+    /*  FNV-1a. */
+    hash = 2166136261u;
+    while (size) {
+        hash ^= *data;
+        hash *= 16777619u;
+        ++data;
+        --size;
+    }
+
+    return hash;
+}
+
+static void nn_lvc_resize (struct nn_lvc *self, uint32_t buckets)
+{
+    struct nn_list_item *it;
+    struct nn_lvc_item *item;
+
+    nn_free (self->buckets);
+    self->buckets = nn_alloc (sizeof (struct nn_lvc_item*) * buckets,
+        "last value cache");
+    alloc_assert (self->buckets);
+    memset (self->buckets, 0, sizeof (struct nn_lvc_item*) * buckets);
+    self->mask = buckets - 1;
+
+    /*  Re-link all the items into the new buckets. */
+    for (it = nn_list_begin (&self->items); it != nn_list_end (&self->items);
+          it = nn_list_next (&self->items, it)) {
+        item = nn_cont (it, struct nn_lvc_item, item);
+        item->next = self->buckets [item->hash & self->mask];
+        self->buckets [item->hash & self->mask] = item;
+    }
+}
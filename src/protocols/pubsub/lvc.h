@@ -0,0 +1,75 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+
+#ifndef NN_LVC_INCLUDED
+#define NN_LVC_INCLUDED
+
+#include "../../utils/msg.h"
+#include "../../utils/list.h"
+#include "../../utils/int.h"
+
+#include <stddef.h>
+
+/*  Last-value cache. Holds the most recent message for each topic, where
+    the topic is a prefix of the message body. Messages are retrieved in
+    the order in which their topics were first stored; storing a message
+    for a topic that is already there replaces the old message in place. */
+
+struct nn_lvc_item;
+
+struct nn_lvc {
+
+    /*  Items in the order they will be retrieved. */
+    struct nn_list items;
+
+    /*  Number of items stored. */
+    size_t count;
+
+    /*  Hash table of the items, keyed by the topic. Each bucket is
+        a singly-linked list of items. NULL if the cache is empty. */
+    struct nn_lvc_item **buckets;
+
+    /*  Number of buckets minus one. Number of buckets is a power of 2. */
+    uint32_t mask;
+};
+
+/*  Initialise an empty cache. */
+void nn_lvc_init (struct nn_lvc *self);
+
+/*  Drop all the messages and release the resources held by the cache. */
+void nn_lvc_term (struct nn_lvc *self);
+
+/*  Store the message under the topic made of its first 'topic' bytes.
+    The message is moved to the cache. If there already was a message with
+    the same topic, it is discarded and 1 is returned. Otherwise, 0 is
+    returned. */
+int nn_lvc_put (struct nn_lvc *self, struct nn_msg *msg, size_t topic);
+
+/*  Retrieve the oldest message from the cache. Returns -EAGAIN if the cache
+    is empty. */
+int nn_lvc_get (struct nn_lvc *self, struct nn_msg *msg);
+
+/*  Returns 1 if there are no messages in the cache, 0 otherwise. */
+int nn_lvc_empty (struct nn_lvc *self);
+
+#endif
@@ -0,0 +1,269 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+
+#include "topicset.h"
+
+#include "../../utils/alloc.h"
+#include "../../utils/fast.h"
+#include "../../utils/err.h"
+
+#include <string.h>
+
+#define NN_TOPICSET_INITIAL_SLOTS 16
+
+/*  Private functions. */
+static uint32_t nn_topicset_hash (const uint8_t *data, size_t size);
+static const uint8_t *nn_topicset_data (const struct nn_topicset_slot *slot);
+static uint32_t nn_topicset_find (struct nn_topicset *self, uint32_t hash,
+    const uint8_t *data, size_t size);
+static void nn_topicset_insert (struct nn_topicset *self,
+    struct nn_topicset_slot *new);
+static void nn_topicset_erase (struct nn_topicset *self, uint32_t pos);
+static void nn_topicset_resize (struct nn_topicset *self, uint32_t slots);
+
+void nn_topicset_init (struct nn_topicset *self)
+{
+    self->mask = 0;
+    self->items = 0;
+    self->slots = NULL;
+}
+
+void nn_topicset_term (struct nn_topicset *self)
+{
+    uint32_t pos;
+
+    if (!self->slots)
+        return;
+    for (pos = 0; pos <= self->mask; ++pos)
+        if (self->slots [pos].dist &&
+              self->slots [pos].size > NN_TOPICSET_INLINE_MAX)
+            nn_free (self->slots [pos].topic.ptr);
+    nn_free (self->slots);
+    self->slots = NULL;
+}
+
+int nn_topicset_subscribe (struct nn_topicset *self, const uint8_t *data,
+    size_t size)
+{
+    uint32_t hash;
+    uint32_t pos;
+    struct nn_topicset_slot new;
+
+    if (nn_slow ((uint32_t) size != size))
+        return -EINVAL;
+
+    hash = nn_topicset_hash (data, size);
+    pos = nn_topicset_find (self, hash, data, size);
+    if (pos != (uint32_t) -1) {
+        ++self->slots [pos].refcount;
+        return 0;
+    }
+
+    /*  Keep the table at most 3/4 full. Robin Hood probing keeps the probe
+        sequences short even at this load and the slots are what most of
+        the memory goes to. */
+    if (!self->slots)
+        nn_topicset_resize (self, NN_TOPICSET_INITIAL_SLOTS);
+    else if ((self->items + 1) * 4 > (self->mask + 1) * 3)
+        nn_topicset_resize (self, (self->mask + 1) * 2);
+
+    new.hash = hash;
+    new.dist = 1;
+    new.refcount = 1;
+    new.size = (uint32_t) size;
+    if (size <= NN_TOPICSET_INLINE_MAX) {
+        if (size)
+            memcpy (new.topic.data, data, size);
+    }
+    else {
+        new.topic.ptr = nn_alloc (size, "topic");
+        alloc_assert (new.topic.ptr);
+        memcpy (new.topic.ptr, data, size);
+    }
+    nn_topicset_insert (self, &new);
+    ++self->items;
+
+    return 1;
+}
+
+int nn_topicset_unsubscribe (struct nn_topicset *self, const uint8_t *data,
+    size_t size)
+{
+    uint32_t pos;
+
+    pos = nn_topicset_find (self, nn_topicset_hash (data, size), data, size);
+    if (pos == (uint32_t) -1)
+        return -EINVAL;
+    if (--self->slots [pos].refcount)
+        return 0;
+    nn_topicset_erase (self, pos);
+
+    /*  Release the table once the last topic is gone. */
+    if (!self->items) {
+        nn_free (self->slots);
+        self->slots = NULL;
+        self->mask = 0;
+    }
+
+    return 1;
+}
+
+int nn_topicset_match (struct nn_topicset *self, const uint8_t *data,
+    size_t size)
+{
+    return nn_topicset_find (self, nn_topicset_hash (data, size),
+        data, size) != (uint32_t) -1 ? 1 : 0;
+}
+
+void nn_topicset_walk (struct nn_topicset *self, nn_topicset_walk_fn fn,
+    void *arg)
+{
+    uint32_t pos;
+
+    if (!self->slots)
+        return;
+    for (pos = 0; pos <= self->mask; ++pos)
+        if (self->slots [pos].dist)
+            fn (nn_topicset_data (&self->slots [pos]),
+                self->slots [pos].size, arg);
+}
+
+static uint32_t nn_topicset_hash (const uint8_t *data, size_t size)
+{
+    uint32_t hash;
+
+    /*  FNV-1a. Topics are typically short identifiers, so a simple bytewise
+        hash is as fast as anything fancier. */
+    hash = 2166136261u;
+    while (size) {
+        hash ^= *data;
+        hash *= 16777619u;
+        ++data;
+        --size;
+    }
+
+    return hash;
+}
+
+static const uint8_t *nn_topicset_data (const struct nn_topicset_slot *slot)
+{
+    return slot->size <= NN_TOPICSET_INLINE_MAX ?
+        slot->topic.data : slot->topic.ptr;
+}
+
+static uint32_t nn_topicset_find (struct nn_topicset *self, uint32_t hash,
+    const uint8_t *data, size_t size)
+{
+    uint32_t pos;
+    uint32_t dist;
+    struct nn_topicset_slot *slot;
+
+    if (nn_slow (!self->slots))
+        return (uint32_t) -1;
+
+    pos = hash & self->mask;
+    for (dist = 1;; ++dist, pos = (pos + 1) & self->mask) {
+        slot = &self->slots [pos];
+
+        /*  The topics are ordered by their distance from the home slot. If
+            the topic was in the table we would have already found it. This
+            check also covers the empty slots. */
+        if (slot->dist < dist)
+            return (uint32_t) -1;
+        if (slot->hash == hash && slot->size == size &&
+              memcmp (nn_topicset_data (slot), data, size) == 0)
+            return pos;
+    }
+}
+
+static void nn_topicset_insert (struct nn_topicset *self,
+    struct nn_topicset_slot *new)
+{
+    uint32_t pos;
+    struct nn_topicset_slot *slot;
+    struct nn_topicset_slot tmp;
+
+    pos = new->hash & self->mask;
+    for (;; ++new->dist, pos = (pos + 1) & self->mask) {
+        slot = &self->slots [pos];
+        if (!slot->dist) {
+            *slot = *new;
+            return;
+        }
+
+        /*  Take the slot from the topic that is closer to its home slot and
+            continue looking for a place for that one instead. */
+        if (slot->dist < new->dist) {
+            tmp = *slot;
+            *slot = *new;
+            *new = tmp;
+        }
+    }
+}
+
+static void nn_topicset_erase (struct nn_topicset *self, uint32_t pos)
+{
+    uint32_t next;
+    struct nn_topicset_slot *slot;
+
+    if (self->slots [pos].size > NN_TOPICSET_INLINE_MAX)
+        nn_free (self->slots [pos].topic.ptr);
+
+    /*  Shift the following topics one slot back, up to the first empty slot
+        or the first topic that is already in its home slot. */
+    while (1) {
+        next = (pos + 1) & self->mask;
+        slot = &self->slots [next];
+        if (slot->dist <= 1)
+            break;
+        self->slots [pos] = *slot;
+        --self->slots [pos].dist;
+        pos = next;
+    }
+    self->slots [pos].dist = 0;
+    --self->items;
+}
+
+static void nn_topicset_resize (struct nn_topicset *self, uint32_t slots)
+{
+    struct nn_topicset_slot *old;
+    uint32_t oldslots;
+    uint32_t pos;
+
+    old = self->slots;
+    oldslots = old ? self->mask + 1 : 0;
+
+    self->slots = nn_alloc (sizeof (struct nn_topicset_slot) * slots,
+        "topic set");
+    alloc_assert (self->slots);
+    memset (self->slots, 0, sizeof (struct nn_topicset_slot) * slots);
+    self->mask = slots - 1;
+
+    for (pos = 0; pos != oldslots; ++pos) {
+        if (!old [pos].dist)
+            continue;
+        old [pos].dist = 1;
+        nn_topicset_insert (self, &old [pos]);
+    }
+    nn_free (old);
+}
@@ -0,0 +1,104 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+
+#ifndef NN_TOPICSET_INCLUDED
+#define NN_TOPICSET_INCLUDED
+
+#include "../../utils/int.h"
+
+#include <stddef.h>
+
+/*  Set of subscriptions matched exactly rather than by prefix. Topics are
+    kept in an open-addressing hash table with Robin Hood probing. Topics
+    that fit into a slot are stored in the slot itself, so that looking them
+    up touches a single cache line and they need no allocation of their
+    own. */
+
+/*  Topics up to this size are stored inline in the slot. */
+#define NN_TOPICSET_INLINE_MAX 8
+
+struct nn_topicset_slot {
+
+    /*  Hash of the topic. */
+    uint32_t hash;
+
+    /*  Distance from the slot the topic hashes to, plus one. Zero means
+        the slot is empty. */
+    uint32_t dist;
+
+    /*  Number of subscriptions to the topic. */
+    uint32_t refcount;
+
+    /*  Size of the topic. */
+    uint32_t size;
+
+    /*  The topic itself if it is short enough, otherwise pointer to
+        a separately allocated copy of it. */
+    union {
+        uint8_t *ptr;
+        uint8_t data [NN_TOPICSET_INLINE_MAX];
+    } topic;
+};
+
+struct nn_topicset {
+
+    /*  Number of slots minus one. Number of slots is always a power of 2. */
+    uint32_t mask;
+
+    /*  Number of topics in the set. */
+    uint32_t items;
+
+    /*  Array of slots. NULL if there are no topics in the set. */
+    struct nn_topicset_slot *slots;
+};
+
+/*  Initialise an empty set. */
+void nn_topicset_init (struct nn_topicset *self);
+
+/*  Release all the resources associated with the set. */
+void nn_topicset_term (struct nn_topicset *self);
+
+/*  Add the topic to the set. If the topic is not yet there, 1 is returned.
+    If it already exists in the set, its reference count is incremented and
+    0 is returned. */
+int nn_topicset_subscribe (struct nn_topicset *self, const uint8_t *data,
+    size_t size);
+
+/*  Remove the topic from the set. If the topic was actually removed, 1 is
+    returned. If reference count was decremented without falling to zero,
+    0 is returned. If the topic is not in the set, -EINVAL is returned. */
+int nn_topicset_unsubscribe (struct nn_topicset *self, const uint8_t *data,
+    size_t size);
+
+/*  Returns 1 if the topic is in the set, 0 otherwise. */
+int nn_topicset_match (struct nn_topicset *self, const uint8_t *data,
+    size_t size);
+
+/*  Invokes 'fn' for each topic in the set. The topic passed to the callback
+    is valid only for the duration of the call. */
+typedef void (*nn_topicset_walk_fn) (const uint8_t *data, size_t size,
+    void *arg);
+void nn_topicset_walk (struct nn_topicset *self, nn_topicset_walk_fn fn,
+    void *arg);
+
+#endif
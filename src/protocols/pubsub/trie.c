@@ -29,34 +29,222 @@
 #include "../../utils/fast.h"
 #include "../../utils/err.h"
 
+/*  Prefixes and sparse child arrays are compared using vector instructions
+    where available. */
+#if defined __SSE2__
+#include <emmintrin.h>
+#define NN_TRIE_SSE2
+#elif defined __ARM_NEON && defined __BYTE_ORDER__ && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#define NN_TRIE_NEON
+#endif
+
 /*  Double check that the size of node structure is as small as
     we believe it to be. */
 CT_ASSERT (sizeof (struct nn_trie_node) == 24);
 
+/*  The prefix is compared by loading 16 bytes starting at its beginning.
+    Make sure they all belong to the node. */
+CT_ASSERT (offsetof (struct nn_trie_node, prefix) + 16 <=
+    sizeof (struct nn_trie_node));
+
+/*  Size of the first arena block. Each following block is twice as large,
+    up to the maximum. */
+#define NN_TRIE_BLOCK_MIN 1024
+#define NN_TRIE_BLOCK_MAX (64 * 1024)
+
+/*  Header of an arena block. Nodes follow it. */
+struct nn_trie_block {
+    struct nn_trie_block *next;
+};
+
+/*  Size of a node with the specified number of children. */
+#define NN_TRIE_NODE_SIZE(children) (sizeof (struct nn_trie_node) + \
+    (children) * sizeof (struct nn_trie_node*))
+
+/*  State of the trie traversal. 'buf' holds the string represented by
+    the node being visited. */
+struct nn_trie_walk {
+    uint8_t *buf;
+    size_t capacity;
+    nn_trie_walk_fn fn;
+    void *arg;
+};
+
 /*  Forward declarations. */
-static struct nn_trie_node *nn_node_compact (struct nn_trie_node *self);
+static struct nn_trie_node *nn_trie_alloc (struct nn_trie *self,
+    int children);
+static void nn_trie_free (struct nn_trie *self, struct nn_trie_node *node,
+    int children);
+static struct nn_trie_node *nn_trie_realloc (struct nn_trie *self,
+    struct nn_trie_node *node, int old_children, int new_children);
+static struct nn_trie_node *nn_node_compact (struct nn_trie *trie,
+    struct nn_trie_node *self);
 static int nn_node_check_prefix (struct nn_trie_node *self,
     const uint8_t *data, size_t size);
 static struct nn_trie_node **nn_node_child (struct nn_trie_node *self,
     int index);
 static struct nn_trie_node **nn_node_next (struct nn_trie_node *self,
     uint8_t c);
-static int nn_node_unsubscribe (struct nn_trie_node **self,
-    const uint8_t *data, size_t size);
-static void nn_node_term (struct nn_trie_node *self);
+static int nn_node_unsubscribe (struct nn_trie *trie,
+    struct nn_trie_node **self, const uint8_t *data, size_t size);
+static void nn_node_term (struct nn_trie *trie, struct nn_trie_node *self);
 static int nn_node_has_subscribers (struct nn_trie_node *self);
+static void nn_node_walk (struct nn_trie_node *self,
+    struct nn_trie_walk *walk, size_t len);
 static void nn_node_dump (struct nn_trie_node *self, int indent);
 static void nn_node_indent (int indent);
 static void nn_node_putchar (uint8_t c);
 
 void nn_trie_init (struct nn_trie *self)
 {
+    int i;
+
     self->root = NULL;
+    self->blocks = NULL;
+    self->blocksz = 0;
+    self->pos = NULL;
+    self->left = 0;
+    for (i = 0; i != NN_TRIE_ARENA_CHILDREN + 1; ++i)
+        self->free [i] = NULL;
 }
 
 void nn_trie_term (struct nn_trie *self)
 {
-    nn_node_term (self->root);
+    struct nn_trie_block *block;
+
+    /*  Large nodes are deallocated one by one, the rest goes away along
+        with the arena. */
+    nn_node_term (self, self->root);
+    while (self->blocks) {
+        block = (struct nn_trie_block*) self->blocks;
+        self->blocks = block->next;
+        nn_free (block);
+    }
+}
+
+static struct nn_trie_node *nn_trie_alloc (struct nn_trie *self,
+    int children)
+{
+    size_t size;
+    struct nn_trie_node *node;
+    struct nn_trie_block *block;
+
+    size = NN_TRIE_NODE_SIZE (children);
+    if (nn_slow (children > NN_TRIE_ARENA_CHILDREN)) {
+        node = nn_alloc (size, "trie node");
+        alloc_assert (node);
+        return node;
+    }
+
+    /*  Re-use a deallocated node of the same size, if there's one. */
+    if (self->free [children]) {
+        node = (struct nn_trie_node*) self->free [children];
+        self->free [children] = *(void**) node;
+        return node;
+    }
+
+    /*  Start a new block if there's not enough space left in the current
+        one. The rest of the current block is left unused. */
+    if (nn_slow (self->left < size)) {
+        self->blocksz = self->blocksz ? self->blocksz * 2 : NN_TRIE_BLOCK_MIN;
+        if (self->blocksz > NN_TRIE_BLOCK_MAX)
+            self->blocksz = NN_TRIE_BLOCK_MAX;
+        block = nn_alloc (sizeof (struct nn_trie_block) + self->blocksz,
+            "trie block");
+        alloc_assert (block);
+        block->next = (struct nn_trie_block*) self->blocks;
+        self->blocks = block;
+        self->pos = (uint8_t*) (block + 1);
+        self->left = self->blocksz;
+    }
+
+    node = (struct nn_trie_node*) self->pos;
+    self->pos += size;
+    self->left -= size;
+    return node;
+}
+
+static void nn_trie_free (struct nn_trie *self, struct nn_trie_node *node,
+    int children)
+{
+    if (nn_slow (children > NN_TRIE_ARENA_CHILDREN)) {
+        nn_free (node);
+        return;
+    }
+    *(void**) node = self->free [children];
+    self->free [children] = node;
+}
+
+static struct nn_trie_node *nn_trie_realloc (struct nn_trie *self,
+    struct nn_trie_node *node, int old_children, int new_children)
+{
+    struct nn_trie_node *new_node;
+
+    if (old_children == new_children)
+        return node;
+    if (old_children > NN_TRIE_ARENA_CHILDREN &&
+          new_children > NN_TRIE_ARENA_CHILDREN) {
+        new_node = nn_realloc (node, NN_TRIE_NODE_SIZE (new_children));
+        alloc_assert (new_node);
+        return new_node;
+    }
+    new_node = nn_trie_alloc (self, new_children);
+    memcpy (new_node, node, NN_TRIE_NODE_SIZE (old_children < new_children ?
+        old_children : new_children));
+    nn_trie_free (self, node, old_children);
+    return new_node;
+}
+
+void nn_trie_walk (struct nn_trie *self, nn_trie_walk_fn fn, void *arg)
+{
+    struct nn_trie_walk walk;
+
+    walk.buf = NULL;
+    walk.capacity = 0;
+    walk.fn = fn;
+    walk.arg = arg;
+    nn_node_walk (self->root, &walk, 0);
+    if (walk.buf)
+        nn_free (walk.buf);
+}
+
+void nn_node_walk (struct nn_trie_node *self, struct nn_trie_walk *walk,
+    size_t len)
+{
+    int i;
+    int children;
+    uint8_t c;
+    struct nn_trie_node *ch;
+
+    if (!self)
+        return;
+
+    /*  Make sure there's enough space for the prefix and one more character
+        identifying the child node. */
+    if (len + self->prefix_len + 1 > walk->capacity) {
+        walk->capacity = (len + self->prefix_len + 1) * 2;
+        walk->buf = nn_realloc (walk->buf, walk->capacity);
+        alloc_assert (walk->buf);
+    }
+    memcpy (walk->buf + len, self->prefix, self->prefix_len);
+    len += self->prefix_len;
+
+    if (nn_node_has_subscribers (self))
+        walk->fn (walk->buf, len, walk->arg);
+
+    children = self->type <= NN_TRIE_SPARSE_MAX ?
+        self->type : (self->u.dense.max - self->u.dense.min + 1);
+    for (i = 0; i != children; ++i) {
+        ch = *nn_node_child (self, i);
+        if (!ch)
+            continue;
+        c = self->type <= NN_TRIE_SPARSE_MAX ?
+            self->u.sparse.children [i] : (uint8_t) (self->u.dense.min + i);
+        walk->buf [len] = c;
+        nn_node_walk (ch, walk, len + 1);
+    }
 }
 
 void nn_trie_dump (struct nn_trie *self)
@@ -134,7 +322,7 @@ void nn_node_putchar (uint8_t c)
         putchar (c);
 }
 
-void nn_node_term (struct nn_trie_node *self)
+void nn_node_term (struct nn_trie *trie, struct nn_trie_node *self)
 {
     int children;
     int i;
@@ -147,10 +335,10 @@ void nn_node_term (struct nn_trie_node *self)
     children = self->type <= NN_TRIE_SPARSE_MAX ?
         self->type : (self->u.dense.max - self->u.dense.min + 1);
     for (i = 0; i != children; ++i)
-        nn_node_term (*nn_node_child (self, i));
+        nn_node_term (trie, *nn_node_child (self, i));
 
     /*  Deallocate this node. */
-    nn_free (self);
+    nn_trie_free (trie, self, children);
 }
 
 int nn_node_check_prefix (struct nn_trie_node *self,
@@ -159,6 +347,33 @@ int nn_node_check_prefix (struct nn_trie_node *self,
     /*  Check how many characters from the data match the prefix. */
 
     int i;
+#if defined NN_TRIE_SSE2
+    unsigned int mask;
+#elif defined NN_TRIE_NEON
+    uint64_t mask;
+#endif
+
+    /*  If there are at least 16 bytes of data, compare the whole prefix
+        at once. The bytes past the end of the prefix are masked out. */
+#if defined NN_TRIE_SSE2
+    if (nn_fast (size >= 16)) {
+        mask = (unsigned int) _mm_movemask_epi8 (_mm_cmpeq_epi8 (
+            _mm_loadu_si128 ((const __m128i*) self->prefix),
+            _mm_loadu_si128 ((const __m128i*) data)));
+        mask = ~mask & ((1u << self->prefix_len) - 1);
+        return mask ? __builtin_ctz (mask) : self->prefix_len;
+    }
+#elif defined NN_TRIE_NEON
+    if (nn_fast (size >= 16)) {
+
+        /*  Narrowing the comparison result leaves 4 bits per byte. */
+        mask = vget_lane_u64 (vreinterpret_u64_u8 (vshrn_n_u16 (
+            vreinterpretq_u16_u8 (vceqq_u8 (vld1q_u8 (self->prefix),
+            vld1q_u8 (data))), 4)), 0);
+        mask = ~mask & ((((uint64_t) 1) << (self->prefix_len * 4)) - 1);
+        return mask ? __builtin_ctzll (mask) >> 2 : self->prefix_len;
+    }
+#endif
 
     for (i = 0; i != self->prefix_len; ++i) {
         if (!size || self->prefix [i] != *data)
@@ -181,17 +396,38 @@ struct nn_trie_node **nn_node_next (struct nn_trie_node *self, uint8_t c)
     /*  Finds the pointer to the next node based on the supplied character.
         If there is no such pointer, it returns NULL. */
 
+#if defined NN_TRIE_SSE2
+    unsigned int mask;
+#elif defined NN_TRIE_NEON
+    uint64_t mask;
+#else
     int i;
+#endif
 
     if (self->type == 0)
         return NULL;
 
-    /*  Sparse mode. */
+    /*  Sparse mode. All the characters are compared at once, the unused
+        part of the array is masked out. */
     if (self->type <= 8) {
+#if defined NN_TRIE_SSE2
+        mask = (unsigned int) _mm_movemask_epi8 (_mm_cmpeq_epi8 (
+            _mm_loadl_epi64 ((const __m128i*) self->u.sparse.children),
+            _mm_set1_epi8 ((char) c)));
+        mask &= (1u << self->type) - 1;
+        return mask ? nn_node_child (self, __builtin_ctz (mask)) : NULL;
+#elif defined NN_TRIE_NEON
+        mask = vget_lane_u64 (vreinterpret_u64_u8 (vceq_u8 (
+            vld1_u8 (self->u.sparse.children), vdup_n_u8 (c))), 0);
+        if (self->type < 8)
+            mask &= (((uint64_t) 1) << (self->type * 8)) - 1;
+        return mask ? nn_node_child (self, __builtin_ctzll (mask) >> 3) : NULL;
+#else
         for (i = 0; i != self->type; ++i)
             if (self->u.sparse.children [i] == c)
                 return nn_node_child (self, i);
         return NULL;
+#endif
     }
 
     /*  Dense mode. */
@@ -200,7 +436,8 @@ struct nn_trie_node **nn_node_next (struct nn_trie_node *self, uint8_t c)
     return nn_node_child (self, c - self->u.dense.min);
 }
 
-struct nn_trie_node *nn_node_compact (struct nn_trie_node *self)
+struct nn_trie_node *nn_node_compact (struct nn_trie *trie,
+    struct nn_trie_node *self)
 {
     /*  Tries to merge the node with the child node. Returns pointer to
         the compacted node. */
@@ -227,7 +464,7 @@ struct nn_trie_node *nn_node_compact (struct nn_trie_node *self)
     ch->prefix_len += self->prefix_len + 1;
 
     /*  Get rid of the obsolete parent node. */
-    nn_free (self);
+    nn_trie_free (trie, self, 1);
 
     /*  Return the new compacted node. */
     return ch;
@@ -278,6 +515,11 @@ int nn_trie_subscribe (struct nn_trie *self, const uint8_t *data, size_t size)
         n = nn_node_next (*node, *data);
         if (!n)
             goto step3;
+
+        /*  The character falls into the range of a dense array, but there's
+            no child for it yet. It'll be created in step 4. */
+        if (!*n && (*node)->type == NN_TRIE_DENSE_TYPE)
+            ++(*node)->u.dense.nbr;
         node = n;
         ++data;
         --size;
@@ -287,9 +529,7 @@ int nn_trie_subscribe (struct nn_trie *self, const uint8_t *data, size_t size)
 step2:
 
     ch = *node;
-    *node = nn_alloc (sizeof (struct nn_trie_node) +
-        sizeof (struct nn_trie_node*), "trie node");
-    assert (*node);
+    *node = nn_trie_alloc (self, 1);
     (*node)->refcount = 0;
     (*node)->prefix_len = pos;
     (*node)->type = 1;
@@ -297,7 +537,7 @@ step2:
     (*node)->u.sparse.children [0] = ch->prefix [pos];
     ch->prefix_len -= (pos + 1);
     memmove (ch->prefix, ch->prefix + pos + 1, ch->prefix_len);
-    ch = nn_node_compact (ch);
+    ch = nn_node_compact (self, ch);
     *nn_node_child (*node, 0) = ch;
     pos = (*node)->prefix_len;
 
@@ -311,9 +551,8 @@ step3:
 
     /*  If the new branch fits into sparse array... */
     if ((*node)->type < NN_TRIE_SPARSE_MAX) {
-        *node = nn_realloc (*node, sizeof (struct nn_trie_node) +
-            ((*node)->type + 1) * sizeof (struct nn_trie_node*));
-        assert (*node);
+        *node = nn_trie_realloc (self, *node, (*node)->type,
+            (*node)->type + 1);
         (*node)->u.sparse.children [(*node)->type] = *data;
         ++(*node)->type;
         node = nn_node_child (*node, (*node)->type - 1);
@@ -330,11 +569,9 @@ step3:
         if (c < (*node)->u.dense.min || c > (*node)->u.dense.max) {
             new_min = (*node)->u.dense.min < c ? (*node)->u.dense.min : c;
             new_max = (*node)->u.dense.max > c ? (*node)->u.dense.max : c;
-            *node = nn_realloc (*node, sizeof (struct nn_trie_node) +
-                (new_max - new_min + 1) * sizeof (struct nn_trie_node*));
-            assert (*node);
             old_children = (*node)->u.dense.max - (*node)->u.dense.min + 1;
             new_children = new_max - new_min + 1;
+            *node = nn_trie_realloc (self, *node, old_children, new_children);
             if ((*node)->u.dense.min != new_min) {
                 inserted = (*node)->u.dense.min - new_min;
                 memmove (nn_node_child (*node, inserted),
@@ -374,13 +611,10 @@ step3:
 
         /*  Create a new mode, while keeping the old one for a while. */
         old_node = *node;
-        *node = (struct nn_trie_node*) nn_alloc (sizeof (struct nn_trie_node) +
-            (new_max - new_min + 1) * sizeof (struct nn_trie_node*),
-            "trie node");
-        assert (*node);
+        *node = nn_trie_alloc (self, new_max - new_min + 1);
 
         /*  Fill in the new node. */
-        (*node)->refcount = 0;
+        (*node)->refcount = old_node->refcount;
         (*node)->prefix_len = old_node->prefix_len;
         (*node)->type = NN_TRIE_DENSE_TYPE;
         memcpy ((*node)->prefix, old_node->prefix, old_node->prefix_len);
@@ -397,7 +631,7 @@ step3:
         --size;
 
         /*  Get rid of the obsolete old node. */
-        nn_free (old_node);
+        nn_trie_free (self, old_node, old_node->type);
     }
 
     /*  Step 4 -- Create new nodes for remaining part of the subscription. */
@@ -408,9 +642,7 @@ step4:
 
         /*  Create a new node to hold the next part of the subscription. */
         more_nodes = size > NN_TRIE_PREFIX_MAX;
-        *node = nn_alloc (sizeof (struct nn_trie_node) +
-            (more_nodes ? sizeof (struct nn_trie_node*) : 0), "trie node");
-        assert (*node);
+        *node = nn_trie_alloc (self, more_nodes ? 1 : 0);
 
         /*  Fill in the new node. */
         (*node)->refcount = 0;
@@ -438,29 +670,54 @@ step5:
 }
 
 int nn_trie_match (struct nn_trie *self, const uint8_t *data, size_t size)
+{
+    size_t depth;
+
+    return nn_trie_match_depth (self, data, size, &depth);
+}
+
+int nn_trie_match_depth (struct nn_trie *self, const uint8_t *data,
+    size_t size, size_t *depth)
 {
     struct nn_trie_node *node;
     struct nn_trie_node **tmp;
+    const uint8_t *begin;
+    int pos;
 
+    begin = data;
     node = self->root;
     while (1) {
 
         /*  If we are at the end of the trie, return. */
-        if (!node)
+        if (!node) {
+            *depth = data - begin;
             return 0;
+        }
 
         /*  Check whether whole prefix matches the data. If not so,
-            the whole string won't match. */
-        if (nn_node_check_prefix (node, data, size) != node->prefix_len)
+            the whole string won't match. The result depends either on
+            the mismatching character or on the data ending there. */
+        pos = nn_node_check_prefix (node, data, size);
+        if (pos != node->prefix_len) {
+            *depth = (data - begin) + pos + 1;
             return 0;
+        }
 
         /*  Skip the prefix. */
         data += node->prefix_len;
         size -= node->prefix_len;
 
         /*  If all the data are matched, return. */
-        if (nn_node_has_subscribers (node))
+        if (nn_node_has_subscribers (node)) {
+            *depth = data - begin;
             return 1;
+        }
+
+        /*  There's no more data to match the child nodes against. */
+        if (!size) {
+            *depth = (data - begin) + 1;
+            return 0;
+        }
 
         /*  Move to the next node. */
         tmp = nn_node_next (node, *data);
@@ -472,22 +729,34 @@ int nn_trie_match (struct nn_trie *self, const uint8_t *data, size_t size)
 
 int nn_trie_unsubscribe (struct nn_trie *self, const uint8_t *data, size_t size)
 {
-    return nn_node_unsubscribe (&self->root, data, size);
+    return nn_node_unsubscribe (self, &self->root, data, size);
 }
 
-static int nn_node_unsubscribe (struct nn_trie_node **self,
-    const uint8_t *data, size_t size)
+static int nn_node_unsubscribe (struct nn_trie *trie,
+    struct nn_trie_node **self, const uint8_t *data, size_t size)
 {
+    int rc;
     int i;
     int j;
     int index;
     int new_min;
+    int old_children;
     struct nn_trie_node **ch;
     struct nn_trie_node *new_node;
     struct nn_trie_node *ch2;
 
-    if (!size)
+    /*  The subscription doesn't exist. */
+    if (nn_slow (!*self))
+        return -EINVAL;
+
+    if (!size) {
+
+        /*  The node represents a longer string than the one being
+            unsubscribed. */
+        if (nn_slow ((*self)->prefix_len))
+            return -EINVAL;
         goto found;
+    }
 
     /*  If prefix does not match the data, return. */
     if (nn_node_check_prefix (*self, data, size) != (*self)->prefix_len)
@@ -508,8 +777,9 @@ static int nn_node_unsubscribe (struct nn_trie_node **self,
     /*  Recursive traversal of the trie happens here. If the subscription
         wasn't really removed, nothing have changed in the trie and
         no additional pruning is needed. */
-    if (nn_node_unsubscribe (ch, data + 1, size - 1) == 0)
-        return 0;
+    rc = nn_node_unsubscribe (trie, ch, data + 1, size - 1);
+    if (rc <= 0)
+        return rc;
 
     /*  Subscription removal is already done. Now we are going to compact
         the trie. However, if the following node remains in place, there's
@@ -536,20 +806,19 @@ static int nn_node_unsubscribe (struct nn_trie_node **self,
             nn_node_child (*self, index + 1),
             ((*self)->type - index - 1) * sizeof (struct nn_trie_node*));
         --(*self)->type;
-        *self = nn_realloc (*self, sizeof (struct nn_trie_node) +
-            ((*self)->type * sizeof (struct nn_trie_node*)));
-        assert (*self);
-        
+        *self = nn_trie_realloc (trie, *self, (*self)->type + 1,
+            (*self)->type);
+
         /*  If there are no more children and no refcount, we can delete
             the node altogether. */
         if (!(*self)->type && !nn_node_has_subscribers (*self)) {
-            nn_free (*self);
+            nn_trie_free (trie, *self, 0);
             *self = NULL;
             return 1;
         }
 
         /*  Try to merge the node with the following node. */
-        *self = nn_node_compact (*self);
+        *self = nn_node_compact (trie, *self);
 
         return 1;
     }
@@ -563,8 +832,8 @@ static int nn_node_unsubscribe (struct nn_trie_node **self,
         /*  If the removed item is the leftmost one, trim the array from
             the left side. */
         if (*data == (*self)->u.dense.min) {
-             for (i = 0; i != (*self)->u.dense.max - (*self)->u.dense.min + 1;
-                   ++i)
+             old_children = (*self)->u.dense.max - (*self)->u.dense.min + 1;
+             for (i = 0; i != old_children; ++i)
                  if (*nn_node_child (*self, i))
                      break;
              new_min = i + (*self)->u.dense.min;
@@ -573,25 +842,21 @@ static int nn_node_unsubscribe (struct nn_trie_node **self,
                  sizeof (struct nn_trie_node*));
              (*self)->u.dense.min = new_min;
              --(*self)->u.dense.nbr;
-             *self = nn_realloc (*self, sizeof (struct nn_trie_node) +
-                 ((*self)->u.dense.max - new_min + 1) *
-                 sizeof (struct nn_trie_node*));
-             assert (*self);
+             *self = nn_trie_realloc (trie, *self, old_children,
+                 (*self)->u.dense.max - new_min + 1);
              return 1;
         }
 
         /*  If the removed item is the rightmost one, trim the array from
             the right side. */
         if (*data == (*self)->u.dense.max) {
-             for (i = (*self)->u.dense.max - (*self)->u.dense.min; i != 0; --i)
+             old_children = (*self)->u.dense.max - (*self)->u.dense.min + 1;
+             for (i = old_children - 1; i != 0; --i)
                  if (*nn_node_child (*self, i))
                      break;
              (*self)->u.dense.max = i + (*self)->u.dense.min;
              --(*self)->u.dense.nbr;
-             *self = nn_realloc (*self, sizeof (struct nn_trie_node) +
-                 ((*self)->u.dense.max - (*self)->u.dense.min + 1) *
-                 sizeof (struct nn_trie_node*));
-             assert (*self);
+             *self = nn_trie_realloc (trie, *self, old_children, i + 1);
              return 1;
         }
 
@@ -602,10 +867,8 @@ static int nn_node_unsubscribe (struct nn_trie_node **self,
 
     /*  Convert dense array into sparse array. */
     {
-        new_node = nn_alloc (sizeof (struct nn_trie_node) +
-            NN_TRIE_SPARSE_MAX * sizeof (struct nn_trie_node*), "trie node");
-        assert (new_node);
-        new_node->refcount = 0;
+        new_node = nn_trie_alloc (trie, NN_TRIE_SPARSE_MAX);
+        new_node->refcount = (*self)->refcount;
         new_node->prefix_len = (*self)->prefix_len;
         memcpy (new_node->prefix, (*self)->prefix, new_node->prefix_len);
         new_node->type = NN_TRIE_SPARSE_MAX;
@@ -620,7 +883,8 @@ static int nn_node_unsubscribe (struct nn_trie_node **self,
             }
         }
         assert (j == NN_TRIE_SPARSE_MAX);
-        nn_free (*self);
+        nn_trie_free (trie, *self,
+            (*self)->u.dense.max - (*self)->u.dense.min + 1);
         *self = new_node;
         return 1;
     }
@@ -642,13 +906,13 @@ found:
 
         /*  If there are no children, we can delete the node altogether. */
         if (!(*self)->type) {
-            nn_free (*self);
+            nn_trie_free (trie, *self, 0);
             *self = NULL;
             return 1;
         }
 
         /*  Try to merge the node with the following node. */
-        *self = nn_node_compact (*self);
+        *self = nn_node_compact (trie, *self);
         return 1;
     }
 
@@ -38,6 +38,9 @@
 /* 'type' is set to this value when in the dense mode. */
 #define NN_TRIE_DENSE_TYPE (NN_TRIE_SPARSE_MAX + 1)
 
+/*  Nodes with up to this many children are allocated from the arena. */
+#define NN_TRIE_ARENA_CHILDREN 16
+
 /*  This structure represents a node in patricia trie. It's a header to be
     followed by the array of pointers to child nodes. Each node represents
     the string composed of all the prefixes on the way from the trie root,
@@ -90,6 +93,16 @@ struct nn_trie {
     /*  The root node of the trie (representing the empty subscription). */
     struct nn_trie_node *root;
 
+    /*  Nodes are carved out of large memory blocks, so that the nodes
+        visited one after another tend to be close to each other. 'pos' and
+        'left' describe the unused space in the most recent block. */
+    void *blocks;
+    size_t blocksz;
+    uint8_t *pos;
+    size_t left;
+
+    /*  Lists of deallocated nodes, one for each number of children. */
+    void *free [NN_TRIE_ARENA_CHILDREN + 1];
 };
 
 /*  Initialise an empty trie. */
@@ -113,6 +126,19 @@ int nn_trie_unsubscribe (struct nn_trie *self, const uint8_t *data,
     it returns 0. */
 int nn_trie_match (struct nn_trie *self, const uint8_t *data, size_t size);
 
+/*  Same as nn_trie_match, but also stores to 'depth' how many leading bytes
+    of the string the result depends on. Any string that shares those bytes
+    with the supplied one produces the same result. If the result depends
+    on where the string ends, 'depth' is set to the size of the string plus
+    one. */
+int nn_trie_match_depth (struct nn_trie *self, const uint8_t *data,
+    size_t size, size_t *depth);
+
+/*  Invokes 'fn' for each string in the trie. The string passed to the
+    callback is valid only for the duration of the call. */
+typedef void (*nn_trie_walk_fn) (const uint8_t *data, size_t size, void *arg);
+void nn_trie_walk (struct nn_trie *self, nn_trie_walk_fn fn, void *arg);
+
 /*  Debugging interface. */
 void nn_trie_dump (struct nn_trie *self);
 
@@ -21,6 +21,8 @@
 */
 
 #include "xpub.h"
+#include "trie.h"
+#include "lvc.h"
 
 #include "../../nn.h"
 #include "../../pubsub.h"
@@ -35,9 +37,22 @@
 #include "../../utils/attr.h"
 
 #include <stddef.h>
+#include <string.h>
 
 struct nn_xpub_data {
     struct nn_dist_data item;
+
+    /*  If set, only messages matching the subscriptions forwarded by the
+        peer are sent to the pipe. */
+    int filter;
+    struct nn_trie trie;
+
+    /*  Item in the list of all the attached pipes. */
+    struct nn_list_item all;
+
+    /*  In the conflating mode, messages waiting for the pipe to become
+        writable. Only the latest message for each topic is kept. */
+    struct nn_lvc lvc;
 };
 
 struct nn_xpub {
@@ -47,6 +62,21 @@ struct nn_xpub {
 
     /*  Distributor. */
     struct nn_dist outpipes;
+
+    /*  Number of pipes with filtering enabled. If zero, messages are simply
+        sent to all the pipes. */
+    int nfiltered;
+
+    /*  List of all the attached pipes, writable or not. */
+    struct nn_list pipes;
+
+    /*  If set, messages for the pipes that are not writable are kept in
+        the per-pipe last-value caches rather than dropped. The topic of
+        a message is given either by the topic length or by the topic
+        delimiter. If neither is set, all messages share a single topic. */
+    int conflate;
+    int topic_length;
+    int topic_delimiter;
 };
 
 /*  Private functions. */
@@ -66,6 +96,11 @@ static int nn_xpub_setopt (struct nn_sockbase *self, int level, int option,
     const void *optval, size_t optvallen);
 static int nn_xpub_getopt (struct nn_sockbase *self, int level, int option,
     void *optval, size_t *optvallen);
+static void nn_xpub_command (struct nn_xpub *self, struct nn_xpub_data *data,
+    struct nn_msg *msg);
+static int nn_xpub_match (struct nn_dist_data *item, struct nn_msg *msg);
+static int nn_xpub_send_conflated (struct nn_xpub *self, struct nn_msg *msg);
+static size_t nn_xpub_topic (struct nn_xpub *self, struct nn_msg *msg);
 static const struct nn_sockbase_vfptr nn_xpub_sockbase_vfptr = {
     NULL,
     nn_xpub_destroy,
@@ -85,10 +120,16 @@ static void nn_xpub_init (struct nn_xpub *self,
 {
     nn_sockbase_init (&self->sockbase, vfptr, hint);
     nn_dist_init (&self->outpipes);
+    self->nfiltered = 0;
+    nn_list_init (&self->pipes);
+    self->conflate = 0;
+    self->topic_length = 0;
+    self->topic_delimiter = -1;
 }
 
 static void nn_xpub_term (struct nn_xpub *self)
 {
+    nn_list_term (&self->pipes);
     nn_dist_term (&self->outpipes);
     nn_sockbase_term (&self->sockbase);
 }
@@ -112,6 +153,11 @@ static int nn_xpub_add (struct nn_sockbase *self, struct nn_pipe *pipe)
 
     data = nn_alloc (sizeof (struct nn_xpub_data), "pipe data (pub)");
     alloc_assert (data);
+    data->filter = 0;
+    nn_trie_init (&data->trie);
+    nn_list_item_init (&data->all);
+    nn_list_insert (&xpub->pipes, &data->all, nn_list_end (&xpub->pipes));
+    nn_lvc_init (&data->lvc);
     nn_dist_add (&xpub->outpipes, pipe, &data->item);
     nn_pipe_setdata (pipe, data);
 
@@ -128,24 +174,91 @@ static void nn_xpub_rm (struct nn_sockbase *self, struct nn_pipe *pipe)
 
     nn_dist_rm (&xpub->outpipes, pipe, &data->item);
 
+    if (data->filter)
+        --xpub->nfiltered;
+    nn_lvc_term (&data->lvc);
+    nn_list_erase (&xpub->pipes, &data->all);
+    nn_list_item_term (&data->all);
+    nn_trie_term (&data->trie);
     nn_free (data);
 }
 
-static void nn_xpub_in (NN_UNUSED struct nn_sockbase *self,
-                       NN_UNUSED struct nn_pipe *pipe)
+static void nn_xpub_in (struct nn_sockbase *self, struct nn_pipe *pipe)
 {
-    /*  We shouldn't get any messages from subscribers. */
-    nn_assert (0);
+    int rc;
+    struct nn_xpub *xpub;
+    struct nn_xpub_data *data;
+    struct nn_msg msg;
+
+    xpub = nn_cont (self, struct nn_xpub, sockbase);
+    data = nn_pipe_getdata (pipe);
+
+    /*  The only messages subscribers send are subscription commands. */
+    while (1) {
+        rc = nn_pipe_recv (pipe, &msg);
+        errnum_assert (rc >= 0, -rc);
+        nn_xpub_command (xpub, data, &msg);
+        nn_msg_term (&msg);
+        if (rc & NN_PIPE_RELEASE)
+            break;
+    }
+}
+
+static void nn_xpub_command (struct nn_xpub *self, struct nn_xpub_data *data,
+    struct nn_msg *msg)
+{
+    uint8_t *body;
+    size_t size;
+
+    body = nn_chunkref_data (&msg->body);
+    size = nn_chunkref_size (&msg->body);
+
+    /*  Malformed commands are silently ignored. */
+    if (nn_slow (size < 1))
+        return;
+
+    switch (body [0]) {
+    case NN_XPUB_CMD_SUBSCRIBE:
+        nn_trie_subscribe (&data->trie, body + 1, size - 1);
+        return;
+    case NN_XPUB_CMD_UNSUBSCRIBE:
+        nn_trie_unsubscribe (&data->trie, body + 1, size - 1);
+        return;
+    case NN_XPUB_CMD_FILTER:
+    case NN_XPUB_CMD_NOFILTER:
+
+        /*  Either way, the subscriber is going to start over. */
+        nn_trie_term (&data->trie);
+        nn_trie_init (&data->trie);
+        self->nfiltered -= data->filter;
+        data->filter = body [0] == NN_XPUB_CMD_FILTER ? 1 : 0;
+        self->nfiltered += data->filter;
+        return;
+    default:
+        return;
+    }
 }
 
 static void nn_xpub_out (struct nn_sockbase *self, struct nn_pipe *pipe)
 {
+    int rc;
     struct nn_xpub *xpub;
     struct nn_xpub_data *data;
+    struct nn_msg msg;
 
     xpub = nn_cont (self, struct nn_xpub, sockbase);
     data = nn_pipe_getdata (pipe);
 
+    /*  Send the conflated messages first. The pipe is not considered
+        writable until all of them are sent, so that newer messages don't
+        overtake them. */
+    while (nn_lvc_get (&data->lvc, &msg) == 0) {
+        rc = nn_pipe_send (pipe, &msg);
+        errnum_assert (rc >= 0, -rc);
+        if (rc & NN_PIPE_RELEASE)
+            return;
+    }
+
     nn_dist_out (&xpub->outpipes, pipe, &data->item);
 }
 
@@ -156,24 +269,145 @@ static int nn_xpub_events (NN_UNUSED struct nn_sockbase *self)
 
 static int nn_xpub_send (struct nn_sockbase *self, struct nn_msg *msg)
 {
-    return nn_dist_send (&nn_cont (self, struct nn_xpub, sockbase)->outpipes,
-        msg, NULL);
+    struct nn_xpub *xpub;
+
+    xpub = nn_cont (self, struct nn_xpub, sockbase);
+
+    if (nn_slow (xpub->conflate))
+        return nn_xpub_send_conflated (xpub, msg);
+    if (!xpub->nfiltered)
+        return nn_dist_send (&xpub->outpipes, msg, NULL);
+    return nn_dist_send_filtered (&xpub->outpipes, msg, nn_xpub_match);
 }
 
-static int nn_xpub_setopt (NN_UNUSED struct nn_sockbase *self,
-    NN_UNUSED int level, NN_UNUSED int option,
-    NN_UNUSED const void *optval, NN_UNUSED size_t optvallen)
+static int nn_xpub_match (struct nn_dist_data *item, struct nn_msg *msg)
 {
-    return -ENOPROTOOPT;
+    struct nn_xpub_data *data;
+
+    data = nn_cont (item, struct nn_xpub_data, item);
+    if (!data->filter)
+        return 1;
+    return nn_trie_match (&data->trie, nn_chunkref_data (&msg->body),
+        nn_chunkref_size (&msg->body));
 }
 
-static int nn_xpub_getopt (NN_UNUSED struct nn_sockbase *self,
-    NN_UNUSED int level, NN_UNUSED int option,
-    NN_UNUSED void *optval, NN_UNUSED size_t *optvallen)
+static int nn_xpub_send_conflated (struct nn_xpub *self, struct nn_msg *msg)
 {
+    struct nn_list_item *it;
+    struct nn_xpub_data *data;
+    struct nn_msg copy;
+
+    /*  Pipes that can't accept the message right now get it stored instead,
+        replacing any older message with the same topic. So does a pipe
+        that still has stored messages to send. */
+    for (it = nn_list_begin (&self->pipes); it != nn_list_end (&self->pipes);
+          it = nn_list_next (&self->pipes, it)) {
+        data = nn_cont (it, struct nn_xpub_data, all);
+        if (!nn_xpub_match (&data->item, msg))
+            continue;
+        nn_msg_cp (&copy, msg);
+        if (nn_lvc_empty (&data->lvc) &&
+              nn_dist_writable (&self->outpipes, &data->item))
+            nn_dist_send_to (&self->outpipes, &data->item, &copy);
+        else
+            nn_lvc_put (&data->lvc, &copy, nn_xpub_topic (self, msg));
+    }
+    nn_msg_term (msg);
+
+    return 0;
+}
+
+static size_t nn_xpub_topic (struct nn_xpub *self, struct nn_msg *msg)
+{
+    uint8_t *data;
+    uint8_t *end;
+    size_t size;
+
+    data = nn_chunkref_data (&msg->body);
+    size = nn_chunkref_size (&msg->body);
+    if (self->topic_length > 0)
+        return size < (size_t) self->topic_length ?
+            size : (size_t) self->topic_length;
+    if (self->topic_delimiter >= 0) {
+        end = memchr (data, self->topic_delimiter, size);
+        return end ? (size_t) (end - data) : size;
+    }
+    return 0;
+}
+
+static int nn_xpub_setopt (struct nn_sockbase *self, int level, int option,
+    const void *optval, size_t optvallen)
+{
+    int val;
+    struct nn_xpub *xpub;
+
+    xpub = nn_cont (self, struct nn_xpub, sockbase);
+
+    if (level != NN_PUB)
+        return -ENOPROTOOPT;
+
+    if (nn_slow (optvallen != sizeof (int)))
+        return -EINVAL;
+    val = *(int*) optval;
+
+    if (option == NN_PUB_CONFLATE) {
+        xpub->conflate = val ? 1 : 0;
+        return 0;
+    }
+
+    /*  Topic length and topic delimiter are mutually exclusive. */
+    if (option == NN_PUB_TOPIC_LENGTH) {
+        if (nn_slow (val < 0))
+            return -EINVAL;
+        if (nn_slow (val > 0 && xpub->topic_delimiter >= 0))
+            return -EINVAL;
+        xpub->topic_length = val;
+        return 0;
+    }
+
+    if (option == NN_PUB_TOPIC_DELIMITER) {
+        if (nn_slow (val < -1 || val > 255))
+            return -EINVAL;
+        if (nn_slow (val >= 0 && xpub->topic_length > 0))
+            return -EINVAL;
+        xpub->topic_delimiter = val;
+        return 0;
+    }
+
     return -ENOPROTOOPT;
 }
 
+static int nn_xpub_getopt (struct nn_sockbase *self, int level, int option,
+    void *optval, size_t *optvallen)
+{
+    struct nn_xpub *xpub;
+
+    xpub = nn_cont (self, struct nn_xpub, sockbase);
+
+    if (level != NN_PUB)
+        return -ENOPROTOOPT;
+
+    if (nn_slow (*optvallen < sizeof (int)))
+        return -EINVAL;
+
+    switch (option) {
+    case NN_PUB_CONFLATE:
+        *(int*) optval = xpub->conflate;
+        break;
+    case NN_PUB_TOPIC_LENGTH:
+        *(int*) optval = xpub->topic_length;
+        break;
+    case NN_PUB_TOPIC_DELIMITER:
+        *(int*) optval = xpub->topic_delimiter;
+        break;
+    default:
+        return -ENOPROTOOPT;
+    }
+    *optvallen = sizeof (int);
+
+    return 0;
+}
+
 int nn_xpub_create (void *hint, struct nn_sockbase **sockbase)
 {
     struct nn_xpub *self;
@@ -30,5 +30,14 @@ extern struct nn_socktype *nn_xpub_socktype;
 int nn_xpub_create (void *hint, struct nn_sockbase **sockbase);
 int nn_xpub_ispeer (int socktype);
 
+/*  Subscription forwarding. Subscribers may send messages consisting of
+    a single command byte followed by the topic to the publisher. Until
+    NN_XPUB_CMD_FILTER is received from a pipe, all messages are sent to it.
+    Afterwards, only messages matching the topics subscribed to are. */
+#define NN_XPUB_CMD_UNSUBSCRIBE 0
+#define NN_XPUB_CMD_SUBSCRIBE 1
+#define NN_XPUB_CMD_FILTER 2
+#define NN_XPUB_CMD_NOFILTER 3
+
 #endif
 
@@ -22,7 +22,9 @@
 */
 
 #include "xsub.h"
+#include "xpub.h"
 #include "trie.h"
+#include "topicset.h"
 
 #include "../../nn.h"
 #include "../../pubsub.h"
@@ -36,20 +38,97 @@
 #include "../../utils/list.h"
 #include "../../utils/attr.h"
 
+#include <string.h>
+
+/*  Number of entries in the match cache. Must be a power of 2. */
+#define NN_XSUB_CACHE_SIZE 128
+
+/*  Number of leading bytes of the message used as the cache key. Chosen so
+    that an entry takes 32 bytes, i.e. two entries per cache line. */
+#define NN_XSUB_CACHE_TOPIC 26
+
+/*  Cached result of matching a message against the trie. */
+struct nn_xsub_cache_entry {
+
+    /*  The entry is valid only if this matches the generation of the cache. */
+    uint32_t gen;
+
+    /*  Size of the key. If it's less than NN_XSUB_CACHE_TOPIC, the entry
+        applies only to messages of exactly this size. */
+    uint8_t size;
+
+    /*  1 if the messages starting with the key match the subscriptions. */
+    uint8_t match;
+
+    uint8_t topic [NN_XSUB_CACHE_TOPIC];
+};
+
+/*  Subscription command waiting to be sent to the publisher. */
+struct nn_xsub_cmd {
+    struct nn_list_item item;
+    struct nn_msg msg;
+};
+
 struct nn_xsub_data {
     struct nn_fq_data fq;
+    struct nn_pipe *pipe;
+
+    /*  Item in the list of all the attached pipes. */
+    struct nn_list_item item;
+
+    /*  1 if the pipe is able to accept outbound messages. */
+    int writable;
+
+    /*  Subscription commands waiting for the pipe to become writable. */
+    struct nn_list cmds;
 };
 
 struct nn_xsub {
     struct nn_sockbase sockbase;
     struct nn_fq fq;
     struct nn_trie trie;
+
+    /*  If set, subscriptions are forwarded to the publishers so that they
+        can filter the messages before sending them. */
+    int forward;
+
+    /*  List of all the attached pipes. */
+    struct nn_list pipes;
+
+    /*  In the exact-match mode, the subscriptions are stored here instead
+        of the trie. The mode is selected by setting either the topic length
+        or the topic delimiter. */
+    struct nn_topicset topics;
+    int topic_length;
+    int topic_delimiter;
+
+    /*  Direct-mapped cache of recent trie match results. Bumping
+        the generation invalidates all the entries at once. */
+    uint32_t cache_gen;
+    struct nn_xsub_cache_entry cache [NN_XSUB_CACHE_SIZE];
 };
 
 /*  Private functions. */
 static void nn_xsub_init (struct nn_xsub *self,
     const struct nn_sockbase_vfptr *vfptr, void *hint);
 static void nn_xsub_term (struct nn_xsub *self);
+static void nn_xsub_command (struct nn_xsub_data *data, int cmd,
+    const void *topic, size_t size);
+static void nn_xsub_command_all (struct nn_xsub *self, int cmd,
+    const void *topic, size_t size);
+static void nn_xsub_subscription (const uint8_t *topic, size_t size,
+    void *arg);
+static void nn_xsub_flush (struct nn_xsub_data *data);
+static int nn_xsub_exact (struct nn_xsub *self);
+static int nn_xsub_match (struct nn_xsub *self, const uint8_t *data,
+    size_t size);
+static int nn_xsub_valid (struct nn_xsub *self, const void *topic,
+    size_t size);
+static void nn_xsub_walk (struct nn_xsub *self, struct nn_xsub_data *data);
+static uint32_t nn_xsub_cache_hash (const uint8_t *data, size_t size);
+static int nn_xsub_cache_match (struct nn_xsub *self, const uint8_t *data,
+    size_t size);
+static void nn_xsub_cache_invalidate (struct nn_xsub *self);
 
 /*  Implementation of nn_sockbase's virtual functions. */
 static void nn_xsub_destroy (struct nn_sockbase *self);
@@ -83,10 +162,19 @@ static void nn_xsub_init (struct nn_xsub *self,
     nn_sockbase_init (&self->sockbase, vfptr, hint);
     nn_fq_init (&self->fq);
     nn_trie_init (&self->trie);
+    self->forward = 0;
+    nn_list_init (&self->pipes);
+    nn_topicset_init (&self->topics);
+    self->topic_length = 0;
+    self->topic_delimiter = -1;
+    self->cache_gen = 1;
+    memset (self->cache, 0, sizeof (self->cache));
 }
 
 static void nn_xsub_term (struct nn_xsub *self)
 {
+    nn_topicset_term (&self->topics);
+    nn_list_term (&self->pipes);
     nn_trie_term (&self->trie);
     nn_fq_term (&self->fq);
     nn_sockbase_term (&self->sockbase);
@@ -111,9 +199,22 @@ static int nn_xsub_add (struct nn_sockbase *self, struct nn_pipe *pipe)
 
     data = nn_alloc (sizeof (struct nn_xsub_data), "pipe data (sub)");
     alloc_assert (data);
+    data->pipe = pipe;
+    nn_list_item_init (&data->item);
+    nn_list_insert (&xsub->pipes, &data->item, nn_list_end (&xsub->pipes));
+    data->writable = 0;
+    nn_list_init (&data->cmds);
     nn_pipe_setdata (pipe, data);
     nn_fq_add (&xsub->fq, pipe, &data->fq, 8);
 
+    /*  Tell the publisher to start filtering and send it all the existing
+        subscriptions. The commands will be sent once the pipe becomes
+        writable. */
+    if (xsub->forward) {
+        nn_xsub_command (data, NN_XPUB_CMD_FILTER, NULL, 0);
+        nn_xsub_walk (xsub, data);
+    }
+
     return 0;
 }
 
@@ -121,10 +222,24 @@ static void nn_xsub_rm (struct nn_sockbase *self, struct nn_pipe *pipe)
 {
     struct nn_xsub *xsub;
     struct nn_xsub_data *data;
+    struct nn_xsub_cmd *cmd;
 
     xsub = nn_cont (self, struct nn_xsub, sockbase);
     data = nn_pipe_getdata (pipe);
     nn_fq_rm (&xsub->fq, pipe, &data->fq);
+
+    /*  Drop the subscription commands that haven't been sent yet. */
+    while (!nn_list_empty (&data->cmds)) {
+        cmd = nn_cont (nn_list_begin (&data->cmds), struct nn_xsub_cmd, item);
+        nn_list_erase (&data->cmds, &cmd->item);
+        nn_list_item_term (&cmd->item);
+        nn_msg_term (&cmd->msg);
+        nn_free (cmd);
+    }
+    nn_list_term (&data->cmds);
+
+    nn_list_erase (&xsub->pipes, &data->item);
+    nn_list_item_term (&data->item);
     nn_free (data);
 }
 
@@ -139,11 +254,187 @@ static void nn_xsub_in (struct nn_sockbase *self, struct nn_pipe *pipe)
 }
 
 static void nn_xsub_out (NN_UNUSED struct nn_sockbase *self,
-    NN_UNUSED struct nn_pipe *pipe)
+    struct nn_pipe *pipe)
+{
+    struct nn_xsub_data *data;
+
+    /*  The only messages sent to the publishers are subscription commands.
+        Send those that were waiting for the pipe to become writable. */
+    data = nn_pipe_getdata (pipe);
+    data->writable = 1;
+    nn_xsub_flush (data);
+}
+
+static void nn_xsub_flush (struct nn_xsub_data *data)
+{
+    int rc;
+    struct nn_xsub_cmd *cmd;
+
+    while (data->writable && !nn_list_empty (&data->cmds)) {
+        cmd = nn_cont (nn_list_begin (&data->cmds), struct nn_xsub_cmd, item);
+        nn_list_erase (&data->cmds, &cmd->item);
+        nn_list_item_term (&cmd->item);
+        rc = nn_pipe_send (data->pipe, &cmd->msg);
+        errnum_assert (rc >= 0, -rc);
+        if (rc & NN_PIPE_RELEASE)
+            data->writable = 0;
+        nn_free (cmd);
+    }
+}
+
+static void nn_xsub_command (struct nn_xsub_data *data, int cmd,
+    const void *topic, size_t size)
+{
+    struct nn_xsub_cmd *item;
+    uint8_t *body;
+
+    item = nn_alloc (sizeof (struct nn_xsub_cmd), "subscription command");
+    alloc_assert (item);
+    nn_msg_init (&item->msg, size + 1);
+    body = nn_chunkref_data (&item->msg.body);
+    body [0] = (uint8_t) cmd;
+    if (size)
+        memcpy (body + 1, topic, size);
+    nn_list_item_init (&item->item);
+    nn_list_insert (&data->cmds, &item->item, nn_list_end (&data->cmds));
+
+    nn_xsub_flush (data);
+}
+
+static void nn_xsub_command_all (struct nn_xsub *self, int cmd,
+    const void *topic, size_t size)
 {
-    /*  We are not going to send any messages until subscription forwarding
-        is implemented, so there's no point is maintaining a list of pipes
-        ready for sending. */
+    struct nn_list_item *it;
+
+    for (it = nn_list_begin (&self->pipes); it != nn_list_end (&self->pipes);
+          it = nn_list_next (&self->pipes, it))
+        nn_xsub_command (nn_cont (it, struct nn_xsub_data, item), cmd,
+            topic, size);
+}
+
+static void nn_xsub_subscription (const uint8_t *topic, size_t size,
+    void *arg)
+{
+    nn_xsub_command ((struct nn_xsub_data*) arg, NN_XPUB_CMD_SUBSCRIBE,
+        topic, size);
+}
+
+static int nn_xsub_exact (struct nn_xsub *self)
+{
+    return self->topic_length > 0 || self->topic_delimiter >= 0;
+}
+
+static int nn_xsub_match (struct nn_xsub *self, const uint8_t *data,
+    size_t size)
+{
+    const uint8_t *end;
+
+    if (nn_fast (!nn_xsub_exact (self)))
+        return nn_xsub_cache_match (self, data, size);
+
+    /*  Extract the topic from the message and look it up in the set. */
+    if (self->topic_length > 0) {
+        if (size < (size_t) self->topic_length)
+            return 0;
+        return nn_topicset_match (&self->topics, data,
+            (size_t) self->topic_length);
+    }
+    end = memchr (data, self->topic_delimiter, size);
+    return nn_topicset_match (&self->topics, data,
+        end ? (size_t) (end - data) : size);
+}
+
+static uint32_t nn_xsub_cache_hash (const uint8_t *data, size_t size)
+{
+    uint64_t hash;
+    uint64_t word;
+
+    hash = size;
+    while (size >= 8) {
+        memcpy (&word, data, 8);
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+        data += 8;
+        size -= 8;
+    }
+    if (size) {
+        word = 0;
+        memcpy (&word, data, size);
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+    }
+
+    /*  Mix the high bits, affected by the last bytes of each word, down to
+        the low bits used to index the cache. */
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+
+    return (uint32_t) hash;
+}
+
+static int nn_xsub_cache_match (struct nn_xsub *self, const uint8_t *data,
+    size_t size)
+{
+    int rc;
+    size_t len;
+    size_t depth;
+    struct nn_xsub_cache_entry *entry;
+
+    len = size < NN_XSUB_CACHE_TOPIC ? size : NN_XSUB_CACHE_TOPIC;
+    entry = &self->cache [nn_xsub_cache_hash (data, len) &
+        (NN_XSUB_CACHE_SIZE - 1)];
+    if (nn_fast (entry->gen == self->cache_gen && entry->size == len &&
+          memcmp (entry->topic, data, len) == 0)) {
+        nn_sockbase_stat_increment (&self->sockbase,
+            NN_STAT_MATCH_CACHE_HITS, 1);
+        return entry->match;
+    }
+
+    nn_sockbase_stat_increment (&self->sockbase,
+        NN_STAT_MATCH_CACHE_MISSES, 1);
+    rc = nn_trie_match_depth (&self->trie, data, size, &depth);
+
+    /*  The result can be cached only if it's fully determined by the key,
+        i.e. the whole message is the key or the trie didn't look past it. */
+    if (size < NN_XSUB_CACHE_TOPIC || depth <= NN_XSUB_CACHE_TOPIC) {
+        entry->gen = self->cache_gen;
+        entry->size = (uint8_t) len;
+        entry->match = (uint8_t) rc;
+        memcpy (entry->topic, data, len);
+    }
+
+    return rc;
+}
+
+static void nn_xsub_cache_invalidate (struct nn_xsub *self)
+{
+    ++self->cache_gen;
+
+    /*  On wrap-around, stale entries could appear valid again. */
+    if (nn_slow (self->cache_gen == 0)) {
+        memset (self->cache, 0, sizeof (self->cache));
+        self->cache_gen = 1;
+    }
+}
+
+static int nn_xsub_valid (struct nn_xsub *self, const void *topic,
+    size_t size)
+{
+    /*  In the exact-match mode, a subscription that can never match any
+        message is almost certainly a mistake. */
+    if (self->topic_length > 0)
+        return size == (size_t) self->topic_length;
+    return !size || memchr (topic, self->topic_delimiter, size) == NULL;
+}
+
+static void nn_xsub_walk (struct nn_xsub *self, struct nn_xsub_data *data)
+{
+    /*  Exact topics are forwarded as ordinary prefix subscriptions. The
+        publisher thus sends a superset of the matching messages and the
+        rest is filtered out locally. */
+    if (nn_xsub_exact (self))
+        nn_topicset_walk (&self->topics, nn_xsub_subscription, data);
+    else
+        nn_trie_walk (&self->trie, nn_xsub_subscription, data);
 }
 
 static int nn_xsub_events (struct nn_sockbase *self)
@@ -166,7 +457,7 @@ static int nn_xsub_recv (struct nn_sockbase *self, struct nn_msg *msg)
         if (nn_slow (rc == -EAGAIN))
             return -EAGAIN;
         errnum_assert (rc >= 0, -rc);
-        rc = nn_trie_match (&xsub->trie, nn_chunkref_data (&msg->body),
+        rc = nn_xsub_match (xsub, nn_chunkref_data (&msg->body),
             nn_chunkref_size (&msg->body));
         if (rc == 0)
             continue;
@@ -180,34 +471,139 @@ static int nn_xsub_setopt (struct nn_sockbase *self, int level, int option,
         const void *optval, size_t optvallen)
 {
     int rc;
+    int val;
     struct nn_xsub *xsub;
+    struct nn_xsub_data *data;
+    struct nn_list_item *it;
 
     xsub = nn_cont (self, struct nn_xsub, sockbase);
 
     if (level != NN_SUB)
         return -ENOPROTOOPT;
 
+    /*  The publishers are notified only when the topic is subscribed to
+        for the first time or when the last subscription is removed. */
     if (option == NN_SUB_SUBSCRIBE) {
-        rc = nn_trie_subscribe (&xsub->trie, optval, optvallen);
-        if (rc >= 0)
-            return 0;
-        return rc;
+        if (nn_xsub_exact (xsub)) {
+            if (nn_slow (!nn_xsub_valid (xsub, optval, optvallen)))
+                return -EINVAL;
+            rc = nn_topicset_subscribe (&xsub->topics, optval, optvallen);
+        }
+        else
+            rc = nn_trie_subscribe (&xsub->trie, optval, optvallen);
+        if (rc < 0)
+            return rc;
+        if (rc == 1)
+            nn_xsub_cache_invalidate (xsub);
+        if (rc == 1 && xsub->forward)
+            nn_xsub_command_all (xsub, NN_XPUB_CMD_SUBSCRIBE,
+                optval, optvallen);
+        return 0;
     }
 
     if (option == NN_SUB_UNSUBSCRIBE) {
-        rc = nn_trie_unsubscribe (&xsub->trie, optval, optvallen);
-        if (rc >= 0)
+        if (nn_xsub_exact (xsub))
+            rc = nn_topicset_unsubscribe (&xsub->topics, optval, optvallen);
+        else
+            rc = nn_trie_unsubscribe (&xsub->trie, optval, optvallen);
+        if (rc < 0)
+            return rc;
+        if (rc == 1)
+            nn_xsub_cache_invalidate (xsub);
+        if (rc == 1 && xsub->forward)
+            nn_xsub_command_all (xsub, NN_XPUB_CMD_UNSUBSCRIBE,
+                optval, optvallen);
+        return 0;
+    }
+
+    if (option == NN_SUB_FORWARD) {
+        if (nn_slow (optvallen != sizeof (int)))
+            return -EINVAL;
+        if ((*(int*) optval ? 1 : 0) == xsub->forward)
             return 0;
-        return rc;
+        xsub->forward = *(int*) optval ? 1 : 0;
+        if (xsub->forward) {
+            for (it = nn_list_begin (&xsub->pipes);
+                  it != nn_list_end (&xsub->pipes);
+                  it = nn_list_next (&xsub->pipes, it)) {
+                data = nn_cont (it, struct nn_xsub_data, item);
+                nn_xsub_command (data, NN_XPUB_CMD_FILTER, NULL, 0);
+                nn_xsub_walk (xsub, data);
+            }
+        }
+        else
+            nn_xsub_command_all (xsub, NN_XPUB_CMD_NOFILTER, NULL, 0);
+        return 0;
+    }
+
+    /*  The matching mode can be changed only while there are no
+        subscriptions. Topic length and topic delimiter are mutually
+        exclusive. */
+    if (option == NN_SUB_TOPIC_LENGTH) {
+        if (nn_slow (optvallen != sizeof (int)))
+            return -EINVAL;
+        val = *(int*) optval;
+        if (nn_slow (val < 0))
+            return -EINVAL;
+        if (nn_slow (val > 0 && xsub->topic_delimiter >= 0))
+            return -EINVAL;
+        if (nn_slow (xsub->trie.root || xsub->topics.items))
+            return -EINVAL;
+        xsub->topic_length = val;
+        return 0;
+    }
+
+    if (option == NN_SUB_TOPIC_DELIMITER) {
+        if (nn_slow (optvallen != sizeof (int)))
+            return -EINVAL;
+        val = *(int*) optval;
+        if (nn_slow (val < -1 || val > 255))
+            return -EINVAL;
+        if (nn_slow (val >= 0 && xsub->topic_length > 0))
+            return -EINVAL;
+        if (nn_slow (xsub->trie.root || xsub->topics.items))
+            return -EINVAL;
+        xsub->topic_delimiter = val;
+        return 0;
     }
 
     return -ENOPROTOOPT;
 }
 
-static int nn_xsub_getopt (NN_UNUSED struct nn_sockbase *self,
-    NN_UNUSED int level, NN_UNUSED int option,
-    NN_UNUSED void *optval, NN_UNUSED size_t *optvallen)
+static int nn_xsub_getopt (struct nn_sockbase *self, int level, int option,
+    void *optval, size_t *optvallen)
 {
+    struct nn_xsub *xsub;
+
+    xsub = nn_cont (self, struct nn_xsub, sockbase);
+
+    if (level != NN_SUB)
+        return -ENOPROTOOPT;
+
+    if (option == NN_SUB_FORWARD) {
+        if (nn_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = xsub->forward;
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
+    if (option == NN_SUB_TOPIC_LENGTH) {
+        if (nn_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = xsub->topic_length;
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
+    if (option == NN_SUB_TOPIC_DELIMITER) {
+        if (nn_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = xsub->topic_delimiter;
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
     return -ENOPROTOOPT;
 }
 
@@ -35,6 +35,7 @@
 #include "../../utils/random.h"
 #include "../../utils/wire.h"
 #include "../../utils/list.h"
+#include "../../utils/hash.h"
 #include "../../utils/int.h"
 #include "../../utils/attr.h"
 
@@ -62,6 +63,44 @@
 #define NN_REQ_ACTION_PIPE_RM 6
 
 #define NN_REQ_SRC_RESEND_TIMER 1
+#define NN_REQ_SRC_TASK_TIMER 2
+
+/*  States of a request in the concurrent mode. */
+#define NN_REQ_TASK_DELAYED 1
+#define NN_REQ_TASK_ACTIVE 2
+#define NN_REQ_TASK_RESENDING 3
+#define NN_REQ_TASK_DONE 4
+
+/*  In the concurrent mode, each outstanding request is tracked by a task. */
+struct nn_req_task {
+
+    int state;
+
+    /*  The request ID (including the most significant bit) is used as
+        a key. */
+    struct nn_hash_item hitem;
+
+    /*  Item in the list of all outstanding requests. */
+    struct nn_list_item item;
+
+    /*  Item in the list of requests waiting for a peer to send them to. */
+    struct nn_list_item delayed;
+
+    /*  Stored request, so that it can be re-sent if needed. */
+    struct nn_msg request;
+
+    /*  Timer used to wait while request should be re-sent. */
+    struct nn_timer timer;
+
+    /*  Pipe the request has been sent to. Non-null only in ACTIVE state. */
+    struct nn_pipe *sent_to;
+};
+
+/*  Reply waiting to be received by the user in the concurrent mode. */
+struct nn_req_reply {
+    struct nn_list_item item;
+    struct nn_msg msg;
+};
 
 struct nn_req {
 
@@ -91,6 +130,25 @@ struct nn_req {
     /*  Pipe the current request has been sent to. Non-null only in ACTIVE
         state  */
     struct nn_pipe *sent_to;
+
+    /*  Maximum number of requests in flight. If set to 1, sending a new
+        request cancels the previous one and the state machine above is used.
+        Otherwise, each request is tracked by its own task. */
+    int concurrency;
+
+    /*  Outstanding requests in the concurrent mode. */
+    struct nn_hash tasks_by_id;
+    struct nn_list tasks;
+    int ntasks;
+
+    /*  Requests waiting for a peer to become available. */
+    struct nn_list delayed;
+
+    /*  Number of tasks with the timer that's not idle. */
+    int ntimers;
+
+    /*  Replies in the order they have arrived. */
+    struct nn_list replies;
 };
 
 /*  Private functions. */
@@ -103,6 +161,15 @@ static void nn_req_handler (struct nn_fsm *self, int src, int type,
 static void nn_req_shutdown (struct nn_fsm *self, int src, int type,
     void *srcptr);
 static void nn_req_action_send (struct nn_req *self, int allow_delay);
+static int nn_req_concurrent (struct nn_req *self);
+static int nn_req_task_send (struct nn_req *self, struct nn_req_task *task);
+static void nn_req_task_done (struct nn_req *self, struct nn_req_task *task);
+static void nn_req_task_free (struct nn_req_task *task);
+static void nn_req_task_handler (struct nn_req *self, int type,
+    struct nn_req_task *task);
+static void nn_req_in_concurrent (struct nn_req *self);
+static int nn_req_send_concurrent (struct nn_req *self, struct nn_msg *msg);
+static int nn_req_recv_concurrent (struct nn_req *self, struct nn_msg *msg);
 
 /*  Implementation of nn_sockbase's virtual functions. */
 static void nn_req_stop (struct nn_sockbase *self);
@@ -149,12 +216,36 @@ static void nn_req_init (struct nn_req *self,
     nn_timer_init (&self->timer, NN_REQ_SRC_RESEND_TIMER, &self->fsm);
     self->resend_ivl = NN_REQ_DEFAULT_RESEND_IVL;
 
+    self->concurrency = 1;
+    nn_hash_init (&self->tasks_by_id);
+    nn_list_init (&self->tasks);
+    self->ntasks = 0;
+    nn_list_init (&self->delayed);
+    self->ntimers = 0;
+    nn_list_init (&self->replies);
+
     /*  Start the state machine. */
     nn_fsm_start (&self->fsm);
 }
 
 static void nn_req_term (struct nn_req *self)
 {
+    struct nn_req_reply *reply;
+
+    /*  Deallocate the replies that were never received by the user. */
+    while (!nn_list_empty (&self->replies)) {
+        reply = nn_cont (nn_list_begin (&self->replies),
+            struct nn_req_reply, item);
+        nn_list_erase (&self->replies, &reply->item);
+        nn_list_item_term (&reply->item);
+        nn_msg_term (&reply->msg);
+        nn_free (reply);
+    }
+    nn_list_term (&self->replies);
+    nn_list_term (&self->delayed);
+    nn_list_term (&self->tasks);
+    nn_hash_term (&self->tasks_by_id);
+
     nn_timer_term (&self->timer);
     nn_msg_term (&self->reply);
     nn_msg_term (&self->request);
@@ -181,6 +272,11 @@ static void nn_req_destroy (struct nn_sockbase *self)
     nn_free (req);
 }
 
+static int nn_req_concurrent (struct nn_req *self)
+{
+    return self->concurrency > 1 ? 1 : 0;
+}
+
 static int nn_req_inprogress (struct nn_req *self)
 {
     /*  Return 1 if there's a request submitted. 0 otherwise. */
@@ -200,6 +296,11 @@ static void nn_req_in (struct nn_sockbase *self, struct nn_pipe *pipe)
     /*  Pass the pipe to the raw REQ socket. */
     nn_xreq_in (&req->xreq.sockbase, pipe);
 
+    if (nn_req_concurrent (req)) {
+        nn_req_in_concurrent (req);
+        return;
+    }
+
     while (1) {
 
         /*  Get new reply. */
@@ -254,6 +355,12 @@ static void nn_req_out (struct nn_sockbase *self, struct nn_pipe *pipe)
     /*  Add the pipe to the underlying raw socket. */
     nn_xreq_out (&req->xreq.sockbase, pipe);
 
+    /*  Send the requests that were waiting for a peer. */
+    while (!nn_list_empty (&req->delayed))
+        if (nn_req_task_send (req, nn_cont (nn_list_begin (&req->delayed),
+              struct nn_req_task, delayed)) < 0)
+            break;
+
     /*  Notify the state machine. */
     if (req->state == NN_REQ_STATE_DELAYED)
         nn_fsm_action (&req->fsm, NN_REQ_ACTION_OUT);
@@ -266,6 +373,15 @@ static int nn_req_events (struct nn_sockbase *self)
 
     req = nn_cont (self, struct nn_req, xreq.sockbase);
 
+    /*  In the concurrent mode, new requests can be sent only while the
+        maximum number of requests in flight is not reached. */
+    if (nn_req_concurrent (req)) {
+        rc = req->ntasks < req->concurrency ? NN_SOCKBASE_EVENT_OUT : 0;
+        if (!nn_list_empty (&req->replies))
+            rc |= NN_SOCKBASE_EVENT_IN;
+        return rc;
+    }
+
     /*  OUT is signalled all the time because sending a request while
         another one is being processed cancels the old one. */
     rc = NN_SOCKBASE_EVENT_OUT;
@@ -283,6 +399,11 @@ static int nn_req_send (struct nn_sockbase *self, struct nn_msg *msg)
 
     req = nn_cont (self, struct nn_req, xreq.sockbase);
 
+    /*  In the concurrent mode, wait till one of the outstanding requests
+        completes if the maximum number of requests in flight was reached. */
+    if (nn_req_concurrent (req) && req->ntasks >= req->concurrency)
+        return -EAGAIN;
+
     /*  Generate new request ID for the new request and put it into message
         header. The most important bit is set to 1 to indicate that this is
         the bottom of the backtrace stack. */
@@ -292,6 +413,9 @@ static int nn_req_send (struct nn_sockbase *self, struct nn_msg *msg)
     nn_chunkref_init (&msg->hdr, 4);
     nn_putl (nn_chunkref_data (&msg->hdr), req->reqid | 0x80000000);
 
+    if (nn_req_concurrent (req))
+        return nn_req_send_concurrent (req, msg);
+
     /*  Store the message so that it can be re-sent if there's no reply. */
     nn_msg_term (&req->request);
     nn_msg_mv (&req->request, msg);
@@ -308,6 +432,9 @@ static int nn_req_recv (struct nn_sockbase *self, struct nn_msg *msg)
 
     req = nn_cont (self, struct nn_req, xreq.sockbase);
 
+    if (nn_req_concurrent (req))
+        return nn_req_recv_concurrent (req, msg);
+
     /*  No request was sent. Waiting for a reply doesn't make sense. */
     if (nn_slow (!nn_req_inprogress (req)))
         return -EFSM;
@@ -330,6 +457,7 @@ static int nn_req_setopt (struct nn_sockbase *self, int level, int option,
         const void *optval, size_t optvallen)
 {
     struct nn_req *req;
+    int val;
 
     req = nn_cont (self, struct nn_req, xreq.sockbase);
 
@@ -343,7 +471,25 @@ static int nn_req_setopt (struct nn_sockbase *self, int level, int option,
         return 0;
     }
 
-    return -ENOPROTOOPT;
+    if (option == NN_REQ_CONCURRENCY) {
+        if (nn_slow (optvallen != sizeof (int)))
+            return -EINVAL;
+        val = *(int*) optval;
+        if (nn_slow (val < 1))
+            return -EINVAL;
+
+        /*  Switching between the two modes is possible only when there are
+            no requests in progress. */
+        if ((val > 1) != nn_req_concurrent (req)) {
+            if (nn_req_concurrent (req) ? (req->ntasks ||
+                  !nn_list_empty (&req->replies)) : nn_req_inprogress (req))
+                return -EFSM;
+        }
+        req->concurrency = val;
+        return 0;
+    }
+
+    return nn_xreq_setopt (self, level, option, optval, optvallen);
 }
 
 static int nn_req_getopt (struct nn_sockbase *self, int level, int option,
@@ -364,22 +510,50 @@ static int nn_req_getopt (struct nn_sockbase *self, int level, int option,
         return 0;
     }
 
-    return -ENOPROTOOPT;
+    if (option == NN_REQ_CONCURRENCY) {
+        if (nn_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = req->concurrency;
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
+    if (option == NN_REQ_ID) {
+        if (nn_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = (int) (req->reqid & 0x7fffffff);
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
+    return nn_xreq_getopt (self, level, option, optval, optvallen);
 }
 
 static void nn_req_shutdown (struct nn_fsm *self, int src, int type,
-    NN_UNUSED void *srcptr)
+    void *srcptr)
 {
     struct nn_req *req;
+    struct nn_req_task *task;
 
     req = nn_cont (self, struct nn_req, fsm);
 
     if (nn_slow (src == NN_FSM_ACTION && type == NN_FSM_STOP)) {
         nn_timer_stop (&req->timer);
+
+        /*  Cancel all the outstanding requests in the concurrent mode. */
+        while (!nn_list_empty (&req->tasks)) {
+            task = nn_cont (nn_list_begin (&req->tasks),
+                struct nn_req_task, item);
+            nn_req_task_done (req, task);
+        }
+
         req->state = NN_REQ_STATE_STOPPING;
     }
+    if (nn_slow (src == NN_REQ_SRC_TASK_TIMER))
+        nn_req_task_handler (req, type,
+            nn_cont (srcptr, struct nn_req_task, timer));
     if (nn_slow (req->state == NN_REQ_STATE_STOPPING)) {
-        if (!nn_timer_isidle (&req->timer))
+        if (!nn_timer_isidle (&req->timer) || req->ntimers)
             return;
         req->state = NN_REQ_STATE_IDLE;
         nn_fsm_stopped_noevent (&req->fsm);
@@ -391,12 +565,19 @@ static void nn_req_shutdown (struct nn_fsm *self, int src, int type,
 }
 
 static void nn_req_handler (struct nn_fsm *self, int src, int type,
-    NN_UNUSED void *srcptr)
+    void *srcptr)
 {
     struct nn_req *req;
 
     req = nn_cont (self, struct nn_req, fsm);
 
+    /*  Timers of individual requests in the concurrent mode. */
+    if (src == NN_REQ_SRC_TASK_TIMER) {
+        nn_req_task_handler (req, type,
+            nn_cont (srcptr, struct nn_req_task, timer));
+        return;
+    }
+
     switch (req->state) {
 
 /******************************************************************************/
@@ -684,6 +865,212 @@ static void nn_req_action_send (struct nn_req *self, int allow_delay)
     errnum_assert (0, -rc);
 }
 
+/******************************************************************************/
+/*  Concurrent mode.                                                          */
+/******************************************************************************/
+
+static int nn_req_send_concurrent (struct nn_req *self, struct nn_msg *msg)
+{
+    struct nn_req_task *task;
+
+    task = nn_alloc (sizeof (struct nn_req_task), "request (req)");
+    alloc_assert (task);
+    task->state = NN_REQ_TASK_DELAYED;
+    nn_hash_item_init (&task->hitem);
+    nn_list_item_init (&task->item);
+    nn_list_item_init (&task->delayed);
+    nn_msg_mv (&task->request, msg);
+    nn_timer_init (&task->timer, NN_REQ_SRC_TASK_TIMER, &self->fsm);
+    task->sent_to = NULL;
+
+    nn_hash_insert (&self->tasks_by_id, self->reqid | 0x80000000,
+        &task->hitem);
+    nn_list_insert (&self->tasks, &task->item, nn_list_end (&self->tasks));
+    ++self->ntasks;
+
+    /*  If there are older requests waiting for a peer, preserve the order. */
+    if (!nn_list_empty (&self->delayed)) {
+        nn_list_insert (&self->delayed, &task->delayed,
+            nn_list_end (&self->delayed));
+        return 0;
+    }
+
+    nn_req_task_send (self, task);
+    return 0;
+}
+
+static int nn_req_recv_concurrent (struct nn_req *self, struct nn_msg *msg)
+{
+    struct nn_req_reply *reply;
+
+    /*  No reply is available. If there's no request in flight, waiting for
+        a reply doesn't make sense. */
+    if (nn_list_empty (&self->replies))
+        return self->ntasks ? -EAGAIN : -EFSM;
+
+    /*  Pass the oldest reply to the caller. */
+    reply = nn_cont (nn_list_begin (&self->replies), struct nn_req_reply, item);
+    nn_list_erase (&self->replies, &reply->item);
+    nn_list_item_term (&reply->item);
+    nn_msg_mv (msg, &reply->msg);
+    nn_free (reply);
+
+    return 0;
+}
+
+static void nn_req_in_concurrent (struct nn_req *self)
+{
+    int rc;
+    uint32_t reqid;
+    struct nn_msg msg;
+    struct nn_hash_item *hitem;
+    struct nn_req_reply *reply;
+
+    while (1) {
+
+        /*  Get new reply. */
+        rc = nn_xreq_recv (&self->xreq.sockbase, &msg);
+        if (nn_slow (rc == -EAGAIN))
+            return;
+        errnum_assert (rc == 0, -rc);
+
+        /*  Ignore malformed replies. */
+        if (nn_slow (nn_chunkref_size (&msg.hdr) != sizeof (uint32_t))) {
+            nn_msg_term (&msg);
+            continue;
+        }
+
+        /*  Ignore replies to requests that are not outstanding, such as
+            a second reply to a request that was re-sent. */
+        reqid = nn_getl (nn_chunkref_data (&msg.hdr));
+        hitem = nn_hash_get (&self->tasks_by_id, reqid);
+        if (nn_slow (!hitem)) {
+            nn_msg_term (&msg);
+            continue;
+        }
+        nn_req_task_done (self, nn_cont (hitem, struct nn_req_task, hitem));
+
+        /*  Leave the request ID in the header so that the user is able to
+            match the reply with the request. */
+        nn_putl (nn_chunkref_data (&msg.hdr), reqid & 0x7fffffff);
+
+        /*  Store the reply till the user retrieves it. */
+        reply = nn_alloc (sizeof (struct nn_req_reply), "reply (req)");
+        alloc_assert (reply);
+        nn_list_item_init (&reply->item);
+        nn_msg_mv (&reply->msg, &msg);
+        nn_list_insert (&self->replies, &reply->item,
+            nn_list_end (&self->replies));
+    }
+}
+
+static int nn_req_task_send (struct nn_req *self, struct nn_req_task *task)
+{
+    int rc;
+    struct nn_msg msg;
+    struct nn_pipe *to;
+
+    /*  Send the request. */
+    nn_msg_cp (&msg, &task->request);
+    rc = nn_xreq_send_to (&self->xreq.sockbase, &msg, &to);
+
+    /*  If the request cannot be sent at the moment wait till
+        new outbound pipe arrives. */
+    if (nn_slow (rc == -EAGAIN)) {
+        nn_msg_term (&msg);
+        if (!nn_list_item_isinlist (&task->delayed))
+            nn_list_insert (&self->delayed, &task->delayed,
+                nn_list_end (&self->delayed));
+        task->state = NN_REQ_TASK_DELAYED;
+        return -EAGAIN;
+    }
+    errnum_assert (rc == 0, -rc);
+
+    /*  Request was successfully sent. Set up the re-send timer. */
+    if (nn_list_item_isinlist (&task->delayed))
+        nn_list_erase (&self->delayed, &task->delayed);
+    nn_timer_start (&task->timer, self->resend_ivl);
+    ++self->ntimers;
+    nn_assert (to);
+    task->sent_to = to;
+    task->state = NN_REQ_TASK_ACTIVE;
+    return 0;
+}
+
+static void nn_req_task_done (struct nn_req *self, struct nn_req_task *task)
+{
+    /*  The request is not outstanding any more. */
+    nn_hash_erase (&self->tasks_by_id, &task->hitem);
+    nn_list_erase (&self->tasks, &task->item);
+    --self->ntasks;
+    if (nn_list_item_isinlist (&task->delayed))
+        nn_list_erase (&self->delayed, &task->delayed);
+
+    switch (task->state) {
+    case NN_REQ_TASK_DELAYED:
+
+        /*  Timer is not running. The task can be deallocated straight
+            away. */
+        nn_req_task_free (task);
+        return;
+
+    case NN_REQ_TASK_ACTIVE:
+        nn_timer_stop (&task->timer);
+        task->sent_to = NULL;
+        task->state = NN_REQ_TASK_DONE;
+        return;
+
+    case NN_REQ_TASK_RESENDING:
+
+        /*  Timer is already being stopped. */
+        task->state = NN_REQ_TASK_DONE;
+        return;
+
+    default:
+        nn_assert (0);
+    }
+}
+
+static void nn_req_task_free (struct nn_req_task *task)
+{
+    nn_timer_term (&task->timer);
+    nn_msg_term (&task->request);
+    nn_list_item_term (&task->delayed);
+    nn_list_item_term (&task->item);
+    nn_hash_item_term (&task->hitem);
+    nn_free (task);
+}
+
+static void nn_req_task_handler (struct nn_req *self, int type,
+    struct nn_req_task *task)
+{
+    switch (type) {
+    case NN_TIMER_TIMEOUT:
+
+        /*  The reply haven't arrived in time. Re-send the request once the
+            timer is stopped. Timeouts of completed requests are ignored. */
+        if (task->state != NN_REQ_TASK_ACTIVE)
+            return;
+        nn_timer_stop (&task->timer);
+        task->sent_to = NULL;
+        task->state = NN_REQ_TASK_RESENDING;
+        return;
+
+    case NN_TIMER_STOPPED:
+        --self->ntimers;
+        if (task->state == NN_REQ_TASK_RESENDING) {
+            nn_req_task_send (self, task);
+            return;
+        }
+        nn_assert (task->state == NN_REQ_TASK_DONE);
+        nn_req_task_free (task);
+        return;
+
+    default:
+        nn_fsm_bad_action (self->state, NN_REQ_SRC_TASK_TIMER, type);
+    }
+}
+
 static int nn_req_create (void *hint, struct nn_sockbase **sockbase)
 {
     struct nn_req *self;
@@ -698,6 +1085,8 @@ static int nn_req_create (void *hint, struct nn_sockbase **sockbase)
 
 void nn_req_rm (struct nn_sockbase *self, struct nn_pipe *pipe) {
     struct nn_req *req;
+    struct nn_list_item *it;
+    struct nn_req_task *task;
 
     req = nn_cont (self, struct nn_req, xreq.sockbase);
 
@@ -705,6 +1094,18 @@ void nn_req_rm (struct nn_sockbase *self, struct nn_pipe *pipe) {
     if (nn_slow (pipe == req->sent_to)) {
         nn_fsm_action (&req->fsm, NN_REQ_ACTION_PIPE_RM);
     }
+
+    /*  Re-send the requests that were sent to the removed pipe straight
+        away rather than waiting for the resend interval. */
+    for (it = nn_list_begin (&req->tasks); it != nn_list_end (&req->tasks);
+          it = nn_list_next (&req->tasks, it)) {
+        task = nn_cont (it, struct nn_req_task, item);
+        if (task->state == NN_REQ_TASK_ACTIVE && task->sent_to == pipe) {
+            nn_timer_stop (&task->timer);
+            task->sent_to = NULL;
+            task->state = NN_REQ_TASK_RESENDING;
+        }
+    }
 }
 
 static struct nn_socktype nn_req_socktype_struct = {
@@ -158,25 +158,42 @@ int nn_xreq_send_to (struct nn_sockbase *self, struct nn_msg *msg,
     struct nn_pipe **to)
 {
     int rc;
+    struct nn_pipe *pipe;
+    struct nn_xreq_data *data;
 
     /*  If request cannot be sent due to the pushback, drop it silenly. */
-    rc = nn_lb_send (&nn_cont (self, struct nn_xreq, sockbase)->lb, msg, to);
+    rc = nn_lb_send (&nn_cont (self, struct nn_xreq, sockbase)->lb, msg,
+        &pipe);
     if (nn_slow (rc == -EAGAIN))
         return -EAGAIN;
     errnum_assert (rc >= 0, -rc);
 
+    /*  Account for the request so that load-aware policies can steer
+        subsequent requests away from the peers that are slow to reply. */
+    data = nn_pipe_getdata (pipe);
+    nn_lb_outstanding (&data->lb, 1);
+
+    if (to != NULL)
+        *to = pipe;
+
     return 0;
 }
 
 int nn_xreq_recv (struct nn_sockbase *self, struct nn_msg *msg)
 {
     int rc;
+    struct nn_pipe *pipe;
+    struct nn_xreq_data *data;
 
-    rc = nn_fq_recv (&nn_cont (self, struct nn_xreq, sockbase)->fq, msg, NULL);
+    rc = nn_fq_recv (&nn_cont (self, struct nn_xreq, sockbase)->fq, msg, &pipe);
     if (rc == -EAGAIN)
         return -EAGAIN;
     errnum_assert (rc >= 0, -rc);
 
+    /*  The peer has replied, one request less is pending on it. */
+    data = nn_pipe_getdata (pipe);
+    nn_lb_outstanding (&data->lb, -1);
+
     if (!(rc & NN_PIPE_PARSED)) {
 
         /*  Ignore malformed replies. */
@@ -197,17 +214,37 @@ int nn_xreq_recv (struct nn_sockbase *self, struct nn_msg *msg)
     return 0;
 }
 
-int nn_xreq_setopt (NN_UNUSED struct nn_sockbase *self,
-    NN_UNUSED int level, NN_UNUSED int option,
-    NN_UNUSED const void *optval, NN_UNUSED size_t optvallen)
+int nn_xreq_setopt (struct nn_sockbase *self, int level, int option,
+    const void *optval, size_t optvallen)
 {
+    struct nn_xreq *xreq;
+
+    xreq = nn_cont (self, struct nn_xreq, sockbase);
+
+    if (level == NN_REQ && option == NN_REQ_LB_POLICY) {
+        if (nn_slow (optvallen != sizeof (int)))
+            return -EINVAL;
+        return nn_lb_set_policy (&xreq->lb, *(int*) optval);
+    }
+
     return -ENOPROTOOPT;
 }
 
-int nn_xreq_getopt (NN_UNUSED struct nn_sockbase *self,
-    NN_UNUSED int level, NN_UNUSED int option,
-    NN_UNUSED void *optval, NN_UNUSED size_t *optvallen)
+int nn_xreq_getopt (struct nn_sockbase *self, int level, int option,
+    void *optval, size_t *optvallen)
 {
+    struct nn_xreq *xreq;
+
+    xreq = nn_cont (self, struct nn_xreq, sockbase);
+
+    if (level == NN_REQ && option == NN_REQ_LB_POLICY) {
+        if (nn_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = nn_lb_get_policy (&xreq->lb);
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
     return -ENOPROTOOPT;
 }
 
@@ -108,3 +108,54 @@ int nn_dist_send (struct nn_dist *self, struct nn_msg *msg,
     return 0;
 }
 
+int nn_dist_send_filtered (struct nn_dist *self, struct nn_msg *msg,
+    nn_dist_filter_fn filter)
+{
+    int rc;
+    struct nn_list_item *it;
+    struct nn_dist_data *data;
+    struct nn_msg copy;
+
+    /*  As only a fraction of the pipes is expected to match, message is
+        copied for each matching pipe rather than bulk-copied upfront. */
+    it = nn_list_begin (&self->pipes);
+    while (it != nn_list_end (&self->pipes)) {
+       data = nn_cont (it, struct nn_dist_data, item);
+       if (!filter (data, msg)) {
+           it = nn_list_next (&self->pipes, it);
+           continue;
+       }
+       nn_msg_cp (&copy, msg);
+       rc = nn_pipe_send (data->pipe, &copy);
+       errnum_assert (rc >= 0, -rc);
+       if (rc & NN_PIPE_RELEASE) {
+           --self->count;
+           it = nn_list_erase (&self->pipes, it);
+           continue;
+       }
+       it = nn_list_next (&self->pipes, it);
+    }
+    nn_msg_term (msg);
+
+    return 0;
+}
+
+int nn_dist_writable (NN_UNUSED struct nn_dist *self,
+    struct nn_dist_data *data)
+{
+    return nn_list_item_isinlist (&data->item) ? 1 : 0;
+}
+
+void nn_dist_send_to (struct nn_dist *self, struct nn_dist_data *data,
+    struct nn_msg *msg)
+{
+    int rc;
+
+    nn_assert (nn_list_item_isinlist (&data->item));
+    rc = nn_pipe_send (data->pipe, msg);
+    errnum_assert (rc >= 0, -rc);
+    if (rc & NN_PIPE_RELEASE) {
+        --self->count;
+        nn_list_erase (&self->pipes, &data->item);
+    }
+}
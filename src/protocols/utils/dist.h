@@ -54,4 +54,18 @@ void nn_dist_out (struct nn_dist *self, struct nn_pipe *pipe,
 int nn_dist_send (struct nn_dist *self, struct nn_msg *msg,
     struct nn_pipe *exclude);
 
+/*  Sends the message to the attached pipes for which 'filter' function
+    returns non-zero. */
+typedef int (*nn_dist_filter_fn) (struct nn_dist_data *data,
+    struct nn_msg *msg);
+int nn_dist_send_filtered (struct nn_dist *self, struct nn_msg *msg,
+    nn_dist_filter_fn filter);
+
+/*  Returns 1 if the pipe is ready to accept a message, 0 otherwise. */
+int nn_dist_writable (struct nn_dist *self, struct nn_dist_data *data);
+
+/*  Sends the message to a single writable pipe. */
+void nn_dist_send_to (struct nn_dist *self, struct nn_dist_data *data,
+    struct nn_msg *msg);
+
 #endif
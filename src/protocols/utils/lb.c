@@ -22,14 +22,30 @@
 
 #include "lb.h"
 
+#include "../../nn.h"
+
 #include "../../utils/err.h"
 #include "../../utils/cont.h"
+#include "../../utils/fast.h"
+#include "../../utils/random.h"
 
 #include <stddef.h>
 
+/*  Maximal distance between the two candidates of NN_LB_TWO_CHOICES policy,
+    measured in pipes. */
+#define NN_LB_MAX_STRIDE 8
+
+/*  Private functions. */
+static int nn_lb_cmp (struct nn_priolist_data *a, struct nn_priolist_data *b);
+static struct nn_priolist_data *nn_lb_choose (struct nn_lb *self,
+    struct nn_priolist_data *current);
+
 void nn_lb_init (struct nn_lb *self)
 {
     nn_priolist_init (&self->priolist);
+    self->policy = NN_LB_ROUND_ROBIN;
+    nn_random_generate (&self->rnd, sizeof (self->rnd));
+    self->rnd |= 1;
 }
 
 void nn_lb_term (struct nn_lb *self)
@@ -37,9 +53,24 @@ void nn_lb_term (struct nn_lb *self)
     nn_priolist_term (&self->priolist);
 }
 
+int nn_lb_set_policy (struct nn_lb *self, int policy)
+{
+    if (nn_slow (policy != NN_LB_ROUND_ROBIN &&
+          policy != NN_LB_TWO_CHOICES && policy != NN_LB_LEAST_LOADED))
+        return -EINVAL;
+    self->policy = policy;
+    return 0;
+}
+
+int nn_lb_get_policy (struct nn_lb *self)
+{
+    return self->policy;
+}
+
 void nn_lb_add (struct nn_lb *self, struct nn_pipe *pipe,
     struct nn_lb_data *data, int priority)
 {
+    data->outstanding = 0;
     nn_priolist_add (&self->priolist, pipe, &data->priolist, priority);
 }
 
@@ -68,19 +99,32 @@ int nn_lb_get_priority (struct nn_lb *self)
 int nn_lb_send (struct nn_lb *self, struct nn_msg *msg, struct nn_pipe **to)
 {
     int rc;
+    struct nn_priolist_data *current;
+    struct nn_priolist_data *data;
     struct nn_pipe *pipe;
 
-    /*  Pipe is NULL only when there are no avialable pipes. */
-    pipe = nn_priolist_getpipe (&self->priolist);
-    if (nn_slow (!pipe))
+    /*  Data is NULL only when there are no avialable pipes. */
+    current = nn_priolist_getdata (&self->priolist);
+    if (nn_slow (!current))
         return -EAGAIN;
+    data = current;
+    if (self->policy != NN_LB_ROUND_ROBIN)
+        data = nn_lb_choose (self, current);
+    pipe = data->pipe;
 
     /*  Send the messsage. */
     rc = nn_pipe_send (pipe, msg);
     errnum_assert (rc >= 0, -rc);
 
-    /*  Move to the next pipe. */
-    nn_priolist_advance (&self->priolist, rc & NN_PIPE_RELEASE);
+    /*  Move to the next pipe. If the message went elsewhere than to the
+        current pipe, the chosen pipe may have to be deactivated on its own. */
+    if (data == current)
+        nn_priolist_advance (&self->priolist, rc & NN_PIPE_RELEASE);
+    else {
+        if (rc & NN_PIPE_RELEASE)
+            nn_priolist_deactivate (&self->priolist, data);
+        nn_priolist_advance (&self->priolist, 0);
+    }
 
     if (to != NULL)
         *to = pipe;
@@ -88,3 +132,64 @@ int nn_lb_send (struct nn_lb *self, struct nn_msg *msg, struct nn_pipe **to)
     return rc & ~NN_PIPE_RELEASE;
 }
 
+void nn_lb_outstanding (struct nn_lb_data *data, int delta)
+{
+    if (delta < 0 && data->outstanding < (uint32_t) -delta)
+        data->outstanding = 0;
+    else
+        data->outstanding += delta;
+}
+
+static int nn_lb_cmp (struct nn_priolist_data *a, struct nn_priolist_data *b)
+{
+    struct nn_lb_data *da;
+    struct nn_lb_data *db;
+    size_t ba;
+    size_t bb;
+
+    da = nn_cont (a, struct nn_lb_data, priolist);
+    db = nn_cont (b, struct nn_lb_data, priolist);
+    if (da->outstanding != db->outstanding)
+        return da->outstanding < db->outstanding ? -1 : 1;
+    ba = nn_pipe_backlog (a->pipe);
+    bb = nn_pipe_backlog (b->pipe);
+    if (ba != bb)
+        return ba < bb ? -1 : 1;
+    return 0;
+}
+
+static struct nn_priolist_data *nn_lb_choose (struct nn_lb *self,
+    struct nn_priolist_data *current)
+{
+    struct nn_priolist_data *best;
+    struct nn_priolist_data *it;
+    int steps;
+
+    best = current;
+
+    if (self->policy == NN_LB_TWO_CHOICES) {
+
+        /*  The second candidate is a random pipe a few steps ahead of the
+            current one. Ties go to the current pipe so that evenly loaded
+            pipes are still served in round-robin order. */
+        self->rnd ^= self->rnd << 13;
+        self->rnd ^= self->rnd >> 17;
+        self->rnd ^= self->rnd << 5;
+        steps = 1 + (int) (self->rnd % NN_LB_MAX_STRIDE);
+        it = current;
+        while (steps--)
+            it = nn_priolist_next (&self->priolist, it);
+        if (nn_lb_cmp (it, current) < 0)
+            best = it;
+        return best;
+    }
+
+    /*  NN_LB_LEAST_LOADED: scan all the pipes of the current priority. */
+    for (it = nn_priolist_next (&self->priolist, current); it != current;
+          it = nn_priolist_next (&self->priolist, it)) {
+        if (nn_lb_cmp (it, best) < 0)
+            best = it;
+    }
+    return best;
+}
+
@@ -27,18 +27,30 @@
 
 #include "priolist.h"
 
-/*  A load balancer. Round-robins messages to a set of pipes. */
+#include <stdint.h>
+
+/*  A load balancer. By default it round-robins messages to a set of pipes.
+    Alternatively, it can prefer the less loaded pipe out of two candidates
+    (NN_LB_TWO_CHOICES) or the least loaded pipe of the current priority
+    (NN_LB_LEAST_LOADED). Load of a pipe is the number of requests awaiting
+    the reply from it (as reported by the user via nn_lb_outstanding) and,
+    on a tie, the amount of data queued in the transport. */
 
 struct nn_lb_data {
     struct nn_priolist_data priolist;
+    uint32_t outstanding;
 };
 
 struct nn_lb {
     struct nn_priolist priolist;
+    int policy;
+    uint32_t rnd;
 };
 
 void nn_lb_init (struct nn_lb *self);
 void nn_lb_term (struct nn_lb *self);
+int nn_lb_set_policy (struct nn_lb *self, int policy);
+int nn_lb_get_policy (struct nn_lb *self);
 void nn_lb_add (struct nn_lb *self, struct nn_pipe *pipe,
     struct nn_lb_data *data, int priority);
 void nn_lb_rm (struct nn_lb *self, struct nn_pipe *pipe,
@@ -49,4 +61,7 @@ int nn_lb_can_send (struct nn_lb *self);
 int nn_lb_get_priority (struct nn_lb *self);
 int nn_lb_send (struct nn_lb *self, struct nn_msg *msg, struct nn_pipe **to);
 
+/*  Adjusts the number of requests outstanding on the pipe. */
+void nn_lb_outstanding (struct nn_lb_data *data, int delta);
+
 #endif
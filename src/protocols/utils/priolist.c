@@ -59,29 +59,30 @@ void nn_priolist_add (NN_UNUSED struct nn_priolist *self, struct nn_pipe *pipe,
 
 void nn_priolist_rm (struct nn_priolist *self, NN_UNUSED struct nn_pipe *pipe,
     struct nn_priolist_data *data)
+{
+    /*  Non-active pipes don't need any special processing. */
+    if (nn_list_item_isinlist (&data->item))
+        nn_priolist_deactivate (self, data);
+    nn_list_item_term (&data->item);
+}
+
+void nn_priolist_deactivate (struct nn_priolist *self,
+    struct nn_priolist_data *data)
 {
     struct nn_priolist_slot *slot;
     struct nn_list_item *it;
 
-    /*  Non-active pipes don't need any special processing. */
-    if (!nn_list_item_isinlist (&data->item)) {
-        nn_list_item_term (&data->item);
-        return;
-    }
-
     /*  If the pipe being removed is not current, we can simply erase it
         from the list. */
     slot = &self->slots [data->priority - 1];
     if (slot->current != data) {
         nn_list_erase (&slot->pipes, &data->item);
-        nn_list_item_term (&data->item);
         return;
     }
 
     /*  Advance the current pointer (with wrap-over). */
     it = nn_list_erase (&slot->pipes, &data->item);
     slot->current = nn_cont (it, struct nn_priolist_data, item);
-    nn_list_item_term (&data->item);
     if (!slot->current) {
         it = nn_list_begin (&slot->pipes);
         slot->current = nn_cont (it, struct nn_priolist_data, item);
@@ -147,6 +148,26 @@ struct nn_pipe *nn_priolist_getpipe (struct nn_priolist *self)
     return self->slots [self->current - 1].current->pipe;
 }
 
+struct nn_priolist_data *nn_priolist_getdata (struct nn_priolist *self)
+{
+    if (nn_slow (self->current == -1))
+        return NULL;
+    return self->slots [self->current - 1].current;
+}
+
+struct nn_priolist_data *nn_priolist_next (struct nn_priolist *self,
+    struct nn_priolist_data *data)
+{
+    struct nn_priolist_slot *slot;
+    struct nn_list_item *it;
+
+    slot = &self->slots [data->priority - 1];
+    it = nn_list_next (&slot->pipes, &data->item);
+    if (!it)
+        it = nn_list_begin (&slot->pipes);
+    return nn_cont (it, struct nn_priolist_data, item);
+}
+
 void nn_priolist_advance (struct nn_priolist *self, int release)
 {
     struct nn_priolist_slot *slot;
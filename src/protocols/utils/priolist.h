@@ -85,6 +85,11 @@ void nn_priolist_rm (struct nn_priolist *self, struct nn_pipe *pipe,
 void nn_priolist_activate (struct nn_priolist *self, struct nn_pipe *pipe,
     struct nn_priolist_data *data);
 
+/*  Deactivates an active pipe. To re-activate it use nn_priolist_activate
+    function. */
+void nn_priolist_deactivate (struct nn_priolist *self,
+    struct nn_priolist_data *data);
+
 /*  Returns 1 if there's at least a single active pipe in the list,
     0 otherwise. */
 int nn_priolist_is_active (struct nn_priolist *self);
@@ -93,6 +98,14 @@ int nn_priolist_is_active (struct nn_priolist *self);
     NULL is returned. */
 struct nn_pipe *nn_priolist_getpipe (struct nn_priolist *self);
 
+/*  Same as nn_priolist_getpipe, but returns the pipe's data. */
+struct nn_priolist_data *nn_priolist_getdata (struct nn_priolist *self);
+
+/*  Returns the active pipe that follows 'data' within the same priority
+    level, wrapping around at the end. */
+struct nn_priolist_data *nn_priolist_next (struct nn_priolist *self,
+    struct nn_priolist_data *data);
+
 /*  Moves to the next pipe in the list. If 'release' is set to 1, the current
     pipe is removed from the list. To re-insert it into thr list use
     nn_priolist_activate function. */
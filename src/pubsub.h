@@ -32,8 +32,15 @@ extern "C" {
 #define NN_PUB (NN_PROTO_PUBSUB * 16 + 0)
 #define NN_SUB (NN_PROTO_PUBSUB * 16 + 1)
 
+#define NN_PUB_CONFLATE 1
+#define NN_PUB_TOPIC_LENGTH 2
+#define NN_PUB_TOPIC_DELIMITER 3
+
 #define NN_SUB_SUBSCRIBE 1
 #define NN_SUB_UNSUBSCRIBE 2
+#define NN_SUB_FORWARD 3
+#define NN_SUB_TOPIC_LENGTH 4
+#define NN_SUB_TOPIC_DELIMITER 5
 
 #ifdef __cplusplus
 }
@@ -33,6 +33,9 @@ extern "C" {
 #define NN_REP (NN_PROTO_REQREP * 16 + 1)
 
 #define NN_REQ_RESEND_IVL 1
+#define NN_REQ_CONCURRENCY 2
+#define NN_REQ_ID 3
+#define NN_REQ_LB_POLICY 4
 
 #ifdef __cplusplus
 }
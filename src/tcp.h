@@ -30,6 +30,9 @@ extern "C" {
 #define NN_TCP -3
 
 #define NN_TCP_NODELAY 1
+#define NN_TCP_ZEROCOPY 2
+#define NN_TCP_COMPRESS 3
+#define NN_TCP_COMPRESS_THRESHOLD 4
 
 #ifdef __cplusplus
 }
@@ -116,7 +116,8 @@ void nn_epbase_set_error(struct nn_epbase *self, int errnum);
 void nn_epbase_clear_error(struct nn_epbase *self);
 
 /*  Increments statistics counters in the socket structure  */
-void nn_epbase_stat_increment(struct nn_epbase *self, int name, int increment);
+void nn_epbase_stat_increment(struct nn_epbase *self, int name,
+    int64_t increment);
 
 
 #define NN_STAT_ESTABLISHED_CONNECTIONS 101
@@ -126,6 +127,10 @@ void nn_epbase_stat_increment(struct nn_epbase *self, int name, int increment);
 #define NN_STAT_CONNECT_ERRORS          105
 #define NN_STAT_BIND_ERRORS             106
 #define NN_STAT_ACCEPT_ERRORS           107
+#define NN_STAT_COMPRESS_BYTES_IN       108
+#define NN_STAT_COMPRESS_BYTES_OUT      109
+#define NN_STAT_COMPRESS_TIME           110
+#define NN_STAT_DECOMPRESS_TIME         111
 
 #define NN_STAT_CURRENT_CONNECTIONS     201
 #define NN_STAT_INPROGRESS_CONNECTIONS  202
@@ -164,6 +169,11 @@ struct nn_pipebase_vfptr {
     /*  Receive a message from the network. The function can return either error
         (negative number) or any combination of the flags defined above. */
     int (*recv) (struct nn_pipebase *self, struct nn_msg *msg);
+
+    /*  Returns the number of bytes sent to the pipe that haven't made it to
+        the peer yet, as far as the transport can tell. Can be NULL if the
+        transport doesn't keep track of this. */
+    size_t (*backlog) (struct nn_pipebase *self);
 };
 
 /*  Endpoint specific options. Same restrictions as for nn_pipebase apply  */
@@ -215,6 +225,10 @@ void nn_pipebase_getopt (struct nn_pipebase *self, int level, int option,
     or 0 otherwise. */
 int nn_pipebase_ispeer (struct nn_pipebase *self, int socktype);
 
+/*  Increments statistics counters in the socket structure. */
+void nn_pipebase_stat_increment (struct nn_pipebase *self, int name,
+    int64_t increment);
+
 /******************************************************************************/
 /*  The transport class.                                                      */
 /******************************************************************************/
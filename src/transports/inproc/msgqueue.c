@@ -28,13 +28,28 @@
 
 #include <string.h>
 
+/*  Size of the message as accounted for in the 'mem' counter. Capping it at
+    maxmem makes sure that the counter never exceeds 2 * maxmem and thus
+    fits into 32 bits. */
+static uint32_t nn_msgqueue_msgsize (struct nn_msgqueue *self,
+    struct nn_msg *msg);
+
+/*  Makes the messages written by the writer so far visible to the reader.
+    Returns the number of messages available for reading. */
+static uint32_t nn_msgqueue_refresh (struct nn_msgqueue *self);
+
 void nn_msgqueue_init (struct nn_msgqueue *self, size_t maxmem)
 {
     struct nn_msgqueue_chunk *chunk;
 
-    self->count = 0;
-    self->mem = 0;
-    self->maxmem = maxmem;
+    self->avail = 0;
+    self->consumed = 0;
+    nn_atomic_init (&self->count, 0);
+    nn_atomic_init (&self->mem, 0);
+    nn_assert (maxmem > 0 && maxmem < 0x80000000);
+    self->maxmem = (uint32_t) maxmem;
+    nn_atomic_init (&self->rwaiting, 1);
+    nn_atomic_init (&self->wwaiting, 0);
 
     chunk = nn_alloc (sizeof (struct nn_msgqueue_chunk), "msgqueue chunk");
     alloc_assert (chunk);
@@ -44,8 +59,6 @@ void nn_msgqueue_init (struct nn_msgqueue *self, size_t maxmem)
     self->out.pos = 0;
     self->in.chunk = chunk;
     self->in.pos = 0;
-
-    self->cache = NULL;
 }
 
 void nn_msgqueue_term (struct nn_msgqueue *self)
@@ -67,63 +80,79 @@ void nn_msgqueue_term (struct nn_msgqueue *self)
     nn_assert (self->in.chunk == self->out.chunk);
     nn_free (self->in.chunk);
 
-    /*  Deallocate the cached chunk, if any. */
-    if (self->cache)
-        nn_free (self->cache);
-}
-
-int nn_msgqueue_empty (struct nn_msgqueue *self)
-{
-    return self->count == 0 ? 1 : 0;
+    nn_atomic_term (&self->wwaiting);
+    nn_atomic_term (&self->rwaiting);
+    nn_atomic_term (&self->mem);
+    nn_atomic_term (&self->count);
 }
 
 int nn_msgqueue_send (struct nn_msgqueue *self, struct nn_msg *msg)
 {
-    size_t msgsz;
-
-    /*  By allowing one message of arbitrary size to be written to the queue,
-        we allow even messages that exceed max buffer size to pass through.
-        Beyond that we'll apply the buffer limit as specified by the user. */
-    msgsz = nn_chunkref_size (&msg->hdr) + nn_chunkref_size (&msg->body);
-    if (nn_slow (self->count > 0 && self->mem + msgsz >= self->maxmem))
-        return -EAGAIN;
+    struct nn_msgqueue_chunk *chunk;
 
-    /*  Adjust the statistics. */
-    ++self->count;
-    self->mem += msgsz;
+    nn_atomic_inc (&self->mem, nn_msgqueue_msgsize (self, msg));
 
     /*  Move the content of the message to the pipe. */
     nn_msg_mv (&self->out.chunk->msgs [self->out.pos], msg);
     ++self->out.pos;
 
-    /*  If there's no space for a new message in the pipe, either re-use
-        the cache chunk or allocate a new chunk if it does not exist. */
+    /*  If there's no space for a new message in the pipe, allocate a new
+        chunk. It has to be linked to the current one before the message is
+        published as the reader moves to the next chunk straight away after
+        reading the last message in the current one. */
     if (nn_slow (self->out.pos == NN_MSGQUEUE_GRANULARITY)) {
-        if (nn_slow (!self->cache)) {
-            self->cache = nn_alloc (sizeof (struct nn_msgqueue_chunk),
-                "msgqueue chunk");
-            alloc_assert (self->cache);
-            self->cache->next = NULL;
-        }
-        self->out.chunk->next = self->cache;
-        self->out.chunk = self->cache;
-        self->cache = NULL;
+        chunk = nn_alloc (sizeof (struct nn_msgqueue_chunk),
+            "msgqueue chunk");
+        alloc_assert (chunk);
+        chunk->next = NULL;
+        self->out.chunk->next = chunk;
+        self->out.chunk = chunk;
         self->out.pos = 0;
     }
 
+    /*  Publish the message. Atomic operation acts as a full memory barrier
+        so the reader's flag is read only after the message is visible.
+        Given that the reader checks for messages after setting the flag,
+        at least one side notices the other. CAS makes sure that the reader
+        is woken up at most once. */
+    nn_atomic_inc (&self->count, 1);
+    if (self->rwaiting.n && nn_atomic_cas (&self->rwaiting, 1, 0) == 1)
+        return 1;
+    return 0;
+}
+
+int nn_msgqueue_writable (struct nn_msgqueue *self)
+{
+    if (nn_fast (self->mem.n < self->maxmem))
+        return 1;
+
+    /*  The pipe is full. Register as waiting and check once again to make
+        sure that the reader haven't freed some space in the meantime. */
+    nn_atomic_cas (&self->wwaiting, 0, 1);
+    if (nn_atomic_inc (&self->mem, 0) < self->maxmem &&
+          nn_atomic_cas (&self->wwaiting, 1, 0) == 1)
+        return 1;
     return 0;
 }
 
+size_t nn_msgqueue_mem (struct nn_msgqueue *self)
+{
+    return self->mem.n;
+}
+
 int nn_msgqueue_recv (struct nn_msgqueue *self, struct nn_msg *msg)
 {
+    uint32_t sz;
     struct nn_msgqueue_chunk *o;
 
     /*  If there is no message in the queue. */
-    if (nn_slow (!self->count))
+    if (nn_slow (!self->avail && !nn_msgqueue_refresh (self)))
         return -EAGAIN;
 
     /*  Move the message from the pipe to the user. */
     nn_msg_mv (msg, &self->in.chunk->msgs [self->in.pos]);
+    --self->avail;
+    ++self->consumed;
 
     /*  Move to the next position. */
     ++self->in.pos;
@@ -131,16 +160,45 @@ int nn_msgqueue_recv (struct nn_msgqueue *self, struct nn_msg *msg)
         o = self->in.chunk;
         self->in.chunk = self->in.chunk->next;
         self->in.pos = 0;
-        if (nn_fast (!self->cache))
-            self->cache = o;
-        else
-            nn_free (o);
+        nn_free (o);
     }
 
-    /*  Adjust the statistics. */
-    --self->count;
-    self->mem -= (nn_chunkref_size (&msg->hdr) + nn_chunkref_size (&msg->body));
+    /*  Release the memory and wake up the writer if it waits for it. */
+    sz = nn_msgqueue_msgsize (self, msg);
+    if (nn_atomic_dec (&self->mem, sz) - sz < self->maxmem &&
+          self->wwaiting.n && nn_atomic_cas (&self->wwaiting, 1, 0) == 1)
+        return 1;
+    return 0;
+}
 
+int nn_msgqueue_readable (struct nn_msgqueue *self)
+{
+    if (nn_fast (self->avail || nn_msgqueue_refresh (self)))
+        return 1;
+
+    /*  The pipe is empty. Register as waiting and check once again to make
+        sure that the writer haven't written a message in the meantime. */
+    nn_atomic_cas (&self->rwaiting, 0, 1);
+    if (nn_msgqueue_refresh (self) &&
+          nn_atomic_cas (&self->rwaiting, 1, 0) == 1)
+        return 1;
     return 0;
 }
 
+static uint32_t nn_msgqueue_msgsize (struct nn_msgqueue *self,
+    struct nn_msg *msg)
+{
+    size_t sz;
+
+    sz = nn_chunkref_size (&msg->hdr) + nn_chunkref_size (&msg->body);
+    return sz < self->maxmem ? (uint32_t) sz : self->maxmem;
+}
+
+static uint32_t nn_msgqueue_refresh (struct nn_msgqueue *self)
+{
+    self->avail = nn_atomic_dec (&self->count, self->consumed) -
+        self->consumed;
+    self->consumed = 0;
+    return self->avail;
+}
+
@@ -24,10 +24,16 @@
 #define NN_MSGQUEUE_INCLUDED
 
 #include "../../utils/msg.h"
+#include "../../utils/atomic.h"
 
 #include <stddef.h>
 
-/*  This class is a simple uni-directional message queue. */
+/*  This class is a uni-directional message queue. It is lock-free as long as
+    there's a single writer and a single reader, each of them possibly running
+    in a different thread. The writer can ask whether there's space left in
+    the queue and the reader whether there are messages to read. If there's
+    none, the asking party is registered as waiting and the other party is
+    told to wake it up once the situation changes. */
 
 /*  It's not 128 so that chunk including its footer fits into a memory page. */
 #define NN_MSGQUEUE_GRANULARITY 126
@@ -40,47 +46,69 @@ struct nn_msgqueue_chunk {
 struct nn_msgqueue {
 
     /*  Pointer to the position where next message should be written into
-        the message queue. */
+        the message queue. Accessed by the writer only. */
     struct {
         struct nn_msgqueue_chunk *chunk;
         int pos;
     } out;
 
-    /*  Pointer to the first unread message in the message queue. */
+    /*  Pointer to the first unread message in the message queue. Accessed
+        by the reader only. */
     struct {
         struct nn_msgqueue_chunk *chunk;
         int pos;
     } in;
 
-    /*  Number of messages in the queue. */
-    size_t count;
+    /*  Number of messages the reader knows are available and number of
+        messages it have read without subtracting them from 'count' yet.
+        Accessed by the reader only. */
+    uint32_t avail;
+    uint32_t consumed;
+
+    /*  Number of messages written to the queue minus 'consumed'. */
+    struct nn_atomic count;
 
     /*  Amount of memory used by messages in the queue. */
-    size_t mem;
+    struct nn_atomic mem;
 
     /*   Maximal queue size (in bytes). */
-    size_t maxmem;
+    uint32_t maxmem;
 
-    /*  One empty chunk is always cached so that in case of steady stream
-        of messages through the pipe there are no memory allocations. */
-    struct nn_msgqueue_chunk *cache;
+    /*  Set to 1 when the reader, resp. the writer, waits to be woken up. */
+    struct nn_atomic rwaiting;
+    struct nn_atomic wwaiting;
 };
 
-/*  Initialise the message pipe. maxmem is the maximal queue size in bytes. */
+/*  Initialise the message pipe. maxmem is the maximal queue size in bytes.
+    The reader is initially registered as waiting for messages. */
 void nn_msgqueue_init (struct nn_msgqueue *self, size_t maxmem);
 
 /*  Terminate the message pipe. */
 void nn_msgqueue_term (struct nn_msgqueue *self);
 
-/*  Returns 1 if there are no messages in the queue, 0 otherwise. */
-int nn_msgqueue_empty (struct nn_msgqueue *self);
-
-/*  Writes a message to the pipe. -EAGAIN is returned if the message cannot
-    be sent because the queue is full. */
+/*  Writes a message to the pipe. By allowing one message to exceed the size
+    limit, even messages larger than the limit can pass through. Returns 1
+    if the reader is waiting for messages and has to be woken up, 0
+    otherwise. */
 int nn_msgqueue_send (struct nn_msgqueue *self, struct nn_msg *msg);
 
+/*  Returns 1 if more messages can be written to the pipe. Otherwise
+    the writer is registered as waiting and 0 is returned. */
+int nn_msgqueue_writable (struct nn_msgqueue *self);
+
 /*  Reads a message from the pipe. -EAGAIN is returned if there's no message
-    to receive. */
+    to receive. Otherwise, returns 1 if the writer is waiting for space in
+    the pipe and has to be woken up, 0 otherwise. */
 int nn_msgqueue_recv (struct nn_msgqueue *self, struct nn_msg *msg);
 
+/*  Returns the amount of memory used by the messages in the pipe. Can be
+    called by either party; the value may be out of date by the time it is
+    returned. */
+size_t nn_msgqueue_mem (struct nn_msgqueue *self);
+
+/*  Returns 1 if there are messages to be read from the pipe. Otherwise
+    the reader is registered as waiting and 0 is returned. */
+int nn_msgqueue_readable (struct nn_msgqueue *self);
+
 #endif
+
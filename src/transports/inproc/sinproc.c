@@ -39,14 +39,12 @@
 #define NN_SINPROC_ACTION_READY 1
 #define NN_SINPROC_ACTION_ACCEPTED 2
 
-/*  Set when SENT event was sent to the peer but RECEIVED haven't been
-    passed back yet. */
-#define NN_SINPROC_FLAG_SENDING 1
-
-/*  Set when SENT event was received, but the new message cannot be written
-    to the queue yet, i.e. RECEIVED event haven't been returned
-    to the peer yet. */
-#define NN_SINPROC_FLAG_RECEIVING 2
+/*  The messages are passed between the sessions via the msgqueue of the
+    receiving session. Events are exchanged only when one side has to wake up
+    the other one. SENT event means that there are new messages in the queue
+    of a session that was waiting for them. RECEIVED event means that there's
+    space in the queue of the peer again and this session can resume
+    sending. */
 
 /*  Private functions. */
 static void nn_sinproc_handler (struct nn_fsm *self, int src, int type,
@@ -56,9 +54,11 @@ static void nn_sinproc_shutdown (struct nn_fsm *self, int src, int type,
 
 static int nn_sinproc_send (struct nn_pipebase *self, struct nn_msg *msg);
 static int nn_sinproc_recv (struct nn_pipebase *self, struct nn_msg *msg);
+static size_t nn_sinproc_backlog (struct nn_pipebase *self);
 const struct nn_pipebase_vfptr nn_sinproc_pipebase_vfptr = {
     nn_sinproc_send,
-    nn_sinproc_recv
+    nn_sinproc_recv,
+    nn_sinproc_backlog
 };
 
 void nn_sinproc_init (struct nn_sinproc *self, int src,
@@ -70,14 +70,12 @@ void nn_sinproc_init (struct nn_sinproc *self, int src,
     nn_fsm_init (&self->fsm, nn_sinproc_handler, nn_sinproc_shutdown,
         src, self, owner);
     self->state = NN_SINPROC_STATE_IDLE;
-    self->flags = 0;
     self->peer = NULL;
     nn_pipebase_init (&self->pipebase, &nn_sinproc_pipebase_vfptr, epbase);
     sz = sizeof (rcvbuf);
     nn_epbase_getopt (epbase, NN_SOL_SOCKET, NN_RCVBUF, &rcvbuf, &sz);
     nn_assert (sz == sizeof (rcvbuf));
     nn_msgqueue_init (&self->msgqueue, rcvbuf);
-    nn_msg_init (&self->msg, 0);
     nn_fsm_event_init (&self->event_connect);
     nn_fsm_event_init (&self->event_sent);
     nn_fsm_event_init (&self->event_received);
@@ -92,7 +90,6 @@ void nn_sinproc_term (struct nn_sinproc *self)
     nn_fsm_event_term (&self->event_received);
     nn_fsm_event_term (&self->event_sent);
     nn_fsm_event_term (&self->event_connect);
-    nn_msg_term (&self->msg);
     nn_msgqueue_term (&self->msgqueue);
     nn_pipebase_term (&self->pipebase);
     nn_fsm_term (&self->fsm);
@@ -146,21 +143,34 @@ static int nn_sinproc_send (struct nn_pipebase *self, struct nn_msg *msg)
 
     /*  Sanity checks. */
     nn_assert_state (sinproc, NN_SINPROC_STATE_ACTIVE);
-    nn_assert (!(sinproc->flags & NN_SINPROC_FLAG_SENDING));
 
-    /*  Expose the message to the peer. */
-    nn_msg_term (&sinproc->msg);
-    nn_msg_mv (&sinproc->msg, msg);
+    /*  Pass the message to the peer. If it waits for messages, notify it
+        that there's a message to get. */
+    if (nn_msgqueue_send (&sinproc->peer->msgqueue, msg))
+        nn_fsm_raiseto (&sinproc->fsm, &sinproc->peer->fsm,
+            &sinproc->peer->event_sent, NN_SINPROC_SRC_PEER,
+            NN_SINPROC_SENT, sinproc);
 
-    /*  Notify the peer that there's a message to get. */
-    sinproc->flags |= NN_SINPROC_FLAG_SENDING;
-    nn_fsm_raiseto (&sinproc->fsm, &sinproc->peer->fsm,
-        &sinproc->peer->event_sent, NN_SINPROC_SRC_PEER,
-        NN_SINPROC_SENT, sinproc);
+    /*  If there's still space in the peer's queue, we can go on sending.
+        Otherwise, the peer will let us know once it frees some space. */
+    if (nn_msgqueue_writable (&sinproc->peer->msgqueue))
+        nn_pipebase_sent (&sinproc->pipebase);
 
     return 0;
 }
 
+static size_t nn_sinproc_backlog (struct nn_pipebase *self)
+{
+    struct nn_sinproc *sinproc;
+
+    /*  The messages sent are stored directly in the peer's queue. The peer
+        may be consuming them in parallel so the value is only a hint. */
+    sinproc = nn_cont (self, struct nn_sinproc, pipebase);
+    if (sinproc->state != NN_SINPROC_STATE_ACTIVE)
+        return 0;
+    return nn_msgqueue_mem (&sinproc->peer->msgqueue);
+}
+
 static int nn_sinproc_recv (struct nn_pipebase *self, struct nn_msg *msg)
 {
     int rc;
@@ -174,26 +184,18 @@ static int nn_sinproc_recv (struct nn_pipebase *self, struct nn_msg *msg)
 
     /*  Move the message to the caller. */
     rc = nn_msgqueue_recv (&sinproc->msgqueue, msg);
-    errnum_assert (rc == 0, -rc);
-
-    /*  If there was a message from peer lingering because of the exceeded
-        buffer limit, try to enqueue it once again. */
-    if (sinproc->state != NN_SINPROC_STATE_DISCONNECTED) {
-        if (nn_slow (sinproc->flags & NN_SINPROC_FLAG_RECEIVING)) {
-            rc = nn_msgqueue_send (&sinproc->msgqueue, &sinproc->peer->msg);
-            nn_assert (rc == 0 || rc == -EAGAIN);
-            if (rc == 0) {
-                errnum_assert (rc == 0, -rc);
-                nn_msg_init (&sinproc->peer->msg, 0);
-                nn_fsm_raiseto (&sinproc->fsm, &sinproc->peer->fsm,
-                    &sinproc->peer->event_received, NN_SINPROC_SRC_PEER,
-                    NN_SINPROC_RECEIVED, sinproc);
-                sinproc->flags &= ~NN_SINPROC_FLAG_RECEIVING;
-            }
-        }
-    }
-
-    if (!nn_msgqueue_empty (&sinproc->msgqueue))
+    errnum_assert (rc >= 0, -rc);
+
+    /*  If the peer was blocked because of the exceeded buffer limit, let it
+        know that it can send again. */
+    if (nn_slow (rc == 1) && sinproc->state != NN_SINPROC_STATE_DISCONNECTED)
+        nn_fsm_raiseto (&sinproc->fsm, &sinproc->peer->fsm,
+            &sinproc->peer->event_received, NN_SINPROC_SRC_PEER,
+            NN_SINPROC_RECEIVED, sinproc);
+
+    /*  If there are no more messages, the peer will notify us once it
+        sends a new one. */
+    if (nn_msgqueue_readable (&sinproc->msgqueue))
        nn_pipebase_received (&sinproc->pipebase);
 
     return NN_PIPEBASE_PARSED;
@@ -224,6 +226,7 @@ static void nn_sinproc_shutdown_events (struct nn_sinproc *self, int src,
         }
     case NN_SINPROC_SRC_PEER:
         switch (type) {
+        case NN_SINPROC_SENT:
         case NN_SINPROC_RECEIVED:
             return;
         }
@@ -295,7 +298,6 @@ static void nn_sinproc_handler (struct nn_fsm *self, int src, int type,
 {
     int rc;
     struct nn_sinproc *sinproc;
-    int empty;
 
     sinproc = nn_cont (self, struct nn_sinproc, fsm);
 
@@ -395,33 +397,14 @@ static void nn_sinproc_handler (struct nn_fsm *self, int src, int type,
             switch (type) {
             case NN_SINPROC_SENT:
 
-                empty = nn_msgqueue_empty (&sinproc->msgqueue);
-
-                /*  Push the message to the inbound message queue. */
-                rc = nn_msgqueue_send (&sinproc->msgqueue,
-                    &sinproc->peer->msg);
-                if (rc == -EAGAIN) {
-                    sinproc->flags |= NN_SINPROC_FLAG_RECEIVING;
-                    return;
-                }
-                errnum_assert (rc == 0, -rc);
-                nn_msg_init (&sinproc->peer->msg, 0);
-
                 /*  Notify the user that there's a message to receive. */
-                if (empty)
-                    nn_pipebase_received (&sinproc->pipebase);
-
-                /*  Notify the peer that the message was received. */
-                nn_fsm_raiseto (&sinproc->fsm, &sinproc->peer->fsm,
-                    &sinproc->peer->event_received, NN_SINPROC_SRC_PEER,
-                    NN_SINPROC_RECEIVED, sinproc);
-
+                nn_pipebase_received (&sinproc->pipebase);
                 return;
 
             case NN_SINPROC_RECEIVED:
-                nn_assert (sinproc->flags & NN_SINPROC_FLAG_SENDING);
+
+                /*  There's space in the peer's queue again. */
                 nn_pipebase_sent (&sinproc->pipebase);
-                sinproc->flags &= ~NN_SINPROC_FLAG_SENDING;
                 return;
 
             case NN_SINPROC_DISCONNECT:
@@ -48,7 +48,7 @@ static void nn_aipc_shutdown (struct nn_fsm *self, int src, int type,
    void *srcptr);
 
 void nn_aipc_init (struct nn_aipc *self, int src,
-    struct nn_epbase *epbase, struct nn_fsm *owner)
+    struct nn_epbase *epbase, int shm, struct nn_fsm *owner)
 {
     nn_fsm_init (&self->fsm, nn_aipc_handler, nn_aipc_shutdown,
         src, self, owner);
@@ -58,7 +58,7 @@ void nn_aipc_init (struct nn_aipc *self, int src,
     self->listener = NULL;
     self->listener_owner.src = -1;
     self->listener_owner.fsm = NULL;
-    nn_sipc_init (&self->sipc, NN_AIPC_SRC_SIPC, epbase, &self->fsm);
+    nn_sipc_init (&self->sipc, NN_AIPC_SRC_SIPC, epbase, shm, &self->fsm);
     nn_fsm_event_init (&self->accepted);
     nn_fsm_event_init (&self->done);
     nn_list_item_init (&self->item);
@@ -196,6 +196,11 @@ static void nn_aipc_handler (struct nn_fsm *self, int src, int type,
                 nn_assert (sz == sizeof (val));
                 nn_usock_setsockopt (&aipc->usock, SOL_SOCKET, SO_RCVBUF,
                     &val, sizeof (val));
+                sz = sizeof (val);
+                nn_epbase_getopt (aipc->epbase, NN_SOL_SOCKET, NN_RCVBATCH,
+                    &val, &sz);
+                nn_assert (sz == sizeof (val));
+                nn_usock_set_batch_size (&aipc->usock, (size_t) val);
 
                 /*  Return ownership of the listening socket to the parent. */
                 nn_usock_swap_owner (aipc->listener, &aipc->listener_owner);
@@ -67,6 +67,10 @@ struct nn_bipc {
 
     /*  List of accepted connections. */
     struct nn_list aipcs;
+
+    /*  If non-zero, accepted connections pass large messages via shared
+        memory. */
+    int shm;
 };
 
 /*  nn_epbase virtual interface implementation. */
@@ -85,7 +89,7 @@ static void nn_bipc_shutdown (struct nn_fsm *self, int src, int type,
 static void nn_bipc_start_listening (struct nn_bipc *self);
 static void nn_bipc_start_accepting (struct nn_bipc *self);
 
-int nn_bipc_create (void *hint, struct nn_epbase **epbase)
+int nn_bipc_create (void *hint, struct nn_epbase **epbase, int shm)
 {
     struct nn_bipc *self;
 
@@ -101,6 +105,7 @@ int nn_bipc_create (void *hint, struct nn_epbase **epbase)
     nn_usock_init (&self->usock, NN_BIPC_SRC_USOCK, &self->fsm);
     self->aipc = NULL;
     nn_list_init (&self->aipcs);
+    self->shm = shm;
 
     /*  Start the state machine. */
     nn_fsm_start (&self->fsm);
@@ -316,7 +321,8 @@ static void nn_bipc_start_accepting (struct nn_bipc *self)
     /*  Allocate new aipc state machine. */
     self->aipc = nn_alloc (sizeof (struct nn_aipc), "aipc");
     alloc_assert (self->aipc);
-    nn_aipc_init (self->aipc, NN_BIPC_SRC_AIPC, &self->epbase, &self->fsm);
+    nn_aipc_init (self->aipc, NN_BIPC_SRC_AIPC, &self->epbase, self->shm,
+        &self->fsm);
 
     /*  Start waiting for a new incoming connection. */
     nn_aipc_start (self->aipc, &self->usock);
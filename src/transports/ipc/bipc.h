@@ -27,9 +27,10 @@
 
 #include "../../transport.h"
 
-/*  State machine managing bound IPC socket. */
+/*  State machine managing bound IPC socket. If 'shm' is non-zero,
+    large messages are passed via shared memory. */
 
-int nn_bipc_create (void *hint, struct nn_epbase **epbase);
+int nn_bipc_create (void *hint, struct nn_epbase **epbase, int shm);
 
 #endif
 
@@ -90,7 +90,7 @@ static void nn_cipc_shutdown (struct nn_fsm *self, int src, int type,
     void *srcptr);
 static void nn_cipc_start_connecting (struct nn_cipc *self);
 
-int nn_cipc_create (void *hint, struct nn_epbase **epbase)
+int nn_cipc_create (void *hint, struct nn_epbase **epbase, int shm)
 {
     struct nn_cipc *self;
     int reconnect_ivl;
@@ -119,7 +119,8 @@ int nn_cipc_create (void *hint, struct nn_epbase **epbase)
         reconnect_ivl_max = reconnect_ivl;
     nn_backoff_init (&self->retry, NN_CIPC_SRC_RECONNECT_TIMER,
         reconnect_ivl, reconnect_ivl_max, &self->fsm);
-    nn_sipc_init (&self->sipc, NN_CIPC_SRC_SIPC, &self->epbase, &self->fsm);
+    nn_sipc_init (&self->sipc, NN_CIPC_SRC_SIPC, &self->epbase, shm,
+        &self->fsm);
 
     /*  Start the state machine. */
     nn_fsm_start (&self->fsm);
@@ -405,6 +406,10 @@ static void nn_cipc_start_connecting (struct nn_cipc *self)
     nn_assert (sz == sizeof (val));
     nn_usock_setsockopt (&self->usock, SOL_SOCKET, SO_RCVBUF,
         &val, sizeof (val));
+    sz = sizeof (val);
+    nn_epbase_getopt (&self->epbase, NN_SOL_SOCKET, NN_RCVBATCH, &val, &sz);
+    nn_assert (sz == sizeof (val));
+    nn_usock_set_batch_size (&self->usock, (size_t) val);
 
     /*  Create the IPC address from the address string. */
     addr = nn_epbase_getaddr (&self->epbase);
@@ -27,9 +27,10 @@
 
 #include "../../transport.h"
 
-/*  State machine managing connected IPC socket. */
+/*  State machine managing connected IPC socket. If 'shm' is non-zero,
+    large messages are passed via shared memory. */
 
-int nn_cipc_create (void *hint, struct nn_epbase **epbase);
+int nn_cipc_create (void *hint, struct nn_epbase **epbase, int shm);
 
 #endif
 
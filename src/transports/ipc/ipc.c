@@ -57,12 +57,12 @@ struct nn_transport *nn_ipc = &nn_ipc_vfptr;
 
 static int nn_ipc_bind (void *hint, struct nn_epbase **epbase)
 {
-    return nn_bipc_create (hint, epbase);
+    return nn_bipc_create (hint, epbase, 0);
 }
 
 static int nn_ipc_connect (void *hint, struct nn_epbase **epbase)
 {
-    return nn_cipc_create (hint, epbase);
+    return nn_cipc_create (hint, epbase, 0);
 }
 
 #endif
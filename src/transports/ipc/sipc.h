@@ -29,8 +29,12 @@
 
 #include "../../aio/fsm.h"
 #include "../../aio/usock.h"
+#include "../../aio/timer.h"
 
 #include "../utils/streamhdr.h"
+#include "../utils/sendq.h"
+
+#include "../shm/shmring.h"
 
 #include "../../utils/msg.h"
 
@@ -52,6 +56,10 @@ struct nn_sipc {
     /*  Child state machine to do protocol header exchange. */
     struct nn_streamhdr streamhdr;
 
+    /*  Bounds the time spent sending queued messages after stop is
+        requested. */
+    struct nn_timer linger;
+
     /*  The original owner of the underlying socket. */
     struct nn_fsm_owner usock_owner;
 
@@ -70,18 +78,28 @@ struct nn_sipc {
     /*  State of the outbound state machine. */
     int outstate;
 
-    /*  Buffer used to store the header of outgoing message. */
-    uint8_t outhdr [9];
+    /*  Outbound messages. Those that are not being sent at the moment
+        will be sent in a single batch once the current batch is done. */
+    struct nn_sendq outq;
+
+    /*  If non-zero, large messages are passed via shared memory provided
+        that the peer supports it. */
+    int shm;
+
+    /*  Combination of NN_SIPC_SHM_* flags. */
+    int shmflags;
 
-    /*  Message being sent at the moment. */
-    struct nn_msg outmsg;
+    /*  Shared memory segment created by this side of the connection to pass
+        messages to the peer, and the one created by the peer. */
+    struct nn_shmring outring;
+    struct nn_shmring inring;
 
     /*  Event raised when the state machine ends. */
     struct nn_fsm_event done;
 };
 
 void nn_sipc_init (struct nn_sipc *self, int src,
-    struct nn_epbase *epbase, struct nn_fsm *owner);
+    struct nn_epbase *epbase, int shm, struct nn_fsm *owner);
 void nn_sipc_term (struct nn_sipc *self);
 
 int nn_sipc_isidle (struct nn_sipc *self);
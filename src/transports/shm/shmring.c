@@ -0,0 +1,483 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+
+#if !defined NN_HAVE_WINDOWS
+
+#include "shmring.h"
+
+#include "../../nn.h"
+
+#include "../../utils/err.h"
+#include "../../utils/fast.h"
+#include "../../utils/random.h"
+#include "../../utils/closefd.h"
+#include "../../utils/chunk.h"
+#include "../../utils/mutex.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*  Identifies the segment as a nanomsg ring buffer. */
+#define NN_SHMRING_MAGIC 0x4e4e5352
+
+/*  The header occupies the first page of the segment so that the data area
+    is page-aligned. */
+#define NN_SHMRING_HDRSIZE 4096
+
+/*  All allocations are aligned to the cache line size. */
+#define NN_SHMRING_ALIGN 64
+
+/*  Each message is preceded by NN_SHMRING_ALIGN bytes of unused space.
+    The reader stores the chunk tags there. */
+#define NN_SHMRING_PREFIX NN_SHMRING_ALIGN
+
+/*  Positions in the ring are 32-bit counters that are allowed to wrap
+    around. To keep the arithmetic sound the ring must be smaller than
+    half of their range. */
+#define NN_SHMRING_MAXSIZE 0x40000000
+
+/*  Maximum number of messages the reader can hand to the user without
+    copying at any given time. */
+#define NN_SHMRING_MAXSLOTS 256
+
+/*  Full memory barrier. Data in the ring must be read by the reader before
+    the space is released and must not be overwritten by the writer before
+    it notices that it was released. */
+#if defined __GNUC__
+#define nn_shmring_barrier() __sync_synchronize ()
+#else
+#define nn_shmring_barrier()
+#endif
+
+struct nn_shmring_hdr {
+    uint32_t magic;
+    uint32_t size;
+
+    /*  Total amount of space released by the reader so far. It's placed
+        on a separate cache line as it's the only field written to while
+        the ring is in use. */
+    uint8_t padding [NN_SHMRING_ALIGN - 8];
+    volatile uint32_t tail;
+};
+
+CT_ASSERT (sizeof (struct nn_shmring_hdr) <= NN_SHMRING_HDRSIZE);
+
+/*  Message held by the user on the reader's side. */
+struct nn_shmring_slot {
+
+    /*  Header of the chunk referring to the message in the ring. */
+    uint8_t chunk [NN_CHUNK_EXT_HDRSIZE];
+
+    struct nn_shmring_map *map;
+
+    /*  Amount of space to release once this message, as well as all
+        the messages received before it, are deallocated. */
+    uint32_t adv;
+    int done;
+};
+
+/*  The reader maps the segment just after this structure, on private pages
+    of its own. That way the chunk headers are out of the peer's reach and
+    the chunks can still refer to the data in the segment. */
+struct nn_shmring_map {
+
+    /*  Messages can be deallocated from any thread. */
+    struct nn_mutex sync;
+
+    /*  One reference is held by the nn_shmring object, one by each message
+        held by the user. */
+    int refcount;
+
+    /*  The whole mapping, including this structure. */
+    void *addr;
+    size_t len;
+
+    struct nn_shmring_hdr *hdr;
+
+    /*  Messages held by the user, in the order they were received. */
+    int first;
+    int count;
+    struct nn_shmring_slot slots [NN_SHMRING_MAXSLOTS];
+};
+
+/*  Private functions. */
+static int nn_shmring_checkname (const char *name);
+static void nn_shmring_free (void *arg);
+static void nn_shmring_unref (struct nn_shmring_map *map);
+
+void nn_shmring_init (struct nn_shmring *self)
+{
+    self->hdr = NULL;
+    self->data = NULL;
+    self->size = 0;
+    self->head = 0;
+    self->pos = 0;
+    self->name [0] = 0;
+    self->owner = 0;
+    self->map = NULL;
+}
+
+void nn_shmring_term (struct nn_shmring *self)
+{
+    nn_shmring_close (self);
+}
+
+int nn_shmring_isopen (struct nn_shmring *self)
+{
+    return self->hdr ? 1 : 0;
+}
+
+int nn_shmring_create (struct nn_shmring *self, size_t size)
+{
+#if defined NN_HAVE_SHM_OPEN
+    int rc;
+    int fd;
+    int i;
+    uint64_t rnd;
+    void *addr;
+
+    nn_assert (!self->hdr);
+
+    size = (size + NN_SHMRING_ALIGN - 1) & ~((size_t) NN_SHMRING_ALIGN - 1);
+    nn_assert (size > 0 && size <= NN_SHMRING_MAXSIZE);
+
+    /*  Create the segment with a name that isn't used yet. */
+    for (i = 0; ; ++i) {
+        nn_random_generate (&rnd, sizeof (rnd));
+        snprintf (self->name, sizeof (self->name), "/nn-%d-%llx",
+            (int) getpid (), (unsigned long long) rnd);
+        fd = shm_open (self->name, O_RDWR | O_CREAT | O_EXCL,
+            S_IRUSR | S_IWUSR);
+        if (nn_fast (fd >= 0))
+            break;
+        if (errno != EEXIST || i == 8)
+            return -errno;
+    }
+
+    rc = ftruncate (fd, NN_SHMRING_HDRSIZE + size);
+    if (nn_slow (rc < 0))
+        goto fail;
+    addr = mmap (NULL, NN_SHMRING_HDRSIZE + size, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    if (nn_slow (addr == MAP_FAILED))
+        goto fail;
+    nn_closefd (fd);
+
+    self->hdr = (struct nn_shmring_hdr*) addr;
+    self->hdr->magic = NN_SHMRING_MAGIC;
+    self->hdr->size = (uint32_t) size;
+    self->hdr->tail = 0;
+    self->data = ((uint8_t*) addr) + NN_SHMRING_HDRSIZE;
+    self->size = (uint32_t) size;
+    self->head = 0;
+    self->pos = 0;
+    self->owner = 1;
+
+    return 0;
+
+fail:
+    rc = -errno;
+    nn_closefd (fd);
+    shm_unlink (self->name);
+    return rc;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+int nn_shmring_open (struct nn_shmring *self, const char *name)
+{
+#if defined NN_HAVE_SHM_OPEN
+    int rc;
+    int fd;
+    int i;
+    struct stat st;
+    size_t pagesz;
+    size_t mapsz;
+    size_t len;
+    uint8_t *addr;
+    void *seg;
+    struct nn_shmring_hdr *hdr;
+    struct nn_shmring_map *map;
+
+    nn_assert (!self->hdr);
+
+    /*  The name comes from the peer. Make sure it doesn't refer to anything
+        but a ring buffer. */
+    if (nn_slow (!nn_shmring_checkname (name)))
+        return -EINVAL;
+
+    fd = shm_open (name, O_RDWR, 0);
+    if (nn_slow (fd < 0))
+        return -errno;
+
+    rc = fstat (fd, &st);
+    if (nn_slow (rc < 0)) {
+        rc = -errno;
+        nn_closefd (fd);
+        return rc;
+    }
+    if (nn_slow (st.st_size <= NN_SHMRING_HDRSIZE ||
+          st.st_size > NN_SHMRING_HDRSIZE + NN_SHMRING_MAXSIZE)) {
+        nn_closefd (fd);
+        return -EINVAL;
+    }
+
+    /*  Reserve the address space for the private part and the segment, then
+        place the segment just after the private part. */
+    pagesz = (size_t) sysconf (_SC_PAGESIZE);
+    mapsz = (sizeof (struct nn_shmring_map) + pagesz - 1) / pagesz * pagesz;
+    len = mapsz + (size_t) st.st_size;
+    addr = mmap (NULL, len, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (nn_slow (addr == MAP_FAILED)) {
+        nn_closefd (fd);
+        return -ENOMEM;
+    }
+    seg = mmap (addr + mapsz, (size_t) st.st_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_FIXED, fd, 0);
+    if (nn_slow (seg == MAP_FAILED)) {
+        rc = -errno;
+        munmap (addr, len);
+        nn_closefd (fd);
+        return rc;
+    }
+    nn_closefd (fd);
+
+    /*  Check whether the segment was created by nanomsg. */
+    hdr = (struct nn_shmring_hdr*) seg;
+    if (nn_slow (hdr->magic != NN_SHMRING_MAGIC ||
+          NN_SHMRING_HDRSIZE + (off_t) hdr->size != st.st_size)) {
+        munmap (addr, len);
+        return -EINVAL;
+    }
+
+    /*  Nobody else is going to open the segment. Remove the name so that
+        the memory is freed as soon as both peers unmap it. */
+    shm_unlink (name);
+
+    map = (struct nn_shmring_map*) addr;
+    nn_mutex_init (&map->sync);
+    map->refcount = 1;
+    map->addr = addr;
+    map->len = len;
+    map->hdr = hdr;
+    map->first = 0;
+    map->count = 0;
+    for (i = 0; i != NN_SHMRING_MAXSLOTS; ++i)
+        map->slots [i].map = map;
+
+    self->hdr = hdr;
+    self->data = ((uint8_t*) seg) + NN_SHMRING_HDRSIZE;
+    self->size = hdr->size;
+    self->owner = 0;
+    self->map = map;
+
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+void nn_shmring_close (struct nn_shmring *self)
+{
+#if defined NN_HAVE_SHM_OPEN
+    int rc;
+
+    if (!self->hdr)
+        return;
+
+    /*  The reader's mapping goes away once the user deallocates all
+        the messages. */
+    if (!self->owner)
+        nn_shmring_unref (self->map);
+    else {
+        rc = munmap (self->hdr, NN_SHMRING_HDRSIZE + self->size);
+        errno_assert (rc == 0);
+
+        /*  If the peer haven't opened the segment, remove it. */
+        shm_unlink (self->name);
+    }
+#endif
+
+    nn_shmring_init (self);
+}
+
+const char *nn_shmring_name (struct nn_shmring *self)
+{
+    nn_assert (self->owner);
+    return self->name;
+}
+
+void *nn_shmring_alloc (struct nn_shmring *self, size_t len,
+    uint32_t *offset, uint32_t *adv)
+{
+    uint32_t used;
+    uint32_t skip;
+
+    nn_assert (self->owner);
+
+    len = (len + NN_SHMRING_ALIGN - 1) & ~((size_t) NN_SHMRING_ALIGN - 1);
+    len += NN_SHMRING_PREFIX;
+    if (nn_slow (len > self->size))
+        return NULL;
+
+    /*  Message is always stored contiguously. If it doesn't fit to the end of
+        the data area, the rest of the area is skipped. */
+    skip = self->pos + len > self->size ? self->size - self->pos : 0;
+
+    /*  Check whether the reader have already released enough space. */
+    used = self->head - self->hdr->tail;
+    nn_shmring_barrier ();
+    if (nn_slow (used + skip + len > self->size))
+        return NULL;
+
+    *offset = (skip ? 0 : self->pos) + NN_SHMRING_PREFIX;
+    *adv = skip + (uint32_t) len;
+    self->head += *adv;
+    self->pos = *offset - NN_SHMRING_PREFIX + (uint32_t) len;
+    if (self->pos == self->size)
+        self->pos = 0;
+
+    return self->data + *offset;
+}
+
+int nn_shmring_recv (struct nn_shmring *self, uint32_t offset, uint32_t adv,
+    uint64_t len, void **chunk)
+{
+    int rc;
+    struct nn_shmring_map *map;
+    struct nn_shmring_slot *slot;
+    uint8_t *data;
+
+    nn_assert (!self->owner);
+
+    if (nn_slow (offset < NN_SHMRING_PREFIX || offset > self->size ||
+          len > self->size - offset))
+        return -EINVAL;
+    data = self->data + offset;
+    map = self->map;
+
+    /*  Hand the message to the user as it is. */
+    nn_mutex_lock (&map->sync);
+    if (nn_fast (map->count < NN_SHMRING_MAXSLOTS)) {
+        slot = &map->slots [(map->first + map->count) % NN_SHMRING_MAXSLOTS];
+        slot->adv = adv;
+        slot->done = 0;
+        ++map->count;
+        ++map->refcount;
+        nn_mutex_unlock (&map->sync);
+        nn_chunk_init_ext (slot->chunk, data, (size_t) len,
+            nn_shmring_free, slot);
+        *chunk = data;
+        return 0;
+    }
+    nn_mutex_unlock (&map->sync);
+
+    /*  The user holds too many messages. Copy this one out of the ring. Its
+        space is released along with the most recent message still held by
+        the user, or straight away if there's no such message. */
+    rc = nn_chunk_alloc ((size_t) len, NN_ALLOCMSG_POOL, chunk);
+    errnum_assert (rc == 0, -rc);
+    memcpy (*chunk, data, (size_t) len);
+    nn_mutex_lock (&map->sync);
+    if (map->count > 0)
+        map->slots [(map->first + map->count - 1) %
+            NN_SHMRING_MAXSLOTS].adv += adv;
+    else {
+        nn_shmring_barrier ();
+        map->hdr->tail += adv;
+    }
+    nn_mutex_unlock (&map->sync);
+
+    return 0;
+}
+
+/*  Accepts only names in the form produced by nn_shmring_create, i.e.
+    "/nn-<pid>-<hex>". */
+static int nn_shmring_checkname (const char *name)
+{
+    const char *pos;
+
+    if (strncmp (name, "/nn-", 4) != 0)
+        return 0;
+    pos = name + 4;
+    if (*pos < '0' || *pos > '9')
+        return 0;
+    while (*pos >= '0' && *pos <= '9')
+        ++pos;
+    if (*pos != '-')
+        return 0;
+    ++pos;
+    if (!*pos)
+        return 0;
+    while ((*pos >= '0' && *pos <= '9') || (*pos >= 'a' && *pos <= 'f'))
+        ++pos;
+    return *pos ? 0 : 1;
+}
+
+/*  Invoked when the user deallocates a message that refers to the ring. */
+static void nn_shmring_free (void *arg)
+{
+    struct nn_shmring_slot *slot;
+    struct nn_shmring_map *map;
+
+    slot = (struct nn_shmring_slot*) arg;
+    map = slot->map;
+
+    /*  Release the space of all the messages at the beginning of the ring
+        that were already deallocated. */
+    nn_mutex_lock (&map->sync);
+    slot->done = 1;
+    while (map->count > 0 && map->slots [map->first].done) {
+        nn_shmring_barrier ();
+        map->hdr->tail += map->slots [map->first].adv;
+        map->first = (map->first + 1) % NN_SHMRING_MAXSLOTS;
+        --map->count;
+    }
+    nn_mutex_unlock (&map->sync);
+
+    nn_shmring_unref (map);
+}
+
+static void nn_shmring_unref (struct nn_shmring_map *map)
+{
+    int rc;
+    int refcount;
+
+    nn_mutex_lock (&map->sync);
+    refcount = --map->refcount;
+    nn_mutex_unlock (&map->sync);
+    if (refcount > 0)
+        return;
+
+    nn_mutex_term (&map->sync);
+    rc = munmap (map->addr, map->len);
+    errno_assert (rc == 0);
+}
+
+#endif
@@ -0,0 +1,113 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef NN_SHMRING_INCLUDED
+#define NN_SHMRING_INCLUDED
+
+#if !defined NN_HAVE_WINDOWS
+
+#include "../../utils/int.h"
+
+#include <stddef.h>
+
+/*  Ring buffer placed in a POSIX shared memory segment. The writer process
+    creates the segment and allocates space for messages in it. The offsets
+    of the messages are passed to the reader process out of band, e.g. via
+    an IPC connection. The reader process maps the segment and hands
+    the messages to the user without copying them. The space is released once
+    the user deallocates the message. Messages can be deallocated in any
+    order, however, the space is returned to the writer in the same order it
+    was allocated. */
+
+/*  Maximum length of the segment name, including the terminating zero. */
+#define NN_SHMRING_NAMELEN 32
+
+struct nn_shmring_hdr;
+struct nn_shmring_map;
+
+struct nn_shmring {
+
+    /*  Header of the segment in the shared memory. NULL if the segment is
+        not mapped. */
+    struct nn_shmring_hdr *hdr;
+
+    /*  Data area of the segment and its size. */
+    uint8_t *data;
+    uint32_t size;
+
+    /*  Total amount of space allocated so far and the position in the data
+        area where the next message will be placed. Used by the writer
+        only. */
+    uint32_t head;
+    uint32_t pos;
+
+    /*  Name of the segment. Only the writer needs to keep it, to be able to
+        unlink the segment if the reader never opens it. */
+    char name [NN_SHMRING_NAMELEN];
+    int owner;
+
+    /*  The reader's private part of the mapping. It outlives the object if
+        the user still holds some of the messages. */
+    struct nn_shmring_map *map;
+};
+
+void nn_shmring_init (struct nn_shmring *self);
+void nn_shmring_term (struct nn_shmring *self);
+
+/*  Returns 1 if the segment is mapped, 0 otherwise. */
+int nn_shmring_isopen (struct nn_shmring *self);
+
+/*  Creates a new segment with data area of 'size' bytes and maps it.
+    Used by the writer. */
+int nn_shmring_create (struct nn_shmring *self, size_t size);
+
+/*  Maps the segment created by the peer and unlinks its name so that
+    the segment is destroyed once both processes unmap it. Only names
+    produced by nn_shmring_create are accepted. Returns -EINVAL if the name
+    or the segment is not valid. Used by the reader. */
+int nn_shmring_open (struct nn_shmring *self, const char *name);
+
+/*  Unmaps the segment. */
+void nn_shmring_close (struct nn_shmring *self);
+
+/*  Name of the segment, to be passed to the reader. */
+const char *nn_shmring_name (struct nn_shmring *self);
+
+/*  Allocates 'len' bytes in the ring. Returns NULL if there's not enough
+    free space at the moment. Otherwise, returns pointer to the allocated
+    space and fills in the offset the reader should read the data from
+    and the amount of space it should release afterwards. */
+void *nn_shmring_alloc (struct nn_shmring *self, size_t len,
+    uint32_t *offset, uint32_t *adv);
+
+/*  Returns a chunk holding 'len' bytes at 'offset'. The chunk refers to
+    the ring directly and 'adv' bytes are released once it is deallocated.
+    If the reader already holds too many messages, the data are copied and
+    the space is released straight away. Returns -EINVAL if the data don't
+    fit into the ring. Used by the reader. */
+int nn_shmring_recv (struct nn_shmring *self, uint32_t offset, uint32_t adv,
+    uint64_t len, void **chunk);
+
+#endif
+
+#endif
+
@@ -22,6 +22,8 @@
 
 #include "atcp.h"
 
+#include "../../tcp.h"
+
 #include "../../utils/err.h"
 #include "../../utils/cont.h"
 #include "../../utils/attr.h"
@@ -194,6 +196,17 @@ static void nn_atcp_handler (struct nn_fsm *self, int src, int type,
                 nn_assert (sz == sizeof (val));
                 nn_usock_setsockopt (&atcp->usock, SOL_SOCKET, SO_RCVBUF,
                     &val, sizeof (val));
+                sz = sizeof (val);
+                nn_epbase_getopt (atcp->epbase, NN_SOL_SOCKET, NN_RCVBATCH,
+                    &val, &sz);
+                nn_assert (sz == sizeof (val));
+                nn_usock_set_batch_size (&atcp->usock, (size_t) val);
+                sz = sizeof (val);
+                nn_epbase_getopt (atcp->epbase, NN_TCP, NN_TCP_ZEROCOPY,
+                    &val, &sz);
+                nn_assert (sz == sizeof (val));
+                if (val)
+                    nn_usock_set_zerocopy (&atcp->usock);
 
                 /*  Return ownership of the listening socket to the parent. */
                 nn_usock_swap_owner (atcp->listener, &atcp->listener_owner);
@@ -275,6 +288,16 @@ static void nn_atcp_handler (struct nn_fsm *self, int src, int type,
                 nn_fsm_bad_action (atcp->state, src, type);
             }
 
+        /*  Zero-copy completions may still arrive once the usock was
+            handed back by stcp. */
+        case NN_ATCP_SRC_USOCK:
+            switch (type) {
+            case NN_USOCK_RELEASED:
+                return;
+            default:
+                nn_fsm_bad_action (atcp->state, src, type);
+            }
+
         default:
             nn_fsm_bad_source (atcp->state, src, type);
         }
@@ -288,6 +311,7 @@ static void nn_atcp_handler (struct nn_fsm *self, int src, int type,
         case NN_ATCP_SRC_USOCK:
             switch (type) {
             case NN_USOCK_SHUTDOWN:
+            case NN_USOCK_RELEASED:
                 return;
             case NN_USOCK_STOPPED:
                 nn_fsm_raise (&atcp->fsm, &atcp->done, NN_ATCP_ERROR);
@@ -424,6 +424,16 @@ static void nn_ctcp_handler (struct nn_fsm *self, int src, int type,
                 nn_fsm_bad_action (ctcp->state, src, type);
             }
 
+        /*  Zero-copy completions may still arrive once the usock was
+            handed back by stcp. */
+        case NN_CTCP_SRC_USOCK:
+            switch (type) {
+            case NN_USOCK_RELEASED:
+                return;
+            default:
+                nn_fsm_bad_action (ctcp->state, src, type);
+            }
+
         default:
             nn_fsm_bad_source (ctcp->state, src, type);
         }
@@ -438,6 +448,7 @@ static void nn_ctcp_handler (struct nn_fsm *self, int src, int type,
         case NN_CTCP_SRC_USOCK:
             switch (type) {
             case NN_USOCK_SHUTDOWN:
+            case NN_USOCK_RELEASED:
                 return;
             case NN_USOCK_STOPPED:
                 nn_backoff_start (&ctcp->retry);
@@ -613,6 +624,15 @@ static void nn_ctcp_start_connecting (struct nn_ctcp *self,
     nn_assert (sz == sizeof (val));
     nn_usock_setsockopt (&self->usock, SOL_SOCKET, SO_RCVBUF,
         &val, sizeof (val));
+    sz = sizeof (val);
+    nn_epbase_getopt (&self->epbase, NN_SOL_SOCKET, NN_RCVBATCH, &val, &sz);
+    nn_assert (sz == sizeof (val));
+    nn_usock_set_batch_size (&self->usock, (size_t) val);
+    sz = sizeof (val);
+    nn_epbase_getopt (&self->epbase, NN_TCP, NN_TCP_ZEROCOPY, &val, &sz);
+    nn_assert (sz == sizeof (val));
+    if (val)
+        nn_usock_set_zerocopy (&self->usock);
 
     /*  Bind the socket to the local network interface. */
     rc = nn_usock_bind (&self->usock, (struct sockaddr*) &local, locallen);
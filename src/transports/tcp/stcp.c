@@ -22,13 +22,19 @@
 
 #include "stcp.h"
 
+#include "../../tcp.h"
+
 #include "../../utils/err.h"
+#include "../../utils/alloc.h"
+#include "../../utils/stopwatch.h"
 #include "../../utils/cont.h"
 #include "../../utils/fast.h"
 #include "../../utils/wire.h"
 #include "../../utils/int.h"
 #include "../../utils/attr.h"
 
+#include <string.h>
+
 /*  States of the object as a whole. */
 #define NN_STCP_STATE_IDLE 1
 #define NN_STCP_STATE_PROTOHDR 2
@@ -47,16 +53,28 @@
 #define NN_STCP_OUTSTATE_IDLE 1
 #define NN_STCP_OUTSTATE_SENDING 2
 
+/*  The top bit of the length prefix marks compressed messages. Compressed
+    message is preceded by its uncompressed size. */
+#define NN_STCP_COMPRESSED (((uint64_t) 1) << 63)
+#define NN_STCP_ORIGSIZE 8
+
+/*  Compression scratch buffers larger than this are not kept between
+    messages. */
+#define NN_STCP_LZBUF_MAX (1024 * 1024)
+
 /*  Subordinate srcptr objects. */
 #define NN_STCP_SRC_USOCK 1
 #define NN_STCP_SRC_STREAMHDR 2
+#define NN_STCP_SRC_LINGER 3
 
 /*  Stream is a special type of pipe. Implementation of the virtual pipe API. */
 static int nn_stcp_send (struct nn_pipebase *self, struct nn_msg *msg);
 static int nn_stcp_recv (struct nn_pipebase *self, struct nn_msg *msg);
+static size_t nn_stcp_backlog (struct nn_pipebase *self);
 const struct nn_pipebase_vfptr nn_stcp_pipebase_vfptr = {
     nn_stcp_send,
-    nn_stcp_recv
+    nn_stcp_recv,
+    nn_stcp_backlog
 };
 
 /*  Private functions. */
@@ -64,6 +82,10 @@ static void nn_stcp_handler (struct nn_fsm *self, int src, int type,
     void *srcptr);
 static void nn_stcp_shutdown (struct nn_fsm *self, int src, int type,
     void *srcptr);
+static void nn_stcp_send_batch (struct nn_stcp *self);
+static int nn_stcp_decode (struct nn_stcp *self);
+static size_t nn_stcp_compress (struct nn_stcp *self, struct nn_msg *msg);
+static int nn_stcp_decompress (struct nn_stcp *self);
 
 void nn_stcp_init (struct nn_stcp *self, int src,
     struct nn_epbase *epbase, struct nn_fsm *owner)
@@ -72,14 +94,21 @@ void nn_stcp_init (struct nn_stcp *self, int src,
         src, self, owner);
     self->state = NN_STCP_STATE_IDLE;
     nn_streamhdr_init (&self->streamhdr, NN_STCP_SRC_STREAMHDR, &self->fsm);
+    nn_timer_init (&self->linger, NN_STCP_SRC_LINGER, &self->fsm);
     self->usock = NULL;
     self->usock_owner.src = -1;
     self->usock_owner.fsm = NULL;
     nn_pipebase_init (&self->pipebase, &nn_stcp_pipebase_vfptr, epbase);
     self->instate = -1;
     nn_msg_init (&self->inmsg, 0);
+    self->incompressed = 0;
     self->outstate = -1;
-    nn_msg_init (&self->outmsg, 0);
+    nn_sendq_init (&self->outq);
+    self->compress = 0;
+    self->threshold = 0;
+    self->lz = NULL;
+    self->lzbuf = NULL;
+    self->lzbufsz = 0;
     nn_fsm_event_init (&self->done);
 }
 
@@ -88,9 +117,16 @@ void nn_stcp_term (struct nn_stcp *self)
     nn_assert_state (self, NN_STCP_STATE_IDLE);
 
     nn_fsm_event_term (&self->done);
-    nn_msg_term (&self->outmsg);
+    if (self->lz) {
+        nn_lz_term (self->lz);
+        nn_free (self->lz);
+    }
+    if (self->lzbuf)
+        nn_free (self->lzbuf);
+    nn_sendq_term (&self->outq);
     nn_msg_term (&self->inmsg);
     nn_pipebase_term (&self->pipebase);
+    nn_timer_term (&self->linger);
     nn_streamhdr_term (&self->streamhdr);
     nn_fsm_term (&self->fsm);
 }
@@ -121,35 +157,53 @@ void nn_stcp_stop (struct nn_stcp *self)
 static int nn_stcp_send (struct nn_pipebase *self, struct nn_msg *msg)
 {
     struct nn_stcp *stcp;
-    struct nn_iovec iov [3];
+    uint8_t hdr [8 + NN_STCP_ORIGSIZE];
+    size_t size;
+    size_t len;
 
     stcp = nn_cont (self, struct nn_stcp, pipebase);
 
     nn_assert_state (stcp, NN_STCP_STATE_ACTIVE);
-    nn_assert (stcp->outstate == NN_STCP_OUTSTATE_IDLE);
 
-    /*  Move the message to the local storage. */
-    nn_msg_term (&stcp->outmsg);
-    nn_msg_mv (&stcp->outmsg, msg);
+    size = nn_chunkref_size (&msg->hdr) + nn_chunkref_size (&msg->body);
 
-    /*  Serialise the message header. */
-    nn_putll (stcp->outhdr, nn_chunkref_size (&stcp->outmsg.hdr) +
-        nn_chunkref_size (&stcp->outmsg.body));
+    /*  Compress the message if negotiated. If that doesn't make the message
+        smaller, send it as is. */
+    len = 0;
+    if (stcp->compress && size >= stcp->threshold)
+        len = nn_stcp_compress (stcp, msg);
 
-    /*  Start async sending. */
-    iov [0].iov_base = stcp->outhdr;
-    iov [0].iov_len = sizeof (stcp->outhdr);
-    iov [1].iov_base = nn_chunkref_data (&stcp->outmsg.hdr);
-    iov [1].iov_len = nn_chunkref_size (&stcp->outmsg.hdr);
-    iov [2].iov_base = nn_chunkref_data (&stcp->outmsg.body);
-    iov [2].iov_len = nn_chunkref_size (&stcp->outmsg.body);
-    nn_usock_send (stcp->usock, iov, 3);
+    /*  Serialise the message header and move the message to the outbound
+        queue. */
+    if (len) {
+        nn_putll (hdr, (NN_STCP_ORIGSIZE + len) | NN_STCP_COMPRESSED);
+        nn_putll (hdr + 8, size);
+        nn_sendq_push (&stcp->outq, hdr, sizeof (hdr), msg);
+    }
+    else {
+        nn_putll (hdr, size);
+        nn_sendq_push (&stcp->outq, hdr, 8, msg);
+    }
+
+    /*  If nothing is being sent at the moment, start async sending.
+        Otherwise the message will be sent along with any other queued
+        messages once the current batch is done. */
+    if (stcp->outstate == NN_STCP_OUTSTATE_IDLE)
+        nn_stcp_send_batch (stcp);
 
-    stcp->outstate = NN_STCP_OUTSTATE_SENDING;
+    /*  If there's still space in the queue, the pipe can accept more
+        messages straight away. */
+    if (!nn_sendq_full (&stcp->outq))
+        nn_pipebase_sent (&stcp->pipebase);
 
     return 0;
 }
 
+static size_t nn_stcp_backlog (struct nn_pipebase *self)
+{
+    return nn_cont (self, struct nn_stcp, pipebase)->outq.bytes;
+}
+
 static int nn_stcp_recv (struct nn_pipebase *self, struct nn_msg *msg)
 {
     struct nn_stcp *stcp;
@@ -163,6 +217,14 @@ static int nn_stcp_recv (struct nn_pipebase *self, struct nn_msg *msg)
     nn_msg_mv (msg, &stcp->inmsg);
     nn_msg_init (&stcp->inmsg, 0);
 
+    /*  If the next message was already read from the socket, the pipe stays
+        readable. This way a burst of small messages is processed without
+        passing any events through the state machine. */
+    if (nn_stcp_decode (stcp)) {
+        nn_pipebase_received (&stcp->pipebase);
+        return 0;
+    }
+
     /*  Start receiving new message. */
     stcp->instate = NN_STCP_INSTATE_HDR;
     nn_usock_recv (stcp->usock, stcp->inhdr, sizeof (stcp->inhdr));
@@ -170,24 +232,248 @@ static int nn_stcp_recv (struct nn_pipebase *self, struct nn_msg *msg)
     return 0;
 }
 
+static void nn_stcp_send_batch (struct nn_stcp *self)
+{
+    struct nn_iovec iov [NN_SENDQ_MAXIOVCNT];
+    int iovcnt;
+    struct nn_sendq_file file;
+
+    iovcnt = nn_sendq_batch (&self->outq, iov, &file);
+    self->outstate = NN_STCP_OUTSTATE_SENDING;
+#if defined NN_USOCK_HAVE_SENDFILE
+    if (file.len > 0) {
+        nn_usock_sendfile (self->usock, iov, iovcnt, file.fd, file.offset,
+            file.len);
+        return;
+    }
+#endif
+    nn_usock_send (self->usock, iov, iovcnt);
+}
+
+/*  Replaces the message by its compressed form. Returns the size of
+    the compressed message, or 0 if the message was left intact. */
+static size_t nn_stcp_compress (struct nn_stcp *self, struct nn_msg *msg)
+{
+    int rc;
+    int fd;
+    uint64_t offset;
+    size_t hdrsz;
+    size_t size;
+    size_t maxlen;
+    size_t len;
+    void *out;
+    struct nn_stopwatch stopwatch;
+
+    /*  File-backed messages are better off being sent by sendfile. */
+    if (nn_chunkref_getfile (&msg->body, &fd, &offset))
+        return 0;
+
+    if (nn_slow (!self->lz)) {
+        self->lz = nn_alloc (sizeof (struct nn_lz), "compression state");
+        alloc_assert (self->lz);
+        nn_lz_init (self->lz, self->compress);
+    }
+
+    hdrsz = nn_chunkref_size (&msg->hdr);
+    size = hdrsz + nn_chunkref_size (&msg->body);
+
+    /*  The compressed message, including its original size, must be smaller
+        than the original, otherwise there's no point in compressing. */
+    if (size <= NN_STCP_ORIGSIZE + 1)
+        return 0;
+    maxlen = size - NN_STCP_ORIGSIZE - 1;
+
+    /*  Compress into the scratch buffer. Only the result, once its size
+        is known, is copied into the message. */
+    if (nn_slow (self->lzbufsz < maxlen)) {
+        nn_free (self->lzbuf);
+        self->lzbuf = nn_alloc (maxlen, "compression buffer");
+        alloc_assert (self->lzbuf);
+        self->lzbufsz = maxlen;
+    }
+    nn_stopwatch_init (&stopwatch);
+    len = nn_lz_compress (self->lz, nn_chunkref_data (&msg->hdr), hdrsz,
+        nn_chunkref_data (&msg->body), size - hdrsz, self->lzbuf, maxlen);
+    nn_pipebase_stat_increment (&self->pipebase, NN_STAT_COMPRESS_TIME,
+        nn_stopwatch_term (&stopwatch));
+    out = NULL;
+    if (len) {
+        rc = nn_chunk_alloc (len, 0, &out);
+        if (nn_fast (rc == 0))
+            memcpy (out, self->lzbuf, len);
+    }
+
+    /*  Don't keep huge buffers around after compressing a huge message. */
+    if (nn_slow (self->lzbufsz > NN_STCP_LZBUF_MAX)) {
+        nn_free (self->lzbuf);
+        self->lzbuf = NULL;
+        self->lzbufsz = 0;
+    }
+    if (!out)
+        return 0;
+
+    nn_pipebase_stat_increment (&self->pipebase, NN_STAT_COMPRESS_BYTES_IN,
+        size);
+    nn_pipebase_stat_increment (&self->pipebase, NN_STAT_COMPRESS_BYTES_OUT,
+        NN_STCP_ORIGSIZE + len);
+
+    nn_msg_term (msg);
+    nn_msg_init_chunk (msg, out);
+    return len;
+}
+
+/*  Replaces the compressed message just received by its decompressed form.
+    Returns -EPROTO if the data are malformed. */
+static int nn_stcp_decompress (struct nn_stcp *self)
+{
+    int rc;
+    uint8_t *data;
+    size_t len;
+    uint64_t size;
+    struct nn_msg msg;
+    struct nn_stopwatch stopwatch;
+
+    data = nn_chunkref_data (&self->inmsg.body);
+    len = nn_chunkref_size (&self->inmsg.body);
+    nn_assert (len >= NN_STCP_ORIGSIZE);
+    size = nn_getll (data);
+
+    /*  Check the original size before allocating the memory for it. This way
+        a malicious peer can't make us allocate much more memory than it
+        had actually sent. */
+    if (nn_slow (size / NN_LZ_MAXRATIO > len - NN_STCP_ORIGSIZE))
+        return -EPROTO;
+
+    nn_msg_init (&msg, (size_t) size);
+    nn_stopwatch_init (&stopwatch);
+    rc = nn_lz_decompress (data + NN_STCP_ORIGSIZE, len - NN_STCP_ORIGSIZE,
+        nn_chunkref_data (&msg.body), (size_t) size);
+    nn_pipebase_stat_increment (&self->pipebase, NN_STAT_DECOMPRESS_TIME,
+        nn_stopwatch_term (&stopwatch));
+    if (nn_slow (rc < 0)) {
+        nn_msg_term (&msg);
+        return rc;
+    }
+
+    nn_msg_term (&self->inmsg);
+    nn_msg_mv (&self->inmsg, &msg);
+    return 0;
+}
+
+/*  Decodes the whole message from the data that were already read from
+    the socket. Returns 1 if successful, 0 if there's not enough data. */
+static int nn_stcp_decode (struct nn_stcp *self)
+{
+    int rc;
+    uint8_t *data;
+    size_t len;
+    uint64_t size;
+    void *slab;
+    void *chunk;
+
+    len = nn_usock_batch (self->usock, &data);
+    if (len < sizeof (self->inhdr))
+        return 0;
+    size = nn_getll (data);
+
+    /*  Compressed messages are decompressed by the state machine. */
+    if (size & NN_STCP_COMPRESSED)
+        return 0;
+    if (size > len - sizeof (self->inhdr))
+        return 0;
+
+    /*  Make the message refer to the batch buffer directly. Small messages,
+        as well as any messages once the batch buffer can't be split any more,
+        are copied. */
+    nn_msg_term (&self->inmsg);
+    slab = nn_usock_batch_chunk (self->usock);
+    rc = -ENOMEM;
+    if (size >= nn_chunk_size (slab) / NN_USOCK_BATCH_COPYDIV)
+        rc = nn_chunk_alloc_sub (slab, data + sizeof (self->inhdr),
+            (size_t) size, &chunk);
+    if (nn_fast (rc == 0))
+        nn_msg_init_chunk (&self->inmsg, chunk);
+    else {
+        nn_msg_init (&self->inmsg, (size_t) size);
+        memcpy (nn_chunkref_data (&self->inmsg.body),
+            data + sizeof (self->inhdr), (size_t) size);
+    }
+    nn_usock_consume (self->usock, sizeof (self->inhdr) + (size_t) size);
+    self->instate = NN_STCP_INSTATE_HASMSG;
+
+    return 1;
+}
+
 static void nn_stcp_shutdown (struct nn_fsm *self, int src, int type,
     NN_UNUSED void *srcptr)
 {
     struct nn_stcp *stcp;
+    int linger;
+    size_t sz;
 
     stcp = nn_cont (self, struct nn_stcp, fsm);
 
     if (nn_slow (src == NN_FSM_ACTION && type == NN_FSM_STOP)) {
+
+        /*  nn_send has already reported the queued messages as sent. If
+            the connection is still alive, keep writing them for at most
+            NN_LINGER milliseconds before handing the socket back. */
+        linger = 0;
+        if (stcp->state == NN_STCP_STATE_ACTIVE &&
+              stcp->outstate == NN_STCP_OUTSTATE_SENDING) {
+            sz = sizeof (linger);
+            nn_pipebase_getopt (&stcp->pipebase, NN_SOL_SOCKET, NN_LINGER,
+                &linger, &sz);
+            nn_assert (sz == sizeof (linger));
+        }
+        if (linger == 0)
+            stcp->outstate = NN_STCP_OUTSTATE_IDLE;
+        else if (linger > 0)
+            nn_timer_start (&stcp->linger, linger);
+
         nn_pipebase_stop (&stcp->pipebase);
         nn_streamhdr_stop (&stcp->streamhdr);
         stcp->state = NN_STCP_STATE_STOPPING;
     }
     if (nn_slow (stcp->state == NN_STCP_STATE_STOPPING)) {
+
+        if (src == NN_STCP_SRC_USOCK &&
+              stcp->outstate == NN_STCP_OUTSTATE_SENDING) {
+            switch (type) {
+            case NN_USOCK_SENT:
+                stcp->outstate = NN_STCP_OUTSTATE_IDLE;
+                nn_sendq_hold (&stcp->outq, nn_usock_zcseq (stcp->usock));
+                nn_sendq_release (&stcp->outq, nn_usock_zcdone (stcp->usock));
+                if (nn_sendq_pending (&stcp->outq))
+                    nn_stcp_send_batch (stcp);
+                break;
+            case NN_USOCK_SHUTDOWN:
+            case NN_USOCK_ERROR:
+                stcp->outstate = NN_STCP_OUTSTATE_IDLE;
+                break;
+            }
+        }
+
+        /*  The linger period has expired. Give up on the remaining
+            messages, just like if the connection was broken. */
+        if (src == NN_STCP_SRC_LINGER && type == NN_TIMER_TIMEOUT)
+            stcp->outstate = NN_STCP_OUTSTATE_IDLE;
+
+        if (stcp->outstate == NN_STCP_OUTSTATE_SENDING)
+            return;
+        nn_timer_stop (&stcp->linger);
+        if (!nn_timer_isidle (&stcp->linger))
+            return;
+
         if (nn_streamhdr_isidle (&stcp->streamhdr)) {
             nn_usock_swap_owner (stcp->usock, &stcp->usock_owner);
             stcp->usock = NULL;
             stcp->usock_owner.src = -1;
             stcp->usock_owner.fsm = NULL;
+
+            /*  Drop any messages that couldn't be sent in time. */
+            nn_sendq_clear (&stcp->outq);
+
             stcp->state = NN_STCP_STATE_IDLE;
             nn_fsm_stopped (&stcp->fsm, NN_STCP_STOPPED);
             return;
@@ -204,6 +490,9 @@ static void nn_stcp_handler (struct nn_fsm *self, int src, int type,
     int rc;
     struct nn_stcp *stcp;
     uint64_t size;
+    int full;
+    int val;
+    size_t sz;
 
     stcp = nn_cont (self, struct nn_stcp, fsm);
 
@@ -218,6 +507,11 @@ static void nn_stcp_handler (struct nn_fsm *self, int src, int type,
         case NN_FSM_ACTION:
             switch (type) {
             case NN_FSM_START:
+
+                /*  We can always decompress the messages, irrespective of
+                    whether we compress the outbound ones. */
+                nn_streamhdr_setflags (&stcp->streamhdr,
+                    NN_STREAMHDR_FLAG_COMPRESS);
                 nn_streamhdr_start (&stcp->streamhdr, stcp->usock,
                     &stcp->pipebase);
                 stcp->state = NN_STCP_STATE_PROTOHDR;
@@ -280,10 +574,32 @@ static void nn_stcp_handler (struct nn_fsm *self, int src, int type,
                     return;
                  }
 
-                 /*  Start receiving a message in asynchronous manner. */
-                 stcp->instate = NN_STCP_INSTATE_HDR;
-                 nn_usock_recv (stcp->usock, &stcp->inhdr,
-                     sizeof (stcp->inhdr));
+                 /*  Compress the outbound messages if the user asked for it
+                     and the peer is able to decompress them. */
+                 if (nn_streamhdr_peerflags (&stcp->streamhdr) &
+                       NN_STREAMHDR_FLAG_COMPRESS) {
+                     sz = sizeof (val);
+                     nn_pipebase_getopt (&stcp->pipebase, NN_TCP,
+                         NN_TCP_COMPRESS, &val, &sz);
+                     nn_assert (sz == sizeof (val));
+                     stcp->compress = val;
+                     sz = sizeof (val);
+                     nn_pipebase_getopt (&stcp->pipebase, NN_TCP,
+                         NN_TCP_COMPRESS_THRESHOLD, &val, &sz);
+                     nn_assert (sz == sizeof (val));
+                     stcp->threshold = (size_t) val;
+                 }
+
+                 /*  Start receiving a message in asynchronous manner,
+                     unless it was already read along with the protocol
+                     header. */
+                 if (nn_stcp_decode (stcp))
+                     nn_pipebase_received (&stcp->pipebase);
+                 else {
+                     stcp->instate = NN_STCP_INSTATE_HDR;
+                     nn_usock_recv (stcp->usock, &stcp->inhdr,
+                         sizeof (stcp->inhdr));
+                 }
 
                  /*  Mark the pipe as available for sending. */
                  stcp->outstate = NN_STCP_OUTSTATE_IDLE;
@@ -309,12 +625,37 @@ static void nn_stcp_handler (struct nn_fsm *self, int src, int type,
             switch (type) {
             case NN_USOCK_SENT:
 
-                /*  The message is now fully sent. */
+                /*  The batch of messages is now fully sent. */
                 nn_assert (stcp->outstate == NN_STCP_OUTSTATE_SENDING);
                 stcp->outstate = NN_STCP_OUTSTATE_IDLE;
-                nn_msg_term (&stcp->outmsg);
-                nn_msg_init (&stcp->outmsg, 0);
-                nn_pipebase_sent (&stcp->pipebase);
+
+                /*  If the queue was full, the pipe is waiting for
+                    the space to be freed. */
+                full = nn_sendq_full (&stcp->outq);
+
+                /*  In zero-copy mode the kernel may still be reading
+                    the messages. Keep them until it reports it's done. */
+                nn_sendq_hold (&stcp->outq, nn_usock_zcseq (stcp->usock));
+                nn_sendq_release (&stcp->outq, nn_usock_zcdone (stcp->usock));
+
+                /*  Send the messages queued in the meantime. */
+                if (nn_sendq_pending (&stcp->outq))
+                    nn_stcp_send_batch (stcp);
+
+                /*  The messages that were pending can fill the queue
+                    on their own. In that case keep waiting. */
+                if (full && !nn_sendq_full (&stcp->outq))
+                    nn_pipebase_sent (&stcp->pipebase);
+                return;
+
+            case NN_USOCK_RELEASED:
+
+                /*  The kernel is done with some of the messages sent in
+                    zero-copy mode. */
+                full = nn_sendq_full (&stcp->outq);
+                nn_sendq_release (&stcp->outq, nn_usock_zcdone (stcp->usock));
+                if (full && !nn_sendq_full (&stcp->outq))
+                    nn_pipebase_sent (&stcp->pipebase);
                 return;
 
             case NN_USOCK_RECEIVED:
@@ -325,6 +666,15 @@ static void nn_stcp_handler (struct nn_fsm *self, int src, int type,
                     /*  Message header was received. Allocate memory for the
                         message. */
                     size = nn_getll (stcp->inhdr);
+                    stcp->incompressed = (size & NN_STCP_COMPRESSED) ? 1 : 0;
+                    size &= ~NN_STCP_COMPRESSED;
+                    if (nn_slow (stcp->incompressed &&
+                          size < NN_STCP_ORIGSIZE)) {
+                        nn_pipebase_stop (&stcp->pipebase);
+                        stcp->state = NN_STCP_STATE_DONE;
+                        nn_fsm_raise (&stcp->fsm, &stcp->done, NN_STCP_ERROR);
+                        return;
+                    }
                     nn_msg_term (&stcp->inmsg);
                     nn_msg_init (&stcp->inmsg, (size_t) size);
 
@@ -344,6 +694,19 @@ static void nn_stcp_handler (struct nn_fsm *self, int src, int type,
 
                 case NN_STCP_INSTATE_BODY:
 
+                    /*  A message that can't be decompressed is a protocol
+                        error. Close the connection. */
+                    if (stcp->incompressed) {
+                        rc = nn_stcp_decompress (stcp);
+                        if (nn_slow (rc < 0)) {
+                            nn_pipebase_stop (&stcp->pipebase);
+                            stcp->state = NN_STCP_STATE_DONE;
+                            nn_fsm_raise (&stcp->fsm, &stcp->done,
+                                NN_STCP_ERROR);
+                            return;
+                        }
+                    }
+
                     /*  Message body was received. Notify the owner that it
                         can receive it. */
                     stcp->instate = NN_STCP_INSTATE_HASMSG;
@@ -389,6 +752,8 @@ static void nn_stcp_handler (struct nn_fsm *self, int src, int type,
                 stcp->state = NN_STCP_STATE_DONE;
                 nn_fsm_raise (&stcp->fsm, &stcp->done, NN_STCP_ERROR);
                 return;
+            case NN_USOCK_RELEASED:
+                return;
             default:
                 nn_fsm_bad_action (stcp->state, src, type);
             }
@@ -404,6 +769,11 @@ static void nn_stcp_handler (struct nn_fsm *self, int src, int type,
 /*  this state except stopping the object.                                    */
 /******************************************************************************/
     case NN_STCP_STATE_DONE:
+
+        /*  If the connection was closed because of malformed data, the batch
+            being sent at the moment may still complete. */
+        if (src == NN_STCP_SRC_USOCK)
+            return;
         nn_fsm_bad_source (stcp->state, src, type);
 
 /******************************************************************************/
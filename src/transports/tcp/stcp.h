@@ -27,8 +27,11 @@
 
 #include "../../aio/fsm.h"
 #include "../../aio/usock.h"
+#include "../../aio/timer.h"
 
 #include "../utils/streamhdr.h"
+#include "../utils/sendq.h"
+#include "../utils/lz.h"
 
 #include "../../utils/msg.h"
 
@@ -50,6 +53,10 @@ struct nn_stcp {
     /*  Child state machine to do protocol header exchange. */
     struct nn_streamhdr streamhdr;
 
+    /*  Bounds the time spent sending queued messages after stop is
+        requested. */
+    struct nn_timer linger;
+
     /*  The original owner of the underlying socket. */
     struct nn_fsm_owner usock_owner;
 
@@ -65,14 +72,27 @@ struct nn_stcp {
     /*  Message being received at the moment. */
     struct nn_msg inmsg;
 
+    /*  1 if the message being received is compressed. */
+    int incompressed;
+
     /*  State of the outbound state machine. */
     int outstate;
 
-    /*  Buffer used to store the header of outgoing message. */
-    uint8_t outhdr [8];
-
-    /*  Message being sent at the moment. */
-    struct nn_msg outmsg;
+    /*  Outbound messages. Those that are not being sent at the moment
+        will be sent in a single batch once the current batch is done. */
+    struct nn_sendq outq;
+
+    /*  Compression level for outbound messages, or 0 if they are sent
+        uncompressed. Smaller messages than 'threshold' are never compressed.
+        Compression state is allocated when first needed. */
+    int compress;
+    size_t threshold;
+    struct nn_lz *lz;
+
+    /*  Scratch buffer outbound messages are compressed into. Allocated when
+        first needed and grown to fit the largest message. */
+    uint8_t *lzbuf;
+    size_t lzbufsz;
 
     /*  Event raised when the state machine ends. */
     struct nn_fsm_event done;
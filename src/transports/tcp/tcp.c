@@ -29,6 +29,7 @@
 
 #include "../utils/port.h"
 #include "../utils/iface.h"
+#include "../utils/lz.h"
 
 #include "../../utils/err.h"
 #include "../../utils/alloc.h"
@@ -49,6 +50,9 @@
 struct nn_tcp_optset {
     struct nn_optset base;
     int nodelay;
+    int zerocopy;
+    int compress;
+    int compress_threshold;
 };
 
 static void nn_tcp_optset_destroy (struct nn_optset *self);
@@ -100,6 +104,9 @@ static struct nn_optset *nn_tcp_optset ()
 
     /*  Default values for TCP socket options. */
     optset->nodelay = 0;
+    optset->zerocopy = 0;
+    optset->compress = 0;
+    optset->compress_threshold = 1024;
 
     return &optset->base;   
 }
@@ -131,6 +138,21 @@ static int nn_tcp_optset_setopt (struct nn_optset *self, int option,
             return -EINVAL;
         optset->nodelay = val;
         return 0;
+    case NN_TCP_ZEROCOPY:
+        if (nn_slow (val != 0 && val != 1))
+            return -EINVAL;
+        optset->zerocopy = val;
+        return 0;
+    case NN_TCP_COMPRESS:
+        if (nn_slow (val < 0 || val > NN_LZ_MAXLEVEL))
+            return -EINVAL;
+        optset->compress = val;
+        return 0;
+    case NN_TCP_COMPRESS_THRESHOLD:
+        if (nn_slow (val < 0))
+            return -EINVAL;
+        optset->compress_threshold = val;
+        return 0;
     default:
         return -ENOPROTOOPT;
     }
@@ -148,6 +170,15 @@ static int nn_tcp_optset_getopt (struct nn_optset *self, int option,
     case NN_TCP_NODELAY:
         intval = optset->nodelay;
         break;
+    case NN_TCP_ZEROCOPY:
+        intval = optset->zerocopy;
+        break;
+    case NN_TCP_COMPRESS:
+        intval = optset->compress;
+        break;
+    case NN_TCP_COMPRESS_THRESHOLD:
+        intval = optset->compress_threshold;
+        break;
     default:
         return -ENOPROTOOPT;
     }
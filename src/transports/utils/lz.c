@@ -0,0 +1,361 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+
+#include "lz.h"
+
+#include "../../utils/err.h"
+#include "../../utils/fast.h"
+#include "../../utils/attr.h"
+
+#include <string.h>
+
+#define NN_LZ_MINMATCH 4
+
+/*  Largest distance that can be encoded in a back-reference. */
+#define NN_LZ_MAXOFFSET (NN_LZ_WINDOW - 1)
+
+/*  Limit on the number of candidates examined at each position. */
+#define NN_LZ_MAXDEPTH 256
+
+/*  From this depth on, all the positions within matches are indexed. */
+#define NN_LZ_FULLDEPTH 16
+
+/*  Private functions. */
+static uint32_t nn_lz_hash (const uint8_t *p);
+static size_t nn_lz_count (const uint8_t *a, const uint8_t *b, size_t limit);
+static void nn_lz_insert (struct nn_lz *self, const uint8_t *in, size_t pos);
+static uint8_t *nn_lz_putlen (uint8_t *op, size_t len);
+static uint8_t *nn_lz_emit (uint8_t *op, uint8_t *oend, const uint8_t *pre,
+    size_t prelen, const uint8_t *lit, size_t litlen, size_t offset,
+    size_t matchlen);
+static int nn_lz_getlen (const uint8_t **ip, const uint8_t *iend,
+    size_t *len, size_t limit);
+
+void nn_lz_init (struct nn_lz *self, int level)
+{
+    nn_assert (level >= NN_LZ_MINLEVEL && level <= NN_LZ_MAXLEVEL);
+    self->depth = 1 << (level - 1);
+    if (self->depth > NN_LZ_MAXDEPTH)
+        self->depth = NN_LZ_MAXDEPTH;
+    self->base = 1;
+    memset (self->heads, 0, sizeof (self->heads));
+}
+
+void nn_lz_term (NN_UNUSED struct nn_lz *self)
+{
+}
+
+size_t nn_lz_compress (struct nn_lz *self, const void *hdr, size_t hdrlen,
+    const void *src, size_t srclen, void *dst, size_t dstlen)
+{
+    const uint8_t *pre;
+    const uint8_t *in;
+    uint8_t *op;
+    uint8_t *oend;
+    size_t ip;
+    size_t anchor;
+    size_t pos;
+    size_t cand;
+    size_t len;
+    size_t maxlen;
+    size_t bestlen;
+    size_t bestoff;
+    uint32_t h;
+    uint32_t head;
+    int depth;
+    size_t misses;
+
+    /*  Positions are stored as 32-bit integers. Don't bother with inputs
+        that wouldn't fit. */
+    if (nn_slow (srclen > 0x7fffffff || hdrlen > 0x7fffffff - srclen))
+        return 0;
+
+    /*  Forget the history once the position counter would overflow. */
+    if (nn_slow (self->base > 0xffffffff - srclen - 1)) {
+        self->base = 1;
+        memset (self->heads, 0, sizeof (self->heads));
+    }
+
+    pre = (const uint8_t*) hdr;
+    in = (const uint8_t*) src;
+    op = (uint8_t*) dst;
+    oend = op + dstlen;
+    ip = 0;
+    anchor = 0;
+
+    misses = 0;
+    while (ip + NN_LZ_MINMATCH <= srclen) {
+
+        /*  Insert the current position into the hash chain. */
+        h = nn_lz_hash (in + ip);
+        head = self->heads [h];
+        self->heads [h] = self->base + (uint32_t) ip;
+        if (head >= self->base && ip - (head - self->base) <= NN_LZ_MAXOFFSET)
+            cand = head - self->base;
+        else
+            cand = ip;
+        self->chain [ip & NN_LZ_MAXOFFSET] = (uint16_t) (ip - cand);
+
+        /*  Find the longest match among the candidates. */
+        bestlen = 0;
+        bestoff = 0;
+        maxlen = srclen - ip;
+        depth = self->depth;
+        while (cand != ip && depth--) {
+            if (in [cand + bestlen] == in [ip + bestlen] &&
+                  memcmp (in + cand, in + ip, NN_LZ_MINMATCH) == 0) {
+                len = NN_LZ_MINMATCH + nn_lz_count (in + cand + NN_LZ_MINMATCH,
+                    in + ip + NN_LZ_MINMATCH, maxlen - NN_LZ_MINMATCH);
+                if (len > bestlen) {
+                    bestlen = len;
+                    bestoff = ip - cand;
+                    if (len == maxlen)
+                        break;
+                }
+            }
+            if (!self->chain [cand & NN_LZ_MAXOFFSET])
+                break;
+            cand -= self->chain [cand & NN_LZ_MAXOFFSET];
+            if (ip - cand > NN_LZ_MAXOFFSET)
+                break;
+        }
+
+        /*  Skip faster over the data that don't seem to compress. */
+        if (bestlen < NN_LZ_MINMATCH) {
+            ip += 1 + (misses++ >> 6);
+            continue;
+        }
+        misses = 0;
+
+        /*  The header goes in front of the literals of the first token. */
+        op = nn_lz_emit (op, oend, pre, hdrlen, in + anchor, ip - anchor,
+            bestoff, bestlen);
+        if (nn_slow (!op))
+            return 0;
+        hdrlen = 0;
+
+        /*  Insert the positions covered by the match into the hash chains
+            so that subsequent data can refer to them. At the low levels
+            only the last few ones are inserted. */
+        pos = self->depth >= NN_LZ_FULLDEPTH ||
+            (size_t) self->depth >= bestlen ?
+            ip + 1 : ip + bestlen - self->depth;
+        for (; pos < ip + bestlen && pos + NN_LZ_MINMATCH <= srclen; ++pos)
+            nn_lz_insert (self, in, pos);
+        ip += bestlen;
+        anchor = ip;
+    }
+
+    /*  The remaining bytes are stored as literals. */
+    op = nn_lz_emit (op, oend, pre, hdrlen, in + anchor, srclen - anchor,
+        0, 0);
+    self->base += (uint32_t) srclen;
+    if (nn_slow (!op))
+        return 0;
+    return op - (uint8_t*) dst;
+}
+
+int nn_lz_decompress (const void *src, size_t srclen,
+    void *dst, size_t dstlen)
+{
+    int rc;
+    const uint8_t *ip;
+    const uint8_t *iend;
+    uint8_t *op;
+    uint8_t *oend;
+    const uint8_t *match;
+    uint8_t token;
+    size_t litlen;
+    size_t matchlen;
+    size_t offset;
+
+    ip = (const uint8_t*) src;
+    iend = ip + srclen;
+    op = (uint8_t*) dst;
+    oend = op + dstlen;
+
+    while (ip < iend) {
+        token = *ip++;
+
+        /*  Copy the literals. */
+        litlen = token >> 4;
+        if (litlen == 15) {
+            rc = nn_lz_getlen (&ip, iend, &litlen, dstlen);
+            if (nn_slow (rc < 0))
+                return rc;
+        }
+        if (nn_slow (litlen > (size_t) (iend - ip) ||
+              litlen > (size_t) (oend - op)))
+            return -EPROTO;
+        memcpy (op, ip, litlen);
+        ip += litlen;
+        op += litlen;
+
+        /*  The last token has no back-reference. */
+        if (ip == iend)
+            break;
+
+        /*  Copy the back-reference. The source and the destination may
+            overlap, in which case the data are repeated. */
+        if (nn_slow (iend - ip < 2))
+            return -EPROTO;
+        offset = ip [0] | (ip [1] << 8);
+        ip += 2;
+        if (nn_slow (offset == 0 || offset > (size_t) (op - (uint8_t*) dst)))
+            return -EPROTO;
+        matchlen = token & 15;
+        if (matchlen == 15) {
+            rc = nn_lz_getlen (&ip, iend, &matchlen, dstlen);
+            if (nn_slow (rc < 0))
+                return rc;
+        }
+        matchlen += NN_LZ_MINMATCH;
+        if (nn_slow (matchlen > (size_t) (oend - op)))
+            return -EPROTO;
+        match = op - offset;
+        if (offset >= matchlen) {
+            memcpy (op, match, matchlen);
+            op += matchlen;
+        }
+        else {
+            while (matchlen--)
+                *op++ = *match++;
+        }
+    }
+
+    return op == oend ? 0 : -EPROTO;
+}
+
+static uint32_t nn_lz_hash (const uint8_t *p)
+{
+    uint32_t v;
+
+    /*  The hash is never stored, so byte order doesn't matter. */
+    memcpy (&v, p, sizeof (v));
+    return (v * 2654435761u) >> (32 - NN_LZ_HASHBITS);
+}
+
+/*  Returns the number of equal bytes at the beginning of 'a' and 'b',
+    at most 'limit'. */
+static size_t nn_lz_count (const uint8_t *a, const uint8_t *b, size_t limit)
+{
+    size_t n;
+#if defined __GNUC__ && defined __BYTE_ORDER__ && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t va;
+    uint64_t vb;
+
+    /*  Compare 8 bytes at a time. The first differing byte is found by
+        counting the trailing zero bits of the XOR of the two words. */
+    for (n = 0; n + 8 <= limit; n += 8) {
+        memcpy (&va, a + n, 8);
+        memcpy (&vb, b + n, 8);
+        if (va != vb)
+            return n + (__builtin_ctzll (va ^ vb) >> 3);
+    }
+#else
+    n = 0;
+#endif
+    while (n < limit && a [n] == b [n])
+        ++n;
+    return n;
+}
+
+static void nn_lz_insert (struct nn_lz *self, const uint8_t *in, size_t pos)
+{
+    uint32_t h;
+    uint32_t head;
+
+    h = nn_lz_hash (in + pos);
+    head = self->heads [h];
+    self->heads [h] = self->base + (uint32_t) pos;
+    self->chain [pos & NN_LZ_MAXOFFSET] = (uint16_t) (head >= self->base &&
+        pos - (head - self->base) <= NN_LZ_MAXOFFSET ?
+        pos - (head - self->base) : 0);
+}
+
+/*  Lengths of 15 and more are stored as a sequence of bytes following
+    the token. Each byte adds its value to the length; 255 means that
+    another byte follows. */
+static uint8_t *nn_lz_putlen (uint8_t *op, size_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t) len;
+    return op;
+}
+
+/*  Emits a token. Its literals are 'prelen' bytes at 'pre' followed by
+    'litlen' bytes at 'lit'. */
+static uint8_t *nn_lz_emit (uint8_t *op, uint8_t *oend, const uint8_t *pre,
+    size_t prelen, const uint8_t *lit, size_t litlen, size_t offset,
+    size_t matchlen)
+{
+    size_t need;
+    size_t total;
+
+    /*  Check whether the token fits into the output buffer. */
+    total = prelen + litlen;
+    need = 1 + total + total / 255 + 1;
+    if (matchlen)
+        need += 2 + matchlen / 255 + 1;
+    if (nn_slow (need > (size_t) (oend - op)))
+        return NULL;
+
+    if (matchlen)
+        matchlen -= NN_LZ_MINMATCH;
+    *op++ = (uint8_t) (((total < 15 ? total : 15) << 4) |
+        (matchlen < 15 ? matchlen : 15));
+    if (total >= 15)
+        op = nn_lz_putlen (op, total - 15);
+    if (prelen) {
+        memcpy (op, pre, prelen);
+        op += prelen;
+    }
+    memcpy (op, lit, litlen);
+    op += litlen;
+    if (!offset)
+        return op;
+    *op++ = (uint8_t) (offset & 0xff);
+    *op++ = (uint8_t) (offset >> 8);
+    if (matchlen >= 15)
+        op = nn_lz_putlen (op, matchlen - 15);
+    return op;
+}
+
+static int nn_lz_getlen (const uint8_t **ip, const uint8_t *iend,
+    size_t *len, size_t limit)
+{
+    uint8_t b;
+
+    do {
+        if (nn_slow (*ip == iend || *len > limit))
+            return -EPROTO;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
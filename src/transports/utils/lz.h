@@ -0,0 +1,84 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef NN_LZ_INCLUDED
+#define NN_LZ_INCLUDED
+
+#include "../../utils/int.h"
+
+#include <stddef.h>
+
+/*  Simple LZ77 codec used to compress messages on the wire. The compressed
+    data is a sequence of tokens, each consisting of a run of literal bytes
+    followed by a back-reference to the data decompressed so far. The format
+    doesn't store the length of the original data. It has to be passed
+    to the decompressor separately. */
+
+/*  Valid compression levels. The higher the level the more candidate
+    matches are examined for each position in the input. */
+#define NN_LZ_MINLEVEL 1
+#define NN_LZ_MAXLEVEL 9
+
+/*  Compressed data never expands to more than this multiple of its size.
+    This allows the receiver to reject bogus original sizes before
+    allocating any memory. */
+#define NN_LZ_MAXRATIO 256
+
+#define NN_LZ_HASHBITS 14
+#define NN_LZ_WINDOW 65536
+
+struct nn_lz {
+
+    /*  Number of candidate matches to examine at each position. */
+    int depth;
+
+    /*  Position of the input data within the history. Positions below
+        this value belong to the previous inputs and are ignored. */
+    uint32_t base;
+
+    /*  Last position for each hash of the 4-byte sequence. */
+    uint32_t heads [1 << NN_LZ_HASHBITS];
+
+    /*  For each position within the window, distance to the previous
+        position with the same hash, or 0 if there's none. */
+    uint16_t chain [NN_LZ_WINDOW];
+};
+
+void nn_lz_init (struct nn_lz *self, int level);
+void nn_lz_term (struct nn_lz *self);
+
+/*  Compresses 'hdrlen' bytes from 'hdr' followed by 'srclen' bytes from 'src'
+    into 'dst', as if they were a single buffer. The first segment is meant
+    for short protocol headers. It is stored as literals and only the second
+    one is searched for matches. Returns the size of the compressed data or 0
+    if it doesn't fit into 'dstlen' bytes. */
+size_t nn_lz_compress (struct nn_lz *self, const void *hdr, size_t hdrlen,
+    const void *src, size_t srclen, void *dst, size_t dstlen);
+
+/*  Decompresses 'srclen' bytes from 'src' into exactly 'dstlen' bytes at
+    'dst'. Returns -EPROTO if the compressed data are malformed or don't
+    decompress to 'dstlen' bytes. */
+int nn_lz_decompress (const void *src, size_t srclen,
+    void *dst, size_t dstlen);
+
+#endif
+
@@ -0,0 +1,195 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+
+#include "sendq.h"
+
+#include "../../aio/usock.h"
+
+#include "../../utils/err.h"
+#include "../../utils/fast.h"
+
+#include <string.h>
+
+/*  Whole batch must fit into a single nn_usock_send call. */
+CT_ASSERT (NN_SENDQ_MAXIOVCNT <= NN_USOCK_MAX_IOVCNT);
+
+void nn_sendq_init (struct nn_sendq *self)
+{
+    int i;
+
+    for (i = 0; i != NN_SENDQ_SLOTS; ++i) {
+        self->items [i].hdrlen = 0;
+        nn_msg_init (&self->items [i].msg, 0);
+        self->items [i].seq = 0;
+    }
+    self->first = 0;
+    self->count = 0;
+    self->held = 0;
+    self->inflight = 0;
+    self->bytes = 0;
+}
+
+void nn_sendq_term (struct nn_sendq *self)
+{
+    int i;
+
+    for (i = 0; i != NN_SENDQ_SLOTS; ++i)
+        nn_msg_term (&self->items [i].msg);
+}
+
+void nn_sendq_clear (struct nn_sendq *self)
+{
+    struct nn_sendq_item *item;
+
+    while (self->count) {
+        item = &self->items [self->first];
+        nn_msg_term (&item->msg);
+        nn_msg_init (&item->msg, 0);
+        self->first = (self->first + 1) % NN_SENDQ_SLOTS;
+        --self->count;
+    }
+    self->held = 0;
+    self->inflight = 0;
+    self->bytes = 0;
+}
+
+int nn_sendq_full (struct nn_sendq *self)
+{
+    return self->count >= NN_SENDQ_MAXMSGS ||
+        self->bytes >= NN_SENDQ_MAXBYTES ? 1 : 0;
+}
+
+int nn_sendq_pending (struct nn_sendq *self)
+{
+    return self->count > self->held + self->inflight ? 1 : 0;
+}
+
+void nn_sendq_push (struct nn_sendq *self, const void *hdr, size_t hdrlen,
+    struct nn_msg *msg)
+{
+    struct nn_sendq_item *item;
+
+    nn_assert (self->count < NN_SENDQ_SLOTS);
+    nn_assert (hdrlen <= NN_SENDQ_MAXHDRLEN);
+
+    item = &self->items [(self->first + self->count) % NN_SENDQ_SLOTS];
+    memcpy (item->hdr, hdr, hdrlen);
+    item->hdrlen = hdrlen;
+    nn_msg_term (&item->msg);
+    nn_msg_mv (&item->msg, msg);
+    ++self->count;
+    self->bytes += hdrlen + nn_chunkref_size (&item->msg.hdr) +
+        nn_chunkref_size (&item->msg.body);
+}
+
+int nn_sendq_batch (struct nn_sendq *self, struct nn_iovec *iov,
+    struct nn_sendq_file *file)
+{
+    int iovcnt;
+    struct nn_sendq_item *item;
+
+    nn_assert (self->inflight == 0);
+
+    iovcnt = 0;
+    file->len = 0;
+    while (self->held + self->inflight != self->count) {
+        item = &self->items [(self->first + self->held + self->inflight) %
+            NN_SENDQ_SLOTS];
+        iov [iovcnt].iov_base = item->hdr;
+        iov [iovcnt].iov_len = item->hdrlen;
+        ++iovcnt;
+        iov [iovcnt].iov_base = nn_chunkref_data (&item->msg.hdr);
+        iov [iovcnt].iov_len = nn_chunkref_size (&item->msg.hdr);
+        ++iovcnt;
+
+        /*  Body of the message will be read from the file by the kernel.
+            Nothing can be sent after it in the same batch. */
+#if defined NN_USOCK_HAVE_SENDFILE
+        if (nn_chunkref_getfile (&item->msg.body, &file->fd, &file->offset)) {
+            file->len = nn_chunkref_size (&item->msg.body);
+            ++self->inflight;
+            break;
+        }
+#endif
+        iov [iovcnt].iov_base = nn_chunkref_data (&item->msg.body);
+        iov [iovcnt].iov_len = nn_chunkref_size (&item->msg.body);
+        ++iovcnt;
+        ++self->inflight;
+    }
+
+    return iovcnt;
+}
+
+void nn_sendq_sent (struct nn_sendq *self)
+{
+    struct nn_sendq_item *item;
+
+    nn_assert (self->inflight > 0);
+    nn_assert (self->held == 0);
+
+    while (self->inflight) {
+        item = &self->items [self->first];
+        self->bytes -= item->hdrlen + nn_chunkref_size (&item->msg.hdr) +
+            nn_chunkref_size (&item->msg.body);
+        nn_msg_term (&item->msg);
+        nn_msg_init (&item->msg, 0);
+        self->first = (self->first + 1) % NN_SENDQ_SLOTS;
+        --self->count;
+        --self->inflight;
+    }
+}
+
+void nn_sendq_hold (struct nn_sendq *self, uint32_t seq)
+{
+    struct nn_sendq_item *item;
+
+    nn_assert (self->inflight > 0);
+
+    while (self->inflight) {
+        item = &self->items [(self->first + self->held) % NN_SENDQ_SLOTS];
+        self->bytes -= item->hdrlen + nn_chunkref_size (&item->msg.hdr) +
+            nn_chunkref_size (&item->msg.body);
+        item->seq = seq;
+        ++self->held;
+        --self->inflight;
+    }
+}
+
+void nn_sendq_release (struct nn_sendq *self, uint32_t done)
+{
+    struct nn_sendq_item *item;
+
+    while (self->held) {
+        item = &self->items [self->first];
+
+        /*  The counters are allowed to wrap around. */
+        if ((int32_t) (done - item->seq) < 0)
+            break;
+        nn_msg_term (&item->msg);
+        nn_msg_init (&item->msg, 0);
+        self->first = (self->first + 1) % NN_SENDQ_SLOTS;
+        --self->count;
+        --self->held;
+    }
+}
+
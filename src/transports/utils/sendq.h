@@ -0,0 +1,140 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+
+#ifndef NN_SENDQ_INCLUDED
+#define NN_SENDQ_INCLUDED
+
+#include "../../nn.h"
+
+#include "../../utils/msg.h"
+#include "../../utils/int.h"
+
+#include <stddef.h>
+
+/*  Queue of outbound messages for stream-based transports. Messages are
+    stored along with their wire-level headers so that all the queued
+    messages can be written to the socket using a single nn_usock_send
+    call. At most one batch of messages is being sent at any given time. */
+
+/*  Maximum number of messages stored in the queue. */
+#define NN_SENDQ_MAXMSGS 16
+
+/*  On top of that, there's one spare slot in the queue. It's used by
+    the transport to queue its own control messages even if the queue is
+    full at the moment. */
+#define NN_SENDQ_SLOTS (NN_SENDQ_MAXMSGS + 1)
+
+/*  Once this amount of data is stored in the queue, the queue is reported as
+    full even if there are free slots left. */
+#define NN_SENDQ_MAXBYTES (128 * 1024)
+
+/*  Maximum size of the transport-specific message header. */
+#define NN_SENDQ_MAXHDRLEN 32
+
+/*  Maximum number of iovecs filled in by nn_sendq_batch. */
+#define NN_SENDQ_MAXIOVCNT (NN_SENDQ_SLOTS * 3)
+
+struct nn_sendq_item {
+    uint8_t hdr [NN_SENDQ_MAXHDRLEN];
+    size_t hdrlen;
+    struct nn_msg msg;
+
+    /*  For held messages, the value of the socket's completion counter
+        at which the message can be released. */
+    uint32_t seq;
+};
+
+/*  Part of a file to be sent after the buffers of the batch. */
+struct nn_sendq_file {
+    int fd;
+    uint64_t offset;
+    size_t len;
+};
+
+struct nn_sendq {
+
+    /*  Ring buffer of the messages. */
+    struct nn_sendq_item items [NN_SENDQ_SLOTS];
+
+    /*  Index of the oldest message in the ring. */
+    int first;
+
+    /*  Number of messages in the ring. */
+    int count;
+
+    /*  Number of messages, starting with the oldest one, that were already
+        sent but the socket may still be reading their data. */
+    int held;
+
+    /*  Number of messages, starting with the oldest one, that are being
+        sent at the moment. */
+    int inflight;
+
+    /*  Total size of the messages in the ring. */
+    size_t bytes;
+};
+
+void nn_sendq_init (struct nn_sendq *self);
+void nn_sendq_term (struct nn_sendq *self);
+
+/*  Drops all the messages in the queue, including the batch being sent.
+    The caller is responsible for making sure that the underlying socket
+    doesn't access the batch any more. */
+void nn_sendq_clear (struct nn_sendq *self);
+
+/*  Returns 1 if no more messages can be pushed to the queue. */
+int nn_sendq_full (struct nn_sendq *self);
+
+/*  Returns 1 if there are messages that are not being sent yet. */
+int nn_sendq_pending (struct nn_sendq *self);
+
+/*  Moves the message to the queue. 'hdr' is the wire-level header to be
+    sent before the message. The queue must not be full, except for a single
+    control message which can be put into the spare slot. */
+void nn_sendq_push (struct nn_sendq *self, const void *hdr, size_t hdrlen,
+    struct nn_msg *msg);
+
+/*  Marks the pending messages as being sent and fills in 'iov' with the
+    buffers to send. 'iov' must have space for NN_SENDQ_MAXIOVCNT items.
+    If the body of a message is backed by a file and the socket is able to
+    send files directly, the batch ends with that message and 'file' is
+    filled in with the part of the file to send after the buffers. Otherwise
+    'file->len' is set to zero. Returns number of iovecs filled in. */
+int nn_sendq_batch (struct nn_sendq *self, struct nn_iovec *iov,
+    struct nn_sendq_file *file);
+
+/*  Releases the messages from the batch that was sent. */
+void nn_sendq_sent (struct nn_sendq *self);
+
+/*  Same as nn_sendq_sent, except that the messages are kept in the queue
+    until nn_sendq_release is called with 'done' equal or greater than
+    'seq'. Used when the socket sends the data without copying them. Held
+    messages occupy slots in the queue but don't count towards
+    NN_SENDQ_MAXBYTES. */
+void nn_sendq_hold (struct nn_sendq *self, uint32_t seq);
+
+/*  Releases the held messages up to the sequence number 'done'. Messages
+    are released in the order they were sent. */
+void nn_sendq_release (struct nn_sendq *self, uint32_t done);
+
+#endif
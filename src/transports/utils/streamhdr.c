@@ -63,6 +63,7 @@ void nn_streamhdr_init (struct nn_streamhdr *self, int src,
     self->usock_owner.src = -1;
     self->usock_owner.fsm = NULL;
     self->pipebase = NULL;
+    self->flags = 0;
 }
 
 void nn_streamhdr_term (struct nn_streamhdr *self)
@@ -101,11 +102,24 @@ void nn_streamhdr_start (struct nn_streamhdr *self, struct nn_usock *usock,
     /*  Compose the protocol header. */
     memcpy (self->protohdr, "\0SP\0\0\0\0\0", 8);
     nn_puts (self->protohdr + 4, (uint16_t) protocol);
+    self->protohdr [6] = self->flags;
 
     /*  Launch the state machine. */
     nn_fsm_start (&self->fsm);
 }
 
+void nn_streamhdr_setflags (struct nn_streamhdr *self, int flags)
+{
+    nn_assert_state (self, NN_STREAMHDR_STATE_IDLE);
+    self->flags = (uint8_t) flags;
+}
+
+int nn_streamhdr_peerflags (struct nn_streamhdr *self)
+{
+    /*  Once the exchange is done, the buffer holds the peer's header. */
+    return self->protohdr [6];
+}
+
 void nn_streamhdr_stop (struct nn_streamhdr *self)
 {
     nn_fsm_stop (&self->fsm);
@@ -287,6 +301,21 @@ invalidhdr:
     case NN_STREAMHDR_STATE_STOPPING_TIMER_DONE:
         switch (src) {
 
+        case NN_STREAMHDR_SRC_USOCK:
+            switch (type) {
+            case NN_USOCK_SHUTDOWN:
+                return;
+            case NN_USOCK_ERROR:
+                /*  The peer may have closed the connection while the timer
+                    is being stopped (it may be running on another worker
+                    thread). Report the failure instead of passing a dead
+                    connection to the owner. */
+                streamhdr->state = NN_STREAMHDR_STATE_STOPPING_TIMER_ERROR;
+                return;
+            default:
+                nn_fsm_bad_action (streamhdr->state, src, type);
+            }
+
         case NN_STREAMHDR_SRC_TIMER:
             switch (type) {
             case NN_TIMER_STOPPED:
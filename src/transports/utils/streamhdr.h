@@ -38,6 +38,12 @@
 #define NN_STREAMHDR_ERROR 2
 #define NN_STREAMHDR_STOPPED 3
 
+/*  Capabilities advertised to the peer in the otherwise unused byte of
+    the protocol header. Peers that don't know about a capability simply
+    ignore it. */
+#define NN_STREAMHDR_FLAG_SHM 1
+#define NN_STREAMHDR_FLAG_COMPRESS 2
+
 struct nn_streamhdr {
 
     /*  The state machine. */
@@ -56,6 +62,9 @@ struct nn_streamhdr {
     /*  Handle to the pipe. */
     struct nn_pipebase *pipebase;
 
+    /*  Capabilities to advertise to the peer. */
+    uint8_t flags;
+
     /*  Protocol header. */
     uint8_t protohdr [8];
 
@@ -72,4 +81,12 @@ void nn_streamhdr_start (struct nn_streamhdr *self, struct nn_usock *usock,
     struct nn_pipebase *pipebase);
 void nn_streamhdr_stop (struct nn_streamhdr *self);
 
+/*  Sets the capabilities to advertise. Must be called before
+    nn_streamhdr_start. */
+void nn_streamhdr_setflags (struct nn_streamhdr *self, int flags);
+
+/*  Returns the capabilities advertised by the peer. Valid only after
+    the headers were successfully exchanged. */
+int nn_streamhdr_peerflags (struct nn_streamhdr *self);
+
 #endif
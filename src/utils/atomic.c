@@ -78,3 +78,48 @@ uint32_t nn_atomic_dec (struct nn_atomic *self, uint32_t n)
 #endif
 }
 
+uint32_t nn_atomic_cas (struct nn_atomic *self, uint32_t oldval,
+    uint32_t newval)
+{
+#if defined NN_ATOMIC_WINAPI
+    return (uint32_t) InterlockedCompareExchange ((LONG*) &self->n,
+        (LONG) newval, (LONG) oldval);
+#elif defined NN_ATOMIC_SOLARIS
+    return atomic_cas_32 (&self->n, oldval, newval);
+#elif defined NN_ATOMIC_GCC_BUILTINS
+    return (uint32_t) __sync_val_compare_and_swap (&self->n, oldval, newval);
+#elif defined NN_ATOMIC_MUTEX
+    uint32_t res;
+    nn_mutex_lock (&self->sync);
+    res = self->n;
+    if (res == oldval)
+        self->n = newval;
+    nn_mutex_unlock (&self->sync);
+    return res;
+#else
+#error
+#endif
+}
+
+void nn_atomic_barrier (void)
+{
+#if defined NN_ATOMIC_WINAPI
+    MemoryBarrier ();
+#elif defined NN_ATOMIC_SOLARIS
+    membar_enter ();
+    membar_exit ();
+#elif defined NN_ATOMIC_GCC_BUILTINS
+    __sync_synchronize ();
+#elif defined NN_ATOMIC_MUTEX
+    struct nn_mutex sync;
+
+    /*  Locking and unlocking a mutex implies a full barrier. */
+    nn_mutex_init (&sync);
+    nn_mutex_lock (&sync);
+    nn_mutex_unlock (&sync);
+    nn_mutex_term (&sync);
+#else
+#error
+#endif
+}
+
@@ -57,5 +57,13 @@ uint32_t nn_atomic_inc (struct nn_atomic *self, uint32_t n);
 /*  Atomically subtract n from the object, return old value of the object. */
 uint32_t nn_atomic_dec (struct nn_atomic *self, uint32_t n);
 
+/*  Atomically set the object to 'newval' if its current value is 'oldval'.
+    Return the value of the object before the operation. */
+uint32_t nn_atomic_cas (struct nn_atomic *self, uint32_t oldval,
+    uint32_t newval);
+
+/*  Full memory barrier. Memory accesses are not reordered across it. */
+void nn_atomic_barrier (void);
+
 #endif
 
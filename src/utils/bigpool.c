@@ -0,0 +1,387 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "bigpool.h"
+#include "mutex.h"
+#include "atomic.h"
+#include "glock.h"
+#include "alloc.h"
+#include "fast.h"
+#include "err.h"
+#include "int.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#if !defined NN_HAVE_WINDOWS
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+/*  Each power of two is split into this many size classes. */
+#define NN_BIGPOOL_STEPS 4
+
+/*  Number of size classes needed to cover sizes up to NN_BIGPOOL_MAX. */
+#define NN_BIGPOOL_CLASSES 56
+
+/*  Size of a huge page. Only buffers of at least this size are backed by
+    huge pages. */
+#define NN_BIGPOOL_HUGEPAGE (2 * 1024 * 1024)
+
+/*  Values of NN_HUGEPAGES environment variable. */
+#define NN_BIGPOOL_HUGE_NONE 0
+#define NN_BIGPOOL_HUGE_TRANSPARENT 1
+#define NN_BIGPOOL_HUGE_EXPLICIT 2
+
+/*  Header preceding each buffer. */
+struct nn_bigpool_block {
+
+    /*  Next buffer in the free list. */
+    struct nn_bigpool_block *next;
+
+    /*  Size of the memory mapping, including the header. */
+    size_t mapsize;
+
+    /*  Size class of the buffer, -1 if the buffer is too big to be cached. */
+    int cls;
+
+    /*  1 if the buffer is backed by huge pages. */
+    int huge;
+};
+
+CT_ASSERT (((size_t) NN_BIGPOOL_MIN << ((NN_BIGPOOL_CLASSES - 1) /
+    NN_BIGPOOL_STEPS)) * (2 * NN_BIGPOOL_STEPS) / NN_BIGPOOL_STEPS ==
+    NN_BIGPOOL_MAX);
+
+/*  The mutex is initialised from nn_global_init, or on the first allocation
+    if a message is allocated before any socket was created. It's never
+    destroyed as messages can be freed even after the library terminated. */
+static volatile int nn_bigpool_initialised = 0;
+static struct nn_mutex nn_bigpool_sync;
+
+/*  Freed buffers are cached only while the library is initialised. */
+static int nn_bigpool_active = 0;
+static size_t nn_bigpool_pagesize;
+static int nn_bigpool_hugepages;
+
+/*  Free lists, one per size class. */
+static struct nn_bigpool_block *nn_bigpool_free_list [NN_BIGPOOL_CLASSES];
+
+/*  Allocation statistics. */
+static struct nn_allocstats nn_bigpool_statistics;
+
+/*  Private functions. */
+static void nn_bigpool_init_sync (void);
+static int nn_bigpool_isinit (void);
+static size_t nn_bigpool_class_size (int cls);
+static struct nn_bigpool_block *nn_bigpool_map (size_t size);
+static void nn_bigpool_unmap (struct nn_bigpool_block *block);
+
+void nn_bigpool_init (void)
+{
+    nn_bigpool_init_sync ();
+    nn_mutex_lock (&nn_bigpool_sync);
+    nn_bigpool_active = 1;
+    nn_mutex_unlock (&nn_bigpool_sync);
+}
+
+void nn_bigpool_term (void)
+{
+    int cls;
+    struct nn_bigpool_block *list [NN_BIGPOOL_CLASSES];
+    struct nn_bigpool_block *block;
+
+    /*  Stop caching and return all the cached buffers to the OS. */
+    nn_mutex_lock (&nn_bigpool_sync);
+    nn_bigpool_active = 0;
+    for (cls = 0; cls != NN_BIGPOOL_CLASSES; ++cls) {
+        list [cls] = nn_bigpool_free_list [cls];
+        nn_bigpool_free_list [cls] = NULL;
+        for (block = list [cls]; block; block = block->next) {
+            nn_bigpool_statistics.cached -= block->mapsize;
+            if (block->huge)
+                nn_bigpool_statistics.huge -= block->mapsize;
+        }
+    }
+    nn_mutex_unlock (&nn_bigpool_sync);
+
+    for (cls = 0; cls != NN_BIGPOOL_CLASSES; ++cls) {
+        while (list [cls]) {
+            block = list [cls];
+            list [cls] = block->next;
+            nn_bigpool_unmap (block);
+        }
+    }
+}
+
+static void nn_bigpool_init_sync (void)
+{
+    const char *env;
+#if defined NN_HAVE_WINDOWS
+    SYSTEM_INFO info;
+#endif
+
+    /*  The function is called with nn_glock held. */
+    if (nn_bigpool_initialised)
+        return;
+
+#if defined NN_HAVE_WINDOWS
+    GetSystemInfo (&info);
+    nn_bigpool_pagesize = (size_t) info.dwPageSize;
+#else
+    nn_bigpool_pagesize = (size_t) sysconf (_SC_PAGESIZE);
+#endif
+
+    env = getenv ("NN_HUGEPAGES");
+    if (env && strcmp (env, "transparent") == 0)
+        nn_bigpool_hugepages = NN_BIGPOOL_HUGE_TRANSPARENT;
+    else if (env && strcmp (env, "explicit") == 0)
+        nn_bigpool_hugepages = NN_BIGPOOL_HUGE_EXPLICIT;
+    else
+        nn_bigpool_hugepages = NN_BIGPOOL_HUGE_NONE;
+
+    /*  Allocations don't take nn_glock once the pool is initialised. Make
+        sure they see the mutex initialised. Pairs with the barrier in
+        nn_bigpool_isinit. */
+    nn_mutex_init (&nn_bigpool_sync);
+    nn_atomic_barrier ();
+    nn_bigpool_initialised = 1;
+}
+
+static int nn_bigpool_isinit (void)
+{
+    if (!nn_bigpool_initialised)
+        return 0;
+
+    /*  Don't let the reads of the pool's state be done before the read of
+        the flag. */
+    nn_atomic_barrier ();
+    return 1;
+}
+
+void *nn_bigpool_alloc (size_t size)
+{
+    int cls;
+    size_t mapsize;
+    struct nn_bigpool_block *block;
+    const size_t hdrsz = sizeof (struct nn_bigpool_block);
+
+    if (nn_slow (!nn_bigpool_isinit ())) {
+        nn_glock_lock ();
+        nn_bigpool_init_sync ();
+        nn_glock_unlock ();
+    }
+
+    if (nn_slow (size + hdrsz < size))
+        return NULL;
+    size += hdrsz;
+
+    /*  Find the appropriate size class. */
+    if (nn_slow (size > NN_BIGPOOL_MAX)) {
+        cls = -1;
+        mapsize = (size + nn_bigpool_pagesize - 1) / nn_bigpool_pagesize *
+            nn_bigpool_pagesize;
+        if (nn_slow (mapsize < size))
+            return NULL;
+    }
+    else {
+        cls = 0;
+        while (nn_bigpool_class_size (cls) < size)
+            ++cls;
+        mapsize = nn_bigpool_class_size (cls);
+    }
+
+    /*  Try to reuse a cached buffer. */
+    nn_mutex_lock (&nn_bigpool_sync);
+    block = cls >= 0 ? nn_bigpool_free_list [cls] : NULL;
+    if (nn_fast (block != NULL)) {
+        nn_bigpool_free_list [cls] = block->next;
+        ++nn_bigpool_statistics.hits;
+        nn_bigpool_statistics.cached -= block->mapsize;
+        nn_bigpool_statistics.inuse += block->mapsize;
+        nn_mutex_unlock (&nn_bigpool_sync);
+        return block + 1;
+    }
+    ++nn_bigpool_statistics.misses;
+    nn_mutex_unlock (&nn_bigpool_sync);
+
+    /*  Map a new buffer. */
+    block = nn_bigpool_map (mapsize);
+    if (nn_slow (!block))
+        return NULL;
+    block->cls = cls;
+    nn_mutex_lock (&nn_bigpool_sync);
+    nn_bigpool_statistics.inuse += block->mapsize;
+    if (block->huge)
+        nn_bigpool_statistics.huge += block->mapsize;
+    nn_mutex_unlock (&nn_bigpool_sync);
+
+    return block + 1;
+}
+
+void nn_bigpool_free (void *p)
+{
+    struct nn_bigpool_block *block;
+
+    block = ((struct nn_bigpool_block*) p) - 1;
+
+    nn_mutex_lock (&nn_bigpool_sync);
+    nn_bigpool_statistics.inuse -= block->mapsize;
+
+    /*  Keep the buffer for later use if there's space in the cache. */
+    if (nn_fast (nn_bigpool_active && block->cls >= 0 &&
+          nn_bigpool_statistics.cached + block->mapsize <=
+          NN_BIGPOOL_CACHE_BYTES)) {
+        block->next = nn_bigpool_free_list [block->cls];
+        nn_bigpool_free_list [block->cls] = block;
+        nn_bigpool_statistics.cached += block->mapsize;
+        nn_mutex_unlock (&nn_bigpool_sync);
+        return;
+    }
+
+    if (block->huge)
+        nn_bigpool_statistics.huge -= block->mapsize;
+    nn_mutex_unlock (&nn_bigpool_sync);
+
+    nn_bigpool_unmap (block);
+}
+
+void nn_bigpool_stats (struct nn_allocstats *stats)
+{
+    if (nn_slow (!nn_bigpool_isinit ())) {
+        memset (stats, 0, sizeof (struct nn_allocstats));
+        return;
+    }
+
+    nn_mutex_lock (&nn_bigpool_sync);
+    memcpy (stats, &nn_bigpool_statistics, sizeof (struct nn_allocstats));
+    nn_mutex_unlock (&nn_bigpool_sync);
+}
+
+static size_t nn_bigpool_class_size (int cls)
+{
+    return ((size_t) NN_BIGPOOL_MIN << (cls / NN_BIGPOOL_STEPS)) *
+        (NN_BIGPOOL_STEPS + 1 + cls % NN_BIGPOOL_STEPS) / NN_BIGPOOL_STEPS;
+}
+
+#if defined NN_HAVE_WINDOWS
+
+/*  On Windows the buffers are allocated from the heap and are never backed
+    by huge pages. */
+
+static struct nn_bigpool_block *nn_bigpool_map (size_t size)
+{
+    struct nn_bigpool_block *block;
+
+    block = nn_alloc (size, "message chunk");
+    if (nn_slow (!block))
+        return NULL;
+    block->mapsize = size;
+    block->huge = 0;
+    return block;
+}
+
+static void nn_bigpool_unmap (struct nn_bigpool_block *block)
+{
+    nn_free (block);
+}
+
+#else
+
+static struct nn_bigpool_block *nn_bigpool_map (size_t size)
+{
+    int rc;
+    uint8_t *p;
+    uint8_t *aligned;
+    size_t len;
+    struct nn_bigpool_block *block;
+
+#if defined MAP_HUGETLB
+
+    /*  Explicit huge pages have to be reserved by the administrator. If
+        there are none left, fall back to transparent huge pages. */
+    if (nn_bigpool_hugepages == NN_BIGPOOL_HUGE_EXPLICIT &&
+          size >= NN_BIGPOOL_HUGEPAGE) {
+        len = (size + NN_BIGPOOL_HUGEPAGE - 1) / NN_BIGPOOL_HUGEPAGE *
+            NN_BIGPOOL_HUGEPAGE;
+        p = mmap (NULL, len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            block = (struct nn_bigpool_block*) p;
+            block->mapsize = len;
+            block->huge = 1;
+            return block;
+        }
+    }
+#endif
+
+#if defined MADV_HUGEPAGE
+
+    /*  Transparent huge pages are used only for regions aligned to the huge
+        page size. Map a bigger region and trim it to get one. */
+    if (nn_bigpool_hugepages != NN_BIGPOOL_HUGE_NONE &&
+          size >= NN_BIGPOOL_HUGEPAGE) {
+        len = size + NN_BIGPOOL_HUGEPAGE;
+        p = mmap (NULL, len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (nn_slow (p == MAP_FAILED))
+            return NULL;
+        aligned = (uint8_t*) (((size_t) p + NN_BIGPOOL_HUGEPAGE - 1) /
+            NN_BIGPOOL_HUGEPAGE * NN_BIGPOOL_HUGEPAGE);
+        if (aligned != p) {
+            rc = munmap (p, aligned - p);
+            errno_assert (rc == 0);
+        }
+        if (aligned + size != p + len) {
+            rc = munmap (aligned + size, p + len - (aligned + size));
+            errno_assert (rc == 0);
+        }
+
+        /*  The advice must be given before the memory is touched. */
+        rc = madvise (aligned, size, MADV_HUGEPAGE);
+        block = (struct nn_bigpool_block*) aligned;
+        block->mapsize = size;
+        block->huge = rc == 0 ? 1 : 0;
+        return block;
+    }
+#endif
+
+    p = mmap (NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (nn_slow (p == MAP_FAILED))
+        return NULL;
+    block = (struct nn_bigpool_block*) p;
+    block->mapsize = size;
+    block->huge = 0;
+    return block;
+}
+
+static void nn_bigpool_unmap (struct nn_bigpool_block *block)
+{
+    int rc;
+
+    rc = munmap (block, block->mapsize);
+    errno_assert (rc == 0);
+}
+
+#endif
+
@@ -0,0 +1,61 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef NN_BIGPOOL_INCLUDED
+#define NN_BIGPOOL_INCLUDED
+
+#include "../nn.h"
+
+#include <stddef.h>
+
+/*  Allocator for large message buffers. The buffers are mapped directly from
+    the OS, optionally using huge pages. Freed buffers are kept in a global
+    cache, sorted into size classes four per each power of two, so that
+    a stream of large messages doesn't map and unmap memory for every
+    message. */
+
+/*  Buffers of this size and smaller are not expected to be allocated here.
+    The smallest size class is just above this size. */
+#define NN_BIGPOOL_MIN (64 * 1024)
+
+/*  Largest buffer that is cached. Larger buffers are unmapped straight away
+    when freed. */
+#define NN_BIGPOOL_MAX (1024 * 1024 * 1024)
+
+/*  Maximum number of bytes kept in the cache. */
+#define NN_BIGPOOL_CACHE_BYTES (64 * 1024 * 1024)
+
+/*  Initialises the pool. Called from nn_global_init with nn_glock held.
+    If a buffer is allocated before that, the pool initialises itself. */
+void nn_bigpool_init (void);
+
+/*  Returns all the cached buffers to the OS. Called when the library is
+    terminated. The buffers still in use can be freed afterwards. */
+void nn_bigpool_term (void);
+
+void *nn_bigpool_alloc (size_t size);
+void nn_bigpool_free (void *p);
+
+/*  Fills in the statistics of the allocator. */
+void nn_bigpool_stats (struct nn_allocstats *stats);
+
+#endif
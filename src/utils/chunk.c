@@ -21,6 +21,7 @@
 */
 
 #include "chunk.h"
+#include "chunkpool.h"
 #include "atomic.h"
 #include "alloc.h"
 #include "fast.h"
@@ -29,6 +30,14 @@
 
 #include <string.h>
 
+#if !defined NN_HAVE_WINDOWS
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
 #define NN_CHUNK_TAG 0xdeadcafe
 #define NN_CHUNK_TAG_DEALLOCATED 0xbeadfeed
 
@@ -50,14 +59,61 @@ struct nn_chunk {
         the message data itself. */
 };
 
+/*  In slabs, the empty space following the chunk header holds the array of
+    sub-chunk headers. */
+struct nn_chunk_slab {
+    int nsubs;
+    int used;
+};
+
+struct nn_chunk_sub {
+    struct nn_chunk chunk;
+
+    /*  The slab the data of the sub-chunk belong to. */
+    void *slab;
+};
+
+/*  File-backed chunks are mapped into the memory. The chunk header and this
+    structure are placed on an anonymous page just in front of the mapping
+    of the file. */
+struct nn_chunk_file {
+
+    /*  Private duplicate of the file descriptor supplied by the user. */
+    int fd;
+
+    /*  Position of the first byte of the data in the file. */
+    uint64_t offset;
+
+    /*  The whole memory mapping, including the header page. */
+    void *map;
+    size_t maplen;
+};
+
+/*  External chunks refer to memory managed by someone else, who is notified
+    once the chunk is deallocated. */
+struct nn_chunk_ext {
+    struct nn_chunk chunk;
+    void (*fn) (void *arg);
+    void *arg;
+};
+
+CT_ASSERT (sizeof (struct nn_chunk_ext) <= NN_CHUNK_EXT_HDRSIZE);
+
 /*  Private functions. */
 static struct nn_chunk *nn_chunk_getptr (void *p);
 static void nn_chunk_default_free (void *p);
+static void nn_chunk_sub_free (void *p);
+static void nn_chunk_ext_free (void *p);
+#if !defined NN_HAVE_WINDOWS
+static void nn_chunk_file_free (void *p);
+#endif
+static int nn_chunk_isfile (struct nn_chunk *self);
 
 int nn_chunk_alloc (size_t size, int type, void **result)
 {
     size_t sz;
     struct nn_chunk *self;
+    nn_chunk_free_fn ffn;
     const size_t hdrsz = sizeof (struct nn_chunk) + 2 * sizeof (uint32_t);
 
     /*  Compute total size to be allocated. Check for overflow. */
@@ -67,8 +123,13 @@ int nn_chunk_alloc (size_t size, int type, void **result)
 
     /*  Allocate the actual memory depending on the type. */
     switch (type) {
-    case 0:
+    case NN_ALLOCMSG_DEFAULT:
         self = nn_alloc (sz, "message chunk");
+        ffn = nn_chunk_default_free;
+        break;
+    case NN_ALLOCMSG_POOL:
+        self = nn_chunkpool_alloc (sz);
+        ffn = nn_chunkpool_free;
         break;
     default:
         return -EINVAL;
@@ -79,7 +140,7 @@ int nn_chunk_alloc (size_t size, int type, void **result)
     /*  Fill in the chunk header. */
     nn_atomic_init (&self->refcount, 1);
     self->size = size;
-    self->ffn = nn_chunk_default_free;
+    self->ffn = ffn;
 
     /*  Fill in the size of the empty space between the chunk header
         and the message. */
@@ -102,8 +163,11 @@ void nn_chunk_free (void *p)
         it drops to zero. */
     if (nn_atomic_dec (&self->refcount, 1) <= 1) {
 
-        /*  Mark chunk as deallocated. */
-        nn_putl ((uint8_t*) (((uint32_t*) p) - 1), NN_CHUNK_TAG_DEALLOCATED);
+        /*  Mark chunk as deallocated. File-backed chunks may have the tags
+            in the read-only mapping, which is going to be unmapped anyway. */
+        if (nn_fast (!nn_chunk_isfile (self)))
+            nn_putl ((uint8_t*) (((uint32_t*) p) - 1),
+                NN_CHUNK_TAG_DEALLOCATED);
 
         /*  Deallocate the resources held by the chunk. */
         nn_atomic_term (&self->refcount);
@@ -131,13 +195,26 @@ size_t nn_chunk_size (void *p)
 
 void *nn_chunk_trim (void *p, size_t n)
 {
+    int rc;
     struct nn_chunk *self;
+    void *chunk;
 
     self = nn_chunk_getptr (p);
 
     /*  Sanity check. We cannot trim more bytes than there are in the chunk. */
     nn_assert (n <= self->size);
 
+    /*  The tags can't be written to the read-only file mapping. This happens
+        only when a protocol strips its header off a file-backed message
+        received via inproc transport, so simply copy the rest of the data. */
+    if (nn_slow (nn_chunk_isfile (self))) {
+        rc = nn_chunk_alloc (self->size - n, NN_ALLOCMSG_POOL, &chunk);
+        errnum_assert (rc == 0, -rc);
+        memcpy (chunk, ((uint8_t*) p) + n, self->size - n);
+        nn_chunk_free (p);
+        return chunk;
+    }
+
     /*  Adjust the chunk header. */
     p = ((uint8_t*) p) + n;
     nn_putl ((uint8_t*) (((uint32_t*) p) - 1), NN_CHUNK_TAG);
@@ -150,6 +227,221 @@ void *nn_chunk_trim (void *p, size_t n)
     return p;
 }
 
+int nn_chunk_alloc_slab (size_t size, int nsubs, void **result)
+{
+    int rc;
+    struct nn_chunk_slab *slab;
+    const size_t subsz = sizeof (struct nn_chunk_slab) +
+        nsubs * sizeof (struct nn_chunk_sub);
+
+    nn_assert (nsubs >= 0);
+
+    /*  Allocate a chunk big enough to hold both the sub-chunk headers and
+        the data. Then trim the headers off so that they end up in the empty
+        space following the chunk header. */
+    if (nn_slow (size + subsz < size))
+        return -ENOMEM;
+    rc = nn_chunk_alloc (subsz + size, NN_ALLOCMSG_DEFAULT, result);
+    if (nn_slow (rc < 0))
+        return rc;
+    *result = nn_chunk_trim (*result, subsz);
+    slab = (struct nn_chunk_slab*) (nn_chunk_getptr (*result) + 1);
+    slab->nsubs = nsubs;
+    slab->used = 0;
+
+    return 0;
+}
+
+int nn_chunk_alloc_sub (void *slab, void *data, size_t size, void **result)
+{
+    struct nn_chunk *self;
+    struct nn_chunk_slab *info;
+    struct nn_chunk_sub *sub;
+
+    self = nn_chunk_getptr (slab);
+    info = (struct nn_chunk_slab*) (self + 1);
+
+    /*  The data, including the space for the size of the empty space and
+        the tag, must fit into the slab. */
+    nn_assert ((uint8_t*) data >= (uint8_t*) slab + 2 * sizeof (uint32_t) &&
+        (uint8_t*) data + size <= (uint8_t*) slab + self->size);
+
+    if (nn_slow (info->used >= info->nsubs))
+        return -ENOMEM;
+    sub = ((struct nn_chunk_sub*) (info + 1)) + info->used;
+    ++info->used;
+
+    /*  Fill in the chunk header. */
+    nn_atomic_init (&sub->chunk.refcount, 1);
+    sub->chunk.size = size;
+    sub->chunk.ffn = nn_chunk_sub_free;
+    sub->slab = slab;
+    nn_chunk_addref (slab, 1);
+
+    /*  Everything between the sub-chunk header and the data is considered to
+        be the empty space. */
+    nn_putl ((uint8_t*) (((uint32_t*) data) - 1), NN_CHUNK_TAG);
+    nn_putl ((uint8_t*) (((uint32_t*) data) - 2), (uint8_t*) data -
+        (uint8_t*) (&sub->chunk + 1) - 2 * sizeof (uint32_t));
+
+    *result = data;
+    return 0;
+}
+
+int nn_chunk_reset_slab (void *slab)
+{
+    struct nn_chunk *self;
+
+    self = nn_chunk_getptr (slab);
+
+    /*  Sub-chunks can only be created by the owner of the slab, so if there
+        are no other references, nobody can create one in the meantime.
+        Adding zero is used to read the reference count atomically. */
+    if (nn_atomic_inc (&self->refcount, 0) != 1)
+        return 0;
+    ((struct nn_chunk_slab*) (self + 1))->used = 0;
+    return 1;
+}
+
+void nn_chunk_init_ext (void *hdr, void *data, size_t size,
+    void (*fn) (void *arg), void *arg)
+{
+    struct nn_chunk_ext *ext;
+
+    ext = (struct nn_chunk_ext*) hdr;
+    nn_assert ((uint8_t*) data >= (uint8_t*) (&ext->chunk + 1) +
+        2 * sizeof (uint32_t) && (uint64_t) ((uint8_t*) data -
+        (uint8_t*) (&ext->chunk + 1)) < 0xffffffffull);
+
+    /*  Fill in the chunk header. */
+    nn_atomic_init (&ext->chunk.refcount, 1);
+    ext->chunk.size = size;
+    ext->chunk.ffn = nn_chunk_ext_free;
+    ext->fn = fn;
+    ext->arg = arg;
+
+    /*  Everything between the chunk header and the data is considered to be
+        the empty space. */
+    nn_putl ((uint8_t*) (((uint32_t*) data) - 1), NN_CHUNK_TAG);
+    nn_putl ((uint8_t*) (((uint32_t*) data) - 2), (uint8_t*) data -
+        (uint8_t*) (&ext->chunk + 1) - 2 * sizeof (uint32_t));
+}
+
+int nn_chunk_alloc_file (int fd, uint64_t offset, size_t size, void **result)
+{
+#if defined NN_HAVE_WINDOWS
+    return -ENOTSUP;
+#else
+    int rc;
+    struct stat st;
+    size_t pagesz;
+    size_t delta;
+    size_t hdrsz;
+    size_t maplen;
+    uint8_t *map;
+    void *fmap;
+    struct nn_chunk *self;
+    struct nn_chunk_file *file;
+    uint8_t *data;
+
+    /*  Only ranges within regular files can be mapped safely. Accessing
+        the mapping beyond the end of the file would result in SIGBUS. */
+    rc = fstat (fd, &st);
+    if (nn_slow (rc < 0))
+        return -errno;
+    if (nn_slow (!S_ISREG (st.st_mode)))
+        return -EINVAL;
+    if (nn_slow (offset > (uint64_t) st.st_size ||
+          size > (uint64_t) st.st_size - offset))
+        return -EINVAL;
+
+    /*  The file can be mapped only from a page boundary. The data, except
+        for the header page, are preceded by 'delta' bytes of the file. */
+    pagesz = (size_t) sysconf (_SC_PAGESIZE);
+    delta = (size_t) (offset % pagesz);
+    hdrsz = sizeof (struct nn_chunk) + sizeof (struct nn_chunk_file) +
+        2 * sizeof (uint32_t);
+    hdrsz = (hdrsz + pagesz - 1) / pagesz * pagesz;
+    maplen = hdrsz + delta + size;
+    if (nn_slow (maplen < size))
+        return -ENOMEM;
+
+    /*  Reserve the address space for the whole chunk, then place the file
+        mapping just after the header page. Private mapping is used so that
+        writing the chunk tags never modifies the file. */
+    map = mmap (NULL, maplen, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (nn_slow (map == MAP_FAILED))
+        return -ENOMEM;
+    fmap = map + hdrsz;
+    if (delta + size > 0) {
+        fmap = mmap (fmap, delta + size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_FIXED, fd, (off_t) (offset - delta));
+        if (nn_slow (fmap == MAP_FAILED)) {
+            rc = -errno;
+            munmap (map, maplen);
+            return rc == -ENOMEM ? rc : -EINVAL;
+        }
+    }
+
+    self = (struct nn_chunk*) map;
+    file = (struct nn_chunk_file*) (self + 1);
+    data = map + hdrsz + delta;
+
+    /*  The user may close the file descriptor as soon as the function
+        returns. Keep our own one. */
+    file->fd = fcntl (fd, F_DUPFD_CLOEXEC, 0);
+    if (nn_slow (file->fd < 0)) {
+        rc = -errno;
+        munmap (map, maplen);
+        return rc;
+    }
+    file->offset = offset;
+    file->map = map;
+    file->maplen = maplen;
+
+    /*  Fill in the chunk header. */
+    nn_atomic_init (&self->refcount, 1);
+    self->size = size;
+    self->ffn = nn_chunk_file_free;
+    nn_putl ((uint8_t*) (((uint32_t*) data) - 1), NN_CHUNK_TAG);
+    nn_putl ((uint8_t*) (((uint32_t*) data) - 2), data - (uint8_t*) (self + 1) -
+        2 * sizeof (uint32_t));
+
+    /*  The body is sent straight from the file, so any modification of the
+        mapping would be visible to in-process peers, but not to the remote
+        ones. Once the tags are in place, make the mapping read-only. */
+    if (delta + size > 0) {
+        rc = mprotect (fmap, delta + size, PROT_READ);
+        errno_assert (rc == 0);
+    }
+
+    *result = data;
+    return 0;
+#endif
+}
+
+int nn_chunk_getfile (void *p, int *fd, uint64_t *offset)
+{
+#if defined NN_HAVE_WINDOWS
+    return 0;
+#else
+    struct nn_chunk *self;
+    struct nn_chunk_file *file;
+
+    self = nn_chunk_getptr (p);
+    if (nn_fast (!nn_chunk_isfile (self)))
+        return 0;
+
+    /*  File-backed chunks are never trimmed (see nn_chunk_trim), so the data
+        still start at the original offset. */
+    file = (struct nn_chunk_file*) (self + 1);
+    *fd = file->fd;
+    *offset = file->offset;
+    return 1;
+#endif
+}
+
 static struct nn_chunk *nn_chunk_getptr (void *p)
 {
     uint32_t off;
@@ -161,8 +453,45 @@ static struct nn_chunk *nn_chunk_getptr (void *p)
         sizeof (struct nn_chunk));
 }
 
+static int nn_chunk_isfile (struct nn_chunk *self)
+{
+#if defined NN_HAVE_WINDOWS
+    return 0;
+#else
+    return self->ffn == nn_chunk_file_free ? 1 : 0;
+#endif
+}
+
 static void nn_chunk_default_free (void *p)
 {
     nn_free (p);
 }
 
+static void nn_chunk_sub_free (void *p)
+{
+    nn_chunk_free (((struct nn_chunk_sub*) p)->slab);
+}
+
+static void nn_chunk_ext_free (void *p)
+{
+    struct nn_chunk_ext *ext;
+
+    ext = (struct nn_chunk_ext*) p;
+    ext->fn (ext->arg);
+}
+
+#if !defined NN_HAVE_WINDOWS
+
+static void nn_chunk_file_free (void *p)
+{
+    int rc;
+    struct nn_chunk_file *file;
+
+    file = (struct nn_chunk_file*) (((struct nn_chunk*) p) + 1);
+    rc = close (file->fd);
+    errno_assert (rc == 0);
+    rc = munmap (file->map, file->maplen);
+    errno_assert (rc == 0);
+}
+
+#endif
@@ -43,5 +43,43 @@ size_t nn_chunk_size (void *p);
     chunk. */
 void *nn_chunk_trim (void *p, size_t n);
 
+/*  Allocates a chunk that can be split into at most 'nsubs' sub-chunks. The
+    slab itself is an ordinary chunk and can be passed to nn_chunk_free. */
+int nn_chunk_alloc_slab (size_t size, int nsubs, void **result);
+
+/*  Creates a chunk of 'size' bytes that refers to the memory at 'data' within
+    the slab. The 8 bytes preceding 'data' must belong to the slab and they
+    are overwritten. The sub-chunk holds a reference to the slab, i.e. the
+    slab is deallocated only after all its sub-chunks are. Returns -ENOMEM
+    if all sub-chunks of the slab were already used. */
+int nn_chunk_alloc_sub (void *slab, void *data, size_t size, void **result);
+
+/*  If there are no sub-chunks referring to the slab, makes all of them
+    available once again and returns 1. Otherwise returns 0. */
+int nn_chunk_reset_slab (void *slab);
+
+/*  Creates a chunk that refers to 'size' bytes of a regular file starting at
+    'offset'. The data are mapped into the memory so that the chunk can be
+    used in the same way as any other chunk. The chunk keeps its own
+    duplicate of the file descriptor. */
+int nn_chunk_alloc_file (int fd, uint64_t offset, size_t size, void **result);
+
+/*  Amount of memory needed to hold the header of an external chunk. */
+#define NN_CHUNK_EXT_HDRSIZE 128
+
+/*  Turns 'size' bytes of memory at 'data', which is managed by the caller,
+    into a chunk. The chunk itself is 'data'. The chunk header is placed into
+    NN_CHUNK_EXT_HDRSIZE bytes of pointer-aligned memory at 'hdr', which must
+    be located below 'data', less than 4GB apart. The 8 bytes preceding
+    'data' are overwritten. Once the chunk is deallocated, 'fn' is invoked
+    with 'arg' as a parameter. */
+void nn_chunk_init_ext (void *hdr, void *data, size_t size,
+    void (*fn) (void *arg), void *arg);
+
+/*  If the chunk is backed by a file, fills in the file descriptor and
+    the position of the chunk data within the file and returns 1. Otherwise
+    returns 0. */
+int nn_chunk_getfile (void *p, int *fd, uint64_t *offset);
+
 #endif
 
@@ -0,0 +1,667 @@
+/*
+    Copyright (c) 2012 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "chunkpool.h"
+#include "bigpool.h"
+#include "atomic.h"
+#include "mutex.h"
+#include "glock.h"
+#include "alloc.h"
+#include "fast.h"
+#include "err.h"
+
+#include <string.h>
+
+#if defined NN_HAVE_WINDOWS
+#include "win.h"
+#else
+#include <pthread.h>
+#endif
+
+/*  Smallest size class. Sizes of the classes grow by the factor of two up
+    to NN_CHUNKPOOL_MAX. */
+#define NN_CHUNKPOOL_MIN 64
+#define NN_CHUNKPOOL_CLASSES 11
+
+/*  Maximum number of bytes kept in a single size class of a thread cache. */
+#define NN_CHUNKPOOL_CACHE_BYTES (512 * 1024)
+
+/*  Minimum number of blocks kept in a single size class. */
+#define NN_CHUNKPOOL_CACHE_MINBLOCKS 4
+
+/*  Maximum number of bytes kept in all the size classes of a thread cache
+    together. Blocks freed above either limit are moved to the global lists,
+    where any thread can pick them up. */
+#define NN_CHUNKPOOL_CACHE_TOTAL (1024 * 1024)
+
+/*  Maximum number of bytes kept in the global lists. Blocks freed above this
+    limit are returned to the system allocator. */
+#define NN_CHUNKPOOL_GLOBAL_BYTES (4 * 1024 * 1024)
+
+/*  Maximum number of blocks moved between a thread cache and the global
+    lists in one go. */
+#define NN_CHUNKPOOL_BATCH 16
+
+CT_ASSERT ((NN_CHUNKPOOL_MIN << (NN_CHUNKPOOL_CLASSES - 1)) ==
+    NN_CHUNKPOOL_MAX);
+
+struct nn_chunkpool_cache;
+
+/*  Header preceding each block handed out by the pool. While the block is
+    sitting in a free list, the first bytes of its payload hold the pointer
+    to the next block in the list. */
+struct nn_chunkpool_block {
+
+    /*  Thread cache the block belongs to. NULL for blocks bigger than
+        NN_CHUNKPOOL_MAX, which are allocated from the large buffer pool. */
+    struct nn_chunkpool_cache *cache;
+
+    /*  Size class of the block. */
+    int cls;
+};
+
+#define NN_CHUNKPOOL_NEXT(block)\
+    (*((struct nn_chunkpool_block**) ((block) + 1)))
+
+struct nn_chunkpool_cache {
+
+    /*  Free blocks in individual size classes. Accessed only by the thread
+        owning the cache. */
+    struct nn_chunkpool_block *free [NN_CHUNKPOOL_CLASSES];
+    int nfree [NN_CHUNKPOOL_CLASSES];
+
+    /*  Total size of the free blocks above. */
+    size_t nbytes;
+
+    /*  Blocks returned by other threads. Threads push the blocks to the list
+        using compare-and-swap, the owner grabs the whole list at once. */
+    struct nn_chunkpool_block *volatile remote;
+#if defined NN_ATOMIC_MUTEX
+    struct nn_mutex sync;
+#endif
+
+    /*  Number of blocks allocated from the system allocator that belong to
+        this cache, whether they are in use or not. The cache can be
+        deallocated only when there are none left. Accessed only by the
+        thread owning the cache. */
+    int nblocks;
+
+    /*  Next cache in the global list of caches, see below. */
+    struct nn_chunkpool_cache *next;
+
+#if defined NN_HAVE_WINDOWS
+    /*  The thread owning the cache. Used to find out whether it has already
+        terminated. */
+    HANDLE thread;
+#endif
+};
+
+/*  The mutex protecting the global lists of caches and blocks. It is
+    initialised from nn_global_init, or on the first allocation in a thread
+    if a message is allocated before any socket was created. */
+static struct nn_mutex nn_chunkpool_sync;
+
+/*  Free blocks that don't belong to any thread cache. Threads check for
+    blocks without taking the mutex, hence the volatile. */
+static struct nn_chunkpool_block *volatile
+    nn_chunkpool_global [NN_CHUNKPOOL_CLASSES];
+static size_t nn_chunkpool_global_bytes = 0;
+
+/*  Private functions. */
+static struct nn_chunkpool_cache *nn_chunkpool_getcache (int create);
+static void nn_chunkpool_setcache (struct nn_chunkpool_cache *cache);
+static struct nn_chunkpool_cache *nn_chunkpool_cache_create (void);
+static void nn_chunkpool_cache_destroy (struct nn_chunkpool_cache *cache);
+static int nn_chunkpool_release (struct nn_chunkpool_cache *cache);
+static void nn_chunkpool_push_remote (struct nn_chunkpool_cache *cache,
+    struct nn_chunkpool_block *block);
+static struct nn_chunkpool_block *nn_chunkpool_take_remote (
+    struct nn_chunkpool_cache *cache);
+static void nn_chunkpool_put (struct nn_chunkpool_cache *cache,
+    struct nn_chunkpool_block *block);
+static void nn_chunkpool_drain (struct nn_chunkpool_cache *cache);
+static void nn_chunkpool_spill (struct nn_chunkpool_cache *cache,
+    struct nn_chunkpool_block *block);
+static void nn_chunkpool_refill (struct nn_chunkpool_cache *cache, int cls);
+
+void *nn_chunkpool_alloc (size_t size)
+{
+    int cls;
+    size_t blocksz;
+    struct nn_chunkpool_cache *cache;
+    struct nn_chunkpool_block *block;
+    const size_t hdrsz = sizeof (struct nn_chunkpool_block);
+
+    /*  Big blocks are handled by a different allocator. */
+    if (nn_slow (size > NN_CHUNKPOOL_MAX - hdrsz)) {
+        if (nn_slow (size + hdrsz < size))
+            return NULL;
+        block = nn_bigpool_alloc (size + hdrsz);
+        if (nn_slow (!block))
+            return NULL;
+        block->cache = NULL;
+        block->cls = -1;
+        return block + 1;
+    }
+
+    /*  Find the appropriate size class. */
+    cls = 0;
+    blocksz = NN_CHUNKPOOL_MIN;
+    while (blocksz < size + hdrsz) {
+        blocksz <<= 1;
+        ++cls;
+    }
+
+    cache = nn_chunkpool_getcache (1);
+    if (nn_slow (!cache))
+        return NULL;
+
+    /*  If the local free list is empty, check whether other threads have
+        returned any blocks in the meantime. Then try the global lists. */
+    block = cache->free [cls];
+    if (nn_slow (!block)) {
+        nn_chunkpool_drain (cache);
+        if (!cache->free [cls] && nn_chunkpool_global [cls])
+            nn_chunkpool_refill (cache, cls);
+        block = cache->free [cls];
+    }
+    if (nn_fast (block != NULL)) {
+        cache->free [cls] = NN_CHUNKPOOL_NEXT (block);
+        --cache->nfree [cls];
+        cache->nbytes -= blocksz;
+        return block + 1;
+    }
+
+    /*  Cache is empty. Allocate new block from the system allocator. */
+    block = nn_alloc (blocksz, "message chunk");
+    if (nn_slow (!block))
+        return NULL;
+    block->cache = cache;
+    block->cls = cls;
+    ++cache->nblocks;
+    return block + 1;
+}
+
+void nn_chunkpool_free (void *p)
+{
+    struct nn_chunkpool_block *block;
+
+    block = ((struct nn_chunkpool_block*) p) - 1;
+
+    if (nn_slow (!block->cache)) {
+        nn_bigpool_free (block);
+        return;
+    }
+
+    /*  Fast path. The block is returned by the thread that allocated it. */
+    if (nn_fast (block->cache == nn_chunkpool_getcache (0))) {
+        nn_chunkpool_put (block->cache, block);
+        return;
+    }
+
+    /*  The block belongs to a different thread. Return it to its owner. */
+    nn_chunkpool_push_remote (block->cache, block);
+}
+
+static void nn_chunkpool_put (struct nn_chunkpool_cache *cache,
+    struct nn_chunkpool_block *block)
+{
+    int cls;
+    int limit;
+    size_t blocksz;
+
+    cls = block->cls;
+    blocksz = NN_CHUNKPOOL_MIN << cls;
+    limit = NN_CHUNKPOOL_CACHE_BYTES / blocksz;
+    if (limit < NN_CHUNKPOOL_CACHE_MINBLOCKS)
+        limit = NN_CHUNKPOOL_CACHE_MINBLOCKS;
+    if (nn_slow (cache->nfree [cls] >= limit ||
+          cache->nbytes + blocksz > NN_CHUNKPOOL_CACHE_TOTAL)) {
+        nn_chunkpool_spill (cache, block);
+        return;
+    }
+    NN_CHUNKPOOL_NEXT (block) = cache->free [cls];
+    cache->free [cls] = block;
+    ++cache->nfree [cls];
+    cache->nbytes += blocksz;
+}
+
+/*  Moves the block, along with a batch of free blocks of the same size class,
+    from the cache to the global list. The blocks stop belonging to the cache.
+    If the global lists are full, the blocks are deallocated instead. */
+static void nn_chunkpool_spill (struct nn_chunkpool_cache *cache,
+    struct nn_chunkpool_block *block)
+{
+    int cls;
+    int n;
+    size_t blocksz;
+    struct nn_chunkpool_block *last;
+    struct nn_chunkpool_block *next;
+
+    cls = block->cls;
+    blocksz = NN_CHUNKPOOL_MIN << cls;
+
+    /*  Chain the blocks to move together. */
+    last = block;
+    n = 1;
+    while (n != NN_CHUNKPOOL_BATCH && cache->free [cls]) {
+        NN_CHUNKPOOL_NEXT (last) = cache->free [cls];
+        last = cache->free [cls];
+        cache->free [cls] = NN_CHUNKPOOL_NEXT (last);
+        --cache->nfree [cls];
+        cache->nbytes -= blocksz;
+        ++n;
+    }
+    NN_CHUNKPOOL_NEXT (last) = NULL;
+    cache->nblocks -= n;
+
+    nn_mutex_lock (&nn_chunkpool_sync);
+    if (nn_chunkpool_global_bytes + n * blocksz <= NN_CHUNKPOOL_GLOBAL_BYTES) {
+        NN_CHUNKPOOL_NEXT (last) = nn_chunkpool_global [cls];
+        nn_chunkpool_global [cls] = block;
+        nn_chunkpool_global_bytes += n * blocksz;
+        block = NULL;
+    }
+    nn_mutex_unlock (&nn_chunkpool_sync);
+
+    while (block) {
+        next = NN_CHUNKPOOL_NEXT (block);
+        nn_free (block);
+        block = next;
+    }
+}
+
+/*  Moves a batch of blocks of the size class from the global list to
+    the cache, as long as the cache doesn't grow above its limit. */
+static void nn_chunkpool_refill (struct nn_chunkpool_cache *cache, int cls)
+{
+    int n;
+    size_t blocksz;
+    struct nn_chunkpool_block *block;
+
+    blocksz = NN_CHUNKPOOL_MIN << cls;
+    n = 1;
+    if (cache->nbytes < NN_CHUNKPOOL_CACHE_TOTAL)
+        n = (int) ((NN_CHUNKPOOL_CACHE_TOTAL - cache->nbytes) / blocksz);
+    if (n > NN_CHUNKPOOL_BATCH)
+        n = NN_CHUNKPOOL_BATCH;
+    if (n < 1)
+        n = 1;
+
+    nn_mutex_lock (&nn_chunkpool_sync);
+    while (n && nn_chunkpool_global [cls]) {
+        block = nn_chunkpool_global [cls];
+        nn_chunkpool_global [cls] = NN_CHUNKPOOL_NEXT (block);
+        nn_chunkpool_global_bytes -= blocksz;
+        block->cache = cache;
+        ++cache->nblocks;
+        NN_CHUNKPOOL_NEXT (block) = cache->free [cls];
+        cache->free [cls] = block;
+        ++cache->nfree [cls];
+        cache->nbytes += blocksz;
+        --n;
+    }
+    nn_mutex_unlock (&nn_chunkpool_sync);
+}
+
+static void nn_chunkpool_drain (struct nn_chunkpool_cache *cache)
+{
+    struct nn_chunkpool_block *block;
+    struct nn_chunkpool_block *next;
+
+    block = nn_chunkpool_take_remote (cache);
+    while (block) {
+        next = NN_CHUNKPOOL_NEXT (block);
+        nn_chunkpool_put (cache, block);
+        block = next;
+    }
+}
+
+static void nn_chunkpool_push_remote (struct nn_chunkpool_cache *cache,
+    struct nn_chunkpool_block *block)
+{
+#if defined NN_ATOMIC_MUTEX
+    nn_mutex_lock (&cache->sync);
+    NN_CHUNKPOOL_NEXT (block) = cache->remote;
+    cache->remote = block;
+    nn_mutex_unlock (&cache->sync);
+#else
+    struct nn_chunkpool_block *old;
+
+    /*  The list is only ever consumed as a whole, thus there's no ABA
+        problem here. */
+    while (1) {
+        old = cache->remote;
+        NN_CHUNKPOOL_NEXT (block) = old;
+#if defined NN_ATOMIC_WINAPI
+        if (InterlockedCompareExchangePointer ((PVOID*) &cache->remote,
+              block, old) == old)
+            break;
+#elif defined NN_ATOMIC_SOLARIS
+        if (atomic_cas_ptr (&cache->remote, old, block) == old)
+            break;
+#elif defined NN_ATOMIC_GCC_BUILTINS
+        if (__sync_val_compare_and_swap (&cache->remote, old, block) == old)
+            break;
+#else
+#error
+#endif
+    }
+#endif
+}
+
+static struct nn_chunkpool_block *nn_chunkpool_take_remote (
+    struct nn_chunkpool_cache *cache)
+{
+    struct nn_chunkpool_block *list;
+
+    /*  Cheap check to avoid the atomic operation in the common case. */
+    if (!cache->remote)
+        return NULL;
+
+#if defined NN_ATOMIC_MUTEX
+    nn_mutex_lock (&cache->sync);
+    list = cache->remote;
+    cache->remote = NULL;
+    nn_mutex_unlock (&cache->sync);
+#elif defined NN_ATOMIC_WINAPI
+    list = InterlockedExchangePointer ((PVOID*) &cache->remote, NULL);
+#elif defined NN_ATOMIC_SOLARIS
+    list = atomic_swap_ptr (&cache->remote, NULL);
+#elif defined NN_ATOMIC_GCC_BUILTINS
+    list = __sync_lock_test_and_set (&cache->remote, NULL);
+#else
+#error
+#endif
+
+    return list;
+}
+
+static struct nn_chunkpool_cache *nn_chunkpool_cache_create (void)
+{
+#if defined NN_HAVE_WINDOWS
+    BOOL brc;
+#endif
+    struct nn_chunkpool_cache *self;
+
+    self = nn_alloc (sizeof (struct nn_chunkpool_cache), "chunk pool cache");
+    if (nn_slow (!self))
+        return NULL;
+    memset (self, 0, sizeof (struct nn_chunkpool_cache));
+#if defined NN_ATOMIC_MUTEX
+    nn_mutex_init (&self->sync);
+#endif
+#if defined NN_HAVE_WINDOWS
+    brc = DuplicateHandle (GetCurrentProcess (), GetCurrentThread (),
+        GetCurrentProcess (), &self->thread, SYNCHRONIZE, FALSE, 0);
+    win_assert (brc);
+#endif
+    return self;
+}
+
+static void nn_chunkpool_cache_destroy (struct nn_chunkpool_cache *cache)
+{
+#if defined NN_ATOMIC_MUTEX
+    nn_mutex_term (&cache->sync);
+#endif
+#if defined NN_HAVE_WINDOWS
+    CloseHandle (cache->thread);
+#endif
+    nn_free (cache);
+}
+
+/*  Returns all the free blocks of the cache, including those returned by
+    other threads, to the system allocator. Returns 1 if there are no blocks
+    of the cache left, i.e. if the cache itself can be deallocated. Must be
+    called either by the owner of the cache or, if the owner has terminated,
+    with nn_chunkpool_sync held. */
+static int nn_chunkpool_release (struct nn_chunkpool_cache *cache)
+{
+    int cls;
+    struct nn_chunkpool_block *block;
+    struct nn_chunkpool_block *next;
+
+    block = nn_chunkpool_take_remote (cache);
+    while (block) {
+        next = NN_CHUNKPOOL_NEXT (block);
+        nn_free (block);
+        --cache->nblocks;
+        block = next;
+    }
+    for (cls = 0; cls != NN_CHUNKPOOL_CLASSES; ++cls) {
+        block = cache->free [cls];
+        while (block) {
+            next = NN_CHUNKPOOL_NEXT (block);
+            nn_free (block);
+            --cache->nblocks;
+            block = next;
+        }
+        cache->free [cls] = NULL;
+        cache->nfree [cls] = 0;
+    }
+    cache->nbytes = 0;
+
+    return cache->nblocks == 0 ? 1 : 0;
+}
+
+#if defined NN_HAVE_WINDOWS
+
+/*  All the caches in existence. Windows doesn't notify us about terminated
+    threads, so the caches are checked when the library is terminated. */
+static struct nn_chunkpool_cache *nn_chunkpool_caches = NULL;
+
+static __declspec(thread) struct nn_chunkpool_cache *nn_chunkpool_tls = NULL;
+
+/*  Protected by nn_glock. */
+static int nn_chunkpool_initialised = 0;
+
+void nn_chunkpool_init (void)
+{
+    /*  The function is called with nn_glock held. */
+    if (nn_chunkpool_initialised)
+        return;
+
+    nn_mutex_init (&nn_chunkpool_sync);
+    nn_chunkpool_initialised = 1;
+}
+
+static struct nn_chunkpool_cache *nn_chunkpool_getcache (int create)
+{
+    struct nn_chunkpool_cache *cache;
+
+    if (nn_fast (nn_chunkpool_tls != NULL) || !create)
+        return nn_chunkpool_tls;
+
+    /*  First allocation in this thread. Taking nn_glock makes sure that
+        the pool is initialised and that this thread sees it that way. */
+    nn_glock_lock ();
+    nn_chunkpool_init ();
+    nn_glock_unlock ();
+
+    cache = nn_chunkpool_cache_create ();
+    if (nn_slow (!cache))
+        return NULL;
+    nn_mutex_lock (&nn_chunkpool_sync);
+    cache->next = nn_chunkpool_caches;
+    nn_chunkpool_caches = cache;
+    nn_mutex_unlock (&nn_chunkpool_sync);
+    nn_chunkpool_tls = cache;
+
+    return cache;
+}
+
+static void nn_chunkpool_setcache (struct nn_chunkpool_cache *cache)
+{
+    nn_chunkpool_tls = cache;
+}
+
+#else
+
+/*  Caches left behind by terminated threads. Blocks owned by these caches
+    are still in use, so the caches cannot be deallocated yet. Instead, they
+    are adopted by newly created threads or released once the blocks are
+    returned to them. */
+static struct nn_chunkpool_cache *nn_chunkpool_caches = NULL;
+
+static pthread_key_t nn_chunkpool_key;
+static pthread_once_t nn_chunkpool_once = PTHREAD_ONCE_INIT;
+
+static void nn_chunkpool_orphan (void *arg)
+{
+    struct nn_chunkpool_cache *cache;
+
+    cache = (struct nn_chunkpool_cache*) arg;
+    if (nn_chunkpool_release (cache)) {
+        nn_chunkpool_cache_destroy (cache);
+        return;
+    }
+    nn_mutex_lock (&nn_chunkpool_sync);
+    cache->next = nn_chunkpool_caches;
+    nn_chunkpool_caches = cache;
+    nn_mutex_unlock (&nn_chunkpool_sync);
+}
+
+static void nn_chunkpool_init_once (void)
+{
+    int rc;
+
+    nn_mutex_init (&nn_chunkpool_sync);
+    rc = pthread_key_create (&nn_chunkpool_key, nn_chunkpool_orphan);
+    errnum_assert (rc == 0, rc);
+}
+
+void nn_chunkpool_init (void)
+{
+    int rc;
+
+    rc = pthread_once (&nn_chunkpool_once, nn_chunkpool_init_once);
+    errnum_assert (rc == 0, rc);
+}
+
+static struct nn_chunkpool_cache *nn_chunkpool_getcache (int create)
+{
+    struct nn_chunkpool_cache *cache;
+
+    /*  Allocations don't take nn_glock, so pthread_once is what makes
+        the key visible to them. A thread freeing a block has already
+        synchronised with the thread that allocated it. */
+    if (create)
+        nn_chunkpool_init ();
+    cache = pthread_getspecific (nn_chunkpool_key);
+    if (nn_fast (cache != NULL) || !create)
+        return cache;
+
+    /*  Adopt a cache of a terminated thread, if there's one available. */
+    nn_mutex_lock (&nn_chunkpool_sync);
+    cache = nn_chunkpool_caches;
+    if (cache)
+        nn_chunkpool_caches = cache->next;
+    nn_mutex_unlock (&nn_chunkpool_sync);
+
+    if (!cache) {
+        cache = nn_chunkpool_cache_create ();
+        if (nn_slow (!cache))
+            return NULL;
+    }
+    cache->next = NULL;
+    nn_chunkpool_setcache (cache);
+
+    return cache;
+}
+
+static void nn_chunkpool_setcache (struct nn_chunkpool_cache *cache)
+{
+    int rc;
+
+    rc = pthread_setspecific (nn_chunkpool_key, cache);
+    errnum_assert (rc == 0, rc);
+}
+
+#endif
+
+void nn_chunkpool_term (void)
+{
+    struct nn_chunkpool_cache *own;
+    struct nn_chunkpool_cache *cache;
+    struct nn_chunkpool_cache **it;
+    int cls;
+    struct nn_chunkpool_block *block;
+    struct nn_chunkpool_block *next;
+
+    /*  The function is called with nn_glock held. */
+#if defined NN_HAVE_WINDOWS
+    if (!nn_chunkpool_initialised)
+        return;
+#else
+    nn_chunkpool_init ();
+#endif
+
+    nn_mutex_lock (&nn_chunkpool_sync);
+
+    /*  Blocks in the global lists don't belong to anybody. */
+    for (cls = 0; cls != NN_CHUNKPOOL_CLASSES; ++cls) {
+        block = nn_chunkpool_global [cls];
+        while (block) {
+            next = NN_CHUNKPOOL_NEXT (block);
+            nn_free (block);
+            block = next;
+        }
+        nn_chunkpool_global [cls] = NULL;
+    }
+    nn_chunkpool_global_bytes = 0;
+
+    /*  The cache of this thread can be released straight away. Caches of
+        other running threads can't be touched. They are released when
+        the threads terminate. */
+    own = nn_chunkpool_getcache (0);
+#if !defined NN_HAVE_WINDOWS
+    if (own && nn_chunkpool_release (own)) {
+        nn_chunkpool_setcache (NULL);
+        nn_chunkpool_cache_destroy (own);
+    }
+#endif
+
+    /*  Caches of terminated threads may have got all their blocks back
+        in the meantime. */
+    it = &nn_chunkpool_caches;
+    while (*it) {
+        cache = *it;
+#if defined NN_HAVE_WINDOWS
+        if (cache != own &&
+              WaitForSingleObject (cache->thread, 0) != WAIT_OBJECT_0) {
+            it = &cache->next;
+            continue;
+        }
+#endif
+        if (!nn_chunkpool_release (cache)) {
+            it = &cache->next;
+            continue;
+        }
+        *it = cache->next;
+        if (cache == own)
+            nn_chunkpool_setcache (NULL);
+        nn_chunkpool_cache_destroy (cache);
+    }
+
+    nn_mutex_unlock (&nn_chunkpool_sync);
+}
+
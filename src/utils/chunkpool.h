@@ -0,0 +1,53 @@
+/*
+    Copyright (c) 2012 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+
+#ifndef NN_CHUNKPOOL_INCLUDED
+#define NN_CHUNKPOOL_INCLUDED
+
+#include <stddef.h>
+
+/*  Thread-caching allocator for message chunks. Memory is allocated in
+    power-of-two size classes. Each thread keeps a cache of free blocks so
+    that in steady state no calls to the system allocator are made. A block
+    freed by a different thread than the one that allocated it is returned
+    to the cache it came from using a lock-free list. Free blocks above
+    the per-thread limits are moved to global lists shared by all threads.
+    When a thread terminates its cache is released, unless some of its
+    blocks are still in use. */
+
+/*  Largest block handled by the pool. Larger requests are passed to
+    the large buffer pool (see bigpool.h). */
+#define NN_CHUNKPOOL_MAX (64 * 1024)
+
+/*  Initialises the pool. Called from nn_global_init with nn_glock held.
+    If a block is allocated before that, the pool initialises itself. */
+void nn_chunkpool_init (void);
+
+/*  Releases the cache of the calling thread and the caches left behind by
+    terminated threads. Called when the library is terminated. */
+void nn_chunkpool_term (void);
+
+void *nn_chunkpool_alloc (size_t size);
+void nn_chunkpool_free (void *p);
+
+#endif
@@ -51,7 +51,7 @@ void nn_chunkref_init (struct nn_chunkref *self, size_t size)
 
     ch = (struct nn_chunkref_chunk*) self;
     ch->tag = 0xff;
-    rc = nn_chunk_alloc (size, 0, &ch->chunk);
+    rc = nn_chunk_alloc (size, NN_ALLOCMSG_POOL, &ch->chunk);
     errno_assert (rc == 0);
 }
 
@@ -86,7 +86,7 @@ void *nn_chunkref_getchunk (struct nn_chunkref *self)
         return ch->chunk;
     }
 
-    rc = nn_chunk_alloc (self->ref [0], 0, &chunk);
+    rc = nn_chunk_alloc (self->ref [0], NN_ALLOCMSG_POOL, &chunk);
     errno_assert (rc == 0);
     memcpy (chunk, &self->ref [1], self->ref [0]);
     self->ref [0] = 0;
@@ -124,6 +124,13 @@ size_t nn_chunkref_size (struct nn_chunkref *self)
         self->ref [0];
 }
 
+int nn_chunkref_getfile (struct nn_chunkref *self, int *fd, uint64_t *offset)
+{
+    return self->ref [0] == 0xff ?
+        nn_chunk_getfile (((struct nn_chunkref_chunk*) self)->chunk,
+        fd, offset) : 0;
+}
+
 void nn_chunkref_trim (struct nn_chunkref *self, size_t n)
 {
     struct nn_chunkref_chunk *ch;
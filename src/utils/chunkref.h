@@ -69,6 +69,11 @@ void *nn_chunkref_data (struct nn_chunkref *self);
 /*  Returns the size of the binary data stored in the chunk. */
 size_t nn_chunkref_size (struct nn_chunkref *self);
 
+/*  If the data are stored in a file-backed chunk, fills in the file
+    descriptor and the position of the data within the file and returns 1.
+    Otherwise returns 0. */
+int nn_chunkref_getfile (struct nn_chunkref *self, int *fd, uint64_t *offset);
+
 /*  Trims n bytes from the beginning of the chunk. */
 void nn_chunkref_trim (struct nn_chunkref *self, size_t n);
 
@@ -23,112 +23,117 @@
 #include "hash.h"
 #include "fast.h"
 #include "alloc.h"
-#include "cont.h"
 #include "err.h"
 
+#include <string.h>
+
 #define NN_HASH_INITIAL_SLOTS 32
 
+/*  Number of slots of the old table to process on each insert or lookup
+    while resizing. The old table is at most half full and it has to be
+    drained before the new, double-sized one gets half full, i.e. in at most
+    old-size/2 inserts. Anything above 2 slots per insert would do; a bit of
+    headroom is added to account for the wrap-around. */
+#define NN_HASH_MIGRATE_STEP 4
+
 static uint32_t nn_hash_key (uint32_t key);
 
+static void nn_hash_table_init (struct nn_hash_table *self, uint32_t slots);
+static void nn_hash_table_term (struct nn_hash_table *self);
+static uint32_t nn_hash_table_find (struct nn_hash_table *self, uint32_t key);
+static void nn_hash_table_insert (struct nn_hash_table *self, uint32_t key,
+    struct nn_hash_item *item);
+static void nn_hash_table_erase (struct nn_hash_table *self, uint32_t pos);
+static void nn_hash_migrate (struct nn_hash *self, uint32_t steps);
+
 void nn_hash_init (struct nn_hash *self)
 {
-    uint32_t i;
-
-    self->slots = NN_HASH_INITIAL_SLOTS;
-    self->items = 0;
-    self->array = nn_alloc (sizeof (struct nn_list) * NN_HASH_INITIAL_SLOTS,
-        "hash map");
-    alloc_assert (self->array);
-    for (i = 0; i != NN_HASH_INITIAL_SLOTS; ++i)
-        nn_list_init (&self->array [i]);
+    nn_hash_table_init (&self->cur, NN_HASH_INITIAL_SLOTS);
+    self->old.mask = 0;
+    self->old.items = 0;
+    self->old.slots = NULL;
+    self->migrate = 0;
 }
 
 void nn_hash_term (struct nn_hash *self)
 {
-    uint32_t i;
-
-    for (i = 0; i != self->slots; ++i)
-        nn_list_term (&self->array [i]);
-    nn_free (self->array);
+    nn_assert (!self->old.slots);
+    nn_hash_table_term (&self->cur);
 }
 
 void nn_hash_insert (struct nn_hash *self, uint32_t key,
     struct nn_hash_item *item)
 {
-    struct nn_list_item *it;
-    uint32_t i;
-    uint32_t oldslots;
-    struct nn_list *oldarray;
-    struct nn_hash_item *hitm;
-    uint32_t newslot;
+    nn_assert (!item->inhash);
+    nn_assert (nn_hash_table_find (&self->cur, key) == (uint32_t) -1);
+    nn_assert (!self->old.slots ||
+        nn_hash_table_find (&self->old, key) == (uint32_t) -1);
 
-    i = nn_hash_key (key) % self->slots;
+    /*  Move a few items from the old table, if there's resizing going on. */
+    if (nn_slow (self->old.slots != NULL))
+        nn_hash_migrate (self, NN_HASH_MIGRATE_STEP);
 
-    for (it = nn_list_begin (&self->array [i]);
-          it != nn_list_end (&self->array [i]);
-          it = nn_list_next (&self->array [i], it))
-        nn_assert (nn_cont (it, struct nn_hash_item, list)->key != key);
+    /*  If the table is getting full, allocate a double-sized one. The items
+        are moved to it during subsequent inserts. */
+    if (nn_slow ((self->cur.items + 1) * 2 > self->cur.mask + 1 &&
+          self->cur.mask < 0x7fffffff)) {
 
-    item->key = key;
-    nn_list_insert (&self->array [i], &item->list,
-        nn_list_end (&self->array [i]));
-    ++self->items;
-
-    /*  If the hash is getting full, double the amount of slots and
-        re-hash all the items. */
-    if (nn_slow (self->items * 2 > self->slots && self->slots < 0x80000000)) {
-
-        /*  Allocate new double-sized array of slots. */
-        oldslots = self->slots;
-        oldarray = self->array;
-        self->slots *= 2;
-        self->array = nn_alloc (sizeof (struct nn_list) * self->slots,
-            "hash map");
-        alloc_assert (self->array);
-        for (i = 0; i != self->slots; ++i)
-            nn_list_init (&self->array [i]);
-
-        /*  Move the items from old slot array to new slot array. */
-        for (i = 0; i != oldslots; ++i) {
-            while (!nn_list_empty (&oldarray [i])) {
-                hitm = nn_cont (nn_list_begin (&oldarray [i]),
-                     struct nn_hash_item, list);
-                nn_list_erase (&oldarray [i], &hitm->list);
-                newslot = nn_hash_key (hitm->key) % self->slots;
-                nn_list_insert (&self->array [newslot], &hitm->list,
-                    nn_list_end (&self->array [newslot]));
-            }
-
-            nn_list_term (&oldarray [i]);
-        }
+        /*  Should not happen given the migration step, but make sure we
+            never have more than two tables. */
+        if (nn_slow (self->old.slots != NULL))
+            nn_hash_migrate (self, (uint32_t) -1);
 
-        /*  Deallocate the old array of slots. */
-        nn_free (oldarray);
+        self->old = self->cur;
+        self->migrate = 0;
+        nn_hash_table_init (&self->cur, (self->old.mask + 1) * 2);
     }
+
+    item->key = key;
+    item->inhash = 1;
+    nn_hash_table_insert (&self->cur, key, item);
 }
 
 void nn_hash_erase (struct nn_hash *self, struct nn_hash_item *item)
 {
-    uint32_t slot;
+    uint32_t pos;
+
+    nn_assert (item->inhash);
+
+    pos = nn_hash_table_find (&self->cur, item->key);
+    if (nn_fast (pos != (uint32_t) -1)) {
+        nn_assert (self->cur.slots [pos].item == item);
+        nn_hash_table_erase (&self->cur, pos);
+    }
+    else {
+        nn_assert (self->old.slots);
+        pos = nn_hash_table_find (&self->old, item->key);
+        nn_assert (pos != (uint32_t) -1);
+        nn_assert (self->old.slots [pos].item == item);
+        nn_hash_table_erase (&self->old, pos);
+        if (self->old.items == 0)
+            nn_hash_migrate (self, 0);
+    }
 
-    slot = nn_hash_key (item->key) % self->slots;
-    nn_list_erase (&self->array [slot], &item->list);
+    item->inhash = 0;
 }
 
 struct nn_hash_item *nn_hash_get (struct nn_hash *self, uint32_t key)
 {
-    uint32_t slot;
-    struct nn_list_item *it;
-    struct nn_hash_item *item;
-
-    slot = nn_hash_key (key) % self->slots;
-
-    for (it = nn_list_begin (&self->array [slot]);
-          it != nn_list_end (&self->array [slot]);
-          it = nn_list_next (&self->array [slot], it)) {
-        item = nn_cont (it, struct nn_hash_item, list);
-        if (item->key == key)
-            return item;
+    uint32_t pos;
+
+    /*  Lookups help with the resizing as well, so that the old table
+        doesn't linger around when there are no inserts. */
+    if (nn_slow (self->old.slots != NULL))
+        nn_hash_migrate (self, NN_HASH_MIGRATE_STEP);
+
+    pos = nn_hash_table_find (&self->cur, key);
+    if (nn_fast (pos != (uint32_t) -1))
+        return self->cur.slots [pos].item;
+
+    if (nn_slow (self->old.slots != NULL)) {
+        pos = nn_hash_table_find (&self->old, key);
+        if (pos != (uint32_t) -1)
+            return self->old.slots [pos].item;
     }
 
     return NULL;
@@ -149,11 +154,121 @@ uint32_t nn_hash_key (uint32_t key)
 
 void nn_hash_item_init (struct nn_hash_item *self)
 {
-    nn_list_item_init (&self->list);
+    self->key = 0xffff;
+    self->inhash = 0;
 }
 
 void nn_hash_item_term (struct nn_hash_item *self)
 {
-    nn_list_item_term (&self->list);
+    nn_assert (!self->inhash);
 }
 
+static void nn_hash_table_init (struct nn_hash_table *self, uint32_t slots)
+{
+    self->mask = slots - 1;
+    self->items = 0;
+    self->slots = nn_alloc (sizeof (struct nn_hash_slot) * slots, "hash map");
+    alloc_assert (self->slots);
+    memset (self->slots, 0, sizeof (struct nn_hash_slot) * slots);
+}
+
+static void nn_hash_table_term (struct nn_hash_table *self)
+{
+    nn_assert (self->items == 0);
+    nn_free (self->slots);
+    self->slots = NULL;
+}
+
+static uint32_t nn_hash_table_find (struct nn_hash_table *self, uint32_t key)
+{
+    uint32_t pos;
+    uint32_t dist;
+    struct nn_hash_slot *slot;
+
+    pos = nn_hash_key (key) & self->mask;
+    for (dist = 1;; ++dist, pos = (pos + 1) & self->mask) {
+        slot = &self->slots [pos];
+
+        /*  The items are ordered by their distance from the home slot. If
+            the key was in the table we would have already found it. This
+            check also covers the empty slots. */
+        if (slot->dist < dist)
+            return (uint32_t) -1;
+        if (slot->key == key)
+            return pos;
+    }
+}
+
+static void nn_hash_table_insert (struct nn_hash_table *self, uint32_t key,
+    struct nn_hash_item *item)
+{
+    uint32_t pos;
+    struct nn_hash_slot *slot;
+    struct nn_hash_slot new;
+    struct nn_hash_slot tmp;
+
+    new.key = key;
+    new.dist = 1;
+    new.item = item;
+    pos = nn_hash_key (key) & self->mask;
+    for (;; ++new.dist, pos = (pos + 1) & self->mask) {
+        slot = &self->slots [pos];
+        if (!slot->dist) {
+            *slot = new;
+            ++self->items;
+            return;
+        }
+
+        /*  Take the slot from the item that is closer to its home slot and
+            continue looking for a place for that one instead. */
+        if (slot->dist < new.dist) {
+            tmp = *slot;
+            *slot = new;
+            new = tmp;
+        }
+    }
+}
+
+static void nn_hash_table_erase (struct nn_hash_table *self, uint32_t pos)
+{
+    uint32_t next;
+    struct nn_hash_slot *slot;
+
+    /*  Shift the following items one slot back, up to the first empty slot
+        or the first item that is already in its home slot. */
+    while (1) {
+        next = (pos + 1) & self->mask;
+        slot = &self->slots [next];
+        if (slot->dist <= 1)
+            break;
+        self->slots [pos] = *slot;
+        --self->slots [pos].dist;
+        pos = next;
+    }
+    self->slots [pos].dist = 0;
+    self->slots [pos].item = NULL;
+    --self->items;
+}
+
+static void nn_hash_migrate (struct nn_hash *self, uint32_t steps)
+{
+    struct nn_hash_slot *slot;
+
+    while (self->old.items && steps) {
+
+        /*  Erasing the slot shifts the next item into it, so keep moving
+            items until the slot becomes empty. Items wrapped around the end
+            of the array may end up in slots we've already passed, therefore
+            we keep going round until the old table is empty. */
+        slot = &self->old.slots [self->migrate];
+        while (slot->dist) {
+            nn_hash_table_insert (&self->cur, slot->key, slot->item);
+            nn_hash_table_erase (&self->old, self->migrate);
+        }
+        self->migrate = (self->migrate + 1) & self->old.mask;
+        --steps;
+    }
+
+    if (!self->old.items)
+        nn_hash_table_term (&self->old);
+}
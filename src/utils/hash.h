@@ -23,23 +23,57 @@
 #ifndef NN_HASH_INCLUDED
 #define NN_HASH_INCLUDED
 
-#include "list.h"
 #include "int.h"
 
 #include <stddef.h>
 
+/*  Open-addressing hash table with Robin Hood probing. Items are stored by
+    pointer in a flat array of slots, together with the key so that probing
+    doesn't have to touch the items themselves. When the table grows, the new
+    array is allocated immediately, but the items are moved over from the old
+    one gradually, a few slots per insert, so that no single insert has to
+    re-hash the whole table. */
+
 /*  Use for initialising a hash item statically. */
-#define NN_HASH_ITEM_INITIALIZER {0xffff, NN_LIST_ITEM_INITILIZER}
+#define NN_HASH_ITEM_INITIALIZER {0xffff, 0}
 
 struct nn_hash_item {
     uint32_t key;
-    struct nn_list_item list;
+    int inhash;
 };
 
-struct nn_hash {
-    uint32_t slots;
+struct nn_hash_slot {
+    uint32_t key;
+
+    /*  Distance from the slot the key hashes to, plus one. Zero means the
+        slot is empty. */
+    uint32_t dist;
+
+    struct nn_hash_item *item;
+};
+
+struct nn_hash_table {
+
+    /*  Number of slots minus one. Number of slots is always a power of 2. */
+    uint32_t mask;
+
+    /*  Number of occupied slots. */
     uint32_t items;
-    struct nn_list *array;
+
+    /*  Array of slots. NULL if the table is not allocated. */
+    struct nn_hash_slot *slots;
+};
+
+struct nn_hash {
+
+    /*  The table new items are inserted into. */
+    struct nn_hash_table cur;
+
+    /*  While resizing, the table the items are being moved from. */
+    struct nn_hash_table old;
+
+    /*  Next slot of the old table to move the items from. */
+    uint32_t migrate;
 };
 
 /*  Initialise the hash table. */
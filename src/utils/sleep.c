@@ -32,6 +32,11 @@ void nn_sleep (int milliseconds)
     Sleep (milliseconds);
 }
 
+void nn_relax (void)
+{
+    YieldProcessor ();
+}
+
 #else
 
 #include <time.h>
@@ -47,4 +52,13 @@ void nn_sleep (int milliseconds)
     errno_assert (rc == 0);    
 }
 
+void nn_relax (void)
+{
+#if defined __GNUC__ && (defined __i386__ || defined __x86_64__)
+    __asm__ volatile ("pause");
+#elif defined __GNUC__ && defined __aarch64__
+    __asm__ volatile ("yield");
+#endif
+}
+
 #endif
@@ -27,4 +27,8 @@
 
 void nn_sleep (int milliseconds);
 
+/*  Hint the CPU that the caller is busy-waiting. Doesn't give up the time
+    slice, it just makes spin loops cheaper for the sibling hyperthread. */
+void nn_relax (void);
+
 #endif
@@ -48,8 +48,25 @@ void worker (NN_UNUSED void *arg)
     test_send (sc, "ABC");
 }
 
+void spin_worker (NN_UNUSED void *arg)
+{
+    /*  Send the message while the main thread is still spinning. */
+    nn_sleep (10);
+
+    test_send (sc, "DEF");
+
+    /*  Wait till the spinning period expires and the main thread falls
+        back to blocking. */
+    nn_sleep (100);
+
+    test_send (sc, "DEF");
+}
+
 int main ()
 {
+    int rc;
+    int val;
+    size_t sz;
     struct nn_thread thread;
 
     sb = test_socket (AF_SP, NN_PAIR);
@@ -64,6 +81,34 @@ int main ()
 
     nn_thread_term (&thread);
 
+    /*  Check the NN_RCVSPIN option. */
+    val = -1;
+    rc = nn_setsockopt (sb, NN_SOL_SOCKET, NN_RCVSPIN, &val, sizeof (val));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    val = 50000;
+    rc = nn_setsockopt (sb, NN_SOL_SOCKET, NN_RCVSPIN, &val, sizeof (val));
+    errno_assert (rc == 0);
+    val = 0;
+    sz = sizeof (val);
+    rc = nn_getsockopt (sb, NN_SOL_SOCKET, NN_RCVSPIN, &val, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (val) && val == 50000);
+
+    /*  Receive one message while spinning and one after blocking. */
+    nn_thread_init (&thread, spin_worker, NULL);
+
+    test_recv (sb, "DEF");
+    test_recv (sb, "DEF");
+
+    nn_thread_term (&thread);
+
+    /*  Receive timeout still applies while spinning. */
+    val = 10;
+    rc = nn_setsockopt (sb, NN_SOL_SOCKET, NN_RCVTIMEO, &val, sizeof (val));
+    errno_assert (rc == 0);
+    rc = nn_recv (sb, &val, sizeof (val), 0);
+    nn_assert (rc < 0 && nn_errno () == EAGAIN);
+
     test_close (sc);
     test_close (sb);
 
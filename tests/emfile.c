@@ -25,6 +25,10 @@
 #include "../src/tcp.h"
 #include "../src/utils/err.c"
 
+#if !defined NN_HAVE_WINDOWS
+#include <sys/resource.h>
+#endif
+
 #define SOCKET_ADDRESS "tcp://127.0.0.1:5555"
 #define MAX_SOCKETS 1000
 
@@ -33,8 +37,36 @@ int main ()
     int rc;
     int i;
     int socks [MAX_SOCKETS];
+#if !defined NN_HAVE_WINDOWS
+    struct rlimit rl;
+    struct rlimit oldrl;
+#endif
 
-    /*  First, just create as much SP sockets as possible. */
+    /*  Create more sockets than fit into a single segment of the socket
+        table. The limit on number of SP sockets is much higher than this,
+        so all of them have to succeed. */
+    for (i = 0; i != MAX_SOCKETS; ++i) {
+        socks [i] = nn_socket (AF_SP, NN_PAIR);
+        errno_assert (socks [i] >= 0);
+    }
+    while (1) {
+        --i;
+        if (i == -1)
+            break;
+        rc = nn_close (socks [i]);
+        errno_assert (rc == 0);
+    }
+
+#if !defined NN_HAVE_WINDOWS
+
+    /*  When the process runs out of file descriptors, socket creation
+        fails with EMFILE. */
+    rc = getrlimit (RLIMIT_NOFILE, &oldrl);
+    errno_assert (rc == 0);
+    rl = oldrl;
+    rl.rlim_cur = 64;
+    rc = setrlimit (RLIMIT_NOFILE, &rl);
+    errno_assert (rc == 0);
     for (i = 0; i != MAX_SOCKETS; ++i) {
         socks [i] = nn_socket (AF_SP, NN_PAIR);
         if (socks [i] < 0) {
@@ -42,6 +74,7 @@ int main ()
             break;
         }
     }
+    nn_assert (i != MAX_SOCKETS);
     while (1) {
         --i;
         if (i == -1)
@@ -49,6 +82,16 @@ int main ()
         rc = nn_close (socks [i]);
         errno_assert (rc == 0);
     }
+    rc = setrlimit (RLIMIT_NOFILE, &oldrl);
+    errno_assert (rc == 0);
+
+#endif
+
+    /*  Descriptors outside of the socket table are rejected. */
+    rc = nn_close (-1);
+    nn_assert (rc == -1 && nn_errno () == EBADF);
+    rc = nn_close (0x7fffffff);
+    nn_assert (rc == -1 && nn_errno () == EBADF);
 
     return 0;
 }
@@ -31,6 +31,7 @@ int main ()
     uint32_t k;
     struct nn_hash_item *item;
     struct nn_hash_item *item5000 = NULL;
+    struct nn_hash_item *items;
 
     nn_hash_init (&hash);
 
@@ -55,6 +56,32 @@ int main ()
     }
     nn_hash_term (&hash);
 
+    /*  Interleave inserts and erases so that some of the items are removed
+        while the table is being resized. */
+    items = nn_alloc (sizeof (struct nn_hash_item) * 10000, "items");
+    nn_assert (items);
+    nn_hash_init (&hash);
+    for (k = 0; k != 10000; ++k) {
+        nn_hash_item_init (&items [k]);
+        nn_hash_insert (&hash, k * 7919, &items [k]);
+        if (k % 3 == 2)
+            nn_hash_erase (&hash, &items [k - 1]);
+    }
+    for (k = 0; k != 10000; ++k) {
+        if (k % 3 == 1)
+            nn_assert (nn_hash_get (&hash, k * 7919) == NULL);
+        else
+            nn_assert (nn_hash_get (&hash, k * 7919) == &items [k]);
+    }
+    nn_assert (nn_hash_get (&hash, 1) == NULL);
+    for (k = 0; k != 10000; ++k) {
+        if (k % 3 != 1)
+            nn_hash_erase (&hash, &items [k]);
+        nn_hash_item_term (&items [k]);
+    }
+    nn_hash_term (&hash);
+    nn_free (items);
+
     return 0;
 }
 
@@ -66,6 +66,18 @@ int main ()
         test_recv (sb, "XYZ");
     }
 
+    /*  Transfer spanning several chunks of the message queue. */
+    for (i = 0; i != 1000; ++i) {
+        test_send (sc, "XYZ");
+        if (i % 3 == 0)
+            test_recv (sb, "XYZ");
+    }
+    for (i = 0; i != 1000 - 334; ++i) {
+        test_recv (sb, "XYZ");
+    }
+    rc = nn_recv (sb, buf, sizeof (buf), NN_DONTWAIT);
+    nn_assert (rc < 0 && nn_errno () == EAGAIN);
+
     test_close (sc);
     test_close (sb);
 
@@ -29,6 +29,8 @@
 
 #define SOCKET_ADDRESS "inproc://a"
 
+#define MMSG_COUNT 100
+
 int main ()
 {
     int rc;
@@ -37,6 +39,12 @@ int main ()
     struct nn_iovec iov [2];
     struct nn_msghdr hdr;
     char buf [6];
+    int i;
+    int count;
+    char bufs [MMSG_COUNT][3];
+    void *chunks [MMSG_COUNT];
+    struct nn_iovec iovs [MMSG_COUNT];
+    struct nn_mmsghdr msgs [MMSG_COUNT];
 
     sb = test_socket (AF_SP, NN_PAIR);
     test_bind (sb, SOCKET_ADDRESS);
@@ -66,6 +74,66 @@ int main ()
     nn_assert (rc == 6);
     nn_assert (memcmp (buf, "ABCDEF", 6) == 0);
 
+    /*  Send a batch of messages, longer than a single internal batch. */
+    memset (msgs, 0, sizeof (msgs));
+    for (i = 0; i != MMSG_COUNT; ++i) {
+        bufs [i][0] = 'A' + i % 26;
+        bufs [i][1] = '0' + i / 10;
+        bufs [i][2] = '0' + i % 10;
+        iovs [i].iov_base = bufs [i];
+        iovs [i].iov_len = 3;
+        msgs [i].msg_hdr.msg_iov = &iovs [i];
+        msgs [i].msg_hdr.msg_iovlen = 1;
+    }
+    count = 0;
+    while (count != MMSG_COUNT) {
+        rc = nn_sendmmsg (sc, msgs + count, MMSG_COUNT - count, 0);
+        errno_assert (rc > 0);
+        count += rc;
+    }
+    for (i = 0; i != MMSG_COUNT; ++i)
+        nn_assert (msgs [i].msg_len == 3);
+
+    /*  Receive them as zero-copy messages. */
+    memset (msgs, 0, sizeof (msgs));
+    for (i = 0; i != MMSG_COUNT; ++i) {
+        iovs [i].iov_base = &chunks [i];
+        iovs [i].iov_len = NN_MSG;
+        msgs [i].msg_hdr.msg_iov = &iovs [i];
+        msgs [i].msg_hdr.msg_iovlen = 1;
+    }
+    count = 0;
+    while (count != MMSG_COUNT) {
+        rc = nn_recvmmsg (sb, msgs + count, MMSG_COUNT - count, 0);
+        errno_assert (rc > 0);
+        count += rc;
+    }
+    for (i = 0; i != MMSG_COUNT; ++i) {
+        nn_assert (msgs [i].msg_len == 3);
+        nn_assert (memcmp (chunks [i], bufs [i], 3) == 0);
+        nn_freemsg (chunks [i]);
+    }
+
+    /*  Nothing more to receive. */
+    rc = nn_recvmmsg (sb, msgs, MMSG_COUNT, NN_DONTWAIT);
+    nn_assert (rc == -1 && nn_errno () == EAGAIN);
+
+    /*  Invalid header is reported before any message is received. */
+    iov [0].iov_base = "AB";
+    iov [0].iov_len = 2;
+    memset (&hdr, 0, sizeof (hdr));
+    hdr.msg_iov = iov;
+    hdr.msg_iovlen = 1;
+    rc = nn_sendmsg (sc, &hdr, 0);
+    errno_assert (rc == 2);
+    msgs [1].msg_hdr.msg_iovlen = -1;
+    rc = nn_recvmmsg (sb, msgs, 2, 0);
+    nn_assert (rc == -1 && nn_errno () == EMSGSIZE);
+    rc = nn_recvmmsg (sb, msgs, 1, 0);
+    errno_assert (rc == 1);
+    nn_assert (msgs [0].msg_len == 2);
+    nn_freemsg (chunks [0]);
+
     test_close (sc);
     test_close (sb);
 
@@ -34,9 +34,12 @@
 int main ()
 {
 #if !defined NN_HAVE_WINDOWS
+    int rc;
     int sb;
     int sc;
     int i;
+    int opt;
+    size_t sz;
     int s1, s2;
 
     /*  Try closing a IPC socket while it not connected. */
@@ -52,6 +55,20 @@ int main ()
     nn_sleep (200);
 
     sb = test_socket (AF_SP, NN_PAIR);
+
+    /*  Use batch buffer smaller than some of the messages. */
+    opt = 0;
+    rc = nn_setsockopt (sb, NN_SOL_SOCKET, NN_RCVBATCH, &opt, sizeof (opt));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    opt = 16;
+    rc = nn_setsockopt (sb, NN_SOL_SOCKET, NN_RCVBATCH, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+    sz = sizeof (opt);
+    rc = nn_getsockopt (sb, NN_SOL_SOCKET, NN_RCVBATCH, &opt, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (opt));
+    nn_assert (opt == 16);
+
     test_bind (sb, SOCKET_ADDRESS);
 
     /*  Ping-pong test. */
@@ -27,8 +27,14 @@
 
 #include <string.h>
 
+#if !defined NN_HAVE_WINDOWS
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
 #define SOCKET_ADDRESS "inproc://a"
 #define SOCKET_ADDRESS_TCP "tcp://127.0.0.1:5557"
+#define SOCKET_ADDRESS_IPC "ipc://test-msg.ipc"
 
 char longdata[1 << 20];
 
@@ -38,9 +44,20 @@ int main ()
     int sb;
     int sc;
     unsigned char *buf1, *buf2;
+    unsigned char *bufs [100];
     int i;
+    int j;
     struct nn_iovec iov;
     struct nn_msghdr hdr;
+#if !defined NN_HAVE_WINDOWS
+    struct nn_allocstats stats;
+    size_t hits;
+    int fd;
+    int k;
+    char fname [] = "/tmp/nn-test-msg-XXXXXX";
+    const char *addrs [] = {SOCKET_ADDRESS, SOCKET_ADDRESS_TCP,
+        SOCKET_ADDRESS_IPC};
+#endif
 
     sb = test_socket (AF_SP, NN_PAIR);
     test_bind (sb, SOCKET_ADDRESS);
@@ -93,9 +110,63 @@ int main ()
     rc = nn_freemsg (buf2);
     errno_assert (rc == 0);
 
+    /*  Test messages allocated from the pool, including the ones too big
+        to be pooled.  */
+
+    for (i = 0; i != 3; ++i) {
+        size_t sz = i == 0 ? 10 : (i == 1 ? 1000 : 100000);
+        buf1 = nn_allocmsg (sz, NN_ALLOCMSG_POOL);
+        alloc_assert (buf1);
+        memset (buf1, 'a' + i, sz);
+        rc = nn_send (sc, &buf1, NN_MSG, 0);
+        errno_assert (rc >= 0);
+        nn_assert (rc == (int) sz);
+        buf2 = NULL;
+        rc = nn_recv (sb, &buf2, NN_MSG, 0);
+        errno_assert (rc >= 0);
+        nn_assert (rc == (int) sz);
+        for (j = 0; j != (int) sz; ++j)
+            nn_assert (buf2 [j] == 'a' + i);
+        rc = nn_freemsg (buf2);
+        errno_assert (rc == 0);
+    }
+
+    buf1 = nn_allocmsg (256, 2);
+    nn_assert (!buf1 && nn_errno () == EINVAL);
+
+#if !defined NN_HAVE_WINDOWS
+
+    /*  Test that large messages are recycled rather than returned to
+        the OS. */
+    rc = nn_get_allocstats (&stats);
+    errno_assert (rc == 0);
+    hits = stats.hits;
+    for (i = 0; i != 10; ++i) {
+        buf1 = nn_allocmsg (1000000, NN_ALLOCMSG_POOL);
+        alloc_assert (buf1);
+        memset (buf1, 'a', 1000000);
+        rc = nn_freemsg (buf1);
+        errno_assert (rc == 0);
+    }
+    rc = nn_get_allocstats (&stats);
+    errno_assert (rc == 0);
+    nn_assert (stats.hits >= hits + 9);
+    nn_assert (stats.cached >= 1000000);
+
+#endif
+
     test_close (sc);
     test_close (sb);
 
+#if !defined NN_HAVE_WINDOWS
+
+    /*  The cache is emptied once the library is terminated. */
+    rc = nn_get_allocstats (&stats);
+    errno_assert (rc == 0);
+    nn_assert (stats.cached == 0);
+
+#endif
+
     /*  Test receiving of large message  */
 
     sb = test_socket (AF_SP, NN_PAIR);
@@ -117,9 +188,83 @@ int main ()
     rc = nn_freemsg (buf2);
     errno_assert (rc == 0);
 
+    /*  Test that messages received in a batch stay intact while being held
+        by the user. The sizes span both the small messages that are copied
+        out of the batch buffer and the larger ones that refer to it. */
+
+    for (i = 0; i != 100; ++i) {
+        memset (longdata, 'a' + i % 26, 100 + i * 10);
+        rc = nn_send (sb, longdata, 100 + i * 10, 0);
+        errno_assert (rc >= 0);
+        nn_assert (rc == 100 + i * 10);
+    }
+    for (i = 0; i != 100; ++i) {
+        rc = nn_recv (sc, &bufs [i], NN_MSG, 0);
+        errno_assert (rc >= 0);
+        nn_assert (rc == 100 + i * 10);
+    }
+    for (i = 0; i != 100; ++i) {
+        for (j = 0; j != 100 + i * 10; ++j)
+            nn_assert (bufs [i] [j] == 'a' + i % 26);
+        rc = nn_freemsg (bufs [i]);
+        errno_assert (rc == 0);
+    }
+
     test_close (sc);
     test_close (sb);
 
+#if !defined NN_HAVE_WINDOWS
+
+    /*  Test messages backed by a file. Stream transports pass the file to
+        the socket directly. Follow each of them by an ordinary message to
+        make sure the ordering is preserved. */
+
+    for (i = 0; i != (int) sizeof (longdata); ++i)
+        longdata [i] = (char) (i % 251);
+    fd = mkstemp (fname);
+    errno_assert (fd >= 0);
+    rc = unlink (fname);
+    errno_assert (rc == 0);
+    rc = (int) write (fd, longdata, sizeof (longdata));
+    errno_assert (rc == (int) sizeof (longdata));
+
+    buf1 = nn_allocmsg_file (fd, 0, sizeof (longdata) + 1);
+    nn_assert (!buf1 && nn_errno () == EINVAL);
+    buf1 = nn_allocmsg_file (-1, 0, 100);
+    nn_assert (!buf1 && nn_errno () == EBADF);
+
+    for (k = 0; k != 3; ++k) {
+        sb = test_socket (AF_SP, NN_PAIR);
+        test_bind (sb, (char*) addrs [k]);
+        sc = test_socket (AF_SP, NN_PAIR);
+        test_connect (sc, (char*) addrs [k]);
+
+        for (i = 0; i != 10; ++i) {
+            buf1 = nn_allocmsg_file (fd, i * 4099, 100000 + i);
+            alloc_assert (buf1);
+            nn_assert (buf1 [0] == (unsigned char) longdata [i * 4099]);
+            rc = nn_send (sc, &buf1, NN_MSG, 0);
+            errno_assert (rc >= 0);
+            nn_assert (rc == 100000 + i);
+            test_send (sc, "ABC");
+            rc = nn_recv (sb, &buf2, NN_MSG, 0);
+            errno_assert (rc >= 0);
+            nn_assert (rc == 100000 + i);
+            nn_assert (memcmp (buf2, longdata + i * 4099, rc) == 0);
+            rc = nn_freemsg (buf2);
+            errno_assert (rc == 0);
+            test_recv (sb, "ABC");
+        }
+
+        test_close (sc);
+        test_close (sb);
+    }
+
+    rc = close (fd);
+    errno_assert (rc == 0);
+
+#endif
+
     return 0;
 }
 
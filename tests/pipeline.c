@@ -29,6 +29,10 @@
 
 int main ()
 {
+    int rc;
+    int val;
+    size_t sz;
+    int i;
     int push1;
     int push2;
     int pull1;
@@ -76,6 +80,41 @@ int main ()
     test_close (push1);
     test_close (push2);
 
+    /*  Test load-aware balancing. */
+
+    push1 = test_socket (AF_SP, NN_PUSH);
+    test_bind (push1, SOCKET_ADDRESS);
+    sz = sizeof (val);
+    rc = nn_getsockopt (push1, NN_PUSH, NN_PUSH_LB_POLICY, &val, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (val) && val == NN_LB_ROUND_ROBIN);
+    val = -1;
+    rc = nn_setsockopt (push1, NN_PUSH, NN_PUSH_LB_POLICY, &val, sizeof (val));
+    nn_assert (rc == -1 && nn_errno () == EINVAL);
+    val = NN_LB_LEAST_LOADED;
+    rc = nn_setsockopt (push1, NN_PUSH, NN_PUSH_LB_POLICY, &val, sizeof (val));
+    errno_assert (rc == 0);
+
+    /*  The first pull socket doesn't read its messages, so everything sent
+        after the first message goes to the second one. */
+    pull1 = test_socket (AF_SP, NN_PULL);
+    test_connect (pull1, SOCKET_ADDRESS);
+    nn_sleep (10);
+    test_send (push1, "ABC");
+    pull2 = test_socket (AF_SP, NN_PULL);
+    test_connect (pull2, SOCKET_ADDRESS);
+    nn_sleep (10);
+
+    for (i = 0; i != 4; ++i) {
+        test_send (push1, "DEF");
+        test_recv (pull2, "DEF");
+    }
+    test_recv (pull1, "ABC");
+
+    test_close (push1);
+    test_close (pull1);
+    test_close (pull2);
+
     return 0;
 }
 
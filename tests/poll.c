@@ -37,8 +37,10 @@
 /*  Test of polling via NN_SNDFD/NN_RCVFD mechanism. */
 
 #define SOCKET_ADDRESS "inproc://a"
+#define SOCKET_ADDRESS_B "inproc://b"
 
 int sc;
+int sr;
 
 void routine1 (NN_UNUSED void *arg)
 {
@@ -46,6 +48,11 @@ void routine1 (NN_UNUSED void *arg)
    test_send (sc, "ABC");
 }
 
+void routine3 (NN_UNUSED void *arg)
+{
+   test_recv (sr, "DEF");
+}
+
 void routine2 (NN_UNUSED void *arg)
 {
    nn_sleep (10);
@@ -123,6 +130,7 @@ int main ()
 {
     int rc;
     int sb;
+    int ss;
     char buf [3];
     struct nn_thread thread;
     struct nn_pollfd pfd [2];
@@ -179,6 +187,26 @@ int main ()
     test_recv (sb, "ABC");
     nn_thread_term (&thread);
 
+    /*  Check that nobody misses a wakeup when a thread blocked in nn_recv
+        and a poller observe the same socket. New sockets are used so that
+        NN_RCVFD was never fetched before the messages arrive. */
+    sr = test_socket (AF_SP, NN_PAIR);
+    test_bind (sr, SOCKET_ADDRESS_B);
+    ss = test_socket (AF_SP, NN_PAIR);
+    test_connect (ss, SOCKET_ADDRESS_B);
+    nn_thread_init (&thread, routine3, NULL);
+    nn_sleep (100);
+    test_send (ss, "DEF");
+    test_send (ss, "GHI");
+    nn_thread_term (&thread);
+    rc = getevents (sr, NN_IN, 1000);
+    nn_assert (rc == NN_IN);
+    test_recv (sr, "GHI");
+    rc = getevents (sr, NN_IN, 10);
+    nn_assert (rc == 0);
+    test_close (ss);
+    test_close (sr);
+
     /*  Check terminating the library from a different thread. */
     nn_thread_init (&thread, routine2, NULL);
     rc = getevents (sb, NN_IN, 1000);
@@ -0,0 +1,139 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/nn.h"
+#include "../src/pair.h"
+
+#include "testutil.h"
+
+#include <stdio.h>
+
+/*  Test of the persistent pollset. */
+
+#define SOCKET_ADDRESS "inproc://a"
+
+#define PAIR_COUNT 50
+
+int main ()
+{
+    int rc;
+    int i;
+    int sb;
+    int sc;
+    int socks [PAIR_COUNT][2];
+    char addr [32];
+    struct nn_pollset *ps;
+    struct nn_pollfd pfd [4];
+
+    ps = nn_pollset_create ();
+    errno_assert (ps);
+
+    sb = test_socket (AF_SP, NN_PAIR);
+    test_bind (sb, SOCKET_ADDRESS);
+    sc = test_socket (AF_SP, NN_PAIR);
+    test_connect (sc, SOCKET_ADDRESS);
+
+    rc = nn_pollset_add (ps, sb, NN_POLLIN | NN_POLLOUT);
+    errno_assert (rc == 0);
+    rc = nn_pollset_add (ps, sc, NN_POLLIN);
+    errno_assert (rc == 0);
+    rc = nn_pollset_add (ps, sc, NN_POLLIN);
+    nn_assert (rc == -1 && nn_errno () == EEXIST);
+    rc = nn_pollset_add (ps, 1000, NN_POLLIN);
+    nn_assert (rc == -1 && nn_errno () == EBADF);
+
+    /*  Only OUT is signalled at the beginning. */
+    rc = nn_pollset_wait (ps, pfd, 4, 1000);
+    errno_assert (rc >= 0);
+    nn_assert (rc == 1);
+    nn_assert (pfd [0].fd == sb && pfd [0].revents == NN_POLLOUT);
+
+    /*  IN and OUT for the same socket are reported in a single entry. */
+    test_send (sc, "ABC");
+    nn_sleep (10);
+    rc = nn_pollset_wait (ps, pfd, 4, 1000);
+    errno_assert (rc >= 0);
+    nn_assert (rc == 1);
+    nn_assert (pfd [0].fd == sb);
+    nn_assert (pfd [0].revents == (NN_POLLIN | NN_POLLOUT));
+
+    /*  Stop polling for OUT. Once the message is read, nothing is
+        signalled. */
+    rc = nn_pollset_modify (ps, sb, NN_POLLIN);
+    errno_assert (rc == 0);
+    test_recv (sb, "ABC");
+    rc = nn_pollset_wait (ps, pfd, 4, 10);
+    errno_assert (rc >= 0);
+    nn_assert (rc == 0);
+
+    /*  Message in the other direction. */
+    test_send (sb, "DEF");
+    rc = nn_pollset_wait (ps, pfd, 4, 1000);
+    errno_assert (rc >= 0);
+    nn_assert (rc == 1);
+    nn_assert (pfd [0].fd == sc && pfd [0].revents == NN_POLLIN);
+    test_recv (sc, "DEF");
+
+    rc = nn_pollset_remove (ps, sc);
+    errno_assert (rc == 0);
+    rc = nn_pollset_remove (ps, sc);
+    nn_assert (rc == -1 && nn_errno () == ENOENT);
+    rc = nn_pollset_modify (ps, sc, NN_POLLIN);
+    nn_assert (rc == -1 && nn_errno () == ENOENT);
+
+    /*  Only the ready sockets are reported, and no more of them than fits
+        into the supplied array. */
+    for (i = 0; i != PAIR_COUNT; ++i) {
+        sprintf (addr, "inproc://pollset%d", i);
+        socks [i][0] = test_socket (AF_SP, NN_PAIR);
+        test_bind (socks [i][0], addr);
+        socks [i][1] = test_socket (AF_SP, NN_PAIR);
+        test_connect (socks [i][1], addr);
+        rc = nn_pollset_add (ps, socks [i][0], NN_POLLIN);
+        errno_assert (rc == 0);
+    }
+    test_send (socks [7][1], "GHI");
+    rc = nn_pollset_wait (ps, pfd, 4, 1000);
+    errno_assert (rc >= 0);
+    nn_assert (rc == 1);
+    nn_assert (pfd [0].fd == socks [7][0] && pfd [0].revents == NN_POLLIN);
+    for (i = 0; i != 6; ++i)
+        test_send (socks [i][1], "JKL");
+    nn_sleep (10);
+    rc = nn_pollset_wait (ps, pfd, 4, 1000);
+    errno_assert (rc >= 0);
+    nn_assert (rc == 4);
+
+    /*  Clean up. */
+    for (i = 0; i != PAIR_COUNT; ++i) {
+        rc = nn_pollset_remove (ps, socks [i][0]);
+        errno_assert (rc == 0);
+        test_close (socks [i][1]);
+        test_close (socks [i][0]);
+    }
+    rc = nn_pollset_destroy (ps);
+    errno_assert (rc == 0);
+    test_close (sc);
+    test_close (sb);
+
+    return 0;
+}
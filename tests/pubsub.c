@@ -25,7 +25,12 @@
 
 #include "testutil.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #define SOCKET_ADDRESS "inproc://a"
+#define SOCKET_ADDRESS_TCP "tcp://127.0.0.1:5558"
 
 int main ()
 {
@@ -34,6 +39,11 @@ int main ()
     int pub2;
     int sub1;
     int sub2;
+    int val;
+    size_t sz;
+    int i;
+    int last [2];
+    char buf [16];
 
     pub1 = test_socket (AF_SP, NN_PUB);
     test_bind (pub1, SOCKET_ADDRESS);
@@ -78,6 +88,230 @@ int main ()
     test_close (pub1);
     test_close (sub1);
 
+    /*  Check subscription forwarding. */
+
+    pub1 = test_socket (AF_SP, NN_PUB);
+    test_bind (pub1, SOCKET_ADDRESS_TCP);
+    sub1 = test_socket (AF_SP, NN_SUB);
+    sz = sizeof (val);
+    rc = nn_getsockopt (sub1, NN_SUB, NN_SUB_FORWARD, &val, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (val) && val == 0);
+    val = 1;
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_FORWARD, &val, sizeof (val));
+    errno_assert (rc == 0);
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_SUBSCRIBE, "A", 1);
+    errno_assert (rc == 0);
+    test_connect (sub1, SOCKET_ADDRESS_TCP);
+    sub2 = test_socket (AF_SP, NN_SUB);
+    rc = nn_setsockopt (sub2, NN_SUB, NN_SUB_SUBSCRIBE, "", 0);
+    errno_assert (rc == 0);
+    test_connect (sub2, SOCKET_ADDRESS_TCP);
+    nn_sleep (100);
+
+    /*  Messages not matching the subscriptions are not sent to the subscriber
+        at all. Thus, subscribing to them after they were published doesn't
+        make them appear. */
+    test_send (pub1, "B1");
+    test_send (pub1, "A1");
+    nn_sleep (100);
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_SUBSCRIBE, "B", 1);
+    errno_assert (rc == 0);
+    test_recv (sub1, "A1");
+    test_recv (sub2, "B1");
+    test_recv (sub2, "A1");
+    nn_sleep (100);
+    test_send (pub1, "B2");
+    test_recv (sub1, "B2");
+    test_recv (sub2, "B2");
+
+    /*  Switch the forwarding off. */
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_UNSUBSCRIBE, "A", 1);
+    errno_assert (rc == 0);
+    val = 0;
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_FORWARD, &val, sizeof (val));
+    errno_assert (rc == 0);
+    nn_sleep (100);
+    test_send (pub1, "A3");
+    nn_sleep (100);
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_SUBSCRIBE, "A", 1);
+    errno_assert (rc == 0);
+    test_recv (sub1, "A3");
+    test_recv (sub2, "A3");
+
+    test_close (sub2);
+    test_close (sub1);
+    test_close (pub1);
+
+
+    /*  Check exact matching on fixed-length topics. */
+
+    pub1 = test_socket (AF_SP, NN_PUB);
+    test_bind (pub1, SOCKET_ADDRESS);
+    sub1 = test_socket (AF_SP, NN_SUB);
+    sz = sizeof (val);
+    rc = nn_getsockopt (sub1, NN_SUB, NN_SUB_TOPIC_LENGTH, &val, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (val) && val == 0);
+    rc = nn_getsockopt (sub1, NN_SUB, NN_SUB_TOPIC_DELIMITER, &val, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (val) && val == -1);
+
+    /*  The mode can't be changed while there are subscriptions. */
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_SUBSCRIBE, "A", 1);
+    errno_assert (rc == 0);
+    val = 4;
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_TOPIC_LENGTH, &val, sizeof (val));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_UNSUBSCRIBE, "A", 1);
+    errno_assert (rc == 0);
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_TOPIC_LENGTH, &val, sizeof (val));
+    errno_assert (rc == 0);
+    val = '|';
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_TOPIC_DELIMITER,
+        &val, sizeof (val));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+
+    /*  Subscriptions must have exactly the topic length. */
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_SUBSCRIBE, "ABC", 3);
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_SUBSCRIBE, "ABCD", 4);
+    errno_assert (rc == 0);
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_UNSUBSCRIBE, "ABCE", 4);
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    test_connect (sub1, SOCKET_ADDRESS);
+    nn_sleep (10);
+
+    test_send (pub1, "ABC");
+    test_send (pub1, "ABCE1");
+    test_send (pub1, "ABCDE1");
+    test_send (pub1, "ABCD");
+    test_recv (sub1, "ABCDE1");
+    test_recv (sub1, "ABCD");
+
+    test_close (sub1);
+
+    /*  Check exact matching on delimited topics. */
+
+    sub1 = test_socket (AF_SP, NN_SUB);
+    val = '|';
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_TOPIC_DELIMITER,
+        &val, sizeof (val));
+    errno_assert (rc == 0);
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_SUBSCRIBE, "AB|", 3);
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_SUBSCRIBE, "AB", 2);
+    errno_assert (rc == 0);
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_SUBSCRIBE, "LONGER.TOPIC", 12);
+    errno_assert (rc == 0);
+    test_connect (sub1, SOCKET_ADDRESS);
+    nn_sleep (10);
+
+    test_send (pub1, "ABC|1");
+    test_send (pub1, "A|2");
+    test_send (pub1, "AB|3");
+    test_send (pub1, "LONGER.TOPIC|4");
+    test_send (pub1, "AB");
+    test_recv (sub1, "AB|3");
+    test_recv (sub1, "LONGER.TOPIC|4");
+    test_recv (sub1, "AB");
+
+    test_close (sub1);
+    test_close (pub1);
+
+
+    /*  Check that cached match results follow the subscription changes. */
+
+    pub1 = test_socket (AF_SP, NN_PUB);
+    test_bind (pub1, SOCKET_ADDRESS);
+    sub1 = test_socket (AF_SP, NN_SUB);
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_SUBSCRIBE, "A", 1);
+    errno_assert (rc == 0);
+    test_connect (sub1, SOCKET_ADDRESS);
+    nn_sleep (10);
+
+    test_send (pub1, "B1");
+    test_send (pub1, "A1");
+    test_recv (sub1, "A1");
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_SUBSCRIBE, "B", 1);
+    errno_assert (rc == 0);
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_UNSUBSCRIBE, "A", 1);
+    errno_assert (rc == 0);
+    test_send (pub1, "A1");
+    test_send (pub1, "B1");
+    test_recv (sub1, "B1");
+
+    /*  Subscriptions longer than the cached part of the message, and
+        messages shorter than the subscriptions. */
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_SUBSCRIBE,
+        "market.data.equities.XNYS.IBM", 29);
+    errno_assert (rc == 0);
+    test_send (pub1, "market.data.equities.XNYS.AAPL|1");
+    test_send (pub1, "market.data");
+    test_send (pub1, "market.data.equities.XNYS.IBM|2");
+    test_send (pub1, "market.data.equities.XNYS.AAPL|3");
+    test_send (pub1, "market.data");
+    test_send (pub1, "market.data.equities.XNYS.IBM|4");
+    test_recv (sub1, "market.data.equities.XNYS.IBM|2");
+    test_recv (sub1, "market.data.equities.XNYS.IBM|4");
+
+    test_close (sub1);
+    test_close (pub1);
+
+
+    /*  Check that a publisher in the conflating mode keeps only the latest
+        message for each topic for a subscriber that is not keeping up. */
+
+    pub1 = test_socket (AF_SP, NN_PUB);
+    sz = sizeof (val);
+    rc = nn_getsockopt (pub1, NN_PUB, NN_PUB_CONFLATE, &val, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (val) && val == 0);
+    val = 1;
+    rc = nn_setsockopt (pub1, NN_PUB, NN_PUB_CONFLATE, &val, sizeof (val));
+    errno_assert (rc == 0);
+    rc = nn_setsockopt (pub1, NN_PUB, NN_PUB_TOPIC_LENGTH, &val, sizeof (val));
+    errno_assert (rc == 0);
+    val = '|';
+    rc = nn_setsockopt (pub1, NN_PUB, NN_PUB_TOPIC_DELIMITER,
+        &val, sizeof (val));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    test_bind (pub1, SOCKET_ADDRESS);
+    sub1 = test_socket (AF_SP, NN_SUB);
+    rc = nn_setsockopt (sub1, NN_SUB, NN_SUB_SUBSCRIBE, "", 0);
+    errno_assert (rc == 0);
+    val = 16;
+    rc = nn_setsockopt (sub1, NN_SOL_SOCKET, NN_RCVBUF, &val, sizeof (val));
+    errno_assert (rc == 0);
+    val = 100;
+    rc = nn_setsockopt (sub1, NN_SOL_SOCKET, NN_RCVTIMEO, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_connect (sub1, SOCKET_ADDRESS);
+    nn_sleep (10);
+
+    for (i = 0; i != 200; ++i) {
+        sprintf (buf, "%c%03d", i % 2 ? 'B' : 'A', i / 2);
+        test_send (pub1, buf);
+    }
+
+    /*  Each topic arrives in order, ending with its latest message, but most
+        of the messages in between are skipped. */
+    last [0] = last [1] = -1;
+    for (i = 0; ; ++i) {
+        rc = nn_recv (sub1, buf, sizeof (buf), 0);
+        if (rc < 0 && nn_errno () == EAGAIN)
+            break;
+        errno_assert (rc == 4);
+        buf [4] = 0;
+        nn_assert (buf [0] == 'A' || buf [0] == 'B');
+        nn_assert (atoi (buf + 1) > last [buf [0] - 'A']);
+        last [buf [0] - 'A'] = atoi (buf + 1);
+    }
+    nn_assert (i < 20);
+    nn_assert (last [0] == 99 && last [1] == 99);
+
+    test_close (sub1);
+    test_close (pub1);
+
     return 0;
 }
-
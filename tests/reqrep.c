@@ -25,7 +25,71 @@
 
 #include "testutil.h"
 
+#include <string.h>
+
 #define SOCKET_ADDRESS "inproc://test"
+#define SOCKET_ADDRESS_CONCURRENT "inproc://concurrent"
+
+/*  Receives a request on raw REP socket. Returns the header. */
+static void *recv_request (int s, char *body)
+{
+    int rc;
+    void *hdr;
+    struct nn_iovec iov;
+    struct nn_msghdr msg;
+
+    iov.iov_base = body;
+    iov.iov_len = 1;
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &hdr;
+    msg.msg_controllen = NN_MSG;
+    rc = nn_recvmsg (s, &msg, 0);
+    errno_assert (rc == 1);
+    return hdr;
+}
+
+/*  Sends a reply from raw REP socket. */
+static void send_reply (int s, void *hdr, char body)
+{
+    int rc;
+    struct nn_iovec iov;
+    struct nn_msghdr msg;
+
+    iov.iov_base = &body;
+    iov.iov_len = 1;
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &hdr;
+    msg.msg_controllen = NN_MSG;
+    rc = nn_sendmsg (s, &msg, 0);
+    errno_assert (rc == 1);
+}
+
+/*  Receives a reply on REQ socket. Returns the request ID. */
+static int recv_reply (int s, char *body)
+{
+    int rc;
+    unsigned char *hdr;
+    int id;
+    struct nn_iovec iov;
+    struct nn_msghdr msg;
+
+    iov.iov_base = body;
+    iov.iov_len = 1;
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &hdr;
+    msg.msg_controllen = NN_MSG;
+    rc = nn_recvmsg (s, &msg, 0);
+    errno_assert (rc == 1);
+    id = (hdr [0] << 24) | (hdr [1] << 16) | (hdr [2] << 8) | hdr [3];
+    nn_freemsg (hdr);
+    return id;
+}
 
 int main ()
 {
@@ -37,6 +101,12 @@ int main ()
     int resend_ivl;
     char buf [7];
     int timeo;
+    int i;
+    int val;
+    size_t sz;
+    int ids [3];
+    void *hdrs [3];
+    char body;
 
     /*  Test req/rep with full socket types. */
     rep1 = test_socket (AF_SP, NN_REP);
@@ -176,6 +246,133 @@ int main ()
     test_close (req1);
     test_close (rep1);
 
+    /*  Test multiple requests in flight. */
+
+    rep1 = test_socket (AF_SP_RAW, NN_REP);
+    test_bind (rep1, SOCKET_ADDRESS_CONCURRENT);
+    req1 = test_socket (AF_SP, NN_REQ);
+    test_connect (req1, SOCKET_ADDRESS_CONCURRENT);
+    val = 0;
+    rc = nn_setsockopt (req1, NN_REQ, NN_REQ_CONCURRENCY, &val, sizeof (val));
+    nn_assert (rc == -1 && nn_errno () == EINVAL);
+    val = 3;
+    rc = nn_setsockopt (req1, NN_REQ, NN_REQ_CONCURRENCY, &val, sizeof (val));
+    errno_assert (rc == 0);
+    timeo = 100;
+    rc = nn_setsockopt (req1, NN_SOL_SOCKET, NN_SNDTIMEO,
+        &timeo, sizeof (timeo));
+    errno_assert (rc == 0);
+
+    for (i = 0; i != 3; ++i) {
+        body = 'A' + i;
+        rc = nn_send (req1, &body, 1, 0);
+        errno_assert (rc == 1);
+        sz = sizeof (ids [i]);
+        rc = nn_getsockopt (req1, NN_REQ, NN_REQ_ID, &ids [i], &sz);
+        errno_assert (rc == 0);
+    }
+
+    /*  Maximum number of requests in flight is reached. */
+    rc = nn_send (req1, "D", 1, 0);
+    nn_assert (rc == -1 && nn_errno () == EAGAIN);
+    rc = nn_setsockopt (req1, NN_REQ, NN_REQ_CONCURRENCY, &val, sizeof (val));
+    errno_assert (rc == 0);
+    val = 1;
+    rc = nn_setsockopt (req1, NN_REQ, NN_REQ_CONCURRENCY, &val, sizeof (val));
+    nn_assert (rc == -1 && nn_errno () == EFSM);
+
+    /*  Reply in reverse order. Replies are received in completion order
+        along with the matching request IDs. */
+    for (i = 0; i != 3; ++i) {
+        hdrs [i] = recv_request (rep1, &body);
+        nn_assert (body == 'A' + i);
+    }
+    for (i = 2; i >= 0; --i) {
+        send_reply (rep1, hdrs [i], 'a' + i);
+        nn_assert (recv_reply (req1, &body) == ids [i]);
+        nn_assert (body == 'a' + i);
+    }
+    rc = nn_recv (req1, buf, sizeof (buf), 0);
+    nn_assert (rc == -1 && nn_errno () == EFSM);
+
+    /*  Unanswered request is re-sent. The second reply is dropped. */
+    val = 100;
+    rc = nn_setsockopt (req1, NN_REQ, NN_REQ_RESEND_IVL, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_send (req1, "X");
+    hdrs [0] = recv_request (rep1, &body);
+    nn_assert (body == 'X');
+    hdrs [1] = recv_request (rep1, &body);
+    nn_assert (body == 'X');
+    send_reply (rep1, hdrs [1], 'x');
+    test_recv (req1, "x");
+    send_reply (rep1, hdrs [0], 'y');
+    nn_sleep (50);
+    rc = nn_recv (req1, buf, sizeof (buf), NN_DONTWAIT);
+    nn_assert (rc == -1 && nn_errno () == EFSM);
+
+    /*  Switch back to single request mode. */
+    val = 1;
+    rc = nn_setsockopt (req1, NN_REQ, NN_REQ_CONCURRENCY, &val, sizeof (val));
+    errno_assert (rc == 0);
+
+    /*  Close the socket with requests in flight. */
+    val = 2;
+    rc = nn_setsockopt (req1, NN_REQ, NN_REQ_CONCURRENCY, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_send (req1, "Y");
+    test_send (req1, "Z");
+
+    test_close (req1);
+    test_close (rep1);
+
+    /*  Test load-aware balancing of requests. */
+    req1 = test_socket (AF_SP, NN_REQ);
+    test_bind (req1, SOCKET_ADDRESS_CONCURRENT);
+    sz = sizeof (val);
+    rc = nn_getsockopt (req1, NN_REQ, NN_REQ_LB_POLICY, &val, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (val) && val == NN_LB_ROUND_ROBIN);
+    val = 3;
+    rc = nn_setsockopt (req1, NN_REQ, NN_REQ_LB_POLICY, &val, sizeof (val));
+    nn_assert (rc == -1 && nn_errno () == EINVAL);
+    val = NN_LB_LEAST_LOADED;
+    rc = nn_setsockopt (req1, NN_REQ, NN_REQ_LB_POLICY, &val, sizeof (val));
+    errno_assert (rc == 0);
+    val = 4;
+    rc = nn_setsockopt (req1, NN_REQ, NN_REQ_CONCURRENCY, &val, sizeof (val));
+    errno_assert (rc == 0);
+
+    /*  The first peer never replies, so once it holds a request all the
+        subsequent ones go to the second peer. */
+    rep1 = test_socket (AF_SP_RAW, NN_REP);
+    test_connect (rep1, SOCKET_ADDRESS_CONCURRENT);
+    nn_sleep (10);
+    rep2 = test_socket (AF_SP_RAW, NN_REP);
+    test_connect (rep2, SOCKET_ADDRESS_CONCURRENT);
+    nn_sleep (10);
+
+    test_send (req1, "A");
+    hdrs [0] = recv_request (rep1, &body);
+    nn_assert (body == 'A');
+    for (i = 0; i != 4; ++i) {
+        body = 'B' + i;
+        rc = nn_send (req1, &body, 1, 0);
+        errno_assert (rc == 1);
+        hdrs [1] = recv_request (rep2, &body);
+        nn_assert (body == 'B' + i);
+        send_reply (rep2, hdrs [1], 'b' + i);
+        recv_reply (req1, &body);
+        nn_assert (body == 'b' + i);
+    }
+    rc = nn_recv (rep1, buf, sizeof (buf), NN_DONTWAIT);
+    nn_assert (rc == -1 && nn_errno () == EAGAIN);
+    nn_freemsg (hdrs [0]);
+
+    test_close (req1);
+    test_close (rep2);
+    test_close (rep1);
+
     return 0;
 }
 
@@ -0,0 +1,293 @@
+/*
+    Copyright (c) 2012 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/nn.h"
+#include "../src/pair.h"
+#include "../src/shm.h"
+
+#include "testutil.h"
+#include "../src/utils/thread.c"
+
+#include <string.h>
+
+#if !defined NN_HAVE_WINDOWS
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*  Tests shared memory transport. */
+
+#define SOCKET_ADDRESS "shm://test.ipc"
+#define SOCKET_ADDRESS_IPC "ipc://test.ipc"
+
+static void send_large (int s, size_t size, int seed)
+{
+    int rc;
+    size_t i;
+    unsigned char *buf;
+
+    buf = nn_allocmsg (size, 0);
+    alloc_assert (buf);
+    for (i = 0; i != size; ++i)
+        buf [i] = (unsigned char) (i + seed);
+    rc = nn_send (s, &buf, NN_MSG, 0);
+    errno_assert (rc >= 0);
+    nn_assert (rc == (int) size);
+}
+
+static void recv_large (int s, size_t size, int seed)
+{
+    int rc;
+    size_t i;
+    unsigned char *buf;
+
+    rc = nn_recv (s, &buf, NN_MSG, 0);
+    errno_assert (rc >= 0);
+    nn_assert (rc == (int) size);
+    for (i = 0; i != size; ++i)
+        nn_assert (buf [i] == (unsigned char) (i + seed));
+    rc = nn_freemsg (buf);
+    errno_assert (rc == 0);
+}
+
+static void sender (void *arg)
+{
+    int i;
+
+    for (i = 0; i != 100; ++i)
+        send_large (*(int*) arg, 300000 + i * 100, i);
+}
+
+static void burst_sender (void *arg)
+{
+    int i;
+
+    for (i = 0; i != 8; ++i)
+        send_large (*(int*) arg, 300000, i);
+}
+
+#if !defined NN_HAVE_WINDOWS
+
+/*  Connects to the endpoint using a raw UNIX domain socket, sends a message
+    of the specified type and body and checks that the connection is closed
+    as a result. */
+static void bad_peer (int type, const void *body, size_t size)
+{
+    int rc;
+    int fd;
+    struct sockaddr_un addr;
+    struct timeval tv;
+    unsigned char hdr [9];
+    char buf [64];
+
+    fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    errno_assert (fd >= 0);
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, "test.ipc");
+    rc = connect (fd, (struct sockaddr*) &addr, sizeof (addr));
+    errno_assert (rc == 0);
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    rc = setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv));
+    errno_assert (rc == 0);
+
+    /*  Protocol header of a PAIR socket, followed by the message. */
+    rc = (int) send (fd, "\0SP\0\0\x10\0\0", 8, 0);
+    nn_assert (rc == 8);
+    memset (hdr, 0, sizeof (hdr));
+    hdr [0] = (unsigned char) type;
+    hdr [8] = (unsigned char) size;
+    rc = (int) send (fd, hdr, sizeof (hdr), 0);
+    nn_assert (rc == sizeof (hdr));
+    if (size) {
+        rc = (int) send (fd, body, size, 0);
+        nn_assert (rc == (int) size);
+    }
+
+    /*  Skip the peer's protocol header and wait for the connection to be
+        closed. */
+    do {
+        rc = (int) recv (fd, buf, sizeof (buf), 0);
+        errno_assert (rc >= 0);
+    } while (rc > 0);
+    close (fd);
+}
+
+#if defined NN_HAVE_SHM_OPEN
+
+/*  Asks the peer to map a segment that wasn't created by nanomsg. Checks that
+    the connection is closed and the segment is left untouched. */
+static void bad_segment (const char *name)
+{
+    int rc;
+    int fd;
+
+    shm_unlink (name);
+    fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    errno_assert (fd >= 0);
+    rc = ftruncate (fd, 65536);
+    errno_assert (rc == 0);
+    close (fd);
+
+    bad_peer (3, name, strlen (name));
+
+    rc = shm_unlink (name);
+    errno_assert (rc == 0);
+}
+
+#endif
+
+#endif
+
+int main ()
+{
+#if !defined NN_HAVE_WINDOWS
+    int rc;
+    int sb;
+    int sc;
+    int i;
+    int j;
+    int opt;
+    size_t sz;
+    char body [40];
+    unsigned char *bufs [8];
+    struct nn_thread thread;
+
+    /*  Check the socket option. */
+    sb = test_socket (AF_SP, NN_PAIR);
+    sz = sizeof (opt);
+    rc = nn_getsockopt (sb, NN_SHM, NN_SHM_SIZE, &opt, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (opt));
+    nn_assert (opt == 16 * 1024 * 1024);
+    opt = 1024;
+    rc = nn_setsockopt (sb, NN_SHM, NN_SHM_SIZE, &opt, sizeof (opt));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    opt = 64 * 1024;
+    rc = nn_setsockopt (sb, NN_SHM, NN_SHM_SIZE, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+    sz = sizeof (opt);
+    rc = nn_getsockopt (sb, NN_SHM, NN_SHM_SIZE, &opt, &sz);
+    errno_assert (rc == 0);
+    nn_assert (opt == 64 * 1024);
+    test_bind (sb, SOCKET_ADDRESS);
+
+    opt = 1024 * 1024;
+    rc = nn_setsockopt (sb, NN_SHM, NN_SHM_SIZE, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+
+    /*  Malformed or unexpected control messages close the connection. */
+    memset (body, 0, sizeof (body));
+    bad_peer (2, body, 8);
+    bad_peer (2, body, 16);
+    bad_peer (3, body, sizeof (body));
+    bad_peer (4, NULL, 0);
+    bad_peer (99, NULL, 0);
+#if defined NN_HAVE_SHM_OPEN
+    bad_segment ("/nn-test-segment");
+    bad_segment ("/nn-1-abc");
+#endif
+
+    sc = test_socket (AF_SP, NN_PAIR);
+    opt = 1024 * 1024;
+    rc = nn_setsockopt (sc, NN_SHM, NN_SHM_SIZE, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+    test_connect (sc, SOCKET_ADDRESS);
+
+    /*  Ping-pong test. Small messages are passed via the socket, large ones
+        via the shared memory. */
+    for (i = 0; i != 4; ++i) {
+        test_send (sc, "0123456789012345678901234567890123456789");
+        test_recv (sb, "0123456789012345678901234567890123456789");
+        send_large (sb, 300000, i);
+        recv_large (sc, 300000, i);
+    }
+
+    /*  Messages larger than the shared memory are passed via the socket. */
+    send_large (sc, 2000000, 1);
+    recv_large (sb, 2000000, 1);
+
+    /*  Send a stream of messages that don't fit into the shared memory all
+        at once. The messages wrap around the end of the shared memory and
+        some of them are passed via the socket instead. */
+    nn_thread_init (&thread, sender, &sc);
+    for (i = 0; i != 100; ++i)
+        recv_large (sb, 300000 + i * 100, i);
+    nn_thread_term (&thread);
+
+    /*  Received messages stay in the shared memory until they are
+        deallocated, in any order. The ones that don't fit are passed via
+        the socket. */
+    nn_thread_init (&thread, burst_sender, &sc);
+    for (i = 0; i != 8; ++i) {
+        rc = nn_recv (sb, &bufs [i], NN_MSG, 0);
+        errno_assert (rc == 300000);
+    }
+    nn_thread_term (&thread);
+    for (i = 7; i >= 0; --i) {
+        for (j = 0; j != 300000; ++j)
+            nn_assert (bufs [i][j] == (unsigned char) (j + i));
+        rc = nn_freemsg (bufs [i]);
+        errno_assert (rc == 0);
+    }
+    for (i = 0; i != 4; ++i) {
+        send_large (sc, 300000, i);
+        recv_large (sb, 300000, i);
+    }
+
+    /*  A message can outlive the connection it was received from. */
+    send_large (sc, 300000, 5);
+    rc = nn_recv (sb, &bufs [0], NN_MSG, 0);
+    errno_assert (rc == 300000);
+    test_close (sc);
+    test_close (sb);
+    for (j = 0; j != 300000; ++j)
+        nn_assert (bufs [0][j] == (unsigned char) (j + 5));
+    rc = nn_freemsg (bufs [0]);
+    errno_assert (rc == 0);
+
+    /*  Shared memory transport falls back to the socket when the peer uses
+        IPC transport. */
+    sb = test_socket (AF_SP, NN_PAIR);
+    test_bind (sb, SOCKET_ADDRESS);
+    sc = test_socket (AF_SP, NN_PAIR);
+    test_connect (sc, SOCKET_ADDRESS_IPC);
+    for (i = 0; i != 4; ++i) {
+        send_large (sc, 50000, i);
+        recv_large (sb, 50000, i);
+        send_large (sb, 50000, i);
+        recv_large (sc, 50000, i);
+    }
+    test_close (sc);
+    test_close (sb);
+
+#endif
+
+    return 0;
+}
+
@@ -23,23 +23,58 @@
 #include "../src/nn.h"
 #include "../src/pair.h"
 #include "../src/pubsub.h"
+#include "../src/reqrep.h"
 #include "../src/tcp.h"
 
 #include "testutil.h"
+#include "../src/utils/attr.h"
+#include "../src/utils/thread.c"
 
 /*  Tests TCP transport. */
 
 #define SOCKET_ADDRESS "tcp://127.0.0.1:5555"
+#define LARGE_MSG_SIZE (256 * 1024)
+
+/*  Sizes of the messages used to fill the outbound queue. Small message
+    leaves space in the queue, big message fills it on its own. */
+#define SMALL_SIZE (64 * 1024)
+#define BIG_SIZE (256 * 1024)
+
+static int sc;
+
+/*  Sends small and big messages in turns. Often, the small message is still
+    being sent when the big one is queued behind it. Once the small one is
+    gone, the big one still keeps the queue full. */
+static void sender (NN_UNUSED void *arg)
+{
+    int rc;
+    int i;
+    char *buf;
+
+    buf = malloc (BIG_SIZE);
+    alloc_assert (buf);
+    for (i = 0; i != 200; ++i) {
+        memset (buf, 'a' + i % 26, BIG_SIZE);
+        rc = nn_send (sc, buf, i % 2 ? BIG_SIZE : SMALL_SIZE, 0);
+        errno_assert (rc >= 0);
+        nn_assert (rc == (i % 2 ? BIG_SIZE : SMALL_SIZE));
+    }
+    free (buf);
+}
 
 int main ()
 {
     int rc;
     int sb;
-    int sc;
     int i;
+    int j;
     int opt;
     size_t sz;
     int s1, s2;
+    static char buf [4000];
+    char *bigbuf;
+    struct nn_thread thread;
+    void *msg;
 
     /*  Try closing bound but unconnected socket. */
     sb = test_socket (AF_SP, NN_PAIR);
@@ -73,6 +108,35 @@ int main ()
     nn_assert (sz == sizeof (opt));
     nn_assert (opt == 1);
 
+    /*  Check ZEROCOPY socket option. */
+    sz = sizeof (opt);
+    rc = nn_getsockopt (sc, NN_TCP, NN_TCP_ZEROCOPY, &opt, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (opt));
+    nn_assert (opt == 0);
+    opt = 2;
+    rc = nn_setsockopt (sc, NN_TCP, NN_TCP_ZEROCOPY, &opt, sizeof (opt));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+
+    /*  Check COMPRESS and COMPRESS_THRESHOLD socket options. */
+    sz = sizeof (opt);
+    rc = nn_getsockopt (sc, NN_TCP, NN_TCP_COMPRESS, &opt, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (opt));
+    nn_assert (opt == 0);
+    opt = 10;
+    rc = nn_setsockopt (sc, NN_TCP, NN_TCP_COMPRESS, &opt, sizeof (opt));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    sz = sizeof (opt);
+    rc = nn_getsockopt (sc, NN_TCP, NN_TCP_COMPRESS_THRESHOLD, &opt, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (opt));
+    nn_assert (opt == 1024);
+    opt = -1;
+    rc = nn_setsockopt (sc, NN_TCP, NN_TCP_COMPRESS_THRESHOLD, &opt,
+        sizeof (opt));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+
     /*  Try using invalid address strings. */
     rc = nn_connect (sc, "tcp://*:");
     nn_assert (rc < 0);
@@ -146,6 +210,151 @@ int main ()
         test_recv (sb, "0123456789012345678901234567890123456789");
     }
 
+    /*  Pipelined transfer of messages of different sizes. The messages are
+        sent in batches and have to arrive intact and in order. */
+    for (i = 0; i != 100; ++i) {
+        memset (buf, 'a' + i % 26, i * 37);
+        rc = nn_send (sc, buf, i * 37, 0);
+        errno_assert (rc >= 0);
+        nn_assert (rc == i * 37);
+    }
+    for (i = 0; i != 100; ++i) {
+        rc = nn_recv (sb, buf, sizeof (buf), 0);
+        errno_assert (rc >= 0);
+        nn_assert (rc == i * 37);
+        for (j = 0; j != rc; ++j)
+            nn_assert (buf [j] == 'a' + i % 26);
+    }
+
+    /*  Fill the outbound queue while a batch is being sent. */
+    bigbuf = malloc (BIG_SIZE);
+    alloc_assert (bigbuf);
+    nn_thread_init (&thread, sender, NULL);
+    for (i = 0; i != 200; ++i) {
+        rc = nn_recv (sb, bigbuf, BIG_SIZE, 0);
+        errno_assert (rc >= 0);
+        nn_assert (rc == (i % 2 ? BIG_SIZE : SMALL_SIZE));
+        for (j = 0; j != rc; ++j)
+            nn_assert (bigbuf [j] == 'a' + i % 26);
+    }
+    nn_thread_term (&thread);
+    free (bigbuf);
+
+    test_close (sc);
+    test_close (sb);
+
+    /*  Transfer of large messages with zero-copy sending turned on. Each
+        message is deallocated by the library once the kernel is done with
+        it. */
+    sb = test_socket (AF_SP, NN_PAIR);
+    sc = test_socket (AF_SP, NN_PAIR);
+    opt = 1;
+    rc = nn_setsockopt (sb, NN_TCP, NN_TCP_ZEROCOPY, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+    rc = nn_setsockopt (sc, NN_TCP, NN_TCP_ZEROCOPY, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+    test_bind (sb, SOCKET_ADDRESS);
+    test_connect (sc, SOCKET_ADDRESS);
+    for (i = 0; i != 10; ++i) {
+        msg = nn_allocmsg (LARGE_MSG_SIZE, 0);
+        alloc_assert (msg);
+        memset (msg, 'a' + i, LARGE_MSG_SIZE);
+        rc = nn_send (sc, &msg, NN_MSG, 0);
+        errno_assert (rc >= 0);
+        nn_assert (rc == LARGE_MSG_SIZE);
+        rc = nn_recv (sb, &msg, NN_MSG, 0);
+        errno_assert (rc >= 0);
+        nn_assert (rc == LARGE_MSG_SIZE);
+        for (j = 0; j != rc; ++j)
+            nn_assert (((char*) msg) [j] == 'a' + i);
+        rc = nn_freemsg (msg);
+        errno_assert (rc == 0);
+    }
+    test_send (sb, "ABC");
+    test_recv (sc, "ABC");
+    test_close (sc);
+    test_close (sb);
+
+    /*  Transfer of messages with compression turned on. Compressible,
+        incompressible and tiny messages are interleaved. Each side uses
+        a different compression level. */
+    sb = test_socket (AF_SP, NN_PAIR);
+    sc = test_socket (AF_SP, NN_PAIR);
+    opt = 1;
+    rc = nn_setsockopt (sb, NN_TCP, NN_TCP_COMPRESS, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+    opt = 9;
+    rc = nn_setsockopt (sc, NN_TCP, NN_TCP_COMPRESS, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+    opt = 16;
+    rc = nn_setsockopt (sc, NN_TCP, NN_TCP_COMPRESS_THRESHOLD, &opt,
+        sizeof (opt));
+    errno_assert (rc == 0);
+    test_bind (sb, SOCKET_ADDRESS);
+    test_connect (sc, SOCKET_ADDRESS);
+    for (i = 0; i != 30; ++i) {
+        for (j = 0; j != (int) sizeof (buf); ++j)
+            buf [j] = i % 3 == 0 ? (char) (j % (i + 7)) :
+                i % 3 == 1 ? (char) ((j * 7919 + i) % 251 ^ j >> 3) : 'x';
+        rc = nn_send (sc, buf, i * 131, 0);
+        errno_assert (rc >= 0);
+        nn_assert (rc == i * 131);
+        rc = nn_recv (sb, &msg, NN_MSG, 0);
+        errno_assert (rc >= 0);
+        nn_assert (rc == i * 131);
+        nn_assert (memcmp (msg, buf, rc) == 0);
+        rc = nn_send (sb, &msg, NN_MSG, 0);
+        errno_assert (rc == i * 131);
+        rc = nn_recv (sc, &msg, NN_MSG, 0);
+        errno_assert (rc >= 0);
+        nn_assert (rc == i * 131);
+        nn_assert (memcmp (msg, buf, rc) == 0);
+        rc = nn_freemsg (msg);
+        errno_assert (rc == 0);
+    }
+    for (i = 0; i != 10; ++i) {
+        msg = nn_allocmsg (LARGE_MSG_SIZE, 0);
+        alloc_assert (msg);
+        for (j = 0; j != LARGE_MSG_SIZE; ++j)
+            ((char*) msg) [j] = "nanomsg" [(j / (i + 1)) % 7];
+        rc = nn_send (sc, &msg, NN_MSG, 0);
+        errno_assert (rc == LARGE_MSG_SIZE);
+        rc = nn_recv (sb, &msg, NN_MSG, 0);
+        errno_assert (rc == LARGE_MSG_SIZE);
+        for (j = 0; j != LARGE_MSG_SIZE; ++j)
+            nn_assert (((char*) msg) [j] == "nanomsg" [(j / (i + 1)) % 7]);
+        rc = nn_freemsg (msg);
+        errno_assert (rc == 0);
+    }
+    test_close (sc);
+    test_close (sb);
+
+    /*  Messages with protocol headers are compressed along with
+        the header. */
+    sb = test_socket (AF_SP, NN_REP);
+    sc = test_socket (AF_SP, NN_REQ);
+    opt = 5;
+    rc = nn_setsockopt (sb, NN_TCP, NN_TCP_COMPRESS, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+    rc = nn_setsockopt (sc, NN_TCP, NN_TCP_COMPRESS, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+    test_bind (sb, SOCKET_ADDRESS);
+    test_connect (sc, SOCKET_ADDRESS);
+    memset (buf, 'r', sizeof (buf));
+    for (i = 0; i != 10; ++i) {
+        rc = nn_send (sc, buf, sizeof (buf), 0);
+        errno_assert (rc == sizeof (buf));
+        rc = nn_recv (sb, &msg, NN_MSG, 0);
+        errno_assert (rc == sizeof (buf));
+        nn_assert (memcmp (msg, buf, rc) == 0);
+        rc = nn_send (sb, &msg, NN_MSG, 0);
+        errno_assert (rc == sizeof (buf));
+        rc = nn_recv (sc, &msg, NN_MSG, 0);
+        errno_assert (rc == sizeof (buf));
+        nn_assert (memcmp (msg, buf, rc) == 0);
+        rc = nn_freemsg (msg);
+        errno_assert (rc == 0);
+    }
     test_close (sc);
     test_close (sb);
 
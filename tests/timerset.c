@@ -0,0 +1,89 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/aio/timerset.c"
+#include "../src/utils/clock.c"
+#include "../src/utils/alloc.c"
+#include "../src/utils/err.c"
+
+#define HNDL_COUNT 1000
+
+int main ()
+{
+    int rc;
+    int i;
+    int count;
+    uint64_t prev;
+    struct nn_timerset timerset;
+    struct nn_timerset_hndl hndls [HNDL_COUNT];
+    struct nn_timerset_hndl *hndl;
+
+    nn_timerset_init (&timerset);
+    for (i = 0; i != HNDL_COUNT; ++i)
+        nn_timerset_hndl_init (&hndls [i]);
+
+    /*  Empty timerset. */
+    nn_assert (nn_timerset_timeout (&timerset) == -1);
+    rc = nn_timerset_event (&timerset, &hndl);
+    nn_assert (rc == -EAGAIN);
+
+    /*  Timeout far in the future. */
+    rc = nn_timerset_add (&timerset, 100000, &hndls [0]);
+    nn_assert (rc == 1);
+    nn_assert (nn_timerset_hndl_isactive (&hndls [0]));
+    nn_assert (nn_timerset_timeout (&timerset) > 0);
+    rc = nn_timerset_event (&timerset, &hndl);
+    nn_assert (rc == -EAGAIN);
+    rc = nn_timerset_rm (&timerset, &hndls [0]);
+    nn_assert (rc == 1);
+    nn_assert (!nn_timerset_hndl_isactive (&hndls [0]));
+    rc = nn_timerset_rm (&timerset, &hndls [0]);
+    nn_assert (rc == 0);
+
+    /*  Add timeouts that have already expired in shuffled order, remove some
+        of them and check that the rest is reported in the right order. */
+    for (i = 0; i != HNDL_COUNT; ++i)
+        nn_timerset_add (&timerset, -1 - (i * 7919) % HNDL_COUNT, &hndls [i]);
+    for (i = 0; i < HNDL_COUNT; i += 3)
+        nn_timerset_rm (&timerset, &hndls [i]);
+    nn_assert (nn_timerset_timeout (&timerset) == 0);
+    count = 0;
+    prev = 0;
+    while (1) {
+        rc = nn_timerset_event (&timerset, &hndl);
+        if (rc == -EAGAIN)
+            break;
+        errnum_assert (rc == 0, -rc);
+        nn_assert (!nn_timerset_hndl_isactive (hndl));
+        nn_assert ((hndl - hndls) % 3 != 0);
+        nn_assert (hndl->timeout >= prev);
+        prev = hndl->timeout;
+        ++count;
+    }
+    nn_assert (count == HNDL_COUNT - (HNDL_COUNT + 2) / 3);
+
+    for (i = 0; i != HNDL_COUNT; ++i)
+        nn_timerset_hndl_term (&hndls [i]);
+    nn_timerset_term (&timerset);
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+
+#include "../src/protocols/pubsub/topicset.c"
+#include "../src/utils/alloc.c"
+#include "../src/utils/err.c"
+
+#include <stdio.h>
+#include <string.h>
+
+static void walk_fn (const uint8_t *data, size_t size, void *arg)
+{
+    int *found;
+
+    found = (int*) arg;
+    if (size == 0)
+        found [0]++;
+    else if (size == 3 && memcmp (data, "ABC", 3) == 0)
+        found [1]++;
+    else if (size == 13 && memcmp (data, "ABCDEFGHIJKLM", 13) == 0)
+        found [2]++;
+    else
+        nn_assert (0);
+}
+
+int main ()
+{
+    int rc;
+    int i;
+    char topic [32];
+    struct nn_topicset set;
+    int found [3];
+
+    /*  Try matching with an empty set. */
+    nn_topicset_init (&set);
+    rc = nn_topicset_match (&set, (const uint8_t*) "", 0);
+    nn_assert (rc == 0);
+    rc = nn_topicset_match (&set, (const uint8_t*) "ABC", 3);
+    nn_assert (rc == 0);
+    rc = nn_topicset_unsubscribe (&set, (const uint8_t*) "ABC", 3);
+    nn_assert (rc == -EINVAL);
+    nn_topicset_term (&set);
+
+    /*  Matching is exact, not by prefix. */
+    nn_topicset_init (&set);
+    rc = nn_topicset_subscribe (&set, (const uint8_t*) "ABC", 3);
+    nn_assert (rc == 1);
+    rc = nn_topicset_subscribe (&set, (const uint8_t*) "ABCDEFGHIJKLM", 13);
+    nn_assert (rc == 1);
+    rc = nn_topicset_match (&set, (const uint8_t*) "AB", 2);
+    nn_assert (rc == 0);
+    rc = nn_topicset_match (&set, (const uint8_t*) "ABC", 3);
+    nn_assert (rc == 1);
+    rc = nn_topicset_match (&set, (const uint8_t*) "ABCD", 4);
+    nn_assert (rc == 0);
+    rc = nn_topicset_match (&set, (const uint8_t*) "ABCDEFGHIJKLM", 13);
+    nn_assert (rc == 1);
+    rc = nn_topicset_match (&set, (const uint8_t*) "ABCDEFGHIJKLX", 13);
+    nn_assert (rc == 0);
+    rc = nn_topicset_match (&set, (const uint8_t*) "", 0);
+    nn_assert (rc == 0);
+    rc = nn_topicset_subscribe (&set, (const uint8_t*) "", 0);
+    nn_assert (rc == 1);
+    rc = nn_topicset_match (&set, (const uint8_t*) "", 0);
+    nn_assert (rc == 1);
+    memset (found, 0, sizeof (found));
+    nn_topicset_walk (&set, walk_fn, found);
+    nn_assert (found [0] == 1 && found [1] == 1 && found [2] == 1);
+
+    /*  Check the reference counting. */
+    rc = nn_topicset_subscribe (&set, (const uint8_t*) "ABCDEFGHIJKLM", 13);
+    nn_assert (rc == 0);
+    rc = nn_topicset_unsubscribe (&set, (const uint8_t*) "ABCDEFGHIJKLM", 13);
+    nn_assert (rc == 0);
+    rc = nn_topicset_match (&set, (const uint8_t*) "ABCDEFGHIJKLM", 13);
+    nn_assert (rc == 1);
+    rc = nn_topicset_unsubscribe (&set, (const uint8_t*) "ABCDEFGHIJKLM", 13);
+    nn_assert (rc == 1);
+    rc = nn_topicset_match (&set, (const uint8_t*) "ABCDEFGHIJKLM", 13);
+    nn_assert (rc == 0);
+    rc = nn_topicset_unsubscribe (&set, (const uint8_t*) "ABCDEFGHIJKLM", 13);
+    nn_assert (rc == -EINVAL);
+    rc = nn_topicset_match (&set, (const uint8_t*) "ABC", 3);
+    nn_assert (rc == 1);
+    nn_topicset_term (&set);
+
+    /*  Grow the set well past its initial size, then shrink it back,
+        checking that all the remaining topics can still be found. */
+    nn_topicset_init (&set);
+    for (i = 0; i != 10000; ++i) {
+        sprintf (topic, i % 2 ? "S%d" : "LONG.TOPIC.%d", i);
+        rc = nn_topicset_subscribe (&set, (const uint8_t*) topic,
+            strlen (topic));
+        nn_assert (rc == 1);
+    }
+    nn_assert (set.items == 10000);
+    for (i = 0; i != 10000; i += 2) {
+        sprintf (topic, i % 2 ? "S%d" : "LONG.TOPIC.%d", i);
+        rc = nn_topicset_unsubscribe (&set, (const uint8_t*) topic,
+            strlen (topic));
+        nn_assert (rc == 1);
+    }
+    for (i = 0; i != 10000; ++i) {
+        sprintf (topic, i % 2 ? "S%d" : "LONG.TOPIC.%d", i);
+        rc = nn_topicset_match (&set, (const uint8_t*) topic, strlen (topic));
+        nn_assert (rc == i % 2);
+    }
+    for (i = 1; i < 10000; i += 2) {
+        sprintf (topic, "S%d", i);
+        rc = nn_topicset_unsubscribe (&set, (const uint8_t*) topic,
+            strlen (topic));
+        nn_assert (rc == 1);
+    }
+    nn_assert (set.items == 0 && set.slots == NULL);
+    nn_topicset_term (&set);
+
+    return 0;
+}
@@ -24,10 +24,30 @@
 #include "../src/utils/alloc.c"
 #include "../src/utils/err.c"
 
+#include <string.h>
+
+static void walk_fn (const uint8_t *data, size_t size, void *arg)
+{
+    int *found;
+
+    found = (int*) arg;
+    if (size == 3 && memcmp (data, "ABC", 3) == 0)
+        found [0]++;
+    else if (size == 13 && memcmp (data, "ABCDEFGHIJKLM", 13) == 0)
+        found [1]++;
+    else if (size == 1 && data [0] == 'x')
+        found [2]++;
+    else
+        nn_assert (0);
+}
+
 int main ()
 {
     int rc;
     struct nn_trie trie;
+    int found [3];
+    int i;
+    uint8_t topic [2];
 
     /*  Try matching with an empty trie. */
     nn_trie_init (&trie);
@@ -203,6 +223,54 @@ int main ()
     nn_assert (rc == 1);
     nn_trie_term (&trie);
 
+    /*  Check that a subscription on a node survives conversion of the node
+        from sparse to dense and back. Every other child is added first, so
+        that the rest of them fill the gaps inside the dense array. */
+    nn_trie_init (&trie);
+    rc = nn_trie_subscribe (&trie, (const uint8_t*) "X", 1);
+    nn_assert (rc == 1);
+    for (i = 0; i != 23; ++i) {
+        topic [0] = 'X';
+        topic [1] = 'A' + (i < 12 ? i * 2 : (i - 12) * 2 + 1);
+        rc = nn_trie_subscribe (&trie, topic, 2);
+        nn_assert (rc == 1);
+    }
+    rc = nn_trie_match (&trie, (const uint8_t*) "XZ", 2);
+    nn_assert (rc == 1);
+    for (i = 0; i != 23; ++i) {
+        topic [0] = 'X';
+        topic [1] = 'A' + (i < 12 ? i * 2 : (i - 12) * 2 + 1);
+        rc = nn_trie_unsubscribe (&trie, topic, 2);
+        nn_assert (rc == 1);
+    }
+    rc = nn_trie_match (&trie, (const uint8_t*) "XZ", 2);
+    nn_assert (rc == 1);
+    rc = nn_trie_unsubscribe (&trie, (const uint8_t*) "X", 1);
+    nn_assert (rc == 1);
+    rc = nn_trie_match (&trie, (const uint8_t*) "XZ", 2);
+    nn_assert (rc == 0);
+    nn_trie_term (&trie);
+
+    /*  Try walking the trie and unsubscribing from strings that don't
+        exist. */
+    nn_trie_init (&trie);
+    rc = nn_trie_unsubscribe (&trie, (const uint8_t*) "ABC", 3);
+    nn_assert (rc == -EINVAL);
+    rc = nn_trie_subscribe (&trie, (const uint8_t*) "ABC", 3);
+    nn_assert (rc == 1);
+    rc = nn_trie_subscribe (&trie, (const uint8_t*) "ABCDEFGHIJKLM", 13);
+    nn_assert (rc == 1);
+    rc = nn_trie_subscribe (&trie, (const uint8_t*) "x", 1);
+    nn_assert (rc == 1);
+    rc = nn_trie_unsubscribe (&trie, (const uint8_t*) "ABCD", 4);
+    nn_assert (rc == -EINVAL);
+    rc = nn_trie_match (&trie, (const uint8_t*) "AB", 2);
+    nn_assert (rc == 0);
+    memset (found, 0, sizeof (found));
+    nn_trie_walk (&trie, walk_fn, found);
+    nn_assert (found [0] == 1 && found [1] == 1 && found [2] == 1);
+    nn_trie_term (&trie);
+
     return 0;
 }
 